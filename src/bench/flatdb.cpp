@@ -0,0 +1,89 @@
+// Copyright (c) 2020 The XFS Core Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include "chainparams.h"
+#include "flat-database.h"
+#include "random.h"
+#include "util.h"
+#include "xfsnode-payments.h"
+
+#include <boost/filesystem.hpp>
+
+// Blocks with payment votes in the cache, every one voted on by MNPAYMENTS_SIGNATURES_TOTAL xfsnodes
+static const int FLATDB_BENCH_BLOCKS = 1000;
+
+namespace {
+
+/** Points the data directory to a scratch directory while a benchmark runs */
+class ScratchDataDir
+{
+private:
+    boost::filesystem::path path;
+
+public:
+    ScratchDataDir()
+    {
+        SelectParams(CBaseChainParams::MAIN);
+        path = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path("bench_flatdb_%%%%-%%%%");
+        boost::filesystem::create_directories(path);
+        mapArgs["-datadir"] = path.string();
+        ClearDatadirCache();
+    }
+
+    ~ScratchDataDir()
+    {
+        mapArgs.erase("-datadir");
+        ClearDatadirCache();
+        boost::filesystem::remove_all(path);
+    }
+};
+
+void FillPayments(CXFSnodePayments& payments)
+{
+    for (int nHeight = 0; nHeight < FLATDB_BENCH_BLOCKS; nHeight++) {
+        CXFSnodeBlockPayees blockPayees(nHeight);
+        for (int i = 0; i < MNPAYMENTS_SIGNATURES_TOTAL; i++) {
+            CScript payee = CScript() << OP_DUP << OP_HASH160 << ToByteVector(GetRandHash()) << OP_EQUALVERIFY << OP_CHECKSIG;
+            CXFSnodePaymentVote vote(CTxIn(COutPoint(GetRandHash(), 1)), nHeight, payee);
+            vote.vchSig.resize(65, 0x1c);
+            payments.mapXFSnodePaymentVotes[vote.GetHash()] = vote;
+            blockPayees.AddPayee(vote);
+        }
+        payments.mapXFSnodeBlocks[nHeight] = blockPayees;
+    }
+}
+
+} // anon namespace
+
+static void FlatDBDumpPayments(benchmark::State& state)
+{
+    ScratchDataDir datadir;
+    CXFSnodePayments payments;
+    FillPayments(payments);
+
+    CFlatDB<CXFSnodePayments> flatdb("inpayments.dat", "magicXFSnodePaymentsCache");
+    while (state.KeepRunning()) {
+        flatdb.Dump(payments);
+    }
+}
+
+static void FlatDBLoadPayments(benchmark::State& state)
+{
+    ScratchDataDir datadir;
+    CXFSnodePayments payments;
+    FillPayments(payments);
+
+    CFlatDB<CXFSnodePayments> flatdb("inpayments.dat", "magicXFSnodePaymentsCache");
+    flatdb.Dump(payments);
+    while (state.KeepRunning()) {
+        CXFSnodePayments paymentsLoaded;
+        flatdb.Load(paymentsLoaded, false);
+        assert(paymentsLoaded.mapXFSnodePaymentVotes.size() == payments.mapXFSnodePaymentVotes.size());
+    }
+}
+
+BENCHMARK(FlatDBDumpPayments);
+BENCHMARK(FlatDBLoadPayments);
@@ -0,0 +1,131 @@
+// Copyright (c) 2020 The XFS Core Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include "arith_uint256.h"
+#include "chainparams.h"
+#include "random.h"
+#include "tinyformat.h"
+#include "util.h"
+#include "elysium/elysium.h"
+#include "elysium/mdex.h"
+#include "elysium/sp.h"
+#include "elysium/tally.h"
+
+#include <boost/filesystem.hpp>
+
+#include <string>
+#include <vector>
+
+using namespace elysium;
+
+// Orders in the synthetic order flow, every tenth one cancels an earlier order. The trades are recorded
+// in the scratch databases below, so this sets how much gets written as well.
+static const int METADEX_BENCH_ORDERS = 1000000;
+// Addresses trading in the flow, each one is funded with enough tokens for all of its orders
+static const int METADEX_BENCH_ADDRESSES = 100;
+
+namespace {
+
+const uint32_t properties[] = {3, 4, 5, 6};
+
+struct FlowEntry
+{
+    CMPMetaDEx order;
+    // the earlier order to cancel, if this entry is a cancel
+    int nCancel;
+
+    FlowEntry(const CMPMetaDEx& order, int nCancel) : order(order), nCancel(nCancel) {}
+};
+
+std::string Address(int n)
+{
+    return strprintf("TSrs4fb8LgnMADmBQj1EbadKbUsiuv4D%02d", n);
+}
+
+/** Orders over a few pairs, with prices in steps of 1% within 10% of each other so about half of them trade */
+std::vector<FlowEntry> CreateFlow(int nOrders)
+{
+    seed_insecure_rand(true);
+
+    std::vector<FlowEntry> flow;
+    flow.reserve(nOrders);
+    for (int i = 0; i < nOrders; i++) {
+        uint32_t property = properties[insecure_rand() % 4];
+        uint32_t desired = properties[(property - 3 + 1 + insecure_rand() % 3) % 4];
+        int64_t amountForSale = 100 * (10 + insecure_rand() % 10);
+        int64_t amountDesired = amountForSale * (90 + insecure_rand() % 21) / 100;
+
+        CMPMetaDEx order(Address(insecure_rand() % METADEX_BENCH_ADDRESSES), 1000 + i / 100, property, amountForSale,
+                desired, amountDesired, ArithToUint256(arith_uint256(i + 1)), i % 100, CMPTransaction::ADD);
+        int nCancel = (i > 0 && i % 10 == 0) ? insecure_rand() % i : -1;
+        flow.push_back(FlowEntry(order, nCancel));
+    }
+
+    return flow;
+}
+
+/** The databases the MetaDEx records trades and cancels in, in a scratch directory while a benchmark runs */
+class ScratchDatabases
+{
+private:
+    boost::filesystem::path path;
+
+public:
+    ScratchDatabases()
+    {
+        SelectParams(CBaseChainParams::MAIN);
+        path = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path("bench_metadex_%%%%-%%%%");
+        boost::filesystem::create_directories(path);
+        _my_sps = new CMPSPInfo(path / "MP_spinfo", false);
+        p_txlistdb = new CMPTxList(path / "MP_txlist", false);
+        t_tradelistdb = new CMPTradeList(path / "MP_tradelist", false);
+    }
+
+    ~ScratchDatabases()
+    {
+        metadex.clear();
+        MetaDEx_RebuildOrderBook();
+        mp_tally_map.clear();
+        delete t_tradelistdb; t_tradelistdb = nullptr;
+        delete p_txlistdb; p_txlistdb = nullptr;
+        delete _my_sps; _my_sps = nullptr;
+        boost::filesystem::remove_all(path);
+    }
+};
+
+} // anon namespace
+
+/** The flow through MetaDEx_ADD and MetaDEx_CANCEL_AT_PRICE, trades included */
+static void MetaDExTrades(benchmark::State& state)
+{
+    const std::vector<FlowEntry> flow = CreateFlow(METADEX_BENCH_ORDERS);
+    ScratchDatabases databases;
+
+    while (state.KeepRunning()) {
+        metadex.clear();
+        MetaDEx_RebuildOrderBook();
+        mp_tally_map.clear();
+        for (int i = 0; i < METADEX_BENCH_ADDRESSES; i++) {
+            for (size_t j = 0; j < sizeof(properties) / sizeof(properties[0]); j++) {
+                update_tally_map(Address(i), properties[j], 100000LL * METADEX_BENCH_ORDERS, BALANCE);
+            }
+        }
+
+        for (size_t i = 0; i < flow.size(); i++) {
+            const CMPMetaDEx& order = flow[i].nCancel >= 0 ? flow[flow[i].nCancel].order : flow[i].order;
+            if (flow[i].nCancel >= 0) {
+                MetaDEx_CANCEL_AT_PRICE(flow[i].order.getHash(), flow[i].order.getBlock(), order.getAddr(),
+                        order.getProperty(), order.getAmountForSale(), order.getDesProperty(), order.getAmountDesired());
+                continue;
+            }
+
+            MetaDEx_ADD(order.getAddr(), order.getProperty(), order.getAmountForSale(), order.getBlock(),
+                    order.getDesProperty(), order.getAmountDesired(), order.getHash(), order.getIdx());
+        }
+    }
+}
+
+BENCHMARK(MetaDExTrades);
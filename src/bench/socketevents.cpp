@@ -0,0 +1,126 @@
+// Copyright (c) 2020 The XFS Core Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include "compat.h"
+#include "netbase.h"
+#include "socketevents.h"
+#include "util.h"
+#include "utiltime.h"
+
+#include <ctime>
+#include <iostream>
+#include <vector>
+
+#include <string.h>
+
+// Number of loopback peers the socket handler is waiting on
+static const int SOCKET_EVENTS_PEERS = 1000;
+
+/**
+ * One byte is sent to a single peer out of SOCKET_EVENTS_PEERS idle ones and the receiving side waits
+ * for it the way ThreadSocketHandler does. Time per iteration is the message latency, the extra
+ * output line is process CPU time per wakeup.
+ */
+static void SocketEventsLoopback(benchmark::State& state, SocketEventsMode mode)
+{
+    RaiseFileDescriptorLimit(2 * SOCKET_EVENTS_PEERS + 64);
+    // the socket calls go through compat.h, on Windows they need Winsock started
+    if (!SetupNetworking()) {
+        std::cerr << "SocketEventsLoopback: can't initialize networking" << std::endl;
+        return;
+    }
+
+    SOCKET hListenSocket = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = 0;
+    socklen_t len = sizeof(addr);
+    if (hListenSocket == INVALID_SOCKET ||
+            bind(hListenSocket, (struct sockaddr*)&addr, sizeof(addr)) == SOCKET_ERROR ||
+            listen(hListenSocket, SOMAXCONN) == SOCKET_ERROR ||
+            getsockname(hListenSocket, (struct sockaddr*)&addr, &len) == SOCKET_ERROR) {
+        std::cerr << "SocketEventsLoopback: can't listen on loopback" << std::endl;
+        CloseSocket(hListenSocket);
+        return;
+    }
+
+    // Connecting sockets are created before accepting any, so with select() the watched ones stay below FD_SETSIZE
+    std::vector<SOCKET> vConnected, vAccepted;
+    for (int i = 0; i < SOCKET_EVENTS_PEERS; i++) {
+        SOCKET hSocket = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+        if (hSocket == INVALID_SOCKET || connect(hSocket, (struct sockaddr*)&addr, sizeof(addr)) == SOCKET_ERROR) {
+            std::cerr << "SocketEventsLoopback: can't connect peer " << i << std::endl;
+            CloseSocket(hSocket);
+            break;
+        }
+        SetSocketNonBlocking(hSocket, true);
+        vConnected.push_back(hSocket);
+    }
+    for (size_t i = 0; i < vConnected.size(); i++) {
+        SOCKET hSocket = accept(hListenSocket, NULL, NULL);
+        if (hSocket == INVALID_SOCKET) {
+            std::cerr << "SocketEventsLoopback: can't accept peer " << i << std::endl;
+            while (vConnected.size() > vAccepted.size()) {
+                CloseSocket(vConnected.back());
+                vConnected.pop_back();
+            }
+            break;
+        }
+        vAccepted.push_back(hSocket);
+    }
+
+    CSocketEvents socketEvents(mode);
+    std::vector<CSocketEvents::Socket> vSockets;
+    for (size_t i = 0; i < vConnected.size(); i++) {
+        CSocketEvents::Socket socket = {vConnected[i], &vConnected[i], CSocketEvents::EVENT_RECV | CSocketEvents::EVENT_ERROR};
+        vSockets.push_back(socket);
+        socketEvents.Register(vConnected[i], &vConnected[i], true);
+    }
+
+    std::vector<CSocketEvents::Event> vEvents;
+    uint64_t nCount = 0, nWakeups = 0;
+    std::clock_t cpuStart = std::clock();
+    while (state.KeepRunning() && !vConnected.empty()) {
+        size_t nPeer = nCount++ % vConnected.size();
+        char ch = 'x';
+        send(vAccepted[nPeer], &ch, 1, MSG_NOSIGNAL);
+
+        bool fReceived = false;
+        while (!fReceived) {
+            socketEvents.Wait(vSockets, 1000, vEvents);
+            nWakeups++;
+            for (size_t i = 0; i < vEvents.size(); i++) {
+                if (vEvents[i].cookie == &vConnected[nPeer] && recv(vConnected[nPeer], &ch, 1, MSG_DONTWAIT) == 1)
+                    fReceived = true;
+            }
+        }
+    }
+    double cpuPerWakeup = nWakeups ? double(std::clock() - cpuStart) / CLOCKS_PER_SEC / nWakeups : 0;
+    std::cout << "SocketEvents-" << SocketEventsModeToString(socketEvents.GetMode()) << "-cpu-per-wakeup-"
+              << vConnected.size() << "-peers," << nWakeups << "," << cpuPerWakeup << "," << cpuPerWakeup << ","
+              << cpuPerWakeup << "\n";
+
+    for (size_t i = 0; i < vConnected.size(); i++) {
+        CloseSocket(vConnected[i]);
+        CloseSocket(vAccepted[i]);
+    }
+    CloseSocket(hListenSocket);
+}
+
+static void SocketEventsSelect(benchmark::State& state)
+{
+    SocketEventsLoopback(state, SOCKETEVENTS_SELECT);
+}
+
+static void SocketEventsEpoll(benchmark::State& state)
+{
+    SocketEventsLoopback(state, SOCKETEVENTS_EPOLL);
+}
+
+BENCHMARK(SocketEventsSelect);
+BENCHMARK(SocketEventsEpoll);
@@ -0,0 +1,124 @@
+// Copyright (c) 2020 The XFS Core Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include "darksend.h"
+#include "key.h"
+#include "main.h"
+#include "random.h"
+#include "util.h"
+#include "xfsnode.h"
+
+#include <algorithm>
+
+#include <boost/thread.hpp>
+
+// Xfsnodes announcing themselves in the burst, every one with a broadcast and a ping
+static const int SIG_BURST_XFSNODES = 100;
+// Peers relaying every message of the burst
+static const int SIG_BURST_RELAYS = 4;
+
+namespace {
+
+struct SignedMessage
+{
+    CPubKey pubkey;
+    std::string strMessage;
+    std::vector<unsigned char> vchSig;
+};
+
+/** mnb/mnp traffic of a list sync as it arrives: every message once from each relaying peer */
+std::vector<SignedMessage> MakeSigBurst()
+{
+    std::vector<SignedMessage> vUnique;
+    for (int i = 0; i < SIG_BURST_XFSNODES; i++) {
+        CKey keyCollateral, keyXFSnode;
+        keyCollateral.MakeNewKey(true);
+        keyXFSnode.MakeNewKey(true);
+
+        CXFSnodeBroadcast mnb(CService("10.0.0.1", 8168 + i), CTxIn(COutPoint(GetRandHash(), 1)),
+                              keyCollateral.GetPubKey(), keyXFSnode.GetPubKey(), PROTOCOL_VERSION);
+        mnb.sigTime = GetTime();
+        SignedMessage msgMnb = {mnb.pubKeyCollateralAddress, mnb.GetSignatureMessage(), {}};
+        darkSendSigner.SignMessage(msgMnb.strMessage, msgMnb.vchSig, keyCollateral);
+        vUnique.push_back(msgMnb);
+
+        CXFSnodePing mnp;
+        mnp.vin = mnb.vin;
+        mnp.blockHash = GetRandHash();
+        mnp.sigTime = GetTime();
+        SignedMessage msgMnp = {mnb.pubKeyXFSnode, mnp.GetSignatureMessage(), {}};
+        darkSendSigner.SignMessage(msgMnp.strMessage, msgMnp.vchSig, keyXFSnode);
+        vUnique.push_back(msgMnp);
+    }
+
+    std::vector<SignedMessage> vBurst;
+    for (int i = 0; i < SIG_BURST_RELAYS; i++)
+        vBurst.insert(vBurst.end(), vUnique.begin(), vUnique.end());
+    return vBurst;
+}
+
+} // anon namespace
+
+/** Every relayed copy recovers its signer, as before signatures were cached */
+static void XFSnodeSigBurstUncached(benchmark::State& state)
+{
+    std::vector<SignedMessage> vBurst = MakeSigBurst();
+    while (state.KeepRunning()) {
+        BOOST_FOREACH(const SignedMessage& msg, vBurst) {
+            CHashWriter ss(SER_GETHASH, 0);
+            ss << strMessageMagic;
+            ss << msg.strMessage;
+            CPubKey pubkeyFromSig;
+            bool fValid = pubkeyFromSig.RecoverCompact(ss.GetHash(), msg.vchSig) && pubkeyFromSig.GetID() == msg.pubkey.GetID();
+            assert(fValid);
+        }
+    }
+}
+
+/** Relayed copies are answered from the signature cache */
+static void XFSnodeSigBurstCached(benchmark::State& state)
+{
+    std::vector<SignedMessage> vBurst = MakeSigBurst();
+    std::string strError;
+    while (state.KeepRunning()) {
+        darkSendSigner.ClearSignatureCache();
+        BOOST_FOREACH(const SignedMessage& msg, vBurst) {
+            bool fValid = darkSendSigner.VerifyMessage(msg.pubkey, msg.vchSig, msg.strMessage, strError);
+            assert(fValid);
+        }
+    }
+}
+
+/** The burst is checked on all cores first, the way the xfsnode workers do it */
+static void XFSnodeSigBurstBatched(benchmark::State& state)
+{
+    std::vector<SignedMessage> vBurst = MakeSigBurst();
+    std::vector<std::pair<std::string, std::vector<unsigned char> > > vMessages;
+    BOOST_FOREACH(const SignedMessage& msg, vBurst)
+        vMessages.push_back(std::make_pair(msg.strMessage, msg.vchSig));
+    std::sort(vMessages.begin(), vMessages.end());
+    vMessages.erase(std::unique(vMessages.begin(), vMessages.end()), vMessages.end());
+
+    boost::thread_group threadGroup;
+    StartMessageSigCheckThreads(std::max(GetNumCores() - 1, 0), threadGroup);
+
+    std::string strError;
+    while (state.KeepRunning()) {
+        darkSendSigner.ClearSignatureCache();
+        darkSendSigner.CacheMessageSigners(vMessages);
+        BOOST_FOREACH(const SignedMessage& msg, vBurst) {
+            bool fValid = darkSendSigner.VerifyMessage(msg.pubkey, msg.vchSig, msg.strMessage, strError);
+            assert(fValid);
+        }
+    }
+
+    threadGroup.interrupt_all();
+    threadGroup.join_all();
+}
+
+BENCHMARK(XFSnodeSigBurstUncached);
+BENCHMARK(XFSnodeSigBurstCached);
+BENCHMARK(XFSnodeSigBurstBatched);
@@ -11,6 +11,21 @@
 
 class CTxMemPool;
 
+/** Privacy spends sent in full along with a compact block are limited to this many bytes in total */
+static const unsigned int MAX_CMPCTBLOCK_PREFILL_SIZE = 50000;
+
+/** Compact block reconstruction counters since startup, protected by cs_main */
+struct CompactBlockStats {
+    uint64_t nBlocks = 0;           // blocks reconstructed
+    uint64_t nBlocksRoundTrip = 0;  // ... of which needed a getblocktxn round trip
+    uint64_t nBlocksFailed = 0;     // reconstructions given up in favour of the full block
+    uint64_t nTxPrefilled = 0;
+    uint64_t nTxMempool = 0;
+    uint64_t nTxExtra = 0;          // found in the extra transactions pool
+    uint64_t nTxRequested = 0;
+};
+extern CompactBlockStats compactBlockStats;
+
 // Dumb helper to handle CTransaction compression at serialize-time
 struct TransactionCompressor {
 private:
@@ -148,7 +163,8 @@ public:
     // Dummy for deserialization
     CBlockHeaderAndShortTxIDs() {}
 
-    CBlockHeaderAndShortTxIDs(const CBlock& block, bool fUseWTXID);
+    /** vPrefill are the (ascending) indexes of transactions sent in full besides the coinbase */
+    CBlockHeaderAndShortTxIDs(const CBlock& block, bool fUseWTXID, const std::vector<uint16_t>& vPrefill = std::vector<uint16_t>());
 
     uint64_t GetShortID(const uint256& txhash) const;
 
@@ -194,13 +210,14 @@ public:
 class PartiallyDownloadedBlock {
 protected:
     std::vector<std::shared_ptr<const CTransaction> > txn_available;
-    size_t prefilled_count = 0, mempool_count = 0;
+    size_t prefilled_count = 0, mempool_count = 0, extra_count = 0;
     CTxMemPool* pool;
 public:
     CBlockHeader header;
     PartiallyDownloadedBlock(CTxMemPool* poolIn) : pool(poolIn) {}
 
-    ReadStatus InitData(const CBlockHeaderAndShortTxIDs& cmpctblock);
+    // extra_txn is a list of extra transactions to look at, in <witness hash, reference> form
+    ReadStatus InitData(const CBlockHeaderAndShortTxIDs& cmpctblock, const std::vector<std::pair<uint256, std::shared_ptr<const CTransaction> > >& extra_txn);
     bool IsTxAvailable(size_t index) const;
     ReadStatus FillBlock(CBlock& block, const std::vector<CTransaction>& vtx_missing) const;
 };
@@ -4,6 +4,14 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include "chain.h"
+#include "main.h"
+#include "sync.h"
+#include "txdb.h"
+#include "util.h"
+
+#include <list>
+#include <stdexcept>
+#include <unordered_map>
 
 using namespace std;
 
@@ -61,6 +69,202 @@ const CBlockIndex *CChain::FindFork(const CBlockIndex *pindex) const {
     return pindex;
 }
 
+/**
+ * CBlockIndex mint and spend data
+ */
+namespace {
+
+/** Guards the cache below and mint and spend data pointers of all block index entries */
+CCriticalSection cs_mintSpendData;
+
+/** Block index entries with clean mint and spend data in memory, most recently used first */
+std::list<const CBlockIndex *> mintSpendDataLru;
+std::unordered_map<const CBlockIndex *, std::list<const CBlockIndex *>::iterator> mintSpendDataLruIndex;
+
+void RemoveFromMintSpendDataLru(const CBlockIndex *pindex)
+{
+    auto it = mintSpendDataLruIndex.find(pindex);
+    if (it != mintSpendDataLruIndex.end()) {
+        mintSpendDataLru.erase(it->second);
+        mintSpendDataLruIndex.erase(it);
+    }
+}
+
+}
+
+CBlockIndexMintSpendState::CBlockIndexMintSpendState(const CBlockIndexMintSpendState &other)
+{
+    LOCK(cs_mintSpendData);
+    zerocoinMintCounts = other.zerocoinMintCounts;
+    sigmaMintCounts = other.sigmaMintCounts;
+    nSpentSerials = other.nSpentSerials;
+    pmintSpendData = other.pmintSpendData;
+    fMintSpendDataPinned = other.fMintSpendDataPinned;
+}
+
+CBlockIndexMintSpendState &CBlockIndexMintSpendState::operator=(const CBlockIndexMintSpendState &other)
+{
+    if (this != &other) {
+        LOCK(cs_mintSpendData);
+        zerocoinMintCounts = other.zerocoinMintCounts;
+        sigmaMintCounts = other.sigmaMintCounts;
+        nSpentSerials = other.nSpentSerials;
+        pmintSpendData = other.pmintSpendData;
+        fMintSpendDataPinned = other.fMintSpendDataPinned;
+    }
+    return *this;
+}
+
+void CBlockIndexMintSpendState::SetNull()
+{
+    LOCK(cs_mintSpendData);
+    zerocoinMintCounts.clear();
+    sigmaMintCounts.clear();
+    nSpentSerials = 0;
+    pmintSpendData.reset();
+    fMintSpendDataPinned = false;
+}
+
+CBlockIndex::~CBlockIndex()
+{
+    LOCK(cs_mintSpendData);
+    if (mintSpend.pmintSpendData && !mintSpend.fMintSpendDataPinned)
+        RemoveFromMintSpendDataLru(this);
+}
+
+void CBlockIndex::TouchMintSpendData() const
+{
+    AssertLockHeld(cs_mintSpendData);
+
+    auto it = mintSpendDataLruIndex.find(this);
+    if (it != mintSpendDataLruIndex.end()) {
+        mintSpendDataLru.splice(mintSpendDataLru.begin(), mintSpendDataLru, it->second);
+        return;
+    }
+
+    mintSpendDataLru.push_front(this);
+    mintSpendDataLruIndex[this] = mintSpendDataLru.begin();
+
+    while (mintSpendDataLru.size() > MAX_MINT_SPEND_DATA_CACHE_SIZE) {
+        const CBlockIndex *evicted = mintSpendDataLru.back();
+        mintSpendDataLruIndex.erase(evicted);
+        mintSpendDataLru.pop_back();
+        // data is clean, summary is up to date
+        evicted->mintSpend.pmintSpendData.reset();
+    }
+}
+
+std::shared_ptr<const CBlockMintSpendData> CBlockIndex::GetMintSpendData() const
+{
+    static const std::shared_ptr<const CBlockMintSpendData> emptyData = std::make_shared<CBlockMintSpendData>();
+
+    {
+        LOCK(cs_mintSpendData);
+        if (mintSpend.pmintSpendData) {
+            if (!mintSpend.fMintSpendDataPinned)
+                TouchMintSpendData();
+            return mintSpend.pmintSpendData;
+        }
+    }
+
+    if (!HasMintSpendData())
+        return emptyData;
+
+    // read without holding the lock, data of different blocks may be loaded in parallel
+    std::shared_ptr<CBlockMintSpendData> data;
+    if (!phashBlock || !pblocktree || !pblocktree->ReadBlockMintSpendData(*phashBlock, data)) {
+        // anonymity sets and accumulators built without the block's coins would be wrong, and pinned
+        // data would overwrite the block's records when written back
+        AbortNode(strprintf("%s: failed to read mint and spend data of block %s", __func__, ToString()),
+                  _("Error reading from database, shutting down."));
+        throw std::runtime_error("failed to read mint and spend data");
+    }
+
+    LOCK(cs_mintSpendData);
+    if (!mintSpend.pmintSpendData)
+        mintSpend.pmintSpendData = data;
+    if (!mintSpend.fMintSpendDataPinned)
+        TouchMintSpendData();
+    return mintSpend.pmintSpendData;
+}
+
+CBlockMintSpendData &CBlockIndex::GetMintSpendDataForUpdate()
+{
+    std::shared_ptr<const CBlockMintSpendData> data = GetMintSpendData();
+
+    LOCK(cs_mintSpendData);
+    if (!mintSpend.fMintSpendDataPinned) {
+        RemoveFromMintSpendDataLru(this);
+        // readers may still hold the clean copy
+        mintSpend.pmintSpendData = std::make_shared<CBlockMintSpendData>(*data);
+        mintSpend.fMintSpendDataPinned = true;
+    }
+    return *mintSpend.pmintSpendData;
+}
+
+void CBlockIndex::MintSpendDataWritten() const
+{
+    LOCK(cs_mintSpendData);
+    if (!mintSpend.fMintSpendDataPinned)
+        return;
+
+    UpdateMintSpendSummary(*mintSpend.pmintSpendData);
+    mintSpend.fMintSpendDataPinned = false;
+    TouchMintSpendData();
+}
+
+bool CBlockIndex::IsMintSpendDataPinned() const
+{
+    LOCK(cs_mintSpendData);
+    return mintSpend.fMintSpendDataPinned;
+}
+
+void CBlockIndex::UpdateMintSpendSummary(const CBlockMintSpendData &data) const
+{
+    LOCK(cs_mintSpendData);
+
+    mintSpend.zerocoinMintCounts.clear();
+    for (const auto &accChange: data.accumulatorChanges)
+        mintSpend.zerocoinMintCounts[accChange.first] = accChange.second.second;
+
+    // keep groups without coins too, so HasMintSpendData() agrees with the data
+    mintSpend.sigmaMintCounts.clear();
+    for (const auto &pubCoins: data.sigmaMintedPubCoins)
+        mintSpend.sigmaMintCounts[pubCoins.first] = pubCoins.second.size();
+
+    mintSpend.nSpentSerials = data.spentSerials.size() + data.sigmaSpentSerials.size();
+}
+
+bool CBlockIndex::HasMintSpendData() const
+{
+    LOCK(cs_mintSpendData);
+    if (mintSpend.pmintSpendData)
+        return !mintSpend.pmintSpendData->IsNull();
+    return !mintSpend.zerocoinMintCounts.empty() || !mintSpend.sigmaMintCounts.empty() || mintSpend.nSpentSerials > 0;
+}
+
+int CBlockIndex::GetZerocoinMintCount(const pair<int,int> &denomAndId) const
+{
+    LOCK(cs_mintSpendData);
+    if (mintSpend.pmintSpendData) {
+        auto it = mintSpend.pmintSpendData->accumulatorChanges.find(denomAndId);
+        return it != mintSpend.pmintSpendData->accumulatorChanges.end() ? it->second.second : 0;
+    }
+    auto it = mintSpend.zerocoinMintCounts.find(denomAndId);
+    return it != mintSpend.zerocoinMintCounts.end() ? it->second : 0;
+}
+
+int CBlockIndex::GetSigmaMintCount(const pair<sigma::CoinDenomination, int> &denomAndId) const
+{
+    LOCK(cs_mintSpendData);
+    if (mintSpend.pmintSpendData) {
+        auto it = mintSpend.pmintSpendData->sigmaMintedPubCoins.find(denomAndId);
+        return it != mintSpend.pmintSpendData->sigmaMintedPubCoins.end() ? it->second.size() : 0;
+    }
+    auto it = mintSpend.sigmaMintCounts.find(denomAndId);
+    return it != mintSpend.sigmaMintCounts.end() ? it->second : 0;
+}
+
 /** Turn the lowest '1' bit in the binary representation of a number into a '0'. */
 int static inline InvertLowestOne(int n) { return n & (n - 1); }
 
@@ -22,6 +22,7 @@
 #include "coin_containers.h"
 #include "streams.h"
 
+#include <memory>
 #include <vector>
 #include <unordered_set>
 
@@ -163,6 +164,70 @@ enum BlockStatus: uint32_t {
     BLOCK_STAKE_MODIFIER     =   1024,
 };
 
+/** Zerocoin and sigma mints and spends of a block, stored along with its block index entry */
+class CBlockMintSpendData
+{
+public:
+    //! Public coin values of mints in this block, ordered by serialized value of public coin
+    //! Maps <denomination,id> to vector of public coins
+    map<pair<int,int>, vector<CBigNum>> mintedPubCoins;
+
+    //! Accumulator updates. Contains only changes made by mints in this block
+    //! Maps <denomination, id> to <accumulator value (CBigNum), number of such mints in this block>
+    map<pair<int,int>, pair<CBigNum,int>> accumulatorChanges;
+
+    //! Values of coin serials spent in this block
+    set<CBigNum> spentSerials;
+
+/////////////////////// Sigma index entries. ////////////////////////////////////////////
+
+    //! Public coin values of mints in this block, ordered by serialized value of public coin
+    //! Maps <denomination,id> to vector of public coins
+    std::map<pair<sigma::CoinDenomination, int>, vector<sigma::PublicCoin>> sigmaMintedPubCoins;
+
+    //! Values of coin serials spent in this block
+    sigma::spend_info_container sigmaSpentSerials;
+
+    bool IsNull() const
+    {
+        return mintedPubCoins.empty() && accumulatorChanges.empty() && spentSerials.empty() &&
+                sigmaMintedPubCoins.empty() && sigmaSpentSerials.empty();
+    }
+};
+
+/** Maximum number of block index entries with clean mint and spend data kept in memory */
+static const unsigned int MAX_MINT_SPEND_DATA_CACHE_SIZE = 10000;
+
+/**
+ * Mint and spend state of a block index entry. It is guarded by cs_mintSpendData (see chain.cpp) because data
+ * is loaded and evicted by any thread reading it, so copies are taken under that lock.
+ */
+class CBlockIndexMintSpendState
+{
+public:
+    //! Number of zerocoin mints in this block by <denomination, id>. Together with the fields below
+    //! it summarizes mint and spend data of the block, which is kept in memory only while in use
+    map<pair<int,int>, int> zerocoinMintCounts;
+
+    //! Number of sigma mints in this block by <denomination, id>
+    std::map<pair<sigma::CoinDenomination, int>, int> sigmaMintCounts;
+
+    //! Number of zerocoin and sigma serials spent in this block
+    unsigned int nSpentSerials;
+
+    //! Mint and spend data, or NULL if it wasn't loaded from the block tree database yet
+    std::shared_ptr<CBlockMintSpendData> pmintSpendData;
+
+    //! Mint and spend data was modified and must not be evicted until it's written to disk
+    bool fMintSpendDataPinned;
+
+    CBlockIndexMintSpendState() : nSpentSerials(0), fMintSpendDataPinned(false) {}
+    CBlockIndexMintSpendState(const CBlockIndexMintSpendState &other);
+    CBlockIndexMintSpendState &operator=(const CBlockIndexMintSpendState &other);
+
+    void SetNull();
+};
+
 /** The block chain is a tree shaped structure starting with the
  * genesis block at the root, with each block potentially having multiple
  * candidates to be the next block. A blockindex may have multiple pprev pointing
@@ -222,29 +287,19 @@ public:
     //! (memory only) Sequential id assigned to distinguish order in which blocks are received.
     uint32_t nSequenceId;
 
-    //! Public coin values of mints in this block, ordered by serialized value of public coin
-    //! Maps <denomination,id> to vector of public coins
-    map<pair<int,int>, vector<CBigNum>> mintedPubCoins;
-
-    //! Accumulator updates. Contains only changes made by mints in this block
-    //! Maps <denomination, id> to <accumulator value (CBigNum), number of such mints in this block>
-    map<pair<int,int>, pair<CBigNum,int>> accumulatorChanges;
-
-	//! Same as accumulatorChanges but for alternative modulus
+	//! (memory only) Same as accumulatorChanges in CBlockMintSpendData but for alternative modulus
 	map<pair<int,int>, pair<CBigNum,int>> alternativeAccumulatorChanges;
 
-    //! Values of coin serials spent in this block
-	set<CBigNum> spentSerials;
+private:
+    //! (memory only) Summary and cached copy of mint and spend data, guarded by cs_mintSpendData
+    mutable CBlockIndexMintSpendState mintSpend;
 
-/////////////////////// Sigma index entries. ////////////////////////////////////////////
+    //! Marks mint and spend data as recently used, evicting the least recently used data over the cache limit
+    void TouchMintSpendData() const;
 
-    //! Public coin values of mints in this block, ordered by serialized value of public coin
-    //! Maps <denomination,id> to vector of public coins
-    std::map<pair<sigma::CoinDenomination, int>, vector<sigma::PublicCoin>> sigmaMintedPubCoins;
-
-    //! Values of coin serials spent in this block
-    sigma::spend_info_container sigmaSpentSerials;
+    friend class CDiskBlockIndex;
 
+public:
     void SetNull()
     {
         phashBlock = NULL;
@@ -267,11 +322,8 @@ public:
         nNonce         = 0;
         vchBlockSig.clear();
 
-        mintedPubCoins.clear();
-        sigmaMintedPubCoins.clear();
-        accumulatorChanges.clear();
-        spentSerials.clear();
-        sigmaSpentSerials.clear();
+        alternativeAccumulatorChanges.clear();
+        mintSpend.SetNull();
         //PoS
         nStakeModifier = uint256();
     }
@@ -294,6 +346,39 @@ public:
             vchBlockSig    = block.vchBlockSig; // qtum
     }
 
+    ~CBlockIndex();
+
+    /**
+     * Returns mint and spend data of this block, loading it from the block tree database if necessary.
+     * Loaded data stays in a bounded least recently used cache, callers keep it alive by holding the pointer.
+     * Failing to read the data aborts the node and throws, it is never returned empty in its place.
+     */
+    std::shared_ptr<const CBlockMintSpendData> GetMintSpendData() const;
+
+    /**
+     * Returns mint and spend data of this block for modification. The data is kept in memory until
+     * the block index entry is written to disk and MintSpendDataWritten() is called.
+     */
+    CBlockMintSpendData &GetMintSpendDataForUpdate();
+
+    //! Called after the block index entry was written to disk, makes modified mint and spend data evictable again
+    void MintSpendDataWritten() const;
+
+    //! Whether modified mint and spend data is waiting to be written to disk
+    bool IsMintSpendDataPinned() const;
+
+    //! Recalculates mint counts and number of spends from the mint and spend data
+    void UpdateMintSpendSummary(const CBlockMintSpendData &data) const;
+
+    //! Whether this block has any mints or spends, doesn't require mint and spend data
+    bool HasMintSpendData() const;
+
+    //! Number of zerocoin mints of given <denomination, id> in this block, doesn't require mint and spend data
+    int GetZerocoinMintCount(const pair<int,int> &denomAndId) const;
+
+    //! Number of sigma mints of given <denomination, id> in this block, doesn't require mint and spend data
+    int GetSigmaMintCount(const pair<sigma::CoinDenomination, int> &denomAndId) const;
+
     CDiskBlockPos GetBlockPos() const {
         CDiskBlockPos ret;
         if (nStatus & BLOCK_HAVE_DATA) {
@@ -482,11 +567,19 @@ public:
         nDiskBlockVersion = 0;
     }
 
+    // the mint and spend state is copied under cs_mintSpendData, this copy isn't shared with other threads
     explicit CDiskBlockIndex(const CBlockIndex* pindex) : CBlockIndex(*pindex) {
         hashPrev = (pprev ? pprev->GetBlockHash() : uint256());
         nDiskBlockVersion = 0;
+        // make sure evicted mint and spend data isn't written back as empty
+        if (!mintSpend.pmintSpendData && HasMintSpendData())
+            mintSpend.pmintSpendData = std::const_pointer_cast<CBlockMintSpendData>(pindex->GetMintSpendData());
+        mintSpend.fMintSpendDataPinned = false;
     }
 
+    //! Mint and spend data read along with this entry
+    std::shared_ptr<CBlockMintSpendData> GetMintSpendDataPtr() const { return mintSpend.pmintSpendData; }
+
     ADD_SERIALIZE_METHODS;
 
     template <typename Stream, typename Operation>
@@ -514,15 +607,21 @@ public:
         if(nNonce == 0)
             READWRITE(vchBlockSig); // qtum
 
+        if (ser_action.ForRead() && !mintSpend.pmintSpendData)
+            mintSpend.pmintSpendData = std::make_shared<CBlockMintSpendData>();
+        static const CBlockMintSpendData emptyMintSpendData;
+        CBlockMintSpendData &mintSpendData = mintSpend.pmintSpendData ? *mintSpend.pmintSpendData :
+                const_cast<CBlockMintSpendData &>(emptyMintSpendData);
+
         if (!(nType & SER_GETHASH) && nVersion >= ZC_ADVANCED_INDEX_VERSION) {
-            READWRITE(mintedPubCoins);
-		    READWRITE(accumulatorChanges);
-            READWRITE(spentSerials);
+            READWRITE(mintSpendData.mintedPubCoins);
+		    READWRITE(mintSpendData.accumulatorChanges);
+            READWRITE(mintSpendData.spentSerials);
 	    }
 
         if (!(nType & SER_GETHASH) && nHeight >= Params().GetConsensus().nSigmaStartBlock) {
-            READWRITE(sigmaMintedPubCoins);
-            READWRITE(sigmaSpentSerials);
+            READWRITE(mintSpendData.sigmaMintedPubCoins);
+            READWRITE(mintSpendData.sigmaSpentSerials);
         }
 
 	    // PoS
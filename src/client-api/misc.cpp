@@ -4,6 +4,7 @@
 
 #include "xfsnodeman.h"
 #include "main.h"
+#include "netmsgstats.h"
 #include "init.h"
 #include "util.h"
 #include "client-api/server.h"
@@ -209,6 +210,17 @@ UniValue backup(Type type, const UniValue& data, const UniValue& auth, bool fHel
     return true;
 }
 
+UniValue netmsgstats(Type type, const UniValue& data, const UniValue& auth, bool fHelp)
+{
+    mapNetMsgTypeStats mapStats;
+    netMsgStats.GetStats(mapStats);
+
+    UniValue obj(UniValue::VOBJ);
+    obj.push_back(Pair("time", GetTime()));
+    obj.push_back(Pair("stats", NetMsgStatsToJSON(mapStats)));
+    return obj;
+}
+
 UniValue stop(Type type, const UniValue& data, const UniValue& auth, bool fHelp)
 {
     // Accept the deprecated and ignored 'detach' boolean argument
@@ -279,6 +291,7 @@ static const CAPICommand commands[] =
   //  --------------------- ------------       ----------------          -------- --------------   --------
     { "misc",               "apiStatus",       &apistatus,               false,     false,           true   },
     { "misc",               "backup",          &backup,                  true,      false,           false  },
+    { "misc",               "netMsgStats",     &netmsgstats,             true,      false,           true   },
     { "misc",               "rpc",             &rpc,                     true,      false,           false  },
     { "misc",               "stop",            &stop,                    true,      false,           false  }
 };
@@ -24,6 +24,26 @@ struct CMintedCoinInfo {
     int nHeight;
 
     static CMintedCoinInfo make(CoinDenomination denomination,  int coinGroupId, int nHeight);
+
+    size_t GetSerializeSize(int nType, int nVersion) const {
+        return 3 * sizeof(int64_t);
+    }
+    template<typename Stream>
+    void Serialize(Stream& s, int nType, int nVersion) const {
+        int64_t tmp = int64_t(denomination);
+        s << tmp;
+        tmp = coinGroupId;
+        s << tmp;
+        tmp = nHeight;
+        s << tmp;
+    }
+    template<typename Stream>
+    void Unserialize(Stream& s, int nType, int nVersion) {
+        int64_t tmp;
+        s >> tmp; denomination = CoinDenomination(tmp);
+        s >> tmp; coinGroupId = int(tmp);
+        s >> tmp; nHeight = int(tmp);
+    }
 };
 
 struct CSpendCoinInfo {
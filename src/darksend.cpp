@@ -3,8 +3,10 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include "activexfsnode.h"
+#include "checkqueue.h"
 #include "coincontrol.h"
 #include "consensus/validation.h"
+#include "crypto/sha256.h"
 #include "darksend.h"
 //#include "governance.h"
 #include "init.h"
@@ -12,6 +14,7 @@
 #include "xfsnode-payments.h"
 #include "xfsnode-sync.h"
 #include "xfsnodeman.h"
+#include "random.h"
 #include "script/sign.h"
 #include "txmempool.h"
 #include "util.h"
@@ -19,6 +22,8 @@
 #include "validationinterface.h"
 
 #include <boost/lexical_cast.hpp>
+#include <boost/thread.hpp>
+#include <boost/unordered_set.hpp>
 
 int nPrivateSendRounds = DEFAULT_PRIVATESEND_ROUNDS;
 int nPrivateSendAmount = DEFAULT_PRIVATESEND_AMOUNT;
@@ -2336,13 +2341,131 @@ bool CDarkSendSigner::SignMessage(std::string strMessage, std::vector<unsigned c
     return key.SignCompact(ss.GetHash(), vchSigRet);
 }
 
-bool CDarkSendSigner::VerifyMessage(CPubKey pubkey, const std::vector<unsigned char> &vchSig, std::string strMessage, std::string &strErrorRet) {
+namespace {
+
+// Entries kept by CMessageSigCache, a few MB
+static const size_t MAX_MESSAGE_SIG_CACHE_SIZE = 100000;
+
+class CMessageSigCacheHasher
+{
+public:
+    size_t operator()(const uint256& key) const {
+        return key.GetCheapHash();
+    }
+};
+
+/**
+ * Valid xfsnode, payment vote and lock vote signatures. Entries are
+ * SHA256(nonce || message hash || signer key id || signature).
+ */
+class CMessageSigCache
+{
+private:
+    uint256 nonce;
+    typedef boost::unordered_set<uint256, CMessageSigCacheHasher> set_type;
+    set_type setValid;
+    boost::shared_mutex cs_sigcache;
+
+public:
+    CMessageSigCache()
+    {
+        GetRandBytes(nonce.begin(), 32);
+    }
+
+    void ComputeEntry(uint256& entry, const uint256& hash, const CKeyID& keyID, const std::vector<unsigned char>& vchSig)
+    {
+        CSHA256().Write(nonce.begin(), 32).Write(hash.begin(), 32).Write(keyID.begin(), keyID.size()).Write(vchSig.data(), vchSig.size()).Finalize(entry.begin());
+    }
+
+    bool Get(const uint256& entry)
+    {
+        boost::shared_lock<boost::shared_mutex> lock(cs_sigcache);
+        return setValid.count(entry);
+    }
+
+    void Set(const uint256& entry)
+    {
+        boost::unique_lock<boost::shared_mutex> lock(cs_sigcache);
+        while (setValid.size() >= MAX_MESSAGE_SIG_CACHE_SIZE) {
+            set_type::size_type s = GetRand(setValid.bucket_count());
+            set_type::local_iterator it = setValid.begin(s);
+            if (it != setValid.end(s)) {
+                setValid.erase(*it);
+            }
+        }
+        setValid.insert(entry);
+    }
+
+    void Clear()
+    {
+        boost::unique_lock<boost::shared_mutex> lock(cs_sigcache);
+        setValid.clear();
+    }
+};
+
+CMessageSigCache messageSigCache;
+
+uint256 GetSignedMessageHash(const std::string& strMessage)
+{
     CHashWriter ss(SER_GETHASH, 0);
     ss << strMessageMagic;
     ss << strMessage;
+    return ss.GetHash();
+}
+
+/** Recovers the signer of a message and adds the signature to the cache, bad signatures are left to VerifyMessage */
+class CMessageSigCheck
+{
+private:
+    std::string strMessage;
+    std::vector<unsigned char> vchSig;
+
+public:
+    CMessageSigCheck() {}
+    CMessageSigCheck(const std::string& strMessageIn, const std::vector<unsigned char>& vchSigIn) :
+        strMessage(strMessageIn), vchSig(vchSigIn) {}
+
+    bool operator()()
+    {
+        uint256 hash = GetSignedMessageHash(strMessage);
+        CPubKey pubkeyFromSig;
+        if (pubkeyFromSig.RecoverCompact(hash, vchSig)) {
+            uint256 entry;
+            messageSigCache.ComputeEntry(entry, hash, pubkeyFromSig.GetID(), vchSig);
+            messageSigCache.Set(entry);
+        }
+        return true;
+    }
+
+    void swap(CMessageSigCheck& check)
+    {
+        strMessage.swap(check.strMessage);
+        vchSig.swap(check.vchSig);
+    }
+};
+
+CCheckQueue<CMessageSigCheck> messageSigCheckQueue(128);
+// a CCheckQueue is driven by one caller at a time
+boost::mutex csMessageSigCheckQueue;
+
+void ThreadMessageSigCheck()
+{
+    RenameThread("xfs-msgsigcheck");
+    messageSigCheckQueue.Thread();
+}
+
+} // anon namespace
+
+bool CDarkSendSigner::VerifyMessage(CPubKey pubkey, const std::vector<unsigned char> &vchSig, std::string strMessage, std::string &strErrorRet) {
+    uint256 hash = GetSignedMessageHash(strMessage);
+    uint256 entry;
+    messageSigCache.ComputeEntry(entry, hash, pubkey.GetID(), vchSig);
+    if (messageSigCache.Get(entry)) {
+        return true;
+    }
 
     CPubKey pubkeyFromSig;
-    if (!pubkeyFromSig.RecoverCompact(ss.GetHash(), vchSig)) {
+    if (!pubkeyFromSig.RecoverCompact(hash, vchSig)) {
         strErrorRet = "Error recovering public key.";
         return false;
     }
@@ -2354,9 +2477,31 @@ bool CDarkSendSigner::VerifyMessage(CPubKey pubkey, const std::vector<unsigned c
         return false;
     }
 
+    messageSigCache.Set(entry);
     return true;
 }
 
+void CDarkSendSigner::CacheMessageSigners(const std::vector<std::pair<std::string, std::vector<unsigned char> > >& vMessages) {
+    std::vector<CMessageSigCheck> vChecks;
+    vChecks.reserve(vMessages.size());
+    for (size_t i = 0; i < vMessages.size(); i++)
+        vChecks.push_back(CMessageSigCheck(vMessages[i].first, vMessages[i].second));
+
+    boost::lock_guard<boost::mutex> lock(csMessageSigCheckQueue);
+    CCheckQueueControl<CMessageSigCheck> control(&messageSigCheckQueue);
+    control.Add(vChecks);
+    control.Wait();
+}
+
+void CDarkSendSigner::ClearSignatureCache() {
+    messageSigCache.Clear();
+}
+
+void StartMessageSigCheckThreads(int nThreads, boost::thread_group& threadGroup) {
+    for (int i = 0; i < nThreads; i++)
+        threadGroup.create_thread(&ThreadMessageSigCheck);
+}
+
 bool CDarkSendEntry::AddScriptSig(const CTxIn &txin) {
     BOOST_FOREACH(CTxDSIn & txdsin, vecTxDSIn)
     {
@@ -10,6 +10,10 @@
 
 class CDarksendPool;
 class CDarkSendSigner;
+
+namespace boost {
+    class thread_group;
+} // namespace boost
 class CDarksendBroadcastTx;
 
 // timeouts
@@ -245,10 +249,17 @@ public:
     bool GetKeysFromSecret(std::string strSecret, CKey& keyRet, CPubKey& pubkeyRet);
     /// Sign the message, returns true if successful
     bool SignMessage(std::string strMessage, std::vector<unsigned char>& vchSigRet, CKey key);
-    /// Verify the message, returns true if succcessful
+    /// Verify the message, returns true if succcessful. Valid signatures are cached, a message relayed by every peer is checked once
     bool VerifyMessage(CPubKey pubkey, const std::vector<unsigned char>& vchSig, std::string strMessage, std::string& strErrorRet);
+    /// Recover the signers of all (message, signature) pairs on the signature check threads and cache them for VerifyMessage
+    void CacheMessageSigners(const std::vector<std::pair<std::string, std::vector<unsigned char> > >& vMessages);
+    /// Forget all cached signatures
+    void ClearSignatureCache();
 };
 
+/** Start the threads CacheMessageSigners hands its work to, without any it runs on the calling thread */
+void StartMessageSigCheckThreads(int nThreads, boost::thread_group& threadGroup);
+
 
 /** Used to keep track of current status of mixing pool
  */
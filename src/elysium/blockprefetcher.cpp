@@ -0,0 +1,165 @@
+#include "blockprefetcher.h"
+
+#include "log.h"
+#include "packetencoder.h"
+
+#include "../chainparams.h"
+#include "../clientversion.h"
+#include "../main.h"
+#include "../streams.h"
+#include "../txdb.h"
+#include "../util.h"
+
+#include <boost/bind.hpp>
+
+#include <exception>
+
+namespace elysium {
+
+namespace {
+
+/**
+ * Reads a transaction through the transaction index, like GetTransaction() does, but without
+ * taking cs_main. Transactions which are not indexed are left to the scan to fetch.
+ */
+bool ReadIndexedTransaction(const uint256& hash, CTransaction& tx)
+{
+    if (!fTxIndex) {
+        return false;
+    }
+
+    CDiskTxPos pos;
+    if (!pblocktree->ReadTxIndex(hash, pos)) {
+        return false;
+    }
+
+    CAutoFile file(OpenBlockFile(pos, true), SER_DISK, CLIENT_VERSION);
+    if (file.IsNull()) {
+        return false;
+    }
+
+    try {
+        CBlockHeader header;
+        file >> header;
+        fseek(file.Get(), pos.nTxOffset, SEEK_CUR);
+        file >> tx;
+    } catch (const std::exception& e) {
+        PrintToLog("%s(): failed to read transaction %s: %s\n", __func__, hash.GetHex(), e.what());
+        return false;
+    }
+
+    return tx.GetHash() == hash;
+}
+
+bool ReadBlock(const CBlockIndex* pindex, PrefetchedBlock& result)
+{
+    if (!ReadBlockFromDisk(result.block, pindex, Params().GetConsensus())) {
+        return false;
+    }
+
+    for (auto& tx : result.block.vtx) {
+        if (tx.IsCoinBase() || !HasPacketMarker(tx)) {
+            continue;
+        }
+
+        for (auto& txIn : tx.vin) {
+            if (txIn.scriptSig.IsSigmaSpend()) {
+                continue;
+            }
+
+            CTransaction txPrev;
+            if (ReadIndexedTransaction(txIn.prevout.hash, txPrev) && txIn.prevout.n < txPrev.vout.size()) {
+                result.inputs.push_back(std::make_pair(txIn.prevout, txPrev.vout[txIn.prevout.n]));
+            }
+        }
+    }
+
+    return true;
+}
+
+} // namespace
+
+BlockPrefetcher::BlockPrefetcher(const std::vector<const CBlockIndex*>& vIndex, int nThreads)
+    : vIndex(vIndex), nNextToRead(0), nNextToReturn(0), fStop(false)
+{
+    try {
+        for (int i = 0; i < nThreads; i++) {
+            threads.create_thread(boost::bind(&BlockPrefetcher::ThreadPrefetch, this));
+        }
+    } catch (...) {
+        // the destructor doesn't run for a constructor that throws, the threads started refer to this
+        Stop();
+        throw;
+    }
+}
+
+BlockPrefetcher::~BlockPrefetcher()
+{
+    Stop();
+}
+
+void BlockPrefetcher::Stop()
+{
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        fStop = true;
+    }
+    condSpace.notify_all();
+    threads.join_all();
+}
+
+bool BlockPrefetcher::Next(PrefetchedBlock& result)
+{
+    if (nNextToReturn >= vIndex.size()) {
+        return false;
+    }
+
+    if (threads.size() == 0) {
+        result = PrefetchedBlock();
+        return ReadBlock(vIndex[nNextToReturn++], result);
+    }
+
+    boost::unique_lock<boost::mutex> lock(mutex);
+    while (!mapReady.count(nNextToReturn)) {
+        condReady.wait(lock);
+    }
+
+    auto it = mapReady.find(nNextToReturn);
+    bool fRead = it->second.first;
+    result = std::move(it->second.second);
+    mapReady.erase(it);
+    nNextToReturn++;
+    condSpace.notify_all();
+
+    return fRead;
+}
+
+void BlockPrefetcher::ThreadPrefetch()
+{
+    RenameThread("elysium-prefetch");
+
+    while (true) {
+        size_t nPos;
+        {
+            boost::unique_lock<boost::mutex> lock(mutex);
+            while (!fStop && nNextToRead < vIndex.size() && nNextToRead >= nNextToReturn + SCAN_PREFETCH_BLOCKS) {
+                condSpace.wait(lock);
+            }
+            if (fStop || nNextToRead >= vIndex.size()) {
+                return;
+            }
+            nPos = nNextToRead++;
+        }
+
+        std::pair<bool, PrefetchedBlock> entry;
+        entry.first = ReadBlock(vIndex[nPos], entry.second);
+
+        {
+            boost::unique_lock<boost::mutex> lock(mutex);
+            mapReady[nPos] = std::move(entry);
+        }
+        condReady.notify_all();
+    }
+}
+
+} // namespace elysium
@@ -0,0 +1,72 @@
+#ifndef ELYSIUM_BLOCKPREFETCHER_H
+#define ELYSIUM_BLOCKPREFETCHER_H
+
+#include "../primitives/block.h"
+#include "../primitives/transaction.h"
+
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+
+#include <map>
+#include <utility>
+#include <vector>
+
+class CBlockIndex;
+
+namespace elysium {
+
+/** Default number of threads reading blocks ahead of the initial scan, 0 reads them on the scanning thread */
+static const int DEFAULT_SCAN_THREADS = 4;
+/** How many blocks the threads may read ahead of the block being processed */
+static const int SCAN_PREFETCH_BLOCKS = 64;
+
+/** A block read ahead of the scan, with the spent outputs of its transactions which carry a marker */
+struct PrefetchedBlock
+{
+    CBlock block;
+    std::vector<std::pair<COutPoint, CTxOut>> inputs;
+};
+
+/**
+ * Reads the blocks of the initial scan ahead on a number of threads.
+ *
+ * Reading a block and looking up the outputs spent by its Elysium transactions is what dominates a
+ * scan, and it doesn't depend on Elysium state. The threads do this ahead of the scan, which takes
+ * the blocks in order and still processes every transaction itself, on its own thread, so the state
+ * is the same as with a serial scan. The prefetched outputs are only used to warm the input cache.
+ *
+ * The lookups go through the transaction index and never take cs_main, the scan holds it.
+ */
+class BlockPrefetcher
+{
+public:
+    /** Start reading blocks, vIndex must stay valid while the prefetcher exists */
+    BlockPrefetcher(const std::vector<const CBlockIndex*>& vIndex, int nThreads);
+    ~BlockPrefetcher();
+
+    /** Wait for the next block, false if it couldn't be read */
+    bool Next(PrefetchedBlock& result);
+
+private:
+    const std::vector<const CBlockIndex*>& vIndex;
+
+    boost::mutex mutex;
+    boost::condition_variable condReady;
+    boost::condition_variable condSpace;
+    // blocks read so far, by position in vIndex, false for blocks that couldn't be read
+    std::map<size_t, std::pair<bool, PrefetchedBlock>> mapReady;
+    size_t nNextToRead;
+    size_t nNextToReturn;
+    bool fStop;
+
+    boost::thread_group threads;
+
+    void ThreadPrefetch();
+    /** Stop the threads and wait for them to exit */
+    void Stop();
+};
+
+} // namespace elysium
+
+#endif // ELYSIUM_BLOCKPREFETCHER_H
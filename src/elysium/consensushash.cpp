@@ -24,11 +24,187 @@
 
 namespace elysium
 {
-bool ShouldConsensusHashBlock(int block) {
-    if (elysium_debug_consensus_hash_every_block) {
-        return true;
+namespace {
+
+const size_t NUM_STATE_COMPONENTS = static_cast<size_t>(StateComponent::Properties) + 1;
+
+// running checksums of the state components, updated on every change of the state
+StateChecksum stateChecksums[NUM_STATE_COMPONENTS];
+
+arith_uint256 HashConsensusString(const std::string& dataStr)
+{
+    uint256 hash;
+    SHA256((const unsigned char*)dataStr.c_str(), dataStr.length(), (unsigned char*)&hash);
+    return UintToArith256(hash);
+}
+
+// hashes the sums of the state components, in the order they are hashed by GetConsensusHash()
+uint256 CombineComponents(const StateChecksum (&components)[NUM_STATE_COMPONENTS])
+{
+    SHA256_CTX shaCtx;
+    SHA256_Init(&shaCtx);
+
+    for (size_t i = 0; i < NUM_STATE_COMPONENTS; ++i) {
+        uint256 sum = ArithToUint256(components[i].GetSum());
+        SHA256_Update(&shaCtx, sum.begin(), sum.size());
+    }
+
+    uint256 stateChecksum;
+    SHA256_Final((unsigned char*)&stateChecksum, &shaCtx);
+
+    return stateChecksum;
+}
+
+// adds every entry of the state to the components, in no particular order
+void AccumulateState(StateChecksum (&components)[NUM_STATE_COMPONENTS])
+{
+    StateChecksum& balances = components[static_cast<size_t>(StateComponent::Balances)];
+    for (std::unordered_map<std::string, CMPTally>::iterator it = mp_tally_map.begin(); it != mp_tally_map.end(); ++it) {
+        CMPTally& tally = it->second;
+        tally.init();
+        uint32_t propertyId = 0;
+        while (0 != (propertyId = tally.next())) {
+            balances.Add(GenerateConsensusString(tally, it->first, propertyId));
+        }
+    }
+
+    StateChecksum& offers = components[static_cast<size_t>(StateComponent::DExOffers)];
+    for (OfferMap::const_iterator it = my_offers.begin(); it != my_offers.end(); ++it) {
+        const std::string& sellCombo = it->first;
+        offers.Add(GenerateConsensusString(it->second, sellCombo.substr(0, sellCombo.size() - 2)));
+    }
+
+    StateChecksum& accepts = components[static_cast<size_t>(StateComponent::DExAccepts)];
+    for (AcceptMap::const_iterator it = my_accepts.begin(); it != my_accepts.end(); ++it) {
+        const std::string& acceptCombo = it->first;
+        accepts.Add(GenerateConsensusString(it->second, acceptCombo.substr(acceptCombo.find("+") + 1)));
+    }
+
+    StateChecksum& trades = components[static_cast<size_t>(StateComponent::MetaDEx)];
+    for (md_PropertiesMap::const_iterator my_it = metadex.begin(); my_it != metadex.end(); ++my_it) {
+        const md_PricesMap& prices = my_it->second;
+        for (md_PricesMap::const_iterator it = prices.begin(); it != prices.end(); ++it) {
+            const md_Set& indexes = it->second;
+            for (md_Set::const_iterator it = indexes.begin(); it != indexes.end(); ++it) {
+                trades.Add(GenerateConsensusString(*it));
+            }
+        }
+    }
+
+    StateChecksum& crowds = components[static_cast<size_t>(StateComponent::Crowdsales)];
+    for (CrowdMap::const_iterator it = my_crowds.begin(); it != my_crowds.end(); ++it) {
+        crowds.Add(GenerateConsensusString(it->second));
+    }
+
+    StateChecksum& properties = components[static_cast<size_t>(StateComponent::Properties)];
+    for (uint8_t ecosystem = 1; ecosystem <= 2; ecosystem++) {
+        uint32_t startPropertyId = (ecosystem == 1) ? 1 : TEST_ECO_PROPERTY_1;
+        for (uint32_t propertyId = startPropertyId; propertyId < _my_sps->peekNextSPID(ecosystem); propertyId++) {
+            CMPSPInfo::Entry sp;
+            if (!_my_sps->getSP(propertyId, sp)) {
+                PrintToLog("Error loading property ID %d for state hashing, hash should not be trusted!\n", propertyId);
+                continue;
+            }
+            properties.Add(GenerateConsensusString(propertyId, sp.issuer));
+        }
+    }
+}
+
+} // namespace
+
+void StateChecksum::Add(const std::string& dataStr)
+{
+    if (dataStr.empty()) return; // empty balances are not part of the state
+    sum += HashConsensusString(dataStr);
+}
+
+void StateChecksum::Remove(const std::string& dataStr)
+{
+    if (dataStr.empty()) return;
+    sum -= HashConsensusString(dataStr);
+}
+
+bool IsStateChecksumEnabled()
+{
+    return elysium_debug_consensus_hash || elysium_debug_consensus_hash_every_block ||
+            elysium_debug_consensus_hash_every_transaction;
+}
+
+void AddToStateChecksum(StateComponent component, const std::string& dataStr)
+{
+    stateChecksums[static_cast<size_t>(component)].Add(dataStr);
+}
+
+void RemoveFromStateChecksum(StateComponent component, const std::string& dataStr)
+{
+    stateChecksums[static_cast<size_t>(component)].Remove(dataStr);
+}
+
+void UpdateStateChecksum(StateComponent component, const std::string& oldStr, const std::string& newStr)
+{
+    if (oldStr == newStr) return;
+    RemoveFromStateChecksum(component, oldStr);
+    AddToStateChecksum(component, newStr);
+}
+
+/**
+ * Obtains a checksum of the active state, which is updated incrementally as the state changes.
+ *
+ * Each part of the state is summed up by a StateChecksum over the same strings that are hashed by
+ * GetConsensusHash(), and the result is the SHA256 hash of the six sums. Unlike the consensus hash, it
+ * doesn't depend on the order of the entries, so it is cheap to obtain after every block.
+ *
+ * It's a debugging aid to spot where the state of two nodes starts to differ. Sums of hashes don't
+ * resist crafted entries (see StateChecksum), so it's neither compared against the checkpoints nor
+ * reported as a consensus hash. Keeping it up to date costs a consensus string per state change, so
+ * it's only maintained with one of the consensus_hash debug options and zero otherwise.
+ */
+uint256 GetStateChecksum()
+{
+    LOCK(cs_main);
+
+    return CombineComponents(stateChecksums);
+}
+
+uint256 CalculateStateChecksum()
+{
+    LOCK(cs_main);
+
+    StateChecksum components[NUM_STATE_COMPONENTS];
+    AccumulateState(components);
+
+    return CombineComponents(components);
+}
+
+uint256 GetCheckedStateChecksum()
+{
+    LOCK(cs_main);
+
+    uint256 stateChecksum = GetStateChecksum();
+    if (elysium_debug_consensus_hash) {
+        uint256 expected = CalculateStateChecksum();
+        if (stateChecksum != expected) {
+            PrintToLog("ERROR: running state checksum %s doesn't match the state %s\n", stateChecksum.GetHex(), expected.GetHex());
+        }
+    }
+
+    return stateChecksum;
+}
+
+void RebuildStateChecksum()
+{
+    LOCK(cs_main);
+
+    for (size_t i = 0; i < NUM_STATE_COMPONENTS; ++i) {
+        stateChecksums[i].Clear();
     }
+    if (!IsStateChecksumEnabled()) return;
+    AccumulateState(stateChecksums);
 
+    if (elysium_debug_consensus_hash) PrintToLog("Rebuilt state checksum: %s\n", GetStateChecksum().GetHex());
+}
+
+bool ShouldConsensusHashBlock(int block) {
     if (!mapArgs.count("-elysiumshowblockconsensushash")) {
         return false;
     }
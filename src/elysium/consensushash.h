@@ -1,11 +1,88 @@
 #ifndef ELYSIUM_CONSENSUSHASH_H
 #define ELYSIUM_CONSENSUSHASH_H
 
+#include "arith_uint256.h"
 #include "uint256.h"
 
+#include <string>
+
+#include <stdint.h>
+
+class CMPAccept;
+class CMPCrowd;
+class CMPMetaDEx;
+class CMPOffer;
+class CMPTally;
+
 namespace elysium
 {
-/** Checks if a given block should be consensus hashed. */
+/** The parts of the state covered by the consensus hash, in the order they are hashed. */
+enum class StateComponent
+{
+    Balances,
+    DExOffers,
+    DExAccepts,
+    MetaDEx,
+    Crowdsales,
+    Properties,
+};
+
+/**
+ * Order independent checksum of a set of consensus strings, used for debugging only.
+ *
+ * The strings are hashed one by one and the hashes summed modulo 2^256, so entries can be
+ * added and removed in any order and the result only depends on the set of entries.
+ *
+ * This is not a cryptographic set hash: with enough candidate entries, a generalized birthday
+ * (Wagner) search finds two different sets with the same sum. It catches accidental divergence,
+ * but must not be used where someone could choose the entries to forge a match.
+ */
+class StateChecksum
+{
+public:
+    StateChecksum() {}
+
+    void Add(const std::string& dataStr);
+    void Remove(const std::string& dataStr);
+    void Clear() { sum = 0; }
+
+    const arith_uint256& GetSum() const { return sum; }
+
+private:
+    arith_uint256 sum;
+};
+
+/** Generates the consensus strings of the state entries, empty for empty balances. */
+std::string GenerateConsensusString(const CMPTally& tallyObj, const std::string& address, const uint32_t propertyId);
+std::string GenerateConsensusString(const CMPOffer& offerObj, const std::string& address);
+std::string GenerateConsensusString(const CMPAccept& acceptObj, const std::string& address);
+std::string GenerateConsensusString(const CMPMetaDEx& tradeObj);
+std::string GenerateConsensusString(const CMPCrowd& crowdObj);
+std::string GenerateConsensusString(const uint32_t propertyId, const std::string& address);
+
+/** Whether the running state checksum is maintained, only with one of the consensus_hash debug options. */
+bool IsStateChecksumEnabled();
+
+/** Adds or removes an entry of the running state checksum, called whenever the state changes. */
+void AddToStateChecksum(StateComponent component, const std::string& dataStr);
+void RemoveFromStateChecksum(StateComponent component, const std::string& dataStr);
+
+/** Replaces an entry of the running state checksum, unless it didn't change. */
+void UpdateStateChecksum(StateComponent component, const std::string& oldStr, const std::string& newStr);
+
+/** Obtains the running checksum of the state, without walking it. */
+uint256 GetStateChecksum();
+
+/** Walks the whole state to calculate what the running checksum should be. */
+uint256 CalculateStateChecksum();
+
+/** Obtains the running checksum of the state, checked against the state with -elysiumdebug=consensus_hash. */
+uint256 GetCheckedStateChecksum();
+
+/** Recalculates the running checksum of the state, after it was loaded or cleared. */
+void RebuildStateChecksum();
+
+/** Checks if a given block should be consensus hashed, as requested by -elysiumshowblockconsensushash. */
 bool ShouldConsensusHashBlock(int block);
 
 /** Obtains a hash of all balances to use for consensus verification and checkpointing. */
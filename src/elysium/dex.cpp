@@ -6,6 +6,7 @@
 
 #include "elysium/dex.h"
 
+#include "elysium/consensushash.h"
 #include "elysium/convert.h"
 #include "elysium/errors.h"
 #include "elysium/log.h"
@@ -197,6 +198,7 @@ int DEx_offerCreate(const std::string& addressSeller, uint32_t propertyId, int64
 
         CMPOffer sellOffer(block, amountOffered, propertyId, amountDesired, minAcceptFee, paymentWindow, txid);
         my_offers.insert(std::make_pair(key, sellOffer));
+        if (IsStateChecksumEnabled()) AddToStateChecksum(StateComponent::DExOffers, GenerateConsensusString(sellOffer, addressSeller));
 
         rc = 0;
     }
@@ -228,6 +230,7 @@ int DEx_offerDestroy(const std::string& addressSeller, uint32_t propertyId)
     // delete the offer
     const std::string key = STR_SELLOFFER_ADDR_PROP_COMBO(addressSeller, propertyId);
     OfferMap::iterator it = my_offers.find(key);
+    if (IsStateChecksumEnabled()) RemoveFromStateChecksum(StateComponent::DExOffers, GenerateConsensusString(it->second, addressSeller));
     my_offers.erase(it);
 
     if (elysium_debug_dex) PrintToLog("%s(%s|%s)\n", __func__, addressSeller, key);
@@ -313,6 +316,7 @@ int DEx_acceptCreate(const std::string& addressBuyer, const std::string& address
 
         CMPAccept acceptOffer(amountReserved, block, offer.getBlockTimeLimit(), offer.getProperty(), offer.getOfferAmountOriginal(), offer.getXZCDesiredOriginal(), offer.getHash());
         my_accepts.insert(std::make_pair(keyAcceptOrder, acceptOffer));
+        if (IsStateChecksumEnabled()) AddToStateChecksum(StateComponent::DExAccepts, GenerateConsensusString(acceptOffer, addressBuyer));
 
         rc = 0;
     }
@@ -376,6 +380,7 @@ int DEx_acceptDestroy(const std::string& addressBuyer, const std::string& addres
         AcceptMap::iterator it = my_accepts.find(key);
 
         if (my_accepts.end() != it) {
+            if (IsStateChecksumEnabled()) RemoveFromStateChecksum(StateComponent::DExAccepts, GenerateConsensusString(it->second, addressBuyer));
             my_accepts.erase(it);
         }
     }
@@ -522,7 +527,11 @@ int DEx_payment(const uint256& txid, unsigned int vout, const std::string& addre
     }
 
     // reduce the amount of units still desired by the buyer and if 0 destroy the Accept order
-    if (p_accept->reduceAcceptAmountRemaining_andIsZero(amountPurchased)) {
+    const std::string acceptBefore = IsStateChecksumEnabled() ? GenerateConsensusString(*p_accept, addressBuyer) : "";
+    bool fAcceptPaid = p_accept->reduceAcceptAmountRemaining_andIsZero(amountPurchased);
+    if (IsStateChecksumEnabled()) UpdateStateChecksum(StateComponent::DExAccepts, acceptBefore, GenerateConsensusString(*p_accept, addressBuyer));
+
+    if (fAcceptPaid) {
         const int64_t reserveSell = getMPbalance(addressSeller, propertyId, SELLOFFER_RESERVE);
         const int64_t reserveAccept = getMPbalance(addressSeller, propertyId, ACCEPT_RESERVE);
 
@@ -562,6 +571,7 @@ unsigned int eraseExpiredAccepts(int blockNow)
 
             DEx_acceptDestroy(addressBuyer, addressSeller, propertyId);
 
+            if (IsStateChecksumEnabled()) RemoveFromStateChecksum(StateComponent::DExAccepts, GenerateConsensusString(acceptOrder, addressBuyer));
             my_accepts.erase(it++);
 
             ++how_many_erased;
@@ -1,6 +1,7 @@
 #include "elysium.h"
 
 #include "activation.h"
+#include "blockprefetcher.h"
 #include "consensushash.h"
 #include "convert.h"
 #include "dex.h"
@@ -16,6 +17,7 @@
 #include "script.h"
 #include "sigmadb.h"
 #include "sp.h"
+#include "statesnapshot.h"
 #include "tally.h"
 #include "tx.h"
 #include "txprocessor.h"
@@ -68,6 +70,7 @@
 #include <stdint.h>
 #include <stdio.h>
 
+#include <algorithm>
 #include <fstream>
 #include <map>
 #include <set>
@@ -118,6 +121,9 @@ static int64_t elysium_prev = 0;
 
 static boost::filesystem::path MPPersistencePath;
 
+//! Writes the state snapshots in the background
+static SnapshotWriter* snapshotWriter = nullptr;
+
 static int elysiumInitialized = 0;
 
 static int reorgRecoveryMode = 0;
@@ -244,6 +250,9 @@ CrowdMap elysium::my_crowds;
 // this is the master list of all amounts for all addresses for all properties, map is unsorted
 std::unordered_map<std::string, CMPTally> elysium::mp_tally_map;
 
+// running totals of the balances and reserves of each property in mp_tally_map, updated along with it
+static std::unordered_map<uint32_t, int64_t> mp_supply_map;
+
 CMPTally* elysium::getTally(const std::string& address)
 {
     std::unordered_map<std::string, CMPTally>::iterator it = mp_tally_map.find(address);
@@ -413,11 +422,51 @@ std::string elysium::getTokenLabel(uint32_t propertyId)
     return tokenStr;
 }
 
+// sums the balances and reserves of a property over all tallies, and counts the addresses owning it
+static int64_t sumTallyTokens(uint32_t propertyId, int64_t& owners)
+{
+    int64_t prev = 0;
+    int64_t totalTokens = 0;
+
+    for (std::unordered_map<std::string, CMPTally>::const_iterator it = mp_tally_map.begin(); it != mp_tally_map.end(); ++it) {
+        const CMPTally& tally = it->second;
+
+        totalTokens += tally.getMoney(propertyId, BALANCE);
+        totalTokens += tally.getMoney(propertyId, SELLOFFER_RESERVE);
+        totalTokens += tally.getMoney(propertyId, ACCEPT_RESERVE);
+        totalTokens += tally.getMoney(propertyId, METADEX_RESERVE);
+
+        if (prev != totalTokens) {
+            prev = totalTokens;
+            owners++;
+        }
+    }
+
+    return totalTokens;
+}
+
+// recalculates the running totals of all properties, after the tallies were replaced
+static void rebuildSupplyMap()
+{
+    mp_supply_map.clear();
+
+    for (std::unordered_map<std::string, CMPTally>::iterator it = mp_tally_map.begin(); it != mp_tally_map.end(); ++it) {
+        CMPTally& tally = it->second;
+        tally.init();
+        uint32_t propertyId = 0;
+        while (0 != (propertyId = tally.next())) {
+            mp_supply_map[propertyId] += tally.getMoney(propertyId, BALANCE);
+            mp_supply_map[propertyId] += tally.getMoney(propertyId, SELLOFFER_RESERVE);
+            mp_supply_map[propertyId] += tally.getMoney(propertyId, ACCEPT_RESERVE);
+            mp_supply_map[propertyId] += tally.getMoney(propertyId, METADEX_RESERVE);
+        }
+    }
+}
+
 // get total tokens for a property
 // optionally counts the number of addresses who own that property: n_owners_total
 int64_t elysium::getTotalTokens(uint32_t propertyId, int64_t* n_owners_total)
 {
-    int64_t prev = 0;
     int64_t owners = 0;
     int64_t totalTokens = 0;
 
@@ -428,22 +477,25 @@ int64_t elysium::getTotalTokens(uint32_t propertyId, int64_t* n_owners_total)
         return 0; // property ID does not exist
     }
 
-    if (!property.fixed || n_owners_total) {
-        for (std::unordered_map<std::string, CMPTally>::const_iterator it = mp_tally_map.begin(); it != mp_tally_map.end(); ++it) {
-            const CMPTally& tally = it->second;
-
-            totalTokens += tally.getMoney(propertyId, BALANCE);
-            totalTokens += tally.getMoney(propertyId, SELLOFFER_RESERVE);
-            totalTokens += tally.getMoney(propertyId, ACCEPT_RESERVE);
-            totalTokens += tally.getMoney(propertyId, METADEX_RESERVE);
+    if (n_owners_total) {
+        // counting the owners still requires a scan over all tallies
+        totalTokens = sumTallyTokens(propertyId, owners);
+        totalTokens += p_feecache->GetCachedAmount(propertyId);
+    } else if (!property.fixed) {
+        std::unordered_map<uint32_t, int64_t>::const_iterator it = mp_supply_map.find(propertyId);
+        if (it != mp_supply_map.end()) {
+            totalTokens = it->second;
+        }
 
-            if (prev != totalTokens) {
-                prev = totalTokens;
-                owners++;
+        if (elysium_debug_tokens) {
+            int64_t totalScanned = sumTallyTokens(propertyId, owners);
+            if (totalScanned != totalTokens) {
+                PrintToLog("%s(%d): ERROR: running total of tokens %d differs from the tally total %d\n", __func__, propertyId, totalTokens, totalScanned);
+                totalTokens = totalScanned;
             }
         }
-        int64_t cachedFee = p_feecache->GetCachedAmount(propertyId);
-        totalTokens += cachedFee;
+
+        totalTokens += p_feecache->GetCachedAmount(propertyId);
     }
 
     if (property.fixed) {
@@ -486,9 +538,14 @@ bool elysium::update_tally_map(const std::string& who, uint32_t propertyId, int6
     }
 
     CMPTally& tally = my_it->second;
+    std::string stateBefore = (ttype != PENDING && IsStateChecksumEnabled()) ? GenerateConsensusString(tally, who, propertyId) : "";
     bRet = tally.updateMoney(propertyId, amount, ttype);
 
     after = getMPbalance(who, propertyId, ttype);
+    if (bRet && ttype != PENDING) {
+        mp_supply_map[propertyId] += amount;
+        if (IsStateChecksumEnabled()) UpdateStateChecksum(StateComponent::Balances, stateBefore, GenerateConsensusString(tally, who, propertyId));
+    }
     if (!bRet) {
         assert(before == after);
         PrintToLog("%s(%s, %u=0x%X, %+d, ttype=%d) ERROR: insufficient balance (=%d)\n", __func__, who, propertyId, propertyId, amount, ttype, before);
@@ -631,6 +688,20 @@ CCriticalSection elysium::cs_tx_cache;
 static unsigned int nCacheHits = 0;
 static unsigned int nCacheMiss = 0;
 
+/**
+ * Adds the output spent by an input to the coins view cache.
+ *
+ * Note: cs_tx_cache should be locked!
+ */
+static void AddTxInputToCache(CCoinsModifier& coins, unsigned int nOut, const CTxOut& txOut)
+{
+    if (nOut >= coins->vout.size()) {
+        coins->vout.resize(nOut+1);
+    }
+    coins->vout[nOut].scriptPubKey = txOut.scriptPubKey;
+    coins->vout[nOut].nValue = txOut.nValue;
+}
+
 /**
  * Fetches transaction inputs and adds them to the coins view cache.
  *
@@ -672,16 +743,27 @@ static bool FillTxInputCache(const CTransaction& tx)
             return false;
         }
 
-        if (nOut >= coins->vout.size()) {
-            coins->vout.resize(nOut+1);
-        }
-        coins->vout[nOut].scriptPubKey = txPrev.vout[nOut].scriptPubKey;
-        coins->vout[nOut].nValue = txPrev.vout[nOut].nValue;
+        AddTxInputToCache(coins, nOut, txPrev.vout[nOut]);
     }
 
     return true;
 }
 
+/**
+ * Adds outputs which were looked up ahead of parsing to the coins view cache.
+ */
+static void PrefillTxInputCache(const std::vector<std::pair<COutPoint, CTxOut>>& inputs)
+{
+    LOCK(cs_tx_cache);
+
+    for (auto& input : inputs) {
+        CCoinsModifier coins = view.ModifyCoins(input.first.hash);
+        if (!coins->IsAvailable(input.first.n)) {
+            AddTxInputToCache(coins, input.first.n, input.second);
+        }
+    }
+}
+
 // idx is position within the block, 0-based
 // int elysium_tx_push(const CTransaction &wtx, int nBlock, unsigned int idx)
 // INPUT: bRPConly -- set to true to avoid moving funds; to be called from various RPC calls like this
@@ -1164,6 +1246,14 @@ static int elysium_initial_scan(int nFirstBlock)
     // used to print the progress to the console and notifies the UI
     ProgressReporter progressReporter(chainActive[nFirstBlock], chainActive[nLastBlock]);
 
+    // blocks are read ahead on other threads, they are processed in order on this one
+    std::vector<const CBlockIndex*> vIndex;
+    for (nBlock = nFirstBlock; nBlock <= nLastBlock && chainActive[nBlock]; ++nBlock) {
+        vIndex.push_back(chainActive[nBlock]);
+    }
+    int nScanThreads = std::max(0, (int)GetArg("-elysiumscanthreads", DEFAULT_SCAN_THREADS));
+    BlockPrefetcher prefetcher(vIndex, nScanThreads);
+
     for (nBlock = nFirstBlock; nBlock <= nLastBlock; ++nBlock)
     {
         if (ShutdownRequested()) {
@@ -1184,12 +1274,15 @@ static int elysium_initial_scan(int nFirstBlock)
         }
 
         // Get block to parse.
-        CBlock block;
+        PrefetchedBlock prefetched;
 
-        if (!ReadBlockFromDisk(block, pblockindex, Params().GetConsensus())) {
+        if (!prefetcher.Next(prefetched)) {
             break;
         }
 
+        const CBlock& block = prefetched.block;
+        PrefillTxInputCache(prefetched.inputs);
+
         // Parse block.
         unsigned parsed = 0;
 
@@ -1437,6 +1530,7 @@ static int elysium_file_load(const string &filename, int what, bool verifyHash =
   {
     case FILETYPE_BALANCES:
       mp_tally_map.clear();
+      mp_supply_map.clear();
       inputLineFunc = input_elysium_balances_string;
       break;
 
@@ -1465,6 +1559,7 @@ static int elysium_file_load(const string &filename, int what, bool verifyHash =
       // TODO
       // ...
       metadex.clear();
+      MetaDEx_RebuildOrderBook();
       inputLineFunc = input_mp_mdexorder_string;
       break;
 
@@ -1549,10 +1644,43 @@ static char const * const statePrefix[NUM_FILETYPES] = {
     "mdexorders",
 };
 
+// loads the snapshot of the given block from path, false if there is no usable one
+bool load_state_snapshot(const boost::filesystem::path& path, const uint256& blockHash)
+{
+  if (!boost::filesystem::exists(path)) {
+    return false;
+  }
+
+  int64_t nStart = GetTimeMillis();
+
+  StateSnapshot snapshot;
+  if (!ReadSnapshot(path, blockHash, snapshot)) {
+    PrintToLog("%s(): failed to load snapshot %s\n", __func__, path.string());
+    return false;
+  }
+
+  mp_tally_map.swap(snapshot.tallies);
+  rebuildSupplyMap();
+  my_offers.swap(snapshot.offers);
+  my_accepts.swap(snapshot.accepts);
+  my_crowds.swap(snapshot.crowds);
+  metadex.swap(snapshot.metadex);
+  MetaDEx_RebuildOrderBook();
+  elysium_prev = snapshot.elysiumPrev;
+  _my_sps->init(snapshot.nextSPID, snapshot.nextTestSPID);
+
+  PrintToLog("%s(): loaded snapshot of block %s in %d ms\n", __func__, blockHash.GetHex(), GetTimeMillis() - nStart);
+
+  return true;
+}
+
 // returns the height of the state loaded
 static int load_most_relevant_state()
 {
   int res = -1;
+
+  // a snapshot may still be written in the background
+  snapshotWriter->Flush();
   // check the SP database and roll it back to its latest valid state
   // according to the active chain
   uint256 spWatermark;
@@ -1617,14 +1745,19 @@ static int load_most_relevant_state()
   int abortRollBackBlock;
   if (curTip != NULL) abortRollBackBlock = curTip->nHeight - (MAX_STATE_HISTORY+1);
   while (NULL != curTip && persistedBlocks.size() > 0 && curTip->nHeight > abortRollBackBlock) {
-    if (persistedBlocks.find(spBlockIndex->GetBlockHash()) != persistedBlocks.end()) {
-      int success = -1;
-      for (int i = 0; i < NUM_FILETYPES; ++i) {
-        boost::filesystem::path path = MPPersistencePath / strprintf("%s-%s.dat", statePrefix[i], curTip->GetBlockHash().ToString());
-        const std::string strFile = path.string();
-        success = elysium_file_load(strFile, i, true);
-        if (success < 0) {
-          break;
+    if (persistedBlocks.find(curTip->GetBlockHash()) != persistedBlocks.end()) {
+      boost::filesystem::path snapshotPath = MPPersistencePath / strprintf("%s-%s.dat", SNAPSHOT_PREFIX, curTip->GetBlockHash().ToString());
+      int success = load_state_snapshot(snapshotPath, curTip->GetBlockHash()) ? 0 : -1;
+
+      // fall back to the text files written by earlier versions
+      if (success < 0) {
+        for (int i = 0; i < NUM_FILETYPES; ++i) {
+          boost::filesystem::path path = MPPersistencePath / strprintf("%s-%s.dat", statePrefix[i], curTip->GetBlockHash().ToString());
+          const std::string strFile = path.string();
+          success = elysium_file_load(strFile, i, true);
+          if (success < 0) {
+            break;
+          }
         }
       }
 
@@ -1634,7 +1767,7 @@ static int load_most_relevant_state()
       }
 
       // remove this from the persistedBlock Set
-      persistedBlocks.erase(spBlockIndex->GetBlockHash());
+      persistedBlocks.erase(curTip->GetBlockHash());
     }
 
     // go to the previous block
@@ -1653,185 +1786,19 @@ static int load_most_relevant_state()
     return -1;
   }
 
+  // the state was replaced by the files, start the running state checksum over
+  RebuildStateChecksum();
+
   // return the height of the block we settled at
   return res;
 }
 
-static int write_elysium_balances(std::ofstream& file, SHA256_CTX* shaCtx)
-{
-    std::unordered_map<std::string, CMPTally>::iterator iter;
-    for (iter = mp_tally_map.begin(); iter != mp_tally_map.end(); ++iter) {
-        bool emptyWallet = true;
-
-        std::string lineOut = (*iter).first;
-        lineOut.append("=");
-        CMPTally& curAddr = (*iter).second;
-        curAddr.init();
-        uint32_t propertyId = 0;
-        while (0 != (propertyId = curAddr.next())) {
-            int64_t balance = (*iter).second.getMoney(propertyId, BALANCE);
-            int64_t sellReserved = (*iter).second.getMoney(propertyId, SELLOFFER_RESERVE);
-            int64_t acceptReserved = (*iter).second.getMoney(propertyId, ACCEPT_RESERVE);
-            int64_t metadexReserved = (*iter).second.getMoney(propertyId, METADEX_RESERVE);
-
-            // we don't allow 0 balances to read in, so if we don't write them
-            // it makes things match up better between persisted state and processed state
-            if (0 == balance && 0 == sellReserved && 0 == acceptReserved && 0 == metadexReserved) {
-                continue;
-            }
-
-            emptyWallet = false;
-
-            lineOut.append(strprintf("%d:%d,%d,%d,%d;",
-                    propertyId,
-                    balance,
-                    sellReserved,
-                    acceptReserved,
-                    metadexReserved));
-        }
-
-        if (false == emptyWallet) {
-            // add the line to the hash
-            SHA256_Update(shaCtx, lineOut.c_str(), lineOut.length());
-
-            // write the line
-            file << lineOut << endl;
-        }
-    }
-
-    return 0;
-}
-
-static int write_mp_offers(ofstream &file, SHA256_CTX *shaCtx)
-{
-  OfferMap::const_iterator iter;
-  for (iter = my_offers.begin(); iter != my_offers.end(); ++iter) {
-    // decompose the key for address
-    std::vector<std::string> vstr;
-    boost::split(vstr, (*iter).first, boost::is_any_of("-"), token_compress_on);
-    CMPOffer const &offer = (*iter).second;
-    offer.saveOffer(file, shaCtx, vstr[0]);
-  }
-
-
-  return 0;
-}
-
-static int write_mp_metadex(ofstream &file, SHA256_CTX *shaCtx)
-{
-  for (md_PropertiesMap::iterator my_it = metadex.begin(); my_it != metadex.end(); ++my_it)
-  {
-    md_PricesMap & prices = my_it->second;
-    for (md_PricesMap::iterator it = prices.begin(); it != prices.end(); ++it)
-    {
-      md_Set & indexes = (it->second);
-      for (md_Set::iterator it = indexes.begin(); it != indexes.end(); ++it)
-      {
-        CMPMetaDEx meta = *it;
-        meta.saveOffer(file, shaCtx);
-      }
-    }
-  }
-
-  return 0;
-}
-
-static int write_mp_accepts(ofstream &file, SHA256_CTX *shaCtx)
-{
-  AcceptMap::const_iterator iter;
-  for (iter = my_accepts.begin(); iter != my_accepts.end(); ++iter) {
-    // decompose the key for address
-    std::vector<std::string> vstr;
-    boost::split(vstr, (*iter).first, boost::is_any_of("-+"), token_compress_on);
-    CMPAccept const &accept = (*iter).second;
-    accept.saveAccept(file, shaCtx, vstr[0], vstr[1]);
-  }
-
-  return 0;
-}
-
-static int write_globals_state(ofstream &file, SHA256_CTX *shaCtx)
-{
-  unsigned int nextSPID = _my_sps->peekNextSPID(ELYSIUM_PROPERTY_ELYSIUM);
-  unsigned int nextTestSPID = _my_sps->peekNextSPID(ELYSIUM_PROPERTY_TELYSIUM);
-  std::string lineOut = strprintf("%d,%d,%d",
-    elysium_prev,
-    nextSPID,
-    nextTestSPID);
-
-  // add the line to the hash
-  SHA256_Update(shaCtx, lineOut.c_str(), lineOut.length());
-
-  // write the line
-  file << lineOut << endl;
-
-  return 0;
-}
-
-static int write_mp_crowdsales(std::ofstream& file, SHA256_CTX* shaCtx)
-{
-    for (CrowdMap::const_iterator it = my_crowds.begin(); it != my_crowds.end(); ++it) {
-        // decompose the key for address
-        const CMPCrowd& crowd = it->second;
-        crowd.saveCrowdSale(file, shaCtx, it->first);
-    }
-
-    return 0;
-}
-
-static int write_state_file( CBlockIndex const *pBlockIndex, int what )
+static bool is_state_prefix( std::string const &str )
 {
-  boost::filesystem::path path = MPPersistencePath / strprintf("%s-%s.dat", statePrefix[what], pBlockIndex->GetBlockHash().ToString());
-  const std::string strFile = path.string();
-
-  std::ofstream file;
-  file.open(strFile.c_str());
-
-  SHA256_CTX shaCtx;
-  SHA256_Init(&shaCtx);
-
-  int result = 0;
-
-  switch(what) {
-  case FILETYPE_BALANCES:
-    result = write_elysium_balances(file, &shaCtx);
-    break;
-
-  case FILETYPE_OFFERS:
-    result = write_mp_offers(file, &shaCtx);
-    break;
-
-  case FILETYPE_ACCEPTS:
-    result = write_mp_accepts(file, &shaCtx);
-    break;
-
-  case FILETYPE_GLOBALS:
-    result = write_globals_state(file, &shaCtx);
-    break;
-
-  case FILETYPE_CROWDSALES:
-      result = write_mp_crowdsales(file, &shaCtx);
-      break;
-
-  case FILETYPE_MDEXORDERS:
-      result = write_mp_metadex(file, &shaCtx);
-      break;
+  if (boost::equals(str, SNAPSHOT_PREFIX)) {
+    return true;
   }
 
-  // generate and wite the double hash of all the contents written
-  uint256 hash1;
-  SHA256_Final((unsigned char*)&hash1, &shaCtx);
-  uint256 hash2;
-  SHA256((unsigned char*)&hash1, sizeof(hash1), (unsigned char*)&hash2);
-  file << "!" << hash2.ToString() << endl;
-
-  file.flush();
-  file.close();
-  return result;
-}
-
-static bool is_state_prefix( std::string const &str )
-{
   for (int i = 0; i < NUM_FILETYPES; ++i) {
     if (boost::equals(str,  statePrefix[i])) {
       return true;
@@ -1888,6 +1855,7 @@ static void prune_state_files( CBlockIndex const *topIndex )
 
       // destroy the associated files!
       std::string strBlockHash = iter->ToString();
+      boost::filesystem::remove(MPPersistencePath / strprintf("%s-%s.dat", SNAPSHOT_PREFIX, strBlockHash));
       for (int i = 0; i < NUM_FILETYPES; ++i) {
         boost::filesystem::path path = MPPersistencePath / strprintf("%s-%s.dat", statePrefix[i], strBlockHash);
         boost::filesystem::remove(path);
@@ -1898,13 +1866,20 @@ static void prune_state_files( CBlockIndex const *topIndex )
 
 int elysium_save_state( CBlockIndex const *pBlockIndex )
 {
-    // write the new state as of the given block
-    write_state_file(pBlockIndex, FILETYPE_BALANCES);
-    write_state_file(pBlockIndex, FILETYPE_OFFERS);
-    write_state_file(pBlockIndex, FILETYPE_ACCEPTS);
-    write_state_file(pBlockIndex, FILETYPE_GLOBALS);
-    write_state_file(pBlockIndex, FILETYPE_CROWDSALES);
-    write_state_file(pBlockIndex, FILETYPE_MDEXORDERS);
+    // copy the state as of the given block, the copy is written out in the background
+    std::unique_ptr<StateSnapshot> snapshot(new StateSnapshot());
+    snapshot->blockHash = pBlockIndex->GetBlockHash();
+    snapshot->tallies = mp_tally_map;
+    snapshot->offers = my_offers;
+    snapshot->accepts = my_accepts;
+    snapshot->crowds = my_crowds;
+    snapshot->metadex = metadex;
+    snapshot->elysiumPrev = elysium_prev;
+    snapshot->nextSPID = _my_sps->peekNextSPID(ELYSIUM_PROPERTY_ELYSIUM);
+    snapshot->nextTestSPID = _my_sps->peekNextSPID(ELYSIUM_PROPERTY_TELYSIUM);
+
+    boost::filesystem::path path = MPPersistencePath / strprintf("%s-%s.dat", SNAPSHOT_PREFIX, pBlockIndex->GetBlockHash().ToString());
+    snapshotWriter->Schedule(std::move(snapshot), path);
 
     // clean-up the directory
     prune_state_files(pBlockIndex);
@@ -1923,10 +1898,12 @@ void clear_all_state()
 
     // Memory based storage
     mp_tally_map.clear();
+    mp_supply_map.clear();
     my_offers.clear();
     my_accepts.clear();
     my_crowds.clear();
     metadex.clear();
+    MetaDEx_RebuildOrderBook();
     my_pending.clear();
     ResetConsensusParams();
     ClearActivations();
@@ -1943,7 +1920,11 @@ void clear_all_state()
     p_feecache->Clear();
     p_feehistory->Clear();
     assert(p_txlistdb->setDBVersion() == DB_VERSION); // new set of databases, set DB version
+    p_txlistdb->UpgradeIndex(DB_INDEX_VERSION);
+    s_stolistdb->UpgradeIndex(DB_INDEX_VERSION);
+    t_tradelistdb->UpgradeIndex(DB_INDEX_VERSION);
     elysium_prev = 0;
+    RebuildStateChecksum();
 
     // Clear wallet state
 #ifdef ENABLE_WALLET
@@ -2017,8 +1998,14 @@ int elysium_init()
     p_feecache = new CElysiumFeeCache(GetDataDir() / "EXODUS_feecache", fReindex);
     p_feehistory = new CElysiumFeeHistory(GetDataDir() / "EXODUS_feehistory", fReindex);
 
+    // databases written by earlier versions have no or outdated secondary indexes
+    t_tradelistdb->UpgradeIndex(DB_INDEX_VERSION);
+    s_stolistdb->UpgradeIndex(DB_INDEX_VERSION);
+    p_txlistdb->UpgradeIndex(DB_INDEX_VERSION);
+
     MPPersistencePath = GetDataDir() / "MP_persist";
     TryCreateDirectory(MPPersistencePath);
+    snapshotWriter = new SnapshotWriter();
 
     txProcessor = new TxProcessor();
 
@@ -2122,6 +2109,7 @@ int elysium_shutdown()
 #ifdef ENABLE_WALLET
     delete wallet; wallet = nullptr;
 #endif
+    delete snapshotWriter; snapshotWriter = nullptr; // writes a pending snapshot first
     delete txProcessor; txProcessor = nullptr;
     delete sigmaDb; sigmaDb = nullptr;
     delete p_txlistdb; p_txlistdb = nullptr;
@@ -2186,8 +2174,8 @@ bool elysium_handler_tx(const CTransaction& tx, int nBlock, unsigned int idx, co
     }
 
     if (fFoundTx && elysium_debug_consensus_hash_every_transaction) {
-        uint256 consensusHash = GetConsensusHash();
-        PrintToLog("Consensus hash for transaction %s: %s\n", tx.GetHash().GetHex(), consensusHash.GetHex());
+        uint256 stateChecksum = GetCheckedStateChecksum();
+        PrintToLog("State checksum for transaction %s: %s\n", tx.GetHash().GetHex(), stateChecksum.GetHex());
     }
 
     return fFoundTx;
@@ -2411,17 +2399,13 @@ std::set<int> CMPTxList::GetSeedBlocks(int startHeight, int endHeight)
 
     if (!pdb) return setSeedBlocks;
 
+    IndexKey prefix(IndexKeyType::Height);
     Iterator* it = NewIterator();
 
-    for (it->SeekToFirst(); it->Valid(); it->Next()) {
-        std::string itData = it->value().ToString();
-        std::vector<std::string> vstr;
-        boost::split(vstr, itData, boost::is_any_of(":"), boost::token_compress_on);
-        if (4 != vstr.size()) continue; // unexpected number of tokens
-        int block = atoi(vstr[1]);
-        if (block >= startHeight && block <= endHeight) {
-            setSeedBlocks.insert(block);
-        }
+    for (it->Seek((IndexKey(prefix) << std::max(startHeight, 0)).str()); it->Valid() && prefix.IsPrefixOf(it->key()); it->Next()) {
+        int block = ReadIndexNumber(it->key(), prefix.size());
+        if (block > endHeight) break;
+        setSeedBlocks.insert(block);
     }
 
     delete it;
@@ -2783,27 +2767,28 @@ int CMPTxList::getMPTransactionCountTotal()
 int CMPTxList::getMPTransactionCountBlock(int block)
 {
     int count = 0;
-    Slice skey, svalue;
+    IndexKey prefix = IndexKey(IndexKeyType::Height) << block;
     Iterator* it = NewIterator();
-    for(it->SeekToFirst(); it->Valid(); it->Next())
+    for(it->Seek(prefix.str()); it->Valid() && prefix.IsPrefixOf(it->key()); it->Next())
     {
-        skey = it->key();
-        svalue = it->value();
-        if (skey.ToString().length() == 64)
-        {
-            string strValue = svalue.ToString();
-            std::vector<std::string> vstr;
-            boost::split(vstr, strValue, boost::is_any_of(":"), token_compress_on);
-            if (4 == vstr.size())
-            {
-                if (atoi(vstr[1]) == block) { ++count; }
-            }
-        }
+        if (it->key().size() == prefix.size() + 64) { ++count; } // cancels are indexed with a longer key
     }
     delete it;
     return count;
 }
 
+/**
+ * Indexes the transaction records by height.
+ */
+void CMPTxList::GetIndexKeys(const std::string& key, const std::string& value, std::vector<std::string>& indexKeys) const
+{
+    std::vector<std::string> vstr;
+    boost::split(vstr, value, boost::is_any_of(":"), token_compress_on);
+    if (4 != vstr.size()) return; // sub records are not indexed
+
+    indexKeys.push_back((IndexKey(IndexKeyType::Height) << atoi(vstr[1])).Entry(key));
+}
+
 string CMPTxList::getKeyValue(string key)
 {
     if (!pdb) return "";
@@ -2891,7 +2876,9 @@ void CMPTxList::recordMetaDExCancelTX(const uint256 &txidMaster, const uint256 &
        PrintToLog("METADEXCANCELDEBUG : Writing master record %s(%s, valid=%s, block= %d, type= %d, number of affected transactions= %d)\n", __FUNCTION__, txidMaster.ToString(), fValid ? "YES":"NO", nBlock, type, refNumber);
        if (pdb)
        {
-           status = pdb->Put(writeoptions, key, value);
+           leveldb::WriteBatch batch;
+           WriteRecord(batch, key, value);
+           status = pdb->Write(writeoptions, &batch);
            PrintToLog("METADEXCANCELDEBUG : %s(): %s, line %d, file: %s\n", __FUNCTION__, status.ToString(), __LINE__, __FILE__);
        }
 
@@ -2964,7 +2951,9 @@ void CMPTxList::recordPaymentTX(const uint256 &txid, bool fValid, int nBlock, un
        PrintToLog("DEXPAYDEBUG : Writing master record %s(%s, valid=%s, block= %d, type= %d, number of payments= %lu)\n", __FUNCTION__, txid.ToString(), fValid ? "YES":"NO", nBlock, type, numberOfPayments);
        if (pdb)
        {
-           status = pdb->Put(writeoptions, key, value);
+           leveldb::WriteBatch batch;
+           WriteRecord(batch, key, value);
+           status = pdb->Write(writeoptions, &batch);
            PrintToLog("DEXPAYDEBUG : %s(): %s, line %d, file: %s\n", __FUNCTION__, status.ToString(), __LINE__, __FILE__);
        }
 
@@ -2987,7 +2976,7 @@ void CMPTxList::recordTX(const uint256 &txid, bool fValid, int nBlock, unsigned
 
   // overwrite detection, we should never be overwriting a tx, as that means we have redone something a second time
   // reorgs delete all txs from levelDB above reorg_chain_height
-  if (p_txlistdb->exists(txid)) PrintToLog("LEVELDB TX OVERWRITE DETECTION - %s\n", txid.ToString());
+  if (exists(txid)) PrintToLog("LEVELDB TX OVERWRITE DETECTION - %s\n", txid.ToString());
 
 const string key = txid.ToString();
 const string value = strprintf("%u:%d:%u:%lu", fValid ? 1:0, nBlock, type, nValue);
@@ -2998,7 +2987,9 @@ Status status;
 
   if (pdb)
   {
-    status = pdb->Put(writeoptions, key, value);
+    leveldb::WriteBatch batch;
+    WriteRecord(batch, key, value);
+    status = pdb->Write(writeoptions, &batch);
     ++nWritten;
     if (elysium_debug_txdb) PrintToLog("%s(): %s, line %d, file: %s\n", __FUNCTION__, status.ToString(), __LINE__, __FILE__);
   }
@@ -3047,6 +3038,7 @@ Slice skey, svalue;
   for(it->SeekToFirst(); it->Valid(); it->Next())
   {
     skey = it->key();
+    if (IsIndexKey(skey)) continue;
     svalue = it->value();
     ++count;
     PrintToLog("entry #%8d= %s:%s\n", count, skey.ToString(), svalue.ToString());
@@ -3060,44 +3052,37 @@ Slice skey, svalue;
 // pass in bDeleteFound = true to erase each entry found within the block range
 bool CMPTxList::isMPinBlockRange(int starting_block, int ending_block, bool bDeleteFound)
 {
-leveldb::Slice skey, svalue;
-unsigned int count = 0;
-std::vector<std::string> vstr;
-int block;
 unsigned int n_found = 0;
+IndexKey prefix(IndexKeyType::Height);
+leveldb::WriteBatch batch;
 
   leveldb::Iterator* it = NewIterator();
 
-  for(it->SeekToFirst(); it->Valid(); it->Next())
+  // the records are indexed by height, so only the range itself is visited
+  for(it->Seek((IndexKey(prefix) << std::max(starting_block, 0)).str()); it->Valid() && prefix.IsPrefixOf(it->key()); it->Next())
   {
-    skey = it->key();
-    svalue = it->value();
-
-    ++count;
+    int block = ReadIndexNumber(it->key(), prefix.size());
+    if (block > ending_block) break;
 
-    string strvalue = it->value().ToString();
+    std::string recordKey = it->key().ToString().substr(prefix.size() + sizeof(uint32_t));
 
-    // parse the string returned, find the validity flag/bit & other parameters
-    boost::split(vstr, strvalue, boost::is_any_of(":"), token_compress_on);
+    ++n_found;
+    PrintToLog("%s() DELETING: %s (block %d)\n", __FUNCTION__, recordKey, block);
+    if (bDeleteFound) {
+        EraseRecord(batch, recordKey);
+        batch.Delete(it->key());
+    }
+  }
 
-    // only care about the block number/height here
-    if (2 <= vstr.size())
-    {
-      block = atoi(vstr[1]);
+  delete it;
 
-      if ((starting_block <= block) && (block <= ending_block))
-      {
-        ++n_found;
-        PrintToLog("%s() DELETING: %s=%s\n", __FUNCTION__, skey.ToString(), svalue.ToString());
-        if (bDeleteFound) pdb->Delete(writeoptions, skey);
-      }
-    }
+  if (bDeleteFound && n_found) {
+    leveldb::Status status = pdb->Write(writeoptions, &batch);
+    if (elysium_debug_txdb) PrintToLog("%s(): %s, line %d, file: %s\n", __FUNCTION__, status.ToString(), __LINE__, __FILE__);
   }
 
   PrintToLog("%s(%d, %d); n_found= %d\n", __FUNCTION__, starting_block, ending_block, n_found);
 
-  delete it;
-
   return (n_found);
 }
 
@@ -3108,11 +3093,13 @@ std::string CMPSTOList::getMySTOReceipts(string filterAddress)
   string mySTOReceipts = "";
   Slice skey, svalue;
   Iterator* it = NewIterator();
-  for(it->SeekToFirst(); it->Valid(); it->Next()) {
+  // records are keyed by address, a filtered lookup starts at the address
+  for(filterAddress.empty() ? it->SeekToFirst() : it->Seek(filterAddress); it->Valid(); it->Next()) {
       skey = it->key();
+      if (IsIndexKey(skey)) continue;
       string recipientAddress = skey.ToString();
+      if((!filterAddress.empty()) && (filterAddress != recipientAddress)) break; // past the filtered address
       if(!IsMyAddress(recipientAddress)) continue; // not ours, not interested
-      if((!filterAddress.empty()) && (filterAddress != recipientAddress)) continue; // not the filtered address
       // ours, get info
       svalue = it->value();
       string strValue = svalue.ToString();
@@ -3152,14 +3139,14 @@ void CMPSTOList::getRecipients(const uint256 txid, string filterAddress, UniValu
   // the fee is variable based on version of STO - provide number of recipients and allow calling function to work out fee
   *numRecipients = 0;
 
-  Slice skey, svalue;
+  // the recipients of a txid are indexed, visit only their records
+  IndexKey prefix = IndexKey(IndexKeyType::Txid) << txid;
   Iterator* it = NewIterator();
-  for(it->SeekToFirst(); it->Valid(); it->Next())
+  for(it->Seek(prefix.str()); it->Valid() && prefix.IsPrefixOf(it->key()); it->Next())
   {
-      skey = it->key();
-      string recipientAddress = skey.ToString();
-      svalue = it->value();
-      string strValue = svalue.ToString();
+      string recipientAddress = it->key().ToString().substr(prefix.size());
+      string strValue;
+      if (!pdb->Get(readoptions, recipientAddress, &strValue).ok()) continue;
       // see if txid is in the data
       size_t txidMatch = strValue.find(txid.ToString());
       if(txidMatch!=std::string::npos)
@@ -3257,7 +3244,9 @@ void CMPSTOList::recordSTOReceive(string address, const uint256 &txid, int nBloc
           Status status;
           if (pdb)
           {
-              status = pdb->Put(writeoptions, key, strValue);
+              leveldb::WriteBatch batch;
+              WriteRecord(batch, key, strValue);
+              status = pdb->Write(writeoptions, &batch);
               PrintToLog("STODBDEBUG : %s(): %s, line %d, file: %s\n", __FUNCTION__, status.ToString(), __LINE__, __FILE__);
           }
       }
@@ -3269,7 +3258,9 @@ void CMPSTOList::recordSTOReceive(string address, const uint256 &txid, int nBloc
       Status status;
       if (pdb)
       {
-          status = pdb->Put(writeoptions, key, value);
+          leveldb::WriteBatch batch;
+          WriteRecord(batch, key, value);
+          status = pdb->Write(writeoptions, &batch);
           PrintToLog("STODBDEBUG : %s(): %s, line %d, file: %s\n", __FUNCTION__, status.ToString(), __LINE__, __FILE__);
       }
   }
@@ -3284,6 +3275,7 @@ void CMPSTOList::printAll()
   for(it->SeekToFirst(); it->Valid(); it->Next())
   {
     skey = it->key();
+    if (IsIndexKey(skey)) continue;
     svalue = it->value();
     ++count;
     PrintToLog("entry #%8d= %s:%s\n", count, skey.ToString(), svalue.ToString());
@@ -3305,11 +3297,20 @@ void CMPSTOList::printStats()
 int CMPSTOList::deleteAboveBlock(int blockNum)
 {
   unsigned int n_found = 0;
-  std::vector<std::string> vecSTORecords;
+  std::set<std::string> setAddresses;
+  IndexKey prefix(IndexKeyType::Height);
   leveldb::Iterator* it = NewIterator();
-  for (it->SeekToFirst(); it->Valid(); it->Next()) {
+  // the addresses with receipts above the block are indexed by height
+  for (it->Seek((IndexKey(prefix) << std::max(blockNum, 0)).str()); it->Valid() && prefix.IsPrefixOf(it->key()); it->Next()) {
+      setAddresses.insert(it->key().ToString().substr(prefix.size() + sizeof(uint32_t)));
+  }
+  delete it;
+
+  std::vector<std::string> vecSTORecords;
+  for (const std::string& address : setAddresses) {
       std::string newValue;
-      std::string oldValue = it->value().ToString();
+      std::string oldValue;
+      if (!pdb->Get(readoptions, address, &oldValue).ok()) continue;
       bool needsUpdate = false;
       boost::split(vecSTORecords, oldValue, boost::is_any_of(","), boost::token_compress_on);
       for (uint32_t i = 0; i<vecSTORecords.size(); i++) {
@@ -3324,7 +3325,10 @@ int CMPSTOList::deleteAboveBlock(int blockNum)
       }
       if (needsUpdate) { // rewrite record with existing key and new value
           ++n_found;
-          leveldb::Status status = pdb->Put(writeoptions, it->key().ToString(), newValue);
+          leveldb::WriteBatch batch;
+          EraseRecord(batch, address);
+          WriteRecord(batch, address, newValue);
+          leveldb::Status status = pdb->Write(writeoptions, &batch);
           PrintToLog("DEBUG STO - rewriting STO data after reorg\n");
           PrintToLog("STODBDEBUG : %s(): %s, line %d, file: %s\n", __FUNCTION__, status.ToString(), __LINE__, __FILE__);
       }
@@ -3332,11 +3336,25 @@ int CMPSTOList::deleteAboveBlock(int blockNum)
 
   PrintToLog("%s(%d); stodb updated records= %d\n", __FUNCTION__, blockNum, n_found);
 
-  delete it;
-
   return (n_found);
 }
 
+/**
+ * Indexes the receipts of an address by height and by txid.
+ */
+void CMPSTOList::GetIndexKeys(const std::string& key, const std::string& value, std::vector<std::string>& indexKeys) const
+{
+  std::vector<std::string> vecSTORecords;
+  boost::split(vecSTORecords, value, boost::is_any_of(","), boost::token_compress_on);
+  for (const std::string& record : vecSTORecords) {
+      std::vector<std::string> vecSTORecordFields;
+      boost::split(vecSTORecordFields, record, boost::is_any_of(":"), boost::token_compress_on);
+      if (4 != vecSTORecordFields.size()) continue;
+      indexKeys.push_back((IndexKey(IndexKeyType::Height) << atoi(vecSTORecordFields[1])).Entry(key));
+      indexKeys.push_back((IndexKey(IndexKeyType::Txid) << uint256S(vecSTORecordFields[0])).Entry(key));
+  }
+}
+
 // MPTradeList here
 bool CMPTradeList::getMatchingTrades(const uint256& txid, uint32_t propertyId, UniValue& tradeArray, int64_t& totalSold, int64_t& totalReceived)
 {
@@ -3348,11 +3366,14 @@ bool CMPTradeList::getMatchingTrades(const uint256& txid, uint32_t propertyId, U
 
   std::vector<std::string> vstr;
   string txidStr = txid.ToString();
+  // matched trades are indexed by both of their txids
+  IndexKey prefix = IndexKey(IndexKeyType::Txid) << txid;
   leveldb::Iterator* it = NewIterator();
-  for(it->SeekToFirst(); it->Valid(); it->Next()) {
+  for(it->Seek(prefix.str()); it->Valid() && prefix.IsPrefixOf(it->key()); it->Next()) {
       // search key to see if this is a matching trade
-      std::string strKey = it->key().ToString();
-      std::string strValue = it->value().ToString();
+      std::string strKey = it->key().ToString().substr(prefix.size());
+      std::string strValue;
+      if (!pdb->Get(readoptions, strKey, &strValue).ok()) continue;
       std::string matchTxid;
       size_t txidMatch = strKey.find(txidStr);
       if (txidMatch == std::string::npos) continue; // no match
@@ -3422,13 +3443,27 @@ bool CompareTradePair(const std::pair<int64_t, UniValue>& firstJSONObj, const st
 void CMPTradeList::getTradesForPair(uint32_t propertyIdSideA, uint32_t propertyIdSideB, UniValue& responseArray, uint64_t count)
 {
   if (!pdb) return;
+
+  // matched trades are indexed by property pair, in the order of the trade
+  std::set<std::string> setMatches;
+  const IndexKey prefixes[] = {
+      IndexKey(IndexKeyType::PropertyPair) << propertyIdSideA << propertyIdSideB,
+      IndexKey(IndexKeyType::PropertyPair) << propertyIdSideB << propertyIdSideA
+  };
   leveldb::Iterator* it = NewIterator();
+  for (const IndexKey& prefix : prefixes) {
+      for (it->Seek(prefix.str()); it->Valid() && prefix.IsPrefixOf(it->key()); it->Next()) {
+          setMatches.insert(it->key().ToString().substr(prefix.size() + sizeof(uint32_t)));
+      }
+  }
+  delete it;
+
   std::vector<std::pair<int64_t, UniValue> > vecResponse;
   bool propertyIdSideAIsDivisible = isPropertyDivisible(propertyIdSideA);
   bool propertyIdSideBIsDivisible = isPropertyDivisible(propertyIdSideB);
-  for(it->SeekToFirst(); it->Valid(); it->Next()) {
-      std::string strKey = it->key().ToString();
-      std::string strValue = it->value().ToString();
+  for (const std::string& strKey : setMatches) {
+      std::string strValue;
+      if (!pdb->Get(readoptions, strKey, &strValue).ok()) continue;
       std::vector<std::string> vecKeys;
       std::vector<std::string> vecValues;
       uint256 sellerTxid, matchingTxid;
@@ -3506,8 +3541,6 @@ void CMPTradeList::getTradesForPair(uint32_t propertyIdSideA, uint32_t propertyI
   for (std::vector<UniValue>::iterator it = responseArrayValues.begin(); it != responseArrayValues.end(); ++it) {
       responseArray.push_back(*it);
   }
-
-  delete it;
 }
 
 // obtains a vector of txids where the supplied address participated in a trade (needed for gettradehistory_MP)
@@ -3516,40 +3549,38 @@ void CMPTradeList::getTradesForPair(uint32_t propertyIdSideA, uint32_t propertyI
 void CMPTradeList::getTradesForAddress(std::string address, std::vector<uint256>& vecTransactions, uint32_t propertyIdFilter)
 {
   if (!pdb) return;
-  std::map<std::string,uint256> mapTrades;
+  // new trades are indexed by address, then block and index
+  IndexKey prefix = IndexKey(IndexKeyType::Address) << address;
   leveldb::Iterator* it = NewIterator();
-  for(it->SeekToFirst(); it->Valid(); it->Next()) {
-      std::string strKey = it->key().ToString();
-      std::string strValue = it->value().ToString();
-      std::vector<std::string> vecValues;
+  for(it->Seek(prefix.str()); it->Valid() && prefix.IsPrefixOf(it->key()); it->Next()) {
+      std::string strKey = it->key().ToString().substr(prefix.size() + 2 * sizeof(uint32_t));
       if (strKey.size() != 64) continue; // only interested in trades
       uint256 txid = uint256S(strKey);
-      size_t addressMatch = strValue.find(address);
-      if (addressMatch == std::string::npos) continue;
-      boost::split(vecValues, strValue, boost::is_any_of(":"), token_compress_on);
-      if (vecValues.size() != 5) {
-          PrintToLog("TRADEDB error - unexpected number of tokens in value (%s)\n", strValue);
-          continue;
+      if (propertyIdFilter != 0) {
+          std::string strValue;
+          std::vector<std::string> vecValues;
+          if (!pdb->Get(readoptions, strKey, &strValue).ok()) continue;
+          boost::split(vecValues, strValue, boost::is_any_of(":"), token_compress_on);
+          if (vecValues.size() != 5) {
+              PrintToLog("TRADEDB error - unexpected number of tokens in value (%s)\n", strValue);
+              continue;
+          }
+          uint32_t propertyIdForSale = boost::lexical_cast<uint32_t>(vecValues[1]);
+          uint32_t propertyIdDesired = boost::lexical_cast<uint32_t>(vecValues[2]);
+          if (propertyIdFilter != propertyIdForSale && propertyIdFilter != propertyIdDesired) continue;
       }
-      uint32_t propertyIdForSale = boost::lexical_cast<uint32_t>(vecValues[1]);
-      uint32_t propertyIdDesired = boost::lexical_cast<uint32_t>(vecValues[2]);
-      int64_t blockNum = boost::lexical_cast<uint32_t>(vecValues[3]);
-      int64_t txIndex = boost::lexical_cast<uint32_t>(vecValues[4]);
-      if (propertyIdFilter != 0 && propertyIdFilter != propertyIdForSale && propertyIdFilter != propertyIdDesired) continue;
-      std::string sortKey = strprintf("%06d%010d", blockNum, txIndex);
-      mapTrades.insert(std::make_pair(sortKey, txid));
+      vecTransactions.push_back(txid);
   }
   delete it;
-  for (std::map<std::string,uint256>::iterator it = mapTrades.begin(); it != mapTrades.end(); it++) {
-      vecTransactions.push_back(it->second);
-  }
 }
 
 void CMPTradeList::recordNewTrade(const uint256& txid, const std::string& address, uint32_t propertyIdForSale, uint32_t propertyIdDesired, int blockNum, int blockIndex)
 {
   if (!pdb) return;
   std::string strValue = strprintf("%s:%d:%d:%d:%d", address, propertyIdForSale, propertyIdDesired, blockNum, blockIndex);
-  Status status = pdb->Put(writeoptions, txid.ToString(), strValue);
+  leveldb::WriteBatch batch;
+  WriteRecord(batch, txid.ToString(), strValue);
+  Status status = pdb->Write(writeoptions, &batch);
   ++nWritten;
   if (elysium_debug_tradedb) PrintToLog("%s(): %s\n", __FUNCTION__, status.ToString());
 }
@@ -3562,7 +3593,9 @@ void CMPTradeList::recordMatchedTrade(const uint256 txid1, const uint256 txid2,
   Status status;
   if (pdb)
   {
-    status = pdb->Put(writeoptions, key, value);
+    leveldb::WriteBatch batch;
+    WriteRecord(batch, key, value);
+    status = pdb->Write(writeoptions, &batch);
     ++nWritten;
     if (elysium_debug_tradedb) PrintToLog("%s(): %s\n", __FUNCTION__, status.ToString());
   }
@@ -3575,35 +3608,55 @@ void CMPTradeList::recordMatchedTrade(const uint256 txid1, const uint256 txid2,
  */
 int CMPTradeList::deleteAboveBlock(int blockNum)
 {
-  leveldb::Slice skey, svalue;
-  unsigned int count = 0;
-  std::vector<std::string> vstr;
-  int block = 0;
   unsigned int n_found = 0;
+  IndexKey prefix(IndexKeyType::Height);
+  leveldb::WriteBatch batch;
   leveldb::Iterator* it = NewIterator();
-  for(it->SeekToFirst(); it->Valid(); it->Next())
+  // trades and trade matches are indexed by height, only the ones to delete are visited
+  for(it->Seek((IndexKey(prefix) << std::max(blockNum, 0)).str()); it->Valid() && prefix.IsPrefixOf(it->key()); it->Next())
   {
-    skey = it->key();
-    svalue = it->value();
-    ++count;
-    string strvalue = it->value().ToString();
-    boost::split(vstr, strvalue, boost::is_any_of(":"), token_compress_on);
-    if (7 == vstr.size()) block = atoi(vstr[6]); // trade matches have 7 tokens, key is txid+txid, only care about block
-    if (5 == vstr.size()) block = atoi(vstr[3]); // trades have 5 tokens, key is txid, only care about block
-    if (block >= blockNum) {
-        ++n_found;
-        PrintToLog("%s() DELETING FROM TRADEDB: %s=%s\n", __FUNCTION__, skey.ToString(), svalue.ToString());
-        pdb->Delete(writeoptions, skey);
-    }
+    std::string strKey = it->key().ToString().substr(prefix.size() + sizeof(uint32_t));
+    ++n_found;
+    PrintToLog("%s() DELETING FROM TRADEDB: %s (block %d)\n", __FUNCTION__, strKey, ReadIndexNumber(it->key(), prefix.size()));
+    EraseRecord(batch, strKey);
+    batch.Delete(it->key());
   }
 
-  PrintToLog("%s(%d); tradedb n_found= %d\n", __FUNCTION__, blockNum, n_found);
-
   delete it;
 
+  if (n_found) {
+    leveldb::Status status = pdb->Write(writeoptions, &batch);
+    if (elysium_debug_tradedb) PrintToLog("%s(): %s\n", __FUNCTION__, status.ToString());
+  }
+
+  PrintToLog("%s(%d); tradedb n_found= %d\n", __FUNCTION__, blockNum, n_found);
+
   return (n_found);
 }
 
+/**
+ * Indexes new trades by height and address, matched trades by height, txids and property pair.
+ */
+void CMPTradeList::GetIndexKeys(const std::string& key, const std::string& value, std::vector<std::string>& indexKeys) const
+{
+  std::vector<std::string> vstr;
+  boost::split(vstr, value, boost::is_any_of(":"), token_compress_on);
+  if (key.size() == 64 && vstr.size() == 5) { // trades have 5 tokens, key is txid
+      uint32_t block = atoi(vstr[3]);
+      uint32_t blockIndex = atoi(vstr[4]);
+      indexKeys.push_back((IndexKey(IndexKeyType::Height) << block).Entry(key));
+      indexKeys.push_back((IndexKey(IndexKeyType::Address) << vstr[0] << block << blockIndex).Entry(key));
+  } else if (key.size() == 129 && vstr.size() == 8) { // trade matches have 8 tokens, key is txid+txid
+      uint32_t prop1 = strtoul(vstr[2].c_str(), NULL, 10);
+      uint32_t prop2 = strtoul(vstr[3].c_str(), NULL, 10);
+      uint32_t block = atoi(vstr[6]);
+      indexKeys.push_back((IndexKey(IndexKeyType::Height) << block).Entry(key));
+      indexKeys.push_back((IndexKey(IndexKeyType::Txid) << uint256S(key.substr(0, 64))).Entry(key));
+      indexKeys.push_back((IndexKey(IndexKeyType::Txid) << uint256S(key.substr(65, 64))).Entry(key));
+      indexKeys.push_back((IndexKey(IndexKeyType::PropertyPair) << prop1 << prop2 << block).Entry(key));
+  }
+}
+
 void CMPTradeList::printStats()
 {
   PrintToLog("CMPTradeList stats: tWritten= %d , tRead= %d\n", nWritten, nRead);
@@ -3616,7 +3669,7 @@ int CMPTradeList::getMPTradeCountTotal()
     Iterator* it = NewIterator();
     for(it->SeekToFirst(); it->Valid(); it->Next())
     {
-        ++count;
+        if (!IsIndexKey(it->key())) { ++count; }
     }
     delete it;
     return count;
@@ -3631,6 +3684,7 @@ void CMPTradeList::printAll()
   for(it->SeekToFirst(); it->Valid(); it->Next())
   {
     skey = it->key();
+    if (IsIndexKey(skey)) continue;
     svalue = it->value();
     ++count;
     PrintToLog("entry #%8d= %s:%s\n", count, skey.ToString(), svalue.ToString());
@@ -3800,6 +3854,10 @@ int elysium_handler_block_end(int nBlockNow, CBlockIndex const * pBlockIndex,
         uint256 consensusHash = GetConsensusHash();
         PrintToLog("Consensus hash for block %d: %s\n", nBlockNow, consensusHash.GetHex());
     }
+    if (elysium_debug_consensus_hash_every_block) {
+        uint256 stateChecksum = GetCheckedStateChecksum();
+        PrintToLog("State checksum for block %d: %s\n", nBlockNow, stateChecksum.GetHex());
+    }
 
     // request checkpoint verification
     bool checkpointValid = VerifyCheckpoint(nBlockNow, pBlockIndex->GetBlockHash());
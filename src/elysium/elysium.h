@@ -40,6 +40,9 @@ constexpr size_t ELYSIUM_MAX_SIMPLE_MINTS = std::numeric_limits<uint8_t>::max();
 // increment this value to force a refresh of the state (similar to --startclean)
 #define DB_VERSION 6
 
+// increment this value to rebuild the secondary indexes of the databases, without a refresh of the state
+#define DB_INDEX_VERSION 1
+
 // maximum size of string fields
 #define SP_STRING_FIELD_LEN 256
 
@@ -153,6 +156,10 @@ public:
     void printAll();
     bool exists(string address);
     void recordSTOReceive(std::string, const uint256&, int, unsigned int, uint64_t);
+
+protected:
+    /** Indexes the receipts of an address by height and by txid. */
+    void GetIndexKeys(const std::string& key, const std::string& value, std::vector<std::string>& indexKeys) const;
 };
 
 /** LevelDB based storage for the trade history. Trades are listed with key "txid1+txid2".
@@ -181,6 +188,10 @@ public:
     void getTradesForAddress(std::string address, std::vector<uint256>& vecTransactions, uint32_t propertyIdFilter = 0);
     void getTradesForPair(uint32_t propertyIdSideA, uint32_t propertyIdSideB, UniValue& response, uint64_t count);
     int getMPTradeCountTotal();
+
+protected:
+    /** Indexes new trades by height and address, matched trades by height, txids and property pair. */
+    void GetIndexKeys(const std::string& key, const std::string& value, std::vector<std::string>& indexKeys) const;
 };
 
 /** LevelDB based storage for transactions, with txid as key and validity bit, and other data as value.
@@ -232,6 +243,10 @@ public:
     void printAll();
 
     bool isMPinBlockRange(int, int, bool);
+
+protected:
+    /** Indexes the transaction records by height. */
+    void GetIndexKeys(const std::string& key, const std::string& value, std::vector<std::string>& indexKeys) const;
 };
 
 //! Available balances of wallet properties
@@ -1,9 +1,11 @@
 #include "elysium/mdex.h"
 
+#include "elysium/consensushash.h"
 #include "elysium/errors.h"
 #include "elysium/fees.h"
 #include "elysium/log.h"
 #include "elysium/elysium.h"
+#include "elysium/orderbook.h"
 #include "elysium/rules.h"
 #include "elysium/sp.h"
 #include "elysium/tx.h"
@@ -30,6 +32,8 @@
 #include <map>
 #include <set>
 #include <string>
+#include <utility>
+#include <vector>
 
 typedef boost::multiprecision::cpp_dec_float_100 dec_float;
 typedef boost::multiprecision::checked_int128_t int128_t;
@@ -42,6 +46,9 @@ using namespace elysium;
 //! Global map for price and order data
 md_PropertiesMap elysium::metadex;
 
+//! Index of the orders in metadex by pair and price, used for matching
+static MetaDExOrderBook orderbook;
+
 md_PricesMap* elysium::get_Prices(uint32_t prop)
 {
     md_PropertiesMap::iterator it = metadex.find(prop);
@@ -142,51 +149,49 @@ static MatchReturnType x_Trade(CMPMetaDEx* const pnew)
     if (elysium_debug_metadex1) PrintToLog("%s(%s: prop=%d, desprop=%d, desprice= %s);newo: %s\n",
         __FUNCTION__, pnew->getAddr(), propertyForSale, propertyDesired, xToString(pnew->inversePrice()), pnew->ToString());
 
-    md_PricesMap* const ppriceMap = get_Prices(propertyDesired);
+    // the orders which sell the desired property for the property offered
+    MetaDExOrderBook::Levels* const plevels = orderbook.GetLevels(propertyDesired, propertyForSale);
 
     // nothing for the desired property exists in the market, sorry!
-    if (!ppriceMap) {
+    if (!plevels) {
         PrintToLog("%s()=%d:%s NOT FOUND ON THE MARKET\n", __FUNCTION__, NewReturn, getTradeReturnType(NewReturn));
         return NewReturn;
     }
 
-    // within the desired property map (given one property) iterate over the items looking at prices
-    for (md_PricesMap::iterator priceIt = ppriceMap->begin(); priceIt != ppriceMap->end(); ++priceIt) { // check all prices
-        const rational_t sellersPrice = priceIt->first;
+    const MetaDExPrice buyersPrice = GetInversePrice(*pnew);
+
+    // within the pair iterate over the price levels, from the lowest price
+    for (MetaDExOrderBook::Levels::iterator levelIt = plevels->begin(); levelIt != plevels->end(); ++levelIt) { // check all prices
+        const MetaDExPrice sellersPrice = levelIt->price;
 
         if (elysium_debug_metadex2) PrintToLog("comparing prices: desprice %s needs to be GREATER THAN OR EQUAL TO %s\n",
-            xToString(pnew->inversePrice()), xToString(sellersPrice));
+            xToString(pnew->inversePrice()), xToString(sellersPrice.ToRational()));
 
         // Is the desired price check satisfied? The buyer's inverse price must be larger than that of the seller.
-        if (pnew->inversePrice() < sellersPrice) {
-            continue;
+        // The levels are sorted, so none of the following levels satisfies it either.
+        if (buyersPrice < sellersPrice) {
+            break;
         }
 
-        md_Set* const pofferSet = &(priceIt->second);
+        md_Set* const pofferSet = levelIt->set;
+        std::deque<md_Set::iterator>& offers = levelIt->orders;
 
-        // at good (single) price level and property iterate over offers looking at all parameters to find the match
-        md_Set::iterator offerIt = pofferSet->begin();
-        while (offerIt != pofferSet->end()) { // specific price, check all properties
+        // at good (single) price level iterate over offers looking at all parameters to find the match
+        size_t nOffer = 0;
+        while (nOffer < offers.size()) { // specific price, check all orders
+            const md_Set::iterator offerIt = offers[nOffer];
             const CMPMetaDEx* const pold = &(*offerIt);
-            assert(pold->unitPrice() == sellersPrice);
+            assert(GetUnitPrice(*pold) == sellersPrice);
+            assert(pold->getDesProperty() == propertyForSale);
 
-            if (elysium_debug_metadex1) PrintToLog("Looking at existing: %s (its prop= %d, its des prop= %d) = %s\n",
-                xToString(sellersPrice), pold->getProperty(), pold->getDesProperty(), pold->ToString());
-
-            // does the desired property match?
-            if (pold->getDesProperty() != propertyForSale) {
-                ++offerIt;
-                continue;
-            }
-
-            if (elysium_debug_metadex1) PrintToLog("MATCH FOUND, Trade: %s = %s\n", xToString(sellersPrice), pold->ToString());
+            if (elysium_debug_metadex1) PrintToLog("MATCH FOUND, Trade: %s = %s\n", xToString(sellersPrice.ToRational()), pold->ToString());
 
             // match found, execute trade now!
             const int64_t seller_amountForSale = pold->getAmountRemaining();
             const int64_t buyer_amountOffered = pnew->getAmountRemaining();
 
             if (elysium_debug_metadex1) PrintToLog("$$ trading using price: %s; seller: forsale=%d, desired=%d, remaining=%d, buyer amount offered=%d\n",
-                xToString(sellersPrice), pold->getAmountForSale(), pold->getAmountDesired(), pold->getAmountRemaining(), pnew->getAmountRemaining());
+                xToString(sellersPrice.ToRational()), pold->getAmountForSale(), pold->getAmountDesired(), pold->getAmountRemaining(), pnew->getAmountRemaining());
             if (elysium_debug_metadex1) PrintToLog("$$ old: %s\n", pold->ToString());
             if (elysium_debug_metadex1) PrintToLog("$$ new: %s\n", pnew->ToString());
 
@@ -198,8 +203,8 @@ static MatchReturnType x_Trade(CMPMetaDEx* const pnew)
             assert(pnew->getProperty() != pnew->getDesProperty());
             assert(pnew->getProperty() == pold->getDesProperty());
             assert(pold->getProperty() == pnew->getDesProperty());
-            assert(pold->unitPrice() <= pnew->inversePrice());
-            assert(pnew->unitPrice() <= pold->inversePrice());
+            assert(sellersPrice <= buyersPrice);
+            assert(GetUnitPrice(*pnew) <= GetInversePrice(*pold));
 
             ///////////////////////////
 
@@ -219,7 +224,7 @@ static MatchReturnType x_Trade(CMPMetaDEx* const pnew)
             if (nCouldBuy == 0) {
                 if (elysium_debug_metadex1) PrintToLog(
                         "-- buyer has not enough tokens for sale to purchase one unit!\n");
-                ++offerIt;
+                ++nOffer;
                 continue;
             }
 
@@ -232,12 +237,12 @@ static MatchReturnType x_Trade(CMPMetaDEx* const pnew)
 
             // If the resulting adjusted unit price is higher than Alice' price, the
             // orders shall not execute, and no representable fill is made
-            const rational_t xEffectivePrice(nWouldPay, nCouldBuy);
+            const MetaDExPrice xEffectivePrice(nWouldPay, nCouldBuy);
 
-            if (xEffectivePrice > pnew->inversePrice()) {
+            if (xEffectivePrice > buyersPrice) {
                 if (elysium_debug_metadex1) PrintToLog(
-                        "-- effective price is too expensive: %s\n", xToString(xEffectivePrice));
-                ++offerIt;
+                        "-- effective price is too expensive: %s\n", xToString(xEffectivePrice.ToRational()));
+                ++nOffer;
                 continue;
             }
 
@@ -252,8 +257,8 @@ static MatchReturnType x_Trade(CMPMetaDEx* const pnew)
             ///////////////////////////
 
             // postconditions
-            assert(xEffectivePrice >= pold->unitPrice());
-            assert(xEffectivePrice <= pnew->inversePrice());
+            assert(xEffectivePrice >= sellersPrice);
+            assert(xEffectivePrice <= buyersPrice);
             assert(0 <= seller_amountLeft);
             assert(0 <= buyer_amountLeft);
             assert(seller_amountForSale == seller_amountLeft + buyer_amountGot);
@@ -315,23 +320,32 @@ static MatchReturnType x_Trade(CMPMetaDEx* const pnew)
 
             if (elysium_debug_metadex1) PrintToLog("++ erased old: %s\n", offerIt->ToString());
             // erase the old seller element
-            pofferSet->erase(offerIt++);
-
-            // insert the updated one in place of the old
+            if (IsStateChecksumEnabled()) RemoveFromStateChecksum(StateComponent::MetaDEx, GenerateConsensusString(*offerIt));
             if (0 < seller_replacement.getAmountRemaining()) {
+                pofferSet->erase(offerIt);
+
+                // insert the updated one in place of the old
                 PrintToLog("++ inserting seller_replacement: %s\n", seller_replacement.ToString());
-                pofferSet->insert(seller_replacement);
+                md_Set::iterator replacementIt = pofferSet->insert(seller_replacement).first;
+                orderbook.ReplaceAt(*levelIt, nOffer++, replacementIt);
+                if (IsStateChecksumEnabled()) AddToStateChecksum(StateComponent::MetaDEx, GenerateConsensusString(seller_replacement));
+            } else {
+                orderbook.EraseAt(*levelIt, nOffer);
+                pofferSet->erase(offerIt);
             }
 
             if (bBuyerSatisfied) {
                 assert(buyer_amountLeft == 0);
                 break;
             }
-        } // specific price, check all properties
+        } // specific price, check all orders
 
         if (bBuyerSatisfied) break;
     } // check all prices
 
+    // drop the levels which were filled completely
+    orderbook.PruneLevels(propertyDesired, propertyForSale);
+
     PrintToLog("%s()=%d:%s\n", __FUNCTION__, NewReturn, getTradeReturnType(NewReturn));
 
     return NewReturn;
@@ -426,28 +440,6 @@ std::string CMPMetaDEx::ToString() const
         property, FormatMP(property, amount_forsale), desired_property, FormatMP(desired_property, amount_desired));
 }
 
-void CMPMetaDEx::saveOffer(std::ofstream& file, SHA256_CTX* shaCtx) const
-{
-    std::string lineOut = strprintf("%s,%d,%d,%d,%d,%d,%d,%d,%s,%d",
-        addr,
-        block,
-        amount_forsale,
-        property,
-        amount_desired,
-        desired_property,
-        subaction,
-        idx,
-        txid.ToString(),
-        amount_remaining
-    );
-
-    // add the line to the hash
-    SHA256_Update(shaCtx, lineOut.c_str(), lineOut.length());
-
-    // write the line
-    file << lineOut << std::endl;
-}
-
 bool MetaDEx_compare::operator()(const CMPMetaDEx &lhs, const CMPMetaDEx &rhs) const
 {
     if (lhs.getBlock() == rhs.getBlock()) return lhs.getIdx() < rhs.getIdx();
@@ -456,37 +448,32 @@ bool MetaDEx_compare::operator()(const CMPMetaDEx &lhs, const CMPMetaDEx &rhs) c
 
 bool elysium::MetaDEx_INSERT(const CMPMetaDEx& objMetaDEx)
 {
-    // Create an empty price map (to use in case price map for this property does not already exist)
-    md_PricesMap temp_prices;
-    // Attempt to obtain the price map for the property
-    md_PricesMap *p_prices = get_Prices(objMetaDEx.getProperty());
-
-    // Create an empty set of metadex objects (to use in case no set currently exists at this price)
-    md_Set temp_indexes;
-    md_Set *p_indexes = NULL;
-
-    // Prepare for return code
-    std::pair <md_Set::iterator, bool> ret;
-
-    // Attempt to obtain a set of metadex objects for this price from the price map
-    if (p_prices) p_indexes = get_Indexes(p_prices, objMetaDEx.unitPrice());
-    // See if the set was populated, if not no set exists at this price level, use the empty set that we created earlier
-    if (!p_indexes) p_indexes = &temp_indexes;
+    // Obtain the set of metadex objects for this property and price, it's created if it doesn't exist yet
+    md_Set& indexes = metadex[objMetaDEx.getProperty()][objMetaDEx.unitPrice()];
 
     // Attempt to insert the metadex object into the set
-    ret = p_indexes->insert(objMetaDEx);
+    std::pair<md_Set::iterator, bool> ret = indexes.insert(objMetaDEx);
     if (false == ret.second) return false;
 
-    // If a prices map did not exist for this property, set p_prices to the temp empty price map
-    if (!p_prices) p_prices = &temp_prices;
+    orderbook.Insert(indexes, ret.first);
+    if (IsStateChecksumEnabled()) AddToStateChecksum(StateComponent::MetaDEx, GenerateConsensusString(objMetaDEx));
 
-    // Update the prices map with the new set at this price
-    (*p_prices)[objMetaDEx.unitPrice()] = *p_indexes;
+    return true;
+}
 
-    // Set the metadex map for the property to the updated (or new if it didn't exist) price map
-    metadex[objMetaDEx.getProperty()] = *p_prices;
+void elysium::MetaDEx_RebuildOrderBook()
+{
+    orderbook.Clear();
 
-    return true;
+    for (md_PropertiesMap::iterator my_it = metadex.begin(); my_it != metadex.end(); ++my_it) {
+        md_PricesMap& prices = my_it->second;
+        for (md_PricesMap::iterator it = prices.begin(); it != prices.end(); ++it) {
+            md_Set& indexes = it->second;
+            for (md_Set::iterator it = indexes.begin(); it != indexes.end(); ++it) {
+                orderbook.Insert(indexes, it);
+            }
+        }
+    }
 }
 
 // pretty much directly linked to the ADD TX21 command off the wire
@@ -541,37 +528,37 @@ int elysium::MetaDEx_CANCEL_AT_PRICE(const uint256& txid, unsigned int block, co
         return rc -1;
     }
 
-    // within the desired property map (given one property) iterate over the items
-    for (md_PricesMap::iterator my_it = prices->begin(); my_it != prices->end(); ++my_it) {
-        rational_t sellers_price = my_it->first;
-
-        if (mdex.unitPrice() != sellers_price) continue;
-
-        md_Set* indexes = &(my_it->second);
-
-        for (md_Set::iterator iitt = indexes->begin(); iitt != indexes->end();) {
-            p_mdex = &(*iitt);
-
-            if (elysium_debug_metadex3) PrintToLog("%s(): %s\n", __FUNCTION__, p_mdex->ToString());
+    // the orders of the pair at the price, oldest first
+    std::vector<md_Set::iterator> vOrders;
+    md_Set* indexes = NULL;
+    MetaDExOrderBook::Levels* levels = orderbook.GetLevels(prop, property_desired);
+    MetaDExOrderBook::Level* level = levels ? orderbook.FindLevel(*levels, GetUnitPrice(mdex)) : NULL;
+    if (level) {
+        indexes = level->set;
+        for (size_t i = 0; i < level->orders.size(); ++i) {
+            if (elysium_debug_metadex3) PrintToLog("%s(): %s\n", __FUNCTION__, level->orders[i]->ToString());
+            if (level->orders[i]->getAddr() == sender_addr) vOrders.push_back(level->orders[i]);
+        }
+    }
 
-            if ((p_mdex->getDesProperty() != property_desired) || (p_mdex->getAddr() != sender_addr)) {
-                ++iitt;
-                continue;
-            }
+    for (std::vector<md_Set::iterator>::iterator it = vOrders.begin(); it != vOrders.end(); ++it) {
+        md_Set::iterator iitt = *it;
+        p_mdex = &(*iitt);
 
-            rc = 0;
-            PrintToLog("%s(): REMOVING %s\n", __FUNCTION__, p_mdex->ToString());
+        rc = 0;
+        PrintToLog("%s(): REMOVING %s\n", __FUNCTION__, p_mdex->ToString());
 
-            // move from reserve to main
-            assert(update_tally_map(p_mdex->getAddr(), p_mdex->getProperty(), -p_mdex->getAmountRemaining(), METADEX_RESERVE));
-            assert(update_tally_map(p_mdex->getAddr(), p_mdex->getProperty(), p_mdex->getAmountRemaining(), BALANCE));
+        // move from reserve to main
+        assert(update_tally_map(p_mdex->getAddr(), p_mdex->getProperty(), -p_mdex->getAmountRemaining(), METADEX_RESERVE));
+        assert(update_tally_map(p_mdex->getAddr(), p_mdex->getProperty(), p_mdex->getAmountRemaining(), BALANCE));
 
-            // record the cancellation
-            bool bValid = true;
-            p_txlistdb->recordMetaDExCancelTX(txid, p_mdex->getHash(), bValid, block, p_mdex->getProperty(), p_mdex->getAmountRemaining());
+        // record the cancellation
+        bool bValid = true;
+        p_txlistdb->recordMetaDExCancelTX(txid, p_mdex->getHash(), bValid, block, p_mdex->getProperty(), p_mdex->getAmountRemaining());
 
-            indexes->erase(iitt++);
-        }
+        if (IsStateChecksumEnabled()) RemoveFromStateChecksum(StateComponent::MetaDEx, GenerateConsensusString(*iitt));
+        orderbook.Erase(iitt);
+        indexes->erase(iitt);
     }
 
     if (elysium_debug_metadex2) MetaDEx_debug_print();
@@ -594,33 +581,37 @@ int elysium::MetaDEx_CANCEL_ALL_FOR_PAIR(const uint256& txid, unsigned int block
         return rc -1;
     }
 
-    // within the desired property map (given one property) iterate over the items
-    for (md_PricesMap::iterator my_it = prices->begin(); my_it != prices->end(); ++my_it) {
-        md_Set* indexes = &(my_it->second);
-
-        for (md_Set::iterator iitt = indexes->begin(); iitt != indexes->end();) {
-            p_mdex = &(*iitt);
-
-            if (elysium_debug_metadex3) PrintToLog("%s(): %s\n", __FUNCTION__, p_mdex->ToString());
-
-            if ((p_mdex->getDesProperty() != property_desired) || (p_mdex->getAddr() != sender_addr)) {
-                ++iitt;
-                continue;
+    // the orders of the pair, by price and oldest first
+    std::vector<std::pair<md_Set*, md_Set::iterator> > vOrders;
+    MetaDExOrderBook::Levels* levels = orderbook.GetLevels(prop, property_desired);
+    if (levels) {
+        for (MetaDExOrderBook::Levels::iterator my_it = levels->begin(); my_it != levels->end(); ++my_it) {
+            for (size_t i = 0; i < my_it->orders.size(); ++i) {
+                if (elysium_debug_metadex3) PrintToLog("%s(): %s\n", __FUNCTION__, my_it->orders[i]->ToString());
+                if (my_it->orders[i]->getAddr() == sender_addr) vOrders.push_back(std::make_pair(my_it->set, my_it->orders[i]));
             }
+        }
+    }
 
-            rc = 0;
-            PrintToLog("%s(): REMOVING %s\n", __FUNCTION__, p_mdex->ToString());
+    for (std::vector<std::pair<md_Set*, md_Set::iterator> >::iterator it = vOrders.begin(); it != vOrders.end(); ++it) {
+        md_Set* indexes = it->first;
+        md_Set::iterator iitt = it->second;
+        p_mdex = &(*iitt);
 
-            // move from reserve to main
-            assert(update_tally_map(p_mdex->getAddr(), p_mdex->getProperty(), -p_mdex->getAmountRemaining(), METADEX_RESERVE));
-            assert(update_tally_map(p_mdex->getAddr(), p_mdex->getProperty(), p_mdex->getAmountRemaining(), BALANCE));
+        rc = 0;
+        PrintToLog("%s(): REMOVING %s\n", __FUNCTION__, p_mdex->ToString());
 
-            // record the cancellation
-            bool bValid = true;
-            p_txlistdb->recordMetaDExCancelTX(txid, p_mdex->getHash(), bValid, block, p_mdex->getProperty(), p_mdex->getAmountRemaining());
+        // move from reserve to main
+        assert(update_tally_map(p_mdex->getAddr(), p_mdex->getProperty(), -p_mdex->getAmountRemaining(), METADEX_RESERVE));
+        assert(update_tally_map(p_mdex->getAddr(), p_mdex->getProperty(), p_mdex->getAmountRemaining(), BALANCE));
 
-            indexes->erase(iitt++);
-        }
+        // record the cancellation
+        bool bValid = true;
+        p_txlistdb->recordMetaDExCancelTX(txid, p_mdex->getHash(), bValid, block, p_mdex->getProperty(), p_mdex->getAmountRemaining());
+
+        if (IsStateChecksumEnabled()) RemoveFromStateChecksum(StateComponent::MetaDEx, GenerateConsensusString(*iitt));
+        orderbook.Erase(iitt);
+        indexes->erase(iitt);
     }
 
     if (elysium_debug_metadex3) MetaDEx_debug_print();
@@ -676,6 +667,8 @@ int elysium::MetaDEx_CANCEL_EVERYTHING(const uint256& txid, unsigned int block,
                 bool bValid = true;
                 p_txlistdb->recordMetaDExCancelTX(txid, it->getHash(), bValid, block, it->getProperty(), it->getAmountRemaining());
 
+                if (IsStateChecksumEnabled()) RemoveFromStateChecksum(StateComponent::MetaDEx, GenerateConsensusString(*it));
+                orderbook.Erase(it);
                 indexes.erase(it++);
             }
         }
@@ -704,6 +697,8 @@ int elysium::MetaDEx_SHUTDOWN_ALLPAIR()
                     // move from reserve to balance
                     assert(update_tally_map(it->getAddr(), it->getProperty(), -it->getAmountRemaining(), METADEX_RESERVE));
                     assert(update_tally_map(it->getAddr(), it->getProperty(), it->getAmountRemaining(), BALANCE));
+                    if (IsStateChecksumEnabled()) RemoveFromStateChecksum(StateComponent::MetaDEx, GenerateConsensusString(*it));
+                    orderbook.Erase(it);
                     indexes.erase(it++);
                 }
             }
@@ -728,6 +723,8 @@ int elysium::MetaDEx_SHUTDOWN()
                 // move from reserve to balance
                 assert(update_tally_map(it->getAddr(), it->getProperty(), -it->getAmountRemaining(), METADEX_RESERVE));
                 assert(update_tally_map(it->getAddr(), it->getProperty(), it->getAmountRemaining(), BALANCE));
+                if (IsStateChecksumEnabled()) RemoveFromStateChecksum(StateComponent::MetaDEx, GenerateConsensusString(*it));
+                orderbook.Erase(it);
                 indexes.erase(it++);
             }
         }
@@ -735,22 +732,12 @@ int elysium::MetaDEx_SHUTDOWN()
     return rc;
 }
 
-// searches the metadex maps to see if a trade is still open
-// allows search to be optimized if propertyIdForSale is specified
+// checks whether a trade is still open, and for sale of propertyIdForSale if it's specified
 bool elysium::MetaDEx_isOpen(const uint256& txid, uint32_t propertyIdForSale)
 {
-    for (md_PropertiesMap::iterator my_it = metadex.begin(); my_it != metadex.end(); ++my_it) {
-        if (propertyIdForSale != 0 && propertyIdForSale != my_it->first) continue;
-        md_PricesMap & prices = my_it->second;
-        for (md_PricesMap::iterator it = prices.begin(); it != prices.end(); ++it) {
-            md_Set & indexes = (it->second);
-            for (md_Set::iterator it = indexes.begin(); it != indexes.end(); ++it) {
-                CMPMetaDEx obj = *it;
-                if( obj.getHash().GetHex() == txid.GetHex() ) return true;
-            }
-        }
-    }
-    return false;
+    const CMPMetaDEx* p_mdex = orderbook.Find(txid);
+    if (!p_mdex) return false;
+    return propertyIdForSale == 0 || propertyIdForSale == p_mdex->getProperty();
 }
 
 /**
@@ -837,14 +824,5 @@ void elysium::MetaDEx_debug_print(bool bShowPriceLevel, bool bDisplay)
  */
 const CMPMetaDEx* elysium::MetaDEx_RetrieveTrade(const uint256& txid)
 {
-    for (md_PropertiesMap::iterator propIter = metadex.begin(); propIter != metadex.end(); ++propIter) {
-        md_PricesMap & prices = propIter->second;
-        for (md_PricesMap::iterator pricesIter = prices.begin(); pricesIter != prices.end(); ++pricesIter) {
-            md_Set & indexes = pricesIter->second;
-            for (md_Set::iterator tradesIter = indexes.begin(); tradesIter != indexes.end(); ++tradesIter) {
-                if (txid == (*tradesIter).getHash()) return &(*tradesIter);
-            }
-        }
-    }
-    return (CMPMetaDEx*) NULL;
+    return orderbook.Find(txid);
 }
@@ -0,0 +1,202 @@
+#include "orderbook.h"
+
+#include "../hash.h"
+#include "../random.h"
+
+#include <algorithm>
+#include <limits>
+
+#include <assert.h>
+
+namespace elysium {
+
+namespace {
+
+uint64_t GreatestCommonDivisor(uint64_t a, uint64_t b)
+{
+    while (b != 0) {
+        uint64_t r = a % b;
+        a = b;
+        b = r;
+    }
+    return a;
+}
+
+/** Full 128 bit product of two 64 bit values */
+void Multiply(uint64_t a, uint64_t b, uint64_t& hi, uint64_t& lo)
+{
+    const uint64_t aLo = a & 0xffffffff, aHi = a >> 32;
+    const uint64_t bLo = b & 0xffffffff, bHi = b >> 32;
+
+    const uint64_t p0 = aLo * bLo;
+    const uint64_t p1 = aLo * bHi;
+    const uint64_t p2 = aHi * bLo;
+    const uint64_t p3 = aHi * bHi;
+
+    const uint64_t middle = (p0 >> 32) + (p1 & 0xffffffff) + (p2 & 0xffffffff);
+    lo = (middle << 32) | (p0 & 0xffffffff);
+    hi = p3 + (p1 >> 32) + (p2 >> 32) + (middle >> 32);
+}
+
+uint64_t PairKey(uint32_t propertyForSale, uint32_t propertyDesired)
+{
+    return (static_cast<uint64_t>(propertyForSale) << 32) | propertyDesired;
+}
+
+bool LevelPriceLess(const MetaDExOrderBook::Level& level, const MetaDExPrice& price)
+{
+    return level.price < price;
+}
+
+} // namespace
+
+MetaDExPrice::MetaDExPrice(int64_t numerator, int64_t denominator)
+{
+    assert(numerator >= 0 && denominator > 0);
+
+    uint64_t divisor = GreatestCommonDivisor(numerator, denominator);
+    this->numerator = static_cast<uint64_t>(numerator) / divisor;
+    this->denominator = static_cast<uint64_t>(denominator) / divisor;
+}
+
+rational_t MetaDExPrice::ToRational() const
+{
+    typedef boost::multiprecision::checked_int128_t int128_t;
+    return rational_t(int128_t(numerator), int128_t(denominator));
+}
+
+int MetaDExPrice::Compare(const MetaDExPrice& other) const
+{
+    if (denominator == other.denominator) {
+        return numerator < other.numerator ? -1 : (numerator > other.numerator ? 1 : 0);
+    }
+
+    // a/b <=> c/d is a*d <=> c*b for positive denominators
+    uint64_t lhsHi, lhsLo, rhsHi, rhsLo;
+    Multiply(numerator, other.denominator, lhsHi, lhsLo);
+    Multiply(other.numerator, denominator, rhsHi, rhsLo);
+
+    if (lhsHi != rhsHi) return lhsHi < rhsHi ? -1 : 1;
+    if (lhsLo != rhsLo) return lhsLo < rhsLo ? -1 : 1;
+    return 0;
+}
+
+MetaDExPrice GetUnitPrice(const CMPMetaDEx& order)
+{
+    if (!order.getAmountForSale()) return MetaDExPrice();
+    return MetaDExPrice(order.getAmountDesired(), order.getAmountForSale());
+}
+
+MetaDExPrice GetInversePrice(const CMPMetaDEx& order)
+{
+    if (!order.getAmountDesired()) return MetaDExPrice();
+    return MetaDExPrice(order.getAmountForSale(), order.getAmountDesired());
+}
+
+MetaDExOrderBook::TxidHasher::TxidHasher()
+    : k0(GetRand(std::numeric_limits<uint64_t>::max())), k1(GetRand(std::numeric_limits<uint64_t>::max()))
+{
+}
+
+size_t MetaDExOrderBook::TxidHasher::operator()(const uint256& txid) const
+{
+    return SipHashUint256(k0, k1, txid);
+}
+
+void MetaDExOrderBook::Insert(md_Set& set, md_Set::iterator it)
+{
+    Levels& levels = pairs[PairKey(it->getProperty(), it->getDesProperty())];
+    const MetaDExPrice price = GetUnitPrice(*it);
+
+    Levels::iterator levelIt = std::lower_bound(levels.begin(), levels.end(), price, LevelPriceLess);
+    if (levelIt == levels.end() || levelIt->price != price) {
+        levelIt = levels.insert(levelIt, Level(price, &set));
+    }
+    assert(levelIt->set == &set);
+
+    // orders usually arrive in block order and are appended
+    std::deque<md_Set::iterator>& orders = levelIt->orders;
+    MetaDEx_compare compare;
+    if (orders.empty() || compare(*orders.back(), *it)) {
+        orders.push_back(it);
+    } else {
+        orders.insert(FindEntry(*levelIt, *it), it);
+    }
+
+    ids[it->getHash()] = it;
+}
+
+void MetaDExOrderBook::Erase(md_Set::iterator it)
+{
+    Levels* levels = GetLevels(it->getProperty(), it->getDesProperty());
+    assert(levels);
+    Level* level = FindLevel(*levels, GetUnitPrice(*it));
+    assert(level);
+
+    std::deque<md_Set::iterator>::iterator entry = FindEntry(*level, *it);
+    assert(entry != level->orders.end() && *entry == it);
+    level->orders.erase(entry);
+    ids.erase(it->getHash());
+
+    PruneLevels(it->getProperty(), it->getDesProperty());
+}
+
+void MetaDExOrderBook::EraseAt(Level& level, size_t nPos)
+{
+    assert(nPos < level.orders.size());
+    ids.erase(level.orders[nPos]->getHash());
+    level.orders.erase(level.orders.begin() + nPos);
+}
+
+void MetaDExOrderBook::ReplaceAt(Level& level, size_t nPos, md_Set::iterator it)
+{
+    assert(nPos < level.orders.size());
+    level.orders[nPos] = it;
+    ids[it->getHash()] = it;
+}
+
+MetaDExOrderBook::Levels* MetaDExOrderBook::GetLevels(uint32_t propertyForSale, uint32_t propertyDesired)
+{
+    std::unordered_map<uint64_t, Levels>::iterator it = pairs.find(PairKey(propertyForSale, propertyDesired));
+    if (it == pairs.end()) return nullptr;
+    return &it->second;
+}
+
+void MetaDExOrderBook::PruneLevels(uint32_t propertyForSale, uint32_t propertyDesired)
+{
+    std::unordered_map<uint64_t, Levels>::iterator it = pairs.find(PairKey(propertyForSale, propertyDesired));
+    if (it == pairs.end()) return;
+
+    Levels& levels = it->second;
+    levels.erase(std::remove_if(levels.begin(), levels.end(), [](const Level& level) { return level.orders.empty(); }), levels.end());
+    if (levels.empty()) pairs.erase(it);
+}
+
+MetaDExOrderBook::Level* MetaDExOrderBook::FindLevel(Levels& levels, const MetaDExPrice& price)
+{
+    Levels::iterator it = std::lower_bound(levels.begin(), levels.end(), price, LevelPriceLess);
+    if (it == levels.end() || it->price != price) return nullptr;
+    return &(*it);
+}
+
+const CMPMetaDEx* MetaDExOrderBook::Find(const uint256& txid) const
+{
+    TxidIndex::const_iterator it = ids.find(txid);
+    if (it == ids.end()) return nullptr;
+    return &(*it->second);
+}
+
+void MetaDExOrderBook::Clear()
+{
+    pairs.clear();
+    ids.clear();
+}
+
+std::deque<md_Set::iterator>::iterator MetaDExOrderBook::FindEntry(Level& level, const CMPMetaDEx& order)
+{
+    MetaDEx_compare compare;
+    return std::lower_bound(level.orders.begin(), level.orders.end(), order,
+            [&compare](const md_Set::iterator& entry, const CMPMetaDEx& order) { return compare(*entry, order); });
+}
+
+} // namespace elysium
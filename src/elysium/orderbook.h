@@ -0,0 +1,127 @@
+#ifndef ELYSIUM_ORDERBOOK_H
+#define ELYSIUM_ORDERBOOK_H
+
+#include "mdex.h"
+
+#include "../uint256.h"
+
+#include <deque>
+#include <unordered_map>
+#include <vector>
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace elysium {
+
+/**
+ * A price as a fraction of two positive amounts, reduced to lowest terms.
+ *
+ * Equal fractions have the same representation, like rational_t, and prices are compared exactly
+ * by cross multiplying into 128 bits, so ordering by MetaDExPrice is the same as by rational_t.
+ */
+class MetaDExPrice
+{
+public:
+    MetaDExPrice() : numerator(0), denominator(1) {}
+    MetaDExPrice(int64_t numerator, int64_t denominator);
+
+    uint64_t GetNumerator() const { return numerator; }
+    uint64_t GetDenominator() const { return denominator; }
+
+    rational_t ToRational() const;
+
+    int Compare(const MetaDExPrice& other) const;
+
+    bool operator==(const MetaDExPrice& other) const { return numerator == other.numerator && denominator == other.denominator; }
+    bool operator!=(const MetaDExPrice& other) const { return !(*this == other); }
+    bool operator<(const MetaDExPrice& other) const { return Compare(other) < 0; }
+    bool operator<=(const MetaDExPrice& other) const { return Compare(other) <= 0; }
+    bool operator>(const MetaDExPrice& other) const { return Compare(other) > 0; }
+    bool operator>=(const MetaDExPrice& other) const { return Compare(other) >= 0; }
+
+private:
+    uint64_t numerator;
+    uint64_t denominator;
+};
+
+/** The unit price of an order, amount desired per unit for sale */
+MetaDExPrice GetUnitPrice(const CMPMetaDEx& order);
+/** The inverse price of an order, amount for sale per unit desired */
+MetaDExPrice GetInversePrice(const CMPMetaDEx& order);
+
+/**
+ * Index of the open MetaDEx orders used for matching.
+ *
+ * The orders themselves stay in the global metadex map, the book refers to them by iterator. Orders
+ * are grouped by pair, so matching only looks at orders which want the property offered. The price
+ * levels of a pair are kept in a sorted vector, and each level holds its orders oldest first, the
+ * order of md_Set. Orders can also be looked up by txid.
+ *
+ * Walking the levels of a pair in order visits the matching orders in the same order as walking
+ * the prices of the property for sale in metadex, so matching through the book trades the same.
+ */
+class MetaDExOrderBook
+{
+public:
+    /** The orders of a pair at one price, oldest first */
+    struct Level
+    {
+        MetaDExPrice price;
+        // the orders of the property for sale at this price in metadex
+        md_Set* set;
+        std::deque<md_Set::iterator> orders;
+
+        Level(const MetaDExPrice& price, md_Set* set) : price(price), set(set) {}
+    };
+
+    /** The price levels of a pair, by ascending unit price */
+    typedef std::vector<Level> Levels;
+
+    /** Add an order, which was inserted into set */
+    void Insert(md_Set& set, md_Set::iterator it);
+    /** Remove an order, before it's erased from its set */
+    void Erase(md_Set::iterator it);
+
+    /** Remove the order at a position of a level, before it's erased from its set, the level is kept */
+    void EraseAt(Level& level, size_t nPos);
+    /** Point the position of a level to the updated copy of an order, which replaced it in its set */
+    void ReplaceAt(Level& level, size_t nPos, md_Set::iterator it);
+
+    /** The price levels of the orders selling propertyForSale for propertyDesired, nullptr if there are none */
+    Levels* GetLevels(uint32_t propertyForSale, uint32_t propertyDesired);
+    /** Drop the levels of a pair which have no orders left */
+    void PruneLevels(uint32_t propertyForSale, uint32_t propertyDesired);
+
+    /** Level holding the given price, nullptr if there is none */
+    Level* FindLevel(Levels& levels, const MetaDExPrice& price);
+
+    /** The open order with the given txid, nullptr if there is none */
+    const CMPMetaDEx* Find(const uint256& txid) const;
+
+    size_t Size() const { return ids.size(); }
+    void Clear();
+
+private:
+    /** Salted hash of a txid, so peers can't pick txids which collide in the index */
+    class TxidHasher
+    {
+    public:
+        TxidHasher();
+        size_t operator()(const uint256& txid) const;
+
+    private:
+        uint64_t k0, k1;
+    };
+
+    typedef std::unordered_map<uint256, md_Set::iterator, TxidHasher> TxidIndex;
+
+    std::unordered_map<uint64_t, Levels> pairs;
+    TxidIndex ids;
+
+    std::deque<md_Set::iterator>::iterator FindEntry(Level& level, const CMPMetaDEx& order);
+};
+
+} // namespace elysium
+
+#endif // ELYSIUM_ORDERBOOK_H
@@ -55,7 +55,14 @@ const CBitcoinAddress& GetSystemAddress()
     return isNonMainNet() ? testAddress : mainAddress;
 }
 
-boost::optional<PacketClass> DeterminePacketClass(const CTransaction& tx, int height)
+namespace {
+
+/**
+ * Determines the packet class from the outputs of a transaction, only outputs for which isAllowed
+ * returns true are inspected.
+ */
+template<typename Allowed>
+boost::optional<PacketClass> InspectOutputs(const CTransaction& tx, Allowed isAllowed)
 {
     // Inspect all outputs.
     auto& sysAddr = GetSystemAddress();
@@ -70,7 +77,7 @@ boost::optional<PacketClass> DeterminePacketClass(const CTransaction& tx, int he
             continue;
         }
 
-        if (!IsAllowedOutputType(type, height)) {
+        if (!isAllowed(type)) {
             continue;
         }
 
@@ -106,6 +113,18 @@ boost::optional<PacketClass> DeterminePacketClass(const CTransaction& tx, int he
     return boost::none;
 }
 
+} // namespace
+
+boost::optional<PacketClass> DeterminePacketClass(const CTransaction& tx, int height)
+{
+    return InspectOutputs(tx, [height](txnouttype type) { return IsAllowedOutputType(type, height); });
+}
+
+bool HasPacketMarker(const CTransaction& tx)
+{
+    return InspectOutputs(tx, [](txnouttype) { return true; }) != boost::none;
+}
+
 } // namespace elysium
 
 namespace std {
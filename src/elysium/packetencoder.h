@@ -137,6 +137,12 @@ extern const std::array<unsigned char, 6> magic;
 const CBitcoinAddress& GetSystemAddress();
 boost::optional<PacketClass> DeterminePacketClass(const CTransaction& tx, int height);
 
+/**
+ * Checks whether a transaction carries an Elysium marker, regardless of the output types allowed at
+ * any particular height. True for every transaction DeterminePacketClass() assigns a class to.
+ **/
+bool HasPacketMarker(const CTransaction& tx);
+
 /**
  * Embedds a payload in obfuscated multisig outputs, then adds P2PKH output to system address.
  *
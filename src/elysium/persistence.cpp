@@ -1,7 +1,9 @@
 #include "elysium/persistence.h"
 
+#include "elysium/convert.h"
 #include "elysium/log.h"
 
+#include "tinyformat.h"
 #include "util.h"
 
 #include "leveldb/db.h"
@@ -9,7 +11,46 @@
 
 #include <boost/filesystem/path.hpp>
 
+#include <algorithm>
+#include <string>
+#include <vector>
+
 #include <stdint.h>
+#include <string.h>
+
+IndexKey& IndexKey::operator<<(uint32_t n)
+{
+    elysium::swapByteOrder(n);
+    key.append(reinterpret_cast<const char*>(&n), sizeof(n));
+    return *this;
+}
+
+IndexKey& IndexKey::operator<<(const uint256& hash)
+{
+    key.append(reinterpret_cast<const char*>(hash.begin()), hash.size());
+    return *this;
+}
+
+IndexKey& IndexKey::operator<<(const std::string& str)
+{
+    key.push_back(static_cast<char>(std::min<size_t>(str.size(), 0xff)));
+    key.append(str);
+    return *this;
+}
+
+bool IsIndexKey(const leveldb::Slice& key)
+{
+    return !key.empty() && static_cast<uint8_t>(key[0]) <= static_cast<uint8_t>(IndexKeyType::Address);
+}
+
+uint32_t ReadIndexNumber(const leveldb::Slice& key, size_t pos)
+{
+    assert(key.size() >= pos + sizeof(uint32_t));
+    uint32_t n;
+    memcpy(&n, key.data() + pos, sizeof(n));
+    elysium::swapByteOrder(n);
+    return n;
+}
 
 /**
  * Opens or creates a LevelDB based database.
@@ -64,6 +105,78 @@ void CDBBase::Close()
     }
 }
 
+/**
+ * Adds a record and its index entries to a batch.
+ */
+void CDBBase::WriteRecord(leveldb::WriteBatch& batch, const std::string& key, const std::string& value) const
+{
+    std::vector<std::string> indexKeys;
+    GetIndexKeys(key, value, indexKeys);
+    for (const std::string& indexKey : indexKeys) {
+        batch.Put(indexKey, leveldb::Slice());
+    }
+    batch.Put(key, value);
+}
+
+/**
+ * Adds the deletion of a record and its index entries to a batch.
+ */
+void CDBBase::EraseRecord(leveldb::WriteBatch& batch, const std::string& key) const
+{
+    std::string value;
+    if (pdb->Get(readoptions, key, &value).ok()) {
+        std::vector<std::string> indexKeys;
+        GetIndexKeys(key, value, indexKeys);
+        for (const std::string& indexKey : indexKeys) {
+            batch.Delete(indexKey);
+        }
+    }
+    batch.Delete(key);
+}
+
+/**
+ * Rebuilds the index entries from the records, if they were built for another index version.
+ */
+bool CDBBase::UpgradeIndex(int version)
+{
+    const std::string versionKey = IndexKey(IndexKeyType::Version).str();
+    const std::string versionValue = strprintf("%d", version);
+
+    std::string strValue;
+    if (pdb->Get(readoptions, versionKey, &strValue).ok() && strValue == versionValue) {
+        return false;
+    }
+
+    int64_t nTimeStart = GetTimeMicros();
+    unsigned int nRecords = 0;
+    leveldb::WriteBatch batch;
+    leveldb::Iterator* it = NewIterator();
+
+    // index entries sort before the records, drop the outdated ones and index the records after them
+    for (it->SeekToFirst(); it->Valid() && IsIndexKey(it->key()); it->Next()) {
+        batch.Delete(it->key());
+    }
+    for (; it->Valid(); it->Next()) {
+        std::vector<std::string> indexKeys;
+        GetIndexKeys(it->key().ToString(), it->value().ToString(), indexKeys);
+        for (const std::string& indexKey : indexKeys) {
+            batch.Put(indexKey, leveldb::Slice());
+        }
+        ++nRecords;
+    }
+
+    delete it;
+
+    batch.Put(versionKey, versionValue);
+    leveldb::Status status = pdb->Write(syncoptions, &batch);
+
+    int64_t nTime = GetTimeMicros() - nTimeStart;
+    PrintToLog("Rebuilt index of %d records (version %s -> %d): %s [%.3f ms total]\n",
+        nRecords, strValue.empty() ? "none" : strValue, version, status.ToString(), 0.001 * nTime);
+
+    return true;
+}
+
 
 /**
 @todo  Move initialization and deinitialization of databases into this file (?)
@@ -1,12 +1,65 @@
 #ifndef ELYSIUM_PERSISTENCE_H
 #define ELYSIUM_PERSISTENCE_H
 
+#include "uint256.h"
+
 #include "leveldb/db.h"
+#include "leveldb/write_batch.h"
 
 #include <boost/filesystem/path.hpp>
 
+#include <string>
+#include <vector>
+
 #include <assert.h>
 #include <stddef.h>
+#include <stdint.h>
+
+/** Types of the secondary index entries, which are stored next to the records they point to.
+ */
+enum class IndexKeyType : uint8_t
+{
+    Version = 0,
+    Height = 1,
+    Txid = 2,
+    PropertyPair = 3,
+    Address = 4
+};
+
+/** Key of a secondary index entry.
+ *
+ * Records are keyed by txids and addresses, which never start with the type byte, so all index
+ * entries sort before the records. Numbers are stored big-endian, so that a range of heights, or
+ * all entries of an address or property pair, can be read with a single range scan. The key of
+ * the record an entry points to ends the key of the entry.
+ */
+class IndexKey
+{
+private:
+    std::string key;
+
+public:
+    explicit IndexKey(IndexKeyType type) : key(1, static_cast<char>(type)) {}
+
+    IndexKey& operator<<(uint32_t n);
+    IndexKey& operator<<(const uint256& hash);
+    /** Strings are prefixed by their length, so that no string shorter than 255 bytes is a prefix of another one */
+    IndexKey& operator<<(const std::string& str);
+
+    /** Returns the key of the entry pointing to a record */
+    std::string Entry(const std::string& recordKey) const { return key + recordKey; }
+
+    bool IsPrefixOf(const leveldb::Slice& slice) const { return slice.starts_with(key); }
+
+    const std::string& str() const { return key; }
+    size_t size() const { return key.size(); }
+};
+
+/** Whether a key is the key of an index entry, rather than of a record */
+bool IsIndexKey(const leveldb::Slice& key);
+
+/** Reads a number stored by IndexKey at a position of a key */
+uint32_t ReadIndexNumber(const leveldb::Slice& key, size_t pos);
 
 /** Base class for LevelDB based storage.
  */
@@ -86,7 +139,32 @@ protected:
      */
     void Close();
 
+    /**
+     * Returns the keys of the index entries of a record.
+     *
+     * Databases with secondary indexes override this, the records of other databases are not indexed.
+     */
+    virtual void GetIndexKeys(const std::string& key, const std::string& value, std::vector<std::string>& indexKeys) const {}
+
+    /**
+     * Adds a record and its index entries to a batch.
+     */
+    void WriteRecord(leveldb::WriteBatch& batch, const std::string& key, const std::string& value) const;
+
+    /**
+     * Adds the deletion of a record and its index entries to a batch.
+     */
+    void EraseRecord(leveldb::WriteBatch& batch, const std::string& key) const;
+
 public:
+    /**
+     * Rebuilds the index entries from the records, if they were built for another index version.
+     *
+     * @param version  The current index version
+     * @return True, if the index was rebuilt
+     */
+    bool UpgradeIndex(int version);
+
     /**
      * Deletes all entries of the database, and resets the counters.
      */
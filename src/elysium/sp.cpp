@@ -1,5 +1,6 @@
 #include "sp.h"
 
+#include "consensushash.h"
 #include "log.h"
 #include "elysium.h"
 #include "packetencoder.h"
@@ -150,10 +151,20 @@ bool CMPSPInfo::updateSP(uint32_t propertyId, const Entry& info)
 
     leveldb::WriteBatch batch;
     std::string strSpPrevValue;
+    std::string strIssuerBefore;
 
     // if a value exists move it to the old key
     if (!pdb->Get(readoptions, slSpKey, &strSpPrevValue).IsNotFound()) {
         batch.Put(slSpPrevKey, strSpPrevValue);
+
+        Entry prev;
+        try {
+            CDataStream ssValue(strSpPrevValue.data(), strSpPrevValue.data() + strSpPrevValue.size(), SER_DISK, CLIENT_VERSION);
+            ssValue >> prev;
+            if (IsStateChecksumEnabled()) strIssuerBefore = GenerateConsensusString(propertyId, prev.issuer);
+        } catch (const std::exception& e) {
+            PrintToLog("%s(): ERROR: %s\n", __func__, e.what());
+        }
     }
     batch.Put(slSpKey, slSpValue);
     leveldb::Status status = pdb->Write(syncoptions, &batch);
@@ -163,6 +174,8 @@ bool CMPSPInfo::updateSP(uint32_t propertyId, const Entry& info)
         return false;
     }
 
+    if (IsStateChecksumEnabled()) UpdateStateChecksum(StateComponent::Properties, strIssuerBefore, GenerateConsensusString(propertyId, info.issuer));
+
     PrintToLog("%s(): updated entry for SP %d successfully\n", __func__, propertyId);
     return true;
 }
@@ -222,6 +235,8 @@ uint32_t CMPSPInfo::putSP(uint8_t ecosystem, const Entry& info)
 
     if (!status.ok()) {
         PrintToLog("%s(): ERROR for SP %d: %s\n", __func__, propertyId, status.ToString());
+    } else if (propertyId > 0) {
+        if (IsStateChecksumEnabled()) AddToStateChecksum(StateComponent::Properties, GenerateConsensusString(propertyId, info.issuer));
     }
 
     return propertyId;
@@ -575,44 +590,6 @@ void CMPCrowd::print(const std::string& address, FILE* fp) const
     fprintf(fp, "%s\n", toString(address).c_str());
 }
 
-void CMPCrowd::saveCrowdSale(std::ofstream& file, SHA256_CTX* shaCtx, const std::string& addr) const
-{
-    // compose the outputline
-    // addr,propertyId,nValue,property_desired,deadline,early_bird,percentage,created,mined
-    std::string lineOut = strprintf("%s,%d,%d,%d,%d,%d,%d,%d,%d",
-            addr,
-            propertyId,
-            nValue,
-            property_desired,
-            deadline,
-            early_bird,
-            percentage,
-            u_created,
-            i_created);
-
-    // append N pairs of address=nValue;blockTime for the database
-    std::map<uint256, std::vector<int64_t> >::const_iterator iter;
-    for (iter = txFundraiserData.begin(); iter != txFundraiserData.end(); ++iter) {
-        lineOut.append(strprintf(",%s=", (*iter).first.GetHex()));
-        std::vector<int64_t> const &vals = (*iter).second;
-
-        std::vector<int64_t>::const_iterator valIter;
-        for (valIter = vals.begin(); valIter != vals.end(); ++valIter) {
-            if (valIter != vals.begin()) {
-                lineOut.append(";");
-            }
-
-            lineOut.append(strprintf("%d", *valIter));
-        }
-    }
-
-    // add the line to the hash
-    SHA256_Update(shaCtx, lineOut.c_str(), lineOut.length());
-
-    // write the line
-    file << lineOut << std::endl;
-}
-
 CMPCrowd* elysium::getCrowd(const std::string& address)
 {
     CrowdMap::iterator my_it = my_crowds.find(address);
@@ -949,6 +926,7 @@ void elysium::eraseMaxedCrowdsale(const std::string& address, int64_t blockTime,
         assert(_my_sps->updateSP(crowdsale.getPropertyId(), sp));
 
         // no calculate fractional calls here, no more tokens (at MAX)
+        if (IsStateChecksumEnabled()) RemoveFromStateChecksum(StateComponent::Crowdsales, GenerateConsensusString(crowdsale));
         my_crowds.erase(it);
     }
 }
@@ -995,6 +973,7 @@ unsigned int elysium::eraseExpiredCrowdsale(const CBlockIndex* pBlockIndex)
                 assert(update_tally_map(sp.issuer, crowdsale.getPropertyId(), missedTokens, BALANCE));
             }
 
+            if (IsStateChecksumEnabled()) RemoveFromStateChecksum(StateComponent::Crowdsales, GenerateConsensusString(crowdsale));
             my_crowds.erase(my_it++);
 
             ++how_many_erased;
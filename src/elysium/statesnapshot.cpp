@@ -0,0 +1,357 @@
+#include "statesnapshot.h"
+
+#include "elysium.h"
+#include "log.h"
+
+#include "../clientversion.h"
+#include "../hash.h"
+#include "../libzerocoin/ParallelTasks.h"
+#include "../streams.h"
+#include "../util.h"
+#include "../utiltime.h"
+
+#include <boost/bind.hpp>
+#include <boost/filesystem.hpp>
+
+#include <exception>
+#include <stdexcept>
+#include <vector>
+
+#include <stdio.h>
+#include <string.h>
+
+namespace elysium {
+
+namespace {
+
+const char SNAPSHOT_MAGIC[4] = {'e', 'l', 'y', 's'};
+
+/** Location of a section within a snapshot file that was read into memory */
+struct SectionRef
+{
+    size_t offset;
+    size_t size;
+    uint256 checksum;
+    bool fValid;
+
+    SectionRef() : offset(0), size(0), fValid(false) {}
+};
+
+size_t CountOrders(const md_PropertiesMap& orderbook)
+{
+    size_t nOrders = 0;
+    for (md_PropertiesMap::const_iterator my_it = orderbook.begin(); my_it != orderbook.end(); ++my_it) {
+        const md_PricesMap& prices = my_it->second;
+        for (md_PricesMap::const_iterator it = prices.begin(); it != prices.end(); ++it) {
+            nOrders += it->second.size();
+        }
+    }
+    return nOrders;
+}
+
+void WriteSection(CDataStream& ss, int section, const StateSnapshot& snapshot)
+{
+    switch (section) {
+        case FILETYPE_BALANCES:
+            ss << snapshot.tallies;
+            break;
+        case FILETYPE_OFFERS:
+            ss << snapshot.offers;
+            break;
+        case FILETYPE_ACCEPTS:
+            ss << snapshot.accepts;
+            break;
+        case FILETYPE_GLOBALS:
+            ss << snapshot.elysiumPrev << snapshot.nextSPID << snapshot.nextTestSPID;
+            break;
+        case FILETYPE_CROWDSALES:
+            ss << snapshot.crowds;
+            break;
+        case FILETYPE_MDEXORDERS:
+        {
+            WriteCompactSize(ss, CountOrders(snapshot.metadex));
+            for (md_PropertiesMap::const_iterator my_it = snapshot.metadex.begin(); my_it != snapshot.metadex.end(); ++my_it) {
+                const md_PricesMap& prices = my_it->second;
+                for (md_PricesMap::const_iterator it = prices.begin(); it != prices.end(); ++it) {
+                    const md_Set& indexes = it->second;
+                    for (md_Set::const_iterator it = indexes.begin(); it != indexes.end(); ++it) {
+                        ss << *it;
+                    }
+                }
+            }
+            break;
+        }
+    }
+}
+
+void ReadSection(CDataStream& ss, int section, StateSnapshot& snapshot)
+{
+    switch (section) {
+        case FILETYPE_BALANCES:
+            ss >> snapshot.tallies;
+            break;
+        case FILETYPE_OFFERS:
+            ss >> snapshot.offers;
+            break;
+        case FILETYPE_ACCEPTS:
+            ss >> snapshot.accepts;
+            break;
+        case FILETYPE_GLOBALS:
+            ss >> snapshot.elysiumPrev >> snapshot.nextSPID >> snapshot.nextTestSPID;
+            break;
+        case FILETYPE_CROWDSALES:
+            ss >> snapshot.crowds;
+            break;
+        case FILETYPE_MDEXORDERS:
+        {
+            uint64_t nOrders = ReadCompactSize(ss);
+            for (uint64_t i = 0; i < nOrders; ++i) {
+                CMPMetaDEx order;
+                ss >> order;
+                if (!snapshot.metadex[order.getProperty()][order.unitPrice()].insert(order).second) {
+                    throw std::runtime_error("duplicate MetaDEx order");
+                }
+            }
+            break;
+        }
+    }
+
+    if (!ss.empty()) {
+        throw std::runtime_error("unexpected data at the end of the section");
+    }
+}
+
+/** Checks and decodes a section, run on one of the loading threads */
+void LoadSection(const std::vector<char>& data, const SectionRef& ref, int section, StateSnapshot& snapshot, bool& fLoaded)
+{
+    fLoaded = false;
+
+    const char* begin = data.data() + ref.offset;
+    const char* end = begin + ref.size;
+    if (Hash(begin, end) != ref.checksum) {
+        PrintToLog("%s(): checksum mismatch in section %d\n", __func__, section);
+        return;
+    }
+
+    try {
+        CDataStream ss(begin, end, SER_DISK, CLIENT_VERSION);
+        ReadSection(ss, section, snapshot);
+    } catch (const std::exception& e) {
+        PrintToLog("%s(): failed to decode section %d: %s\n", __func__, section, e.what());
+        return;
+    }
+
+    fLoaded = true;
+}
+
+} // namespace
+
+bool WriteSnapshot(const boost::filesystem::path& path, const StateSnapshot& snapshot)
+{
+    boost::filesystem::path pathTmp = path;
+    pathTmp += ".tmp";
+
+    FILE* file = fopen(pathTmp.string().c_str(), "wb");
+    CAutoFile fileout(file, SER_DISK, CLIENT_VERSION);
+    if (fileout.IsNull()) {
+        PrintToLog("%s(): failed to open %s\n", __func__, pathTmp.string());
+        return false;
+    }
+
+    try {
+        fileout.write(SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC));
+        fileout << SNAPSHOT_VERSION << snapshot.blockHash;
+        WriteCompactSize(fileout, NUM_FILETYPES);
+
+        for (int section = 0; section < NUM_FILETYPES; ++section) {
+            CDataStream ss(SER_DISK, CLIENT_VERSION);
+            WriteSection(ss, section, snapshot);
+
+            fileout << static_cast<uint8_t>(section);
+            WriteCompactSize(fileout, ss.size());
+            fileout.write(&ss[0], ss.size());
+            fileout << Hash(ss.begin(), ss.end());
+        }
+
+        FileCommit(fileout.Get());
+    } catch (const std::exception& e) {
+        PrintToLog("%s(): failed to write %s: %s\n", __func__, pathTmp.string(), e.what());
+        fileout.fclose();
+        boost::filesystem::remove(pathTmp);
+        return false;
+    }
+    fileout.fclose();
+
+    boost::system::error_code ec;
+    boost::filesystem::rename(pathTmp, path, ec);
+    if (ec) {
+        PrintToLog("%s(): failed to rename %s: %s\n", __func__, pathTmp.string(), ec.message());
+        return false;
+    }
+
+    return true;
+}
+
+bool ReadSnapshot(const boost::filesystem::path& path, const uint256& blockHash, StateSnapshot& snapshot)
+{
+    std::vector<char> data;
+    {
+        FILE* file = fopen(path.string().c_str(), "rb");
+        if (!file) {
+            return false;
+        }
+
+        fseek(file, 0, SEEK_END);
+        long nSize = ftell(file);
+        fseek(file, 0, SEEK_SET);
+        if (nSize > 0) {
+            data.resize(nSize);
+            if (fread(data.data(), 1, data.size(), file) != data.size()) {
+                data.clear();
+            }
+        }
+        fclose(file);
+    }
+
+    SectionRef sections[NUM_FILETYPES];
+
+    try {
+        CDataStream ss(data.data(), data.data() + data.size(), SER_DISK, CLIENT_VERSION);
+
+        char magic[sizeof(SNAPSHOT_MAGIC)];
+        uint32_t nVersion = 0;
+        ss.read(magic, sizeof(magic));
+        ss >> nVersion;
+        if (memcmp(magic, SNAPSHOT_MAGIC, sizeof(magic)) != 0 || nVersion != SNAPSHOT_VERSION) {
+            PrintToLog("%s(): %s is not a snapshot of version %d\n", __func__, path.string(), SNAPSHOT_VERSION);
+            return false;
+        }
+
+        ss >> snapshot.blockHash;
+        if (snapshot.blockHash != blockHash) {
+            PrintToLog("%s(): %s is a snapshot of block %s\n", __func__, path.string(), snapshot.blockHash.GetHex());
+            return false;
+        }
+
+        uint64_t nSections = ReadCompactSize(ss);
+        if (nSections != NUM_FILETYPES) {
+            PrintToLog("%s(): %s has %d sections\n", __func__, path.string(), nSections);
+            return false;
+        }
+
+        for (uint64_t i = 0; i < nSections; ++i) {
+            uint8_t section;
+            ss >> section;
+            if (section >= NUM_FILETYPES || sections[section].fValid) {
+                PrintToLog("%s(): %s has an unexpected section %d\n", __func__, path.string(), section);
+                return false;
+            }
+
+            SectionRef& ref = sections[section];
+            ref.size = ReadCompactSize(ss);
+            if (ref.size > ss.size()) {
+                throw std::runtime_error("section exceeds the file");
+            }
+            ref.offset = data.size() - ss.size();
+            ss.ignore(static_cast<int>(ref.size));
+            ss >> ref.checksum;
+            ref.fValid = true;
+        }
+    } catch (const std::exception& e) {
+        PrintToLog("%s(): failed to read %s: %s\n", __func__, path.string(), e.what());
+        return false;
+    }
+
+    // each section is decoded into its own part of the snapshot, the tasks are waited for on any exit
+    bool fLoaded[NUM_FILETYPES];
+    libzerocoin::ParallelTasks tasks(NUM_FILETYPES);
+    for (int section = 0; section < NUM_FILETYPES; ++section) {
+        tasks.Add([&data, &sections, section, &snapshot, &fLoaded]() {
+            LoadSection(data, sections[section], section, snapshot, fLoaded[section]);
+        });
+    }
+    tasks.Wait();
+
+    for (int section = 0; section < NUM_FILETYPES; ++section) {
+        if (!fLoaded[section]) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+SnapshotWriter::SnapshotWriter() : fWriting(false), fStop(false)
+{
+    thread = boost::thread(boost::bind(&SnapshotWriter::ThreadWrite, this));
+}
+
+SnapshotWriter::~SnapshotWriter()
+{
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        fStop = true;
+    }
+    condPending.notify_all();
+    thread.join();
+}
+
+void SnapshotWriter::Schedule(std::unique_ptr<StateSnapshot> snapshot, const boost::filesystem::path& path)
+{
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        if (pending) {
+            PrintToLog("%s(): snapshot of block %s wasn't written yet, replacing it\n", __func__, pending->blockHash.GetHex());
+        }
+        pending = std::move(snapshot);
+        pendingPath = path;
+    }
+    condPending.notify_all();
+}
+
+void SnapshotWriter::Flush()
+{
+    boost::unique_lock<boost::mutex> lock(mutex);
+    while (pending || fWriting) {
+        condIdle.wait(lock);
+    }
+}
+
+void SnapshotWriter::ThreadWrite()
+{
+    RenameThread("elysium-snapshot");
+
+    while (true) {
+        std::unique_ptr<StateSnapshot> snapshot;
+        boost::filesystem::path path;
+        {
+            boost::unique_lock<boost::mutex> lock(mutex);
+            while (!fStop && !pending) {
+                condPending.wait(lock);
+            }
+            // a snapshot scheduled before the shutdown is still written
+            if (!pending) {
+                return;
+            }
+            snapshot = std::move(pending);
+            path = pendingPath;
+            fWriting = true;
+        }
+
+        int64_t nStart = GetTimeMillis();
+        bool fWritten = WriteSnapshot(path, *snapshot);
+        if (elysium_debug_persistence) {
+            PrintToLog("%s(): %s snapshot of block %s in %d ms\n", __func__, fWritten ? "wrote" : "failed to write",
+                    snapshot->blockHash.GetHex(), GetTimeMillis() - nStart);
+        }
+        snapshot.reset();
+
+        {
+            boost::unique_lock<boost::mutex> lock(mutex);
+            fWriting = false;
+        }
+        condIdle.notify_all();
+    }
+}
+
+} // namespace elysium
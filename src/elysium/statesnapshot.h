@@ -0,0 +1,99 @@
+#ifndef ELYSIUM_STATESNAPSHOT_H
+#define ELYSIUM_STATESNAPSHOT_H
+
+#include "dex.h"
+#include "mdex.h"
+#include "sp.h"
+#include "tally.h"
+
+#include "../uint256.h"
+
+#include <boost/filesystem/path.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <utility>
+
+#include <stdint.h>
+
+namespace elysium {
+
+/** Version of the snapshot format, snapshots of other versions are not loaded */
+static const uint32_t SNAPSHOT_VERSION = 1;
+/** Prefix of the snapshot file names, followed by the block hash */
+static const char SNAPSHOT_PREFIX[] = "snapshot";
+
+/** The in-memory state as of a block, which is persisted as a snapshot */
+struct StateSnapshot
+{
+    uint256 blockHash;
+
+    std::unordered_map<std::string, CMPTally> tallies;
+    OfferMap offers;
+    AcceptMap accepts;
+    CrowdMap crowds;
+    md_PropertiesMap metadex;
+
+    int64_t elysiumPrev;
+    uint32_t nextSPID;
+    uint32_t nextTestSPID;
+
+    StateSnapshot() : elysiumPrev(0), nextSPID(0), nextTestSPID(0) {}
+};
+
+/**
+ * Writes a snapshot to a file.
+ *
+ * The file starts with a header holding the format version and the block hash, followed by one
+ * section for each of the FILETYPE_* parts of the state. Each section is stored with its size and
+ * a hash of its content. The file is written under a temporary name and renamed when complete.
+ */
+bool WriteSnapshot(const boost::filesystem::path& path, const StateSnapshot& snapshot);
+
+/**
+ * Reads a snapshot of the given block from a file.
+ *
+ * The sections are checked and decoded in parallel. False if the file can't be read, is of another
+ * version or block, or if any section is corrupted.
+ */
+bool ReadSnapshot(const boost::filesystem::path& path, const uint256& blockHash, StateSnapshot& snapshot);
+
+/**
+ * Writes snapshots on a background thread.
+ *
+ * Taking a snapshot only copies the state, so blocks can be connected while it's written. If more
+ * snapshots are scheduled than the thread keeps up with, only the latest waiting one is written.
+ */
+class SnapshotWriter
+{
+public:
+    SnapshotWriter();
+    ~SnapshotWriter();
+
+    /** Queue a snapshot to be written to the given file */
+    void Schedule(std::unique_ptr<StateSnapshot> snapshot, const boost::filesystem::path& path);
+
+    /** Wait until the queued snapshot, if any, is written */
+    void Flush();
+
+private:
+    boost::mutex mutex;
+    boost::condition_variable condPending;
+    boost::condition_variable condIdle;
+    std::unique_ptr<StateSnapshot> pending;
+    boost::filesystem::path pendingPath;
+    bool fWriting;
+    bool fStop;
+
+    boost::thread thread;
+
+    void ThreadWrite();
+};
+
+} // namespace elysium
+
+#endif // ELYSIUM_STATESNAPSHOT_H
@@ -1,6 +1,8 @@
 #ifndef ELYSIUM_TALLY_H
 #define ELYSIUM_TALLY_H
 
+#include "../serialize.h"
+
 #include <stdint.h>
 #include <map>
 
@@ -60,6 +62,36 @@ public:
 
     /** Prints a balance record to the console. */
     int64_t print(uint32_t propertyId = 1, bool bDivisible = true) const;
+
+    /** Serializes the balance records, pending amounts are not persisted. */
+    template <typename Stream>
+    void Serialize(Stream& s, int nType, int nVersion) const
+    {
+        WriteCompactSize(s, mp_token.size());
+        for (TokenMap::const_iterator it = mp_token.begin(); it != mp_token.end(); ++it) {
+            ::Serialize(s, it->first, nType, nVersion);
+            for (int ttype = 0; ttype < TALLY_TYPE_COUNT; ++ttype) {
+                int64_t amount = (ttype == PENDING) ? 0 : it->second.balance[ttype];
+                ::Serialize(s, amount, nType, nVersion);
+            }
+        }
+    }
+
+    template <typename Stream>
+    void Unserialize(Stream& s, int nType, int nVersion)
+    {
+        mp_token.clear();
+        uint64_t nSize = ReadCompactSize(s);
+        for (uint64_t i = 0; i < nSize; ++i) {
+            uint32_t propertyId;
+            ::Unserialize(s, propertyId, nType, nVersion);
+            BalanceRecord& record = mp_token[propertyId];
+            for (int ttype = 0; ttype < TALLY_TYPE_COUNT; ++ttype) {
+                ::Unserialize(s, record.balance[ttype], nType, nVersion);
+            }
+        }
+        init();
+    }
 };
 
 
@@ -0,0 +1,140 @@
+#include "elysium/consensushash.h"
+#include "elysium/dex.h"
+#include "elysium/elysium.h"
+#include "elysium/log.h"
+#include "elysium/mdex.h"
+#include "elysium/sp.h"
+#include "elysium/tally.h"
+#include "elysium/test/utils_tx.h"
+
+#include "arith_uint256.h"
+#include "test/test_bitcoin.h"
+
+#include <string>
+
+#include <boost/test/unit_test.hpp>
+
+namespace elysium {
+namespace {
+
+struct StateChecksumFixture : ElysiumTestingSetup
+{
+    StateChecksumFixture()
+    {
+        // the running checksum is only maintained with one of the consensus hash debug options
+        elysium_debug_consensus_hash_every_block = true;
+    }
+
+    ~StateChecksumFixture()
+    {
+        elysium_debug_consensus_hash_every_block = false;
+    }
+};
+
+} // namespace
+
+BOOST_FIXTURE_TEST_SUITE(elysium_consensushash_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(state_accumulator_order)
+{
+    StateChecksum first, second;
+    BOOST_CHECK(first.GetSum() == second.GetSum());
+
+    first.Add("a|1|100|0|0|0");
+    first.Add("b|1|200|0|0|0");
+    first.Add("c|3|300|0|0|0");
+
+    second.Add("c|3|300|0|0|0");
+    second.Add("a|1|100|0|0|0");
+    second.Add("b|1|200|0|0|0");
+
+    BOOST_CHECK(first.GetSum() == second.GetSum());
+    BOOST_CHECK(first.GetSum() != arith_uint256(0));
+}
+
+BOOST_AUTO_TEST_CASE(state_accumulator_remove)
+{
+    StateChecksum accumulator, expected;
+    expected.Add("a|1|100|0|0|0");
+
+    accumulator.Add("a|1|100|0|0|0");
+    accumulator.Add("b|1|200|0|0|0");
+    BOOST_CHECK(accumulator.GetSum() != expected.GetSum());
+
+    accumulator.Remove("b|1|200|0|0|0");
+    BOOST_CHECK(accumulator.GetSum() == expected.GetSum());
+
+    accumulator.Remove("a|1|100|0|0|0");
+    BOOST_CHECK(accumulator.GetSum() == arith_uint256(0));
+}
+
+BOOST_AUTO_TEST_CASE(state_accumulator_empty_balance)
+{
+    CMPTally tally;
+    BOOST_CHECK(tally.updateMoney(3, 100, BALANCE));
+    BOOST_CHECK(tally.updateMoney(3, -100, BALANCE));
+    BOOST_CHECK(GenerateConsensusString(tally, "a", 3).empty());
+
+    StateChecksum accumulator;
+    accumulator.Add(GenerateConsensusString(tally, "a", 3));
+    BOOST_CHECK(accumulator.GetSum() == arith_uint256(0));
+}
+
+BOOST_FIXTURE_TEST_CASE(state_checksum_incremental, StateChecksumFixture)
+{
+    const std::string alice = "TSrs4fb8LgnMADmBQj1EbadKbUsiuv4Ddd";
+    const std::string bob = "TG2KNxtPzDxSGj5DTmzZqUNoFfk2zQq9Gk";
+
+    RebuildStateChecksum();
+    const uint256 initial = GetStateChecksum();
+    BOOST_CHECK(initial == CalculateStateChecksum());
+
+    // tallies, including a balance which is emptied again
+    BOOST_CHECK(update_tally_map(alice, 3, 1000, BALANCE));
+    BOOST_CHECK(update_tally_map(alice, 4, 700, BALANCE));
+    BOOST_CHECK(update_tally_map(bob, 3, 500, BALANCE));
+    BOOST_CHECK(update_tally_map(bob, ELYSIUM_PROPERTY_ELYSIUM, 10000, BALANCE));
+    BOOST_CHECK(update_tally_map(alice, 3, -1000, BALANCE));
+    BOOST_CHECK(GetStateChecksum() != initial);
+    BOOST_CHECK(GetStateChecksum() == CalculateStateChecksum());
+
+    // DEx offer, accept, partial payment and cancellation
+    BOOST_CHECK_EQUAL(DEx_offerCreate(bob, ELYSIUM_PROPERTY_ELYSIUM, 4000, 100, 20000, 0, 10, Txid(1), nullptr), 0);
+    BOOST_CHECK(GetStateChecksum() == CalculateStateChecksum());
+    BOOST_CHECK_EQUAL(DEx_acceptCreate(alice, bob, ELYSIUM_PROPERTY_ELYSIUM, 1000, 101, 0, nullptr), 0);
+    BOOST_CHECK(GetStateChecksum() == CalculateStateChecksum());
+    BOOST_CHECK_EQUAL(DEx_payment(Txid(2), 1, bob, alice, 2500, 102, nullptr), 0);
+    BOOST_CHECK(GetStateChecksum() == CalculateStateChecksum());
+    BOOST_CHECK_EQUAL(DEx_acceptDestroy(alice, bob, ELYSIUM_PROPERTY_ELYSIUM, true), 0);
+    BOOST_CHECK(GetStateChecksum() == CalculateStateChecksum());
+    BOOST_CHECK_EQUAL(DEx_offerDestroy(bob, ELYSIUM_PROPERTY_ELYSIUM), 0);
+    BOOST_CHECK(GetStateChecksum() == CalculateStateChecksum());
+
+    // MetaDEx orders, a partial fill and a cancellation
+    BOOST_CHECK_EQUAL(MetaDEx_ADD(alice, 4, 300, 103, 3, 600, Txid(3), 0), 0);
+    BOOST_CHECK(GetStateChecksum() == CalculateStateChecksum());
+    BOOST_CHECK_EQUAL(MetaDEx_ADD(bob, 3, 200, 104, 4, 100, Txid(4), 0), 0);
+    BOOST_CHECK(MetaDEx_isOpen(Txid(3)));
+    BOOST_CHECK(!MetaDEx_isOpen(Txid(4)));
+    BOOST_CHECK(GetStateChecksum() == CalculateStateChecksum());
+    BOOST_CHECK_EQUAL(MetaDEx_CANCEL_ALL_FOR_PAIR(Txid(5), 105, alice, 4, 3), 0);
+    BOOST_CHECK(GetStateChecksum() == CalculateStateChecksum());
+
+    // a property and a change of its issuer
+    CMPSPInfo::Entry sp;
+    sp.issuer = alice;
+    uint32_t propertyId = _my_sps->putSP(ELYSIUM_PROPERTY_ELYSIUM, sp);
+    BOOST_CHECK(GetStateChecksum() == CalculateStateChecksum());
+    sp.issuer = bob;
+    BOOST_CHECK(_my_sps->updateSP(propertyId, sp));
+    BOOST_CHECK(GetStateChecksum() == CalculateStateChecksum());
+
+    // the same state, rebuilt from scratch
+    const uint256 incremental = GetStateChecksum();
+    RebuildStateChecksum();
+    BOOST_CHECK(GetStateChecksum() == incremental);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+
+} // namespace elysium
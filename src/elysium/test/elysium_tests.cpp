@@ -1,23 +1,129 @@
 #include "../elysium.h"
+#include "../fees.h"
 #include "../rules.h"
+#include "../sigmadb.h"
 #include "../sp.h"
+#include "../statesnapshot.h"
+
+#include "utils_tx.h"
 
 #include "base58.h"
 #include "chainparams.h"
+#include "random.h"
 #include "test/test_bitcoin.h"
 
+#include <boost/filesystem.hpp>
 #include <boost/test/unit_test.hpp>
 
 #include <limits>
+#include <map>
+#include <string>
+#include <vector>
+
+extern void clear_all_state();
+extern bool load_state_snapshot(const boost::filesystem::path& path, const uint256& blockHash);
 
 using namespace elysium;
 
-BOOST_FIXTURE_TEST_SUITE(elysium_elysium_tests, TestingSetup)
+namespace {
 
-BOOST_AUTO_TEST_CASE(elysium_mints_overflow)
+const TallyType reserves[] = {SELLOFFER_RESERVE, ACCEPT_RESERVE, METADEX_RESERVE};
+
+/** Two managed properties to issue tokens of */
+struct SupplyTestingSetup : ElysiumTestingSetup
 {
-    _my_sps = new CMPSPInfo(pathTemp / "MP_spinfo_test", false);
+    std::vector<uint32_t> properties;
+
+    SupplyTestingSetup()
+    {
+        CreateProperties();
+    }
 
+    void CreateProperties()
+    {
+        CMPSPInfo::Entry sp;
+        sp.issuer = "TSrs4fb8LgnMADmBQj1EbadKbUsiuv4Ddd";
+        sp.prop_type = ELYSIUM_PROPERTY_TYPE_INDIVISIBLE;
+        sp.fixed = false;
+        sp.manual = true;
+
+        properties.clear();
+        properties.push_back(_my_sps->putSP(ELYSIUM_PROPERTY_ELYSIUM, sp));
+        properties.push_back(_my_sps->putSP(ELYSIUM_PROPERTY_TELYSIUM, sp));
+    }
+};
+
+/** The total the way it was counted before the running totals, a scan over all tallies */
+int64_t ScanTotalTokens(uint32_t propertyId)
+{
+    int64_t total = 0;
+    for (std::unordered_map<std::string, CMPTally>::iterator it = mp_tally_map.begin(); it != mp_tally_map.end(); ++it) {
+        total += it->second.getMoney(propertyId, BALANCE);
+        for (size_t i = 0; i < sizeof(reserves) / sizeof(reserves[0]); i++) {
+            total += it->second.getMoney(propertyId, reserves[i]);
+        }
+    }
+    return total;
+}
+
+/** Grants, revokes, sends, reserve changes and pending amounts on random addresses, a few of them fail */
+void RunTallyUpdates(const std::vector<uint32_t>& properties, int nUpdates)
+{
+    for (int i = 0; i < nUpdates; i++) {
+        uint32_t propertyId = properties[insecure_rand() % properties.size()];
+        std::string address = Address(insecure_rand() % 8);
+        std::string other = Address(insecure_rand() % 8);
+        TallyType reserve = reserves[insecure_rand() % 3];
+        int64_t balance = getMPbalance(address, propertyId, BALANCE);
+        int64_t reserved = getMPbalance(address, propertyId, reserve);
+        int64_t amount = 1 + insecure_rand() % 1000;
+
+        switch (insecure_rand() % 7) {
+        case 0: // grant
+            BOOST_CHECK(update_tally_map(address, propertyId, amount, BALANCE));
+            break;
+        case 1: // revoke, more than the balance fails
+            BOOST_CHECK_EQUAL(update_tally_map(address, propertyId, -amount, BALANCE), amount <= balance);
+            break;
+        case 2: // send
+            if (amount > balance) break;
+            BOOST_CHECK(update_tally_map(address, propertyId, -amount, BALANCE));
+            BOOST_CHECK(update_tally_map(other, propertyId, amount, BALANCE));
+            break;
+        case 3: // reserve
+            if (amount > balance) break;
+            BOOST_CHECK(update_tally_map(address, propertyId, -amount, BALANCE));
+            BOOST_CHECK(update_tally_map(address, propertyId, amount, reserve));
+            break;
+        case 4: // release a reserve
+            if (!reserved) break;
+            BOOST_CHECK(update_tally_map(address, propertyId, -reserved, reserve));
+            BOOST_CHECK(update_tally_map(address, propertyId, reserved, BALANCE));
+            break;
+        case 5: // pending amounts are not part of the supply
+            BOOST_CHECK(update_tally_map(address, propertyId, -amount, PENDING));
+            break;
+        case 6: // a reserve destroyed, like a DEx offer that was accepted and paid
+            if (!reserved) break;
+            BOOST_CHECK(update_tally_map(address, propertyId, -reserved, reserve));
+            break;
+        }
+    }
+}
+
+void CheckTotalTokens(const std::vector<uint32_t>& properties)
+{
+    for (size_t i = 0; i < properties.size(); i++) {
+        BOOST_CHECK_EQUAL(getTotalTokens(properties[i]), ScanTotalTokens(properties[i]));
+    }
+}
+
+} // namespace
+
+BOOST_FIXTURE_TEST_SUITE(elysium_elysium_tests, TestingSetup)
+
+BOOST_FIXTURE_TEST_CASE(elysium_mints_overflow, ElysiumTestingSetup)
+{
     CMPSPInfo::Entry sp;
     sp.denominations = {MAX_INT_8_BYTES};
     auto property = _my_sps->putSP(0, sp); // non-standard
@@ -32,4 +138,48 @@ BOOST_AUTO_TEST_CASE(elysium_mints_overflow)
     );
 }
 
+BOOST_FIXTURE_TEST_CASE(total_tokens_running_totals, SupplyTestingSetup)
+{
+    seed_insecure_rand(true);
+
+    for (int i = 0; i < 20; i++) {
+        RunTallyUpdates(properties, 50);
+        CheckTotalTokens(properties);
+    }
+
+    std::map<uint32_t, int64_t> totals;
+    for (size_t i = 0; i < properties.size(); i++) {
+        totals[properties[i]] = getTotalTokens(properties[i]);
+        BOOST_CHECK(totals[properties[i]] > 0);
+    }
+
+    StateSnapshot snapshot;
+    snapshot.blockHash = Txid(1000);
+    snapshot.tallies = mp_tally_map;
+    snapshot.nextSPID = _my_sps->peekNextSPID(ELYSIUM_PROPERTY_ELYSIUM);
+    snapshot.nextTestSPID = _my_sps->peekNextSPID(ELYSIUM_PROPERTY_TELYSIUM);
+    BOOST_CHECK(WriteSnapshot(pathTemp / "snapshot.dat", snapshot));
+
+    // the running totals start over with the state
+    clear_all_state();
+    CreateProperties();
+    CheckTotalTokens(properties);
+    for (size_t i = 0; i < properties.size(); i++) {
+        BOOST_CHECK_EQUAL(getTotalTokens(properties[i]), 0);
+    }
+
+    RunTallyUpdates(properties, 200);
+    CheckTotalTokens(properties);
+
+    // the tallies are replaced by the ones of the snapshot, the running totals are those of the snapshot
+    BOOST_CHECK(load_state_snapshot(pathTemp / "snapshot.dat", snapshot.blockHash));
+    CheckTotalTokens(properties);
+    for (size_t i = 0; i < properties.size(); i++) {
+        BOOST_CHECK_EQUAL(getTotalTokens(properties[i]), totals[properties[i]]);
+    }
+
+    RunTallyUpdates(properties, 200);
+    CheckTotalTokens(properties);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
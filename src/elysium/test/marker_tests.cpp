@@ -230,6 +230,41 @@ BOOST_AUTO_TEST_CASE(class_class_c)
     }
 }
 
+BOOST_AUTO_TEST_CASE(marker_any_height)
+{
+    {
+        CMutableTransaction mutableTx;
+        mutableTx.vout.push_back(PayToPubKeyHash_Unrelated());
+        mutableTx.vout.push_back(OpReturn_Unrelated());
+        mutableTx.vout.push_back(PayToBareMultisig_3of5());
+
+        CTransaction tx(mutableTx);
+        BOOST_CHECK(!HasPacketMarker(tx));
+    }
+    {
+        CMutableTransaction mutableTx;
+        mutableTx.vout.push_back(PayToPubKeyHash_Elysium());
+        mutableTx.vout.push_back(PayToBareMultisig_1of3());
+
+        CTransaction tx(mutableTx);
+        BOOST_CHECK(HasPacketMarker(tx));
+    }
+    {
+        int nNullDataBlock = ConsensusParams().NULLDATA_BLOCK;
+        MutableConsensusParams().NULLDATA_BLOCK = 999999;
+
+        CMutableTransaction mutableTx;
+        mutableTx.vout.push_back(OpReturn_PlainMarker());
+
+        // not a packet before class C is allowed, but a candidate for the scan regardless
+        CTransaction tx(mutableTx);
+        BOOST_CHECK_EQUAL(DeterminePacketClass(tx, 0), boost::none);
+        BOOST_CHECK(HasPacketMarker(tx));
+
+        MutableConsensusParams().NULLDATA_BLOCK = nNullDataBlock;
+    }
+}
+
 BOOST_AUTO_TEST_SUITE_END()
 
 } // namespace elysium
@@ -0,0 +1,261 @@
+#include "../mdex.h"
+
+#include "../elysium.h"
+#include "../sp.h"
+#include "../tally.h"
+#include "../uint256_extensions.h"
+
+#include "utils_tx.h"
+
+#include "../../arith_uint256.h"
+#include "../../random.h"
+#include "../../tinyformat.h"
+#include "../../test/test_bitcoin.h"
+
+#include <univalue.h>
+
+#include <boost/test/unit_test.hpp>
+
+#include <algorithm>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <stdint.h>
+
+namespace elysium {
+namespace {
+
+const int FLOW_SIZE = 2000;
+const int FLOW_CHECK_INTERVAL = 100;
+const int64_t INITIAL_BALANCE = 1000000000;
+const int NUM_ADDRESSES = 4;
+
+const uint32_t properties[] = {3, 4, 5};
+
+/** The amounts an order trades with an older order, as x_Trade computes them */
+bool CalculateFill(const CMPMetaDEx& taker, const CMPMetaDEx& maker, int64_t& nCouldBuy, int64_t& nWouldPay)
+{
+    arith_uint256 iCouldBuy = (ConvertTo256(taker.getAmountRemaining()) * ConvertTo256(maker.getAmountForSale())) / ConvertTo256(maker.getAmountDesired());
+    nCouldBuy = iCouldBuy < ConvertTo256(maker.getAmountRemaining()) ? ConvertTo64(iCouldBuy) : maker.getAmountRemaining();
+    if (nCouldBuy == 0) return false;
+
+    nWouldPay = ConvertTo64(DivideAndRoundUp((ConvertTo256(nCouldBuy) * ConvertTo256(maker.getAmountDesired())), ConvertTo256(maker.getAmountForSale())));
+    return true;
+}
+
+/**
+ * The MetaDEx as it was before the order book: matching walks all price levels of the desired
+ * property with rational prices, and skips the orders which want another property.
+ *
+ * Fees are not modelled, they aren't activated at the heights of the flow.
+ */
+class ReferenceMetaDEx
+{
+public:
+    struct Totals
+    {
+        int64_t sold;
+        int64_t received;
+
+        Totals() : sold(0), received(0) {}
+    };
+
+    md_PropertiesMap orders;
+    std::map<std::pair<std::string, uint32_t>, int64_t> balances;
+    std::map<std::pair<std::string, uint32_t>, int64_t> reserves;
+    std::map<uint256, Totals> trades;
+
+    void Add(CMPMetaDEx order)
+    {
+        Trade(order);
+        if (order.getAmountRemaining() > 0) {
+            balances[std::make_pair(order.getAddr(), order.getProperty())] -= order.getAmountRemaining();
+            reserves[std::make_pair(order.getAddr(), order.getProperty())] += order.getAmountRemaining();
+            orders[order.getProperty()][order.unitPrice()].insert(order);
+        }
+    }
+
+    int CancelAtPrice(const std::string& addr, uint32_t property, int64_t amount, uint32_t desired, int64_t amountDesired)
+    {
+        md_PropertiesMap::iterator propIt = orders.find(property);
+        if (propIt == orders.end()) return METADEX_ERROR -21;
+
+        int rc = METADEX_ERROR -20;
+        const rational_t price(amountDesired, amount);
+        for (md_PricesMap::iterator priceIt = propIt->second.begin(); priceIt != propIt->second.end(); ++priceIt) {
+            if (priceIt->first != price) continue;
+            if (Cancel(priceIt->second, addr, desired)) rc = 0;
+        }
+        return rc;
+    }
+
+    int CancelAllForPair(const std::string& addr, uint32_t property, uint32_t desired)
+    {
+        md_PropertiesMap::iterator propIt = orders.find(property);
+        if (propIt == orders.end()) return METADEX_ERROR -31;
+
+        int rc = METADEX_ERROR -30;
+        for (md_PricesMap::iterator priceIt = propIt->second.begin(); priceIt != propIt->second.end(); ++priceIt) {
+            if (Cancel(priceIt->second, addr, desired)) rc = 0;
+        }
+        return rc;
+    }
+
+private:
+    void Trade(CMPMetaDEx& taker)
+    {
+        md_PropertiesMap::iterator propIt = orders.find(taker.getDesProperty());
+        if (propIt == orders.end()) return;
+
+        for (md_PricesMap::iterator priceIt = propIt->second.begin(); priceIt != propIt->second.end(); ++priceIt) {
+            if (taker.inversePrice() < priceIt->first) continue;
+
+            md_Set& set = priceIt->second;
+            for (md_Set::iterator it = set.begin(); it != set.end();) {
+                int64_t nCouldBuy, nWouldPay;
+                if (it->getDesProperty() != taker.getProperty() || !CalculateFill(taker, *it, nCouldBuy, nWouldPay) ||
+                        rational_t(nWouldPay, nCouldBuy) > taker.inversePrice()) {
+                    ++it;
+                    continue;
+                }
+
+                balances[std::make_pair(taker.getAddr(), taker.getProperty())] -= nWouldPay;
+                balances[std::make_pair(it->getAddr(), it->getDesProperty())] += nWouldPay;
+                reserves[std::make_pair(it->getAddr(), it->getProperty())] -= nCouldBuy;
+                balances[std::make_pair(taker.getAddr(), taker.getDesProperty())] += nCouldBuy;
+
+                trades[it->getHash()].sold += nCouldBuy;
+                trades[it->getHash()].received += nWouldPay;
+                trades[taker.getHash()].sold += nWouldPay;
+                trades[taker.getHash()].received += nCouldBuy;
+
+                CMPMetaDEx replacement = *it;
+                replacement.setAmountRemaining(it->getAmountRemaining() - nCouldBuy);
+                taker.setAmountRemaining(taker.getAmountRemaining() - nWouldPay);
+
+                set.erase(it++);
+                if (replacement.getAmountRemaining() > 0) set.insert(replacement);
+                if (taker.getAmountRemaining() == 0) return;
+            }
+        }
+    }
+
+    bool Cancel(md_Set& set, const std::string& addr, uint32_t desired)
+    {
+        bool fCancelled = false;
+        for (md_Set::iterator it = set.begin(); it != set.end();) {
+            if (it->getDesProperty() != desired || it->getAddr() != addr) {
+                ++it;
+                continue;
+            }
+            reserves[std::make_pair(it->getAddr(), it->getProperty())] -= it->getAmountRemaining();
+            balances[std::make_pair(it->getAddr(), it->getProperty())] += it->getAmountRemaining();
+            set.erase(it++);
+            fCancelled = true;
+        }
+        return fCancelled;
+    }
+};
+
+/** The open orders of a book, by property, price and age, with the empty price levels left out */
+std::vector<std::string> Flatten(const md_PropertiesMap& orders)
+{
+    std::vector<std::string> flat;
+    for (md_PropertiesMap::const_iterator propIt = orders.begin(); propIt != orders.end(); ++propIt) {
+        for (md_PricesMap::const_iterator priceIt = propIt->second.begin(); priceIt != propIt->second.end(); ++priceIt) {
+            for (md_Set::const_iterator it = priceIt->second.begin(); it != priceIt->second.end(); ++it) {
+                flat.push_back(strprintf("%d:%s:%s:%d:%d:%d:%d:%d:%d", propIt->first, it->getHash().GetHex(), it->getAddr(),
+                        it->getBlock(), it->getIdx(), it->getAmountForSale(), it->getDesProperty(), it->getAmountDesired(),
+                        it->getAmountRemaining()));
+            }
+        }
+    }
+    return flat;
+}
+
+} // namespace
+
+BOOST_FIXTURE_TEST_SUITE(elysium_metadex_tests, ElysiumTestingSetup)
+
+BOOST_AUTO_TEST_CASE(matching_like_price_walk)
+{
+    static const size_t nProperties = sizeof(properties) / sizeof(properties[0]);
+
+    seed_insecure_rand(true);
+
+    ReferenceMetaDEx reference;
+    for (int i = 0; i < NUM_ADDRESSES; i++) {
+        for (size_t j = 0; j < nProperties; j++) {
+            BOOST_CHECK(update_tally_map(Address(i), properties[j], INITIAL_BALANCE, BALANCE));
+            reference.balances[std::make_pair(Address(i), properties[j])] = INITIAL_BALANCE;
+        }
+    }
+
+    // prices within 10% of each other, so about half of the orders trade, and some tiny amounts for the rounding
+    std::vector<CMPMetaDEx> added;
+    for (int i = 0; i < FLOW_SIZE; i++) {
+        const int block = 1000 + i / 10;
+        const unsigned int idx = i % 10;
+        const uint256 txid = Txid(i + 1);
+        const std::string addr = Address(insecure_rand() % NUM_ADDRESSES);
+        const uint32_t property = properties[insecure_rand() % nProperties];
+        const uint32_t desired = properties[(property - properties[0] + 1 + insecure_rand() % (nProperties - 1)) % nProperties];
+
+        const unsigned int nAction = insecure_rand() % 10;
+        if (nAction == 0 && !added.empty()) {
+            // the price of an earlier order, which may be filled already
+            const CMPMetaDEx& order = added[insecure_rand() % added.size()];
+            int rc = MetaDEx_CANCEL_AT_PRICE(txid, block, order.getAddr(), order.getProperty(), order.getAmountForSale(),
+                    order.getDesProperty(), order.getAmountDesired());
+            BOOST_CHECK_EQUAL(rc, reference.CancelAtPrice(order.getAddr(), order.getProperty(), order.getAmountForSale(),
+                    order.getDesProperty(), order.getAmountDesired()));
+        } else if (nAction == 1) {
+            int rc = MetaDEx_CANCEL_ALL_FOR_PAIR(txid, block, addr, property, desired);
+            BOOST_CHECK_EQUAL(rc, reference.CancelAllForPair(addr, property, desired));
+        } else {
+            int64_t amountForSale = (insecure_rand() % 8 == 0) ? 1 + insecure_rand() % 10 : 100 * (10 + insecure_rand() % 10) + insecure_rand() % 100;
+            int64_t amountDesired = std::max<int64_t>(1, amountForSale * (90 + insecure_rand() % 21) / 100);
+
+            CMPMetaDEx order(addr, block, property, amountForSale, desired, amountDesired, txid, idx, CMPTransaction::ADD);
+            BOOST_CHECK_EQUAL(MetaDEx_ADD(addr, property, amountForSale, block, desired, amountDesired, txid, idx), 0);
+            reference.Add(order);
+            added.push_back(order);
+        }
+
+        if ((i + 1) % FLOW_CHECK_INTERVAL != 0) continue;
+
+        BOOST_CHECK(Flatten(metadex) == Flatten(reference.orders));
+        for (int j = 0; j < NUM_ADDRESSES; j++) {
+            for (size_t k = 0; k < nProperties; k++) {
+                const std::pair<std::string, uint32_t> key(Address(j), properties[k]);
+                BOOST_CHECK_EQUAL(getMPbalance(key.first, key.second, BALANCE), reference.balances[key]);
+                BOOST_CHECK_EQUAL(getMPbalance(key.first, key.second, METADEX_RESERVE), reference.reserves[key]);
+            }
+        }
+    }
+
+    // the flow has to cover partial fills, so the book can't be empty
+    BOOST_CHECK(!Flatten(reference.orders).empty());
+    BOOST_CHECK(!reference.trades.empty());
+
+    for (size_t i = 0; i < added.size(); i++) {
+        const CMPMetaDEx& order = added[i];
+
+        UniValue tradeArray(UniValue::VARR);
+        int64_t totalSold = 0, totalReceived = 0;
+        t_tradelistdb->getMatchingTrades(order.getHash(), order.getProperty(), tradeArray, totalSold, totalReceived);
+        const ReferenceMetaDEx::Totals& totals = reference.trades[order.getHash()];
+        BOOST_CHECK_EQUAL(totalSold, totals.sold);
+        BOOST_CHECK_EQUAL(totalReceived, totals.received);
+
+        md_PricesMap::const_iterator priceIt = reference.orders[order.getProperty()].find(order.unitPrice());
+        bool fOpen = priceIt != reference.orders[order.getProperty()].end() && priceIt->second.count(order);
+        BOOST_CHECK_EQUAL(MetaDEx_isOpen(order.getHash(), order.getProperty()), fOpen);
+    }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+
+} // namespace elysium
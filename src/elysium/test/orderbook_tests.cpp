@@ -0,0 +1,162 @@
+#include "../orderbook.h"
+
+#include "../mdex.h"
+
+#include "utils_tx.h"
+
+#include "../../random.h"
+#include "../../test/test_bitcoin.h"
+
+#include <boost/test/unit_test.hpp>
+
+#include <limits>
+#include <string>
+#include <vector>
+
+#include <stdint.h>
+
+namespace elysium {
+namespace {
+
+CMPMetaDEx CreateOrder(int block, unsigned int idx, uint32_t property, int64_t amountForSale, uint32_t desiredProperty, int64_t amountDesired)
+{
+    return CMPMetaDEx("TSrs4fb8LgnMADmBQj1EbadKbUsiuv4Ddd", block, property, amountForSale, desiredProperty, amountDesired,
+            Txid(block * 1000 + idx), idx, CMPTransaction::ADD);
+}
+
+md_Set::iterator Insert(md_PropertiesMap& orders, MetaDExOrderBook& book, const CMPMetaDEx& order)
+{
+    md_Set& set = orders[order.getProperty()][order.unitPrice()];
+    md_Set::iterator it = set.insert(order).first;
+    book.Insert(set, it);
+    return it;
+}
+
+int64_t RandomAmount()
+{
+    switch (insecure_rand() % 3) {
+        case 0: return 1 + insecure_rand() % 100;
+        case 1: return 1 + insecure_rand();
+        default: return std::numeric_limits<int64_t>::max() - insecure_rand() % 1000;
+    }
+}
+
+} // namespace
+
+BOOST_FIXTURE_TEST_SUITE(elysium_orderbook_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(price_reduced)
+{
+    BOOST_CHECK(MetaDExPrice(10, 4) == MetaDExPrice(5, 2));
+    BOOST_CHECK_EQUAL(MetaDExPrice(10, 4).GetNumerator(), 5);
+    BOOST_CHECK_EQUAL(MetaDExPrice(10, 4).GetDenominator(), 2);
+    BOOST_CHECK(MetaDExPrice(10, 4).ToRational() == rational_t(5, 2));
+    BOOST_CHECK(MetaDExPrice(3, 3) == MetaDExPrice(1, 1));
+}
+
+BOOST_AUTO_TEST_CASE(price_ordered_like_rational)
+{
+    const int64_t max = std::numeric_limits<int64_t>::max();
+    BOOST_CHECK(MetaDExPrice(max - 1, max) < MetaDExPrice(max, max - 1));
+    BOOST_CHECK(MetaDExPrice(max - 1, max) < MetaDExPrice(1, 1));
+    BOOST_CHECK(MetaDExPrice(max, max - 1) > MetaDExPrice(1, 1));
+    BOOST_CHECK(MetaDExPrice(1, max) < MetaDExPrice(1, max - 1));
+
+    for (int i = 0; i < 10000; ++i) {
+        int64_t a = RandomAmount(), b = RandomAmount(), c = RandomAmount(), d = RandomAmount();
+        if (i % 4 == 0) {
+            c = a;
+            d = b;
+        }
+        MetaDExPrice lhs(a, b), rhs(c, d);
+        rational_t lhsRational(a, b), rhsRational(c, d);
+
+        BOOST_CHECK_EQUAL(lhs < rhs, lhsRational < rhsRational);
+        BOOST_CHECK_EQUAL(lhs == rhs, lhsRational == rhsRational);
+        BOOST_CHECK_EQUAL(lhs > rhs, lhsRational > rhsRational);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(book_levels)
+{
+    md_PropertiesMap orders;
+    MetaDExOrderBook book;
+
+    Insert(orders, book, CreateOrder(10, 1, 3, 100, 4, 200));
+    Insert(orders, book, CreateOrder(10, 2, 3, 100, 4, 100));
+    Insert(orders, book, CreateOrder(11, 1, 3, 50, 4, 100));
+    Insert(orders, book, CreateOrder(11, 2, 3, 100, 5, 100));
+    // loaded out of block order
+    Insert(orders, book, CreateOrder(9, 1, 3, 10, 4, 20));
+
+    MetaDExOrderBook::Levels* levels = book.GetLevels(3, 4);
+    BOOST_REQUIRE(levels);
+    BOOST_CHECK_EQUAL(levels->size(), 2);
+    BOOST_CHECK(levels->at(0).price == MetaDExPrice(1, 1));
+    BOOST_CHECK(levels->at(1).price == MetaDExPrice(2, 1));
+
+    // oldest first
+    const MetaDExOrderBook::Level& level = levels->at(1);
+    BOOST_CHECK_EQUAL(level.orders.size(), 3);
+    BOOST_CHECK_EQUAL(level.orders[0]->getBlock(), 9);
+    BOOST_CHECK_EQUAL(level.orders[1]->getBlock(), 10);
+    BOOST_CHECK_EQUAL(level.orders[2]->getBlock(), 11);
+
+    BOOST_CHECK(book.GetLevels(3, 5));
+    BOOST_CHECK(!book.GetLevels(4, 3));
+    BOOST_CHECK_EQUAL(book.Size(), 5);
+}
+
+BOOST_AUTO_TEST_CASE(book_erase)
+{
+    md_PropertiesMap orders;
+    MetaDExOrderBook book;
+
+    md_Set::iterator first = Insert(orders, book, CreateOrder(10, 1, 3, 100, 4, 200));
+    md_Set::iterator second = Insert(orders, book, CreateOrder(10, 2, 3, 100, 4, 200));
+
+    BOOST_CHECK(book.Find(Txid(10001)) == &(*first));
+    BOOST_CHECK(book.Find(Txid(10002)) == &(*second));
+
+    md_Set& set = orders[3][first->unitPrice()];
+    book.Erase(first);
+    set.erase(first);
+
+    BOOST_CHECK(!book.Find(Txid(10001)));
+    BOOST_CHECK_EQUAL(book.GetLevels(3, 4)->at(0).orders.size(), 1);
+
+    book.Erase(second);
+    set.erase(second);
+
+    // empty levels and pairs are dropped
+    BOOST_CHECK(!book.GetLevels(3, 4));
+    BOOST_CHECK_EQUAL(book.Size(), 0);
+}
+
+BOOST_AUTO_TEST_CASE(book_replace)
+{
+    md_PropertiesMap orders;
+    MetaDExOrderBook book;
+
+    md_Set::iterator it = Insert(orders, book, CreateOrder(10, 1, 3, 100, 4, 200));
+    Insert(orders, book, CreateOrder(10, 2, 3, 100, 4, 200));
+
+    CMPMetaDEx replacement = *it;
+    replacement.setAmountRemaining(40);
+
+    MetaDExOrderBook::Level& level = book.GetLevels(3, 4)->at(0);
+    md_Set& set = *level.set;
+    set.erase(it);
+    book.ReplaceAt(level, 0, set.insert(replacement).first);
+
+    BOOST_CHECK_EQUAL(book.Find(Txid(10001))->getAmountRemaining(), 40);
+    BOOST_CHECK_EQUAL(level.orders[0]->getAmountRemaining(), 40);
+
+    book.EraseAt(level, 1);
+    BOOST_CHECK(!book.Find(Txid(10002)));
+    BOOST_CHECK_EQUAL(level.orders.size(), 1);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+
+} // namespace elysium
@@ -0,0 +1,151 @@
+#include "../elysium.h"
+#include "../persistence.h"
+
+#include "utils_tx.h"
+
+#include "../../test/test_bitcoin.h"
+
+#include <boost/test/unit_test.hpp>
+
+#include <memory>
+#include <set>
+#include <string>
+#include <vector>
+
+namespace elysium {
+namespace {
+
+/** Trade list which can write records without their index entries, like earlier versions did */
+class TestTradeList : public CMPTradeList
+{
+public:
+    TestTradeList(const boost::filesystem::path& path) : CMPTradeList(path, true)
+    {
+    }
+
+    void WriteUnindexed(const std::string& key, const std::string& value)
+    {
+        pdb->Put(writeoptions, key, value);
+    }
+};
+
+class PersistenceTestingSetup : public TestingSetup
+{
+public:
+    PersistenceTestingSetup() : TestingSetup(CBaseChainParams::REGTEST)
+    {
+    }
+};
+
+} // namespace
+
+BOOST_FIXTURE_TEST_SUITE(elysium_persistence_tests, PersistenceTestingSetup)
+
+BOOST_AUTO_TEST_CASE(index_keys)
+{
+    std::string height1 = (IndexKey(IndexKeyType::Height) << 255).str();
+    std::string height2 = (IndexKey(IndexKeyType::Height) << 256).str();
+    std::string height3 = (IndexKey(IndexKeyType::Height) << 65536).str();
+
+    BOOST_CHECK(height1 < height2);
+    BOOST_CHECK(height2 < height3);
+    BOOST_CHECK_EQUAL(ReadIndexNumber(height3, 1), 65536);
+
+    BOOST_CHECK(IsIndexKey(height1));
+    BOOST_CHECK(IsIndexKey(IndexKey(IndexKeyType::Version).str()));
+    BOOST_CHECK(!IsIndexKey(Txid(1).ToString()));
+    BOOST_CHECK(!IsIndexKey("TSrs4fb8LgnMADmBQj1EbadKbUsiuv4Ddd"));
+    BOOST_CHECK(!IsIndexKey("dbversion"));
+
+    // an address is never a prefix of a longer one
+    IndexKey address = IndexKey(IndexKeyType::Address) << std::string("abc");
+    BOOST_CHECK(!address.IsPrefixOf((IndexKey(IndexKeyType::Address) << std::string("abcd")).str()));
+    BOOST_CHECK(address.IsPrefixOf(address.Entry(Txid(1).ToString())));
+}
+
+BOOST_AUTO_TEST_CASE(txlist_block_range)
+{
+    std::unique_ptr<CMPTxList> db(new CMPTxList(pathTemp / "MP_txlist_test", true));
+
+    db->recordTX(Txid(1), true, 10, 0, 100);
+    db->recordTX(Txid(2), true, 11, 0, 100);
+    db->recordTX(Txid(3), false, 11, 0, 100);
+    db->recordTX(Txid(4), true, 300, 0, 100);
+    db->recordMetaDExCancelTX(Txid(5), Txid(1), true, 11, 3, 100);
+
+    BOOST_CHECK_EQUAL(db->getMPTransactionCountBlock(10), 1);
+    BOOST_CHECK_EQUAL(db->getMPTransactionCountBlock(11), 2);
+    BOOST_CHECK_EQUAL(db->getMPTransactionCountBlock(12), 0);
+    BOOST_CHECK_EQUAL(db->getMPTransactionCountTotal(), 4);
+    BOOST_CHECK(db->GetSeedBlocks(0, 1000) == std::set<int>({10, 11, 300}));
+    BOOST_CHECK(db->GetSeedBlocks(11, 299) == std::set<int>({11}));
+
+    BOOST_CHECK(!db->isMPinBlockRange(12, 299, false));
+    BOOST_CHECK(db->isMPinBlockRange(11, 299, false));
+    BOOST_CHECK(db->exists(Txid(2)));
+
+    BOOST_CHECK(db->isMPinBlockRange(11, 299, true));
+    BOOST_CHECK(db->exists(Txid(1)));
+    BOOST_CHECK(!db->exists(Txid(2)));
+    BOOST_CHECK(!db->exists(Txid(3)));
+    BOOST_CHECK(db->exists(Txid(4)));
+    BOOST_CHECK_EQUAL(db->getNumberOfMetaDExCancels(Txid(5)), 0);
+    BOOST_CHECK_EQUAL(db->getMPTransactionCountBlock(11), 0);
+    BOOST_CHECK(!db->isMPinBlockRange(11, 299, false));
+}
+
+BOOST_AUTO_TEST_CASE(tradelist_trades_for_address)
+{
+    std::unique_ptr<TestTradeList> db(new TestTradeList(pathTemp / "MP_tradelist_test"));
+
+    db->recordNewTrade(Txid(1), "alice", 3, 1, 20, 2);
+    db->recordNewTrade(Txid(2), "bob", 3, 1, 20, 1);
+    db->recordNewTrade(Txid(3), "alice", 4, 1, 20, 1);
+    db->recordNewTrade(Txid(4), "alice", 3, 1, 21, 0);
+    db->recordNewTrade(Txid(5), "alicex", 3, 1, 19, 0);
+    db->recordMatchedTrade(Txid(2), Txid(1), "bob", "alice", 3, 1, 100, 200, 20, 0);
+
+    std::vector<uint256> trades;
+    db->getTradesForAddress("alice", trades);
+    BOOST_CHECK(trades == std::vector<uint256>({Txid(3), Txid(1), Txid(4)}));
+
+    trades.clear();
+    db->getTradesForAddress("alice", trades, 4);
+    BOOST_CHECK(trades == std::vector<uint256>({Txid(3)}));
+
+    BOOST_CHECK_EQUAL(db->getMPTradeCountTotal(), 6);
+
+    BOOST_CHECK_EQUAL(db->deleteAboveBlock(20), 5);
+    BOOST_CHECK_EQUAL(db->getMPTradeCountTotal(), 1);
+
+    trades.clear();
+    db->getTradesForAddress("alice", trades);
+    BOOST_CHECK(trades.empty());
+
+    trades.clear();
+    db->getTradesForAddress("alicex", trades);
+    BOOST_CHECK(trades == std::vector<uint256>({Txid(5)}));
+}
+
+BOOST_AUTO_TEST_CASE(tradelist_upgrade_index)
+{
+    std::unique_ptr<TestTradeList> db(new TestTradeList(pathTemp / "MP_tradelist_test"));
+
+    db->WriteUnindexed(Txid(1).ToString(), "alice:3:1:20:2");
+    db->WriteUnindexed(Txid(2).ToString(), "alice:3:1:20:1");
+
+    std::vector<uint256> trades;
+    db->getTradesForAddress("alice", trades);
+    BOOST_CHECK(trades.empty());
+
+    BOOST_CHECK(db->UpgradeIndex(DB_INDEX_VERSION));
+    BOOST_CHECK(!db->UpgradeIndex(DB_INDEX_VERSION));
+
+    db->getTradesForAddress("alice", trades);
+    BOOST_CHECK(trades == std::vector<uint256>({Txid(2), Txid(1)}));
+    BOOST_CHECK_EQUAL(db->getMPTradeCountTotal(), 2);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+
+} // namespace elysium
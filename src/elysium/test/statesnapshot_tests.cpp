@@ -0,0 +1,135 @@
+#include "../statesnapshot.h"
+
+#include "../elysium.h"
+
+#include "utils_tx.h"
+
+#include "../../test/test_bitcoin.h"
+
+#include <boost/filesystem.hpp>
+#include <boost/test/unit_test.hpp>
+
+#include <fstream>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace elysium {
+namespace {
+
+StateSnapshot CreateSnapshot()
+{
+    StateSnapshot snapshot;
+    snapshot.blockHash = Txid(1000);
+
+    CMPTally& tally = snapshot.tallies["TSrs4fb8LgnMADmBQj1EbadKbUsiuv4Ddd"];
+    tally.updateMoney(3, 100, BALANCE);
+    tally.updateMoney(3, 20, METADEX_RESERVE);
+    tally.updateMoney(4, 5, PENDING);
+
+    snapshot.offers.insert(std::make_pair("TSrs4fb8LgnMADmBQj1EbadKbUsiuv4Ddd-1", CMPOffer(10, 50, 1, 7, 1000, 10, Txid(1))));
+    snapshot.accepts.insert(std::make_pair("TSrs4fb8LgnMADmBQj1EbadKbUsiuv4Ddd-1+TG2KNxtPzDxSGj5DTmzZqUNoFfk2zQq9Gk",
+            CMPAccept(30, 25, 11, 10, 1, 50, 7, Txid(1))));
+
+    CMPCrowd crowd(5, 100, 3, 1500000000, 6, 10, 200, 20);
+    crowd.insertDatabase(Txid(2), std::vector<int64_t>{1, 2, 3, 4});
+    snapshot.crowds.insert(std::make_pair("TG2KNxtPzDxSGj5DTmzZqUNoFfk2zQq9Gk", crowd));
+
+    CMPMetaDEx order("TSrs4fb8LgnMADmBQj1EbadKbUsiuv4Ddd", 12, 3, 20, 4, 40, Txid(3), 1, 1, 15);
+    snapshot.metadex[order.getProperty()][order.unitPrice()].insert(order);
+
+    snapshot.elysiumPrev = 42;
+    snapshot.nextSPID = 6;
+    snapshot.nextTestSPID = 0x80000003;
+
+    return snapshot;
+}
+
+} // namespace
+
+BOOST_FIXTURE_TEST_SUITE(elysium_statesnapshot_tests, TestingSetup)
+
+BOOST_AUTO_TEST_CASE(snapshot_roundtrip)
+{
+    boost::filesystem::path path = pathTemp / "snapshot.dat";
+    StateSnapshot written = CreateSnapshot();
+    BOOST_CHECK(WriteSnapshot(path, written));
+
+    StateSnapshot loaded;
+    BOOST_CHECK(ReadSnapshot(path, written.blockHash, loaded));
+
+    const CMPTally& tally = loaded.tallies["TSrs4fb8LgnMADmBQj1EbadKbUsiuv4Ddd"];
+    BOOST_CHECK_EQUAL(tally.getMoney(3, BALANCE), 100);
+    BOOST_CHECK_EQUAL(tally.getMoney(3, METADEX_RESERVE), 20);
+    BOOST_CHECK_EQUAL(tally.getMoney(4, PENDING), 0); // pending amounts are not persisted
+
+    BOOST_CHECK_EQUAL(loaded.offers.size(), 1);
+    BOOST_CHECK_EQUAL(loaded.offers.begin()->second.getXZCDesiredOriginal(), 7);
+    BOOST_CHECK_EQUAL(loaded.accepts.size(), 1);
+    BOOST_CHECK_EQUAL(loaded.accepts.begin()->second.getAcceptAmountRemaining(), 25);
+
+    BOOST_CHECK_EQUAL(loaded.crowds.size(), 1);
+    BOOST_CHECK_EQUAL(loaded.crowds.begin()->second.getUserCreated(), 200);
+    BOOST_CHECK(loaded.crowds.begin()->second.getDatabase() == written.crowds.begin()->second.getDatabase());
+
+    BOOST_CHECK_EQUAL(loaded.metadex.size(), 1);
+    const md_Set& orders = loaded.metadex[3].begin()->second;
+    BOOST_CHECK_EQUAL(orders.size(), 1);
+    BOOST_CHECK(orders.begin()->getHash() == Txid(3));
+    BOOST_CHECK_EQUAL(orders.begin()->getAmountRemaining(), 15);
+
+    BOOST_CHECK_EQUAL(loaded.elysiumPrev, 42);
+    BOOST_CHECK_EQUAL(loaded.nextSPID, 6);
+    BOOST_CHECK_EQUAL(loaded.nextTestSPID, 0x80000003);
+
+    // a snapshot of another block is not loaded
+    StateSnapshot other;
+    BOOST_CHECK(!ReadSnapshot(path, Txid(1001), other));
+}
+
+BOOST_AUTO_TEST_CASE(snapshot_corrupted)
+{
+    boost::filesystem::path path = pathTemp / "snapshot.dat";
+    StateSnapshot written = CreateSnapshot();
+    BOOST_CHECK(WriteSnapshot(path, written));
+
+    // flip a byte in the last section
+    std::fstream file(path.string().c_str(), std::ios::in | std::ios::out | std::ios::binary);
+    file.seekg(-40, std::ios::end);
+    char c = 0;
+    file.get(c);
+    file.seekp(-40, std::ios::end);
+    file.put(c ^ 0x01);
+    file.close();
+
+    StateSnapshot loaded;
+    BOOST_CHECK(!ReadSnapshot(path, written.blockHash, loaded));
+}
+
+BOOST_AUTO_TEST_CASE(snapshot_writer)
+{
+    boost::filesystem::path path = pathTemp / "snapshot.dat";
+    uint256 blockHash;
+    {
+        SnapshotWriter writer;
+        std::unique_ptr<StateSnapshot> snapshot(new StateSnapshot(CreateSnapshot()));
+        blockHash = snapshot->blockHash;
+        writer.Schedule(std::move(snapshot), path);
+        writer.Flush();
+        BOOST_CHECK(boost::filesystem::exists(path));
+    }
+
+    StateSnapshot loaded;
+    BOOST_CHECK(ReadSnapshot(path, blockHash, loaded));
+    BOOST_CHECK_EQUAL(loaded.elysiumPrev, 42);
+}
+
+BOOST_AUTO_TEST_CASE(snapshot_missing)
+{
+    StateSnapshot loaded;
+    BOOST_CHECK(!ReadSnapshot(pathTemp / "snapshot-missing.dat", Txid(1), loaded));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+
+} // namespace elysium
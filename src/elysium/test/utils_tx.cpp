@@ -1,11 +1,16 @@
 #include "utils_tx.h"
 
 #include "../elysium.h"
+#include "../fees.h"
 #include "../packetencoder.h"
 #include "../script.h"
+#include "../sigmadb.h"
+#include "../sp.h"
 
+#include "../../arith_uint256.h"
 #include "../../base58.h"
 #include "../../pubkey.h"
+#include "../../tinyformat.h"
 #include "../../utilstrencodings.h"
 
 #include "../../primitives/transaction.h"
@@ -15,6 +20,47 @@
 
 #include <inttypes.h>
 
+extern void clear_all_state();
+
+using namespace elysium;
+
+ElysiumTestingSetup::ElysiumTestingSetup()
+{
+    t_tradelistdb = new CMPTradeList(pathTemp / "MP_tradelist_test", false);
+    s_stolistdb = new CMPSTOList(pathTemp / "MP_stolist_test", false);
+    p_txlistdb = new CMPTxList(pathTemp / "MP_txlist_test", false);
+    sigmaDb = new SigmaDatabase(pathTemp / "MP_sigma_test", false);
+    _my_sps = new CMPSPInfo(pathTemp / "MP_spinfo_test", false);
+    p_ElysiumTXDB = new CElysiumTransactionDB(pathTemp / "Exodus_TXDB_test", false);
+    p_feecache = new CElysiumFeeCache(pathTemp / "EXODUS_feecache_test", false);
+    p_feehistory = new CElysiumFeeHistory(pathTemp / "EXODUS_feehistory_test", false);
+}
+
+ElysiumTestingSetup::~ElysiumTestingSetup()
+{
+    // the state in memory is shared by all tests, leave it empty for the next one
+    clear_all_state();
+
+    delete t_tradelistdb; t_tradelistdb = nullptr;
+    delete s_stolistdb; s_stolistdb = nullptr;
+    delete p_txlistdb; p_txlistdb = nullptr;
+    delete sigmaDb; sigmaDb = nullptr;
+    delete _my_sps; _my_sps = nullptr;
+    delete p_ElysiumTXDB; p_ElysiumTXDB = nullptr;
+    delete p_feecache; p_feecache = nullptr;
+    delete p_feehistory; p_feehistory = nullptr;
+}
+
+uint256 Txid(int n)
+{
+    return ArithToUint256(arith_uint256(n));
+}
+
+std::string Address(int n)
+{
+    return strprintf("TSrs4fb8LgnMADmBQj1EbadKbUsiuv4D%02d", n);
+}
+
 CTxOut PayToPubKeyHash_Elysium()
 {
     CScript scriptPubKey = GetScriptForDestination(elysium::GetSystemAddress().Get());
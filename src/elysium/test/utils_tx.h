@@ -1,8 +1,25 @@
 #ifndef ELYSIUM_TEST_UTILS_TX_H
 #define ELYSIUM_TEST_UTILS_TX_H
 
+#include "../../test/test_bitcoin.h"
+#include "../../uint256.h"
+
+#include <string>
+
 class CTxOut;
 
+/** Opens all databases clear_all_state() resets in pathTemp, and clears the state and deletes them again */
+struct ElysiumTestingSetup : TestingSetup
+{
+    ElysiumTestingSetup();
+    ~ElysiumTestingSetup();
+};
+
+/** A transaction or block hash with value n */
+uint256 Txid(int n);
+/** A distinct address for each n below 100 */
+std::string Address(int n);
+
 CTxOut PayToPubKeyHash_Elysium();
 CTxOut PayToPubKeyHash_Unrelated();
 CTxOut PayToScriptHash_Unrelated();
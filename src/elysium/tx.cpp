@@ -3,6 +3,7 @@
 #include "elysium/tx.h"
 
 #include "elysium/activation.h"
+#include "elysium/consensushash.h"
 #include "elysium/convert.h"
 #include "elysium/dex.h"
 #include "elysium/fees.h"
@@ -1216,8 +1217,10 @@ int CMPTransaction::logicHelper_CrowdsaleParticipation()
     }
 
     // Update the crowdsale object
+    const std::string crowdBefore = IsStateChecksumEnabled() ? GenerateConsensusString(*pcrowdsale) : "";
     pcrowdsale->incTokensUserCreated(tokens.first);
     pcrowdsale->incTokensIssuerCreated(tokens.second);
+    if (IsStateChecksumEnabled()) UpdateStateChecksum(StateComponent::Crowdsales, crowdBefore, GenerateConsensusString(*pcrowdsale));
 
     // Data to pass to txFundraiserData
     int64_t txdata[] = {(int64_t) nValue, blockTime, tokens.first, tokens.second};
@@ -1956,7 +1959,9 @@ int CMPTransaction::logicMath_CreatePropertyVariable()
 
     const uint32_t propertyId = _my_sps->putSP(ecosystem, newSP);
     assert(propertyId > 0);
-    my_crowds.insert(std::make_pair(sender, CMPCrowd(propertyId, nValue, property, deadline, early_bird, percentage, 0, 0)));
+    CMPCrowd crowdsale(propertyId, nValue, property, deadline, early_bird, percentage, 0, 0);
+    my_crowds.insert(std::make_pair(sender, crowdsale));
+    if (IsStateChecksumEnabled()) AddToStateChecksum(StateComponent::Crowdsales, GenerateConsensusString(crowdsale));
 
     PrintToLog("CREATED CROWDSALE id: %d value: %d property: %d\n", propertyId, nValue, property);
 
@@ -2023,6 +2028,7 @@ int CMPTransaction::logicMath_CloseCrowdsale()
     if (missedTokens > 0) {
         assert(update_tally_map(sp.issuer, property, missedTokens, BALANCE));
     }
+    if (IsStateChecksumEnabled()) RemoveFromStateChecksum(StateComponent::Crowdsales, GenerateConsensusString(crowd));
     my_crowds.erase(it);
 
     if (elysium_debug_sp) PrintToLog("CLOSED CROWDSALE id: %d=%X\n", property, property);
@@ -11,8 +11,13 @@
 #include "streams.h"
 #include "util.h"
 
+#include <algorithm>
+
 #include <boost/filesystem.hpp>
 
+/** Default for -xfsnodecacheinterval, seconds between background dumps of the xfsnode caches */
+static const int64_t DEFAULT_FLATDB_DUMP_INTERVAL = 15 * 60;
+
 /** 
 *   Generic Dumping and Loading
 *   ---------------------------
@@ -37,42 +42,75 @@ private:
     std::string strFilename;
     std::string strMagicMessage;
 
+    /** Reads at most nRemaining bytes of the file, the checksum behind the data is read by the caller */
+    class CDataReader
+    {
+    private:
+        CAutoFile& file;
+        uint64_t nRemaining;
+
+    public:
+        CDataReader(CAutoFile& fileIn, uint64_t nSize) : file(fileIn), nRemaining(nSize) {}
+
+        int GetType() { return file.GetType(); }
+        int GetVersion() { return file.GetVersion(); }
+        uint64_t GetRemaining() const { return nRemaining; }
+
+        void read(char *pch, size_t nSize)
+        {
+            if (nSize > nRemaining)
+                throw std::ios_base::failure("CDataReader::read: end of data");
+            file.read(pch, nSize);
+            nRemaining -= nSize;
+        }
+    };
+
     bool Write(const T& objToSave)
     {
         // LOCK(objToSave.cs);
 
         int64_t nStart = GetTimeMillis();
 
-        // serialize, checksum data up to that point, then append checksum
-        CDataStream ssObj(SER_DISK, CLIENT_VERSION);
-        ssObj << strMagicMessage; // specific magic message for this type of object
-        ssObj << FLATDATA(Params().MessageStart()); // network specific magic number
-        ssObj << objToSave;
-        uint256 hash = Hash(ssObj.begin(), ssObj.end());
-        ssObj << hash;
+        // write to a temporary file first, a crash while dumping must not destroy the previous dump
+        boost::filesystem::path pathTmp = pathDB;
+        pathTmp += ".new";
 
         // open output file, and associate with CAutoFile
-        FILE *file = fopen(pathDB.string().c_str(), "wb");
+        FILE *file = fopen(pathTmp.string().c_str(), "wb");
         CAutoFile fileout(file, SER_DISK, CLIENT_VERSION);
         if (fileout.IsNull())
-            return error("%s: Failed to open file %s", __func__, pathDB.string());
+            return error("%s: Failed to open file %s", __func__, pathTmp.string());
 
-        // Write and commit header, data
+        // serialize straight to the file, checksum data up to that point, then append checksum
         try {
-            fileout << ssObj;
+            CHashForwarder<CAutoFile> hashout(&fileout);
+            hashout << strMagicMessage; // specific magic message for this type of object
+            hashout << FLATDATA(Params().MessageStart()); // network specific magic number
+            hashout << objToSave;
+            fileout << hashout.GetHash();
         }
         catch (std::exception &e) {
+            fileout.fclose();
+            boost::filesystem::remove(pathTmp);
             return error("%s: Serialize or I/O error - %s", __func__, e.what());
         }
+        FileCommit(fileout.Get());
         fileout.fclose();
 
+        if (!RenameOver(pathTmp, pathDB))
+            return error("%s: Rename-into-place failed for %s", __func__, pathDB.string());
+
         LogPrintf("Written info to %s  %dms\n", strFilename, GetTimeMillis() - nStart);
         LogPrintf("     %s\n", objToSave.ToString());
 
         return true;
     }
 
-    ReadResult Read(T& objToLoad, bool fDryRun = false)
+    /**
+     * Deserialize the file into pobjToLoad while it is read, the checksum is computed on the way.
+     * With pobjToLoad NULL only the header and the checksum are verified.
+     */
+    ReadResult Read(T* pobjToLoad)
     {
         //LOCK(objToLoad.cs);
 
@@ -86,43 +124,23 @@ private:
             return FileError;
         }
 
-        // use file size to size memory buffer
-        int fileSize = boost::filesystem::file_size(pathDB);
-        int dataSize = fileSize - sizeof(uint256);
-        // Don't try to resize to a negative number if file is small
-        if (dataSize < 0)
-            dataSize = 0;
-        std::vector<unsigned char> vchData;
-        vchData.resize(dataSize);
-        uint256 hashIn;
-
-        // read data and checksum from file
-        try {
-            filein.read((char *)&vchData[0], dataSize);
-            filein >> hashIn;
-        }
-        catch (std::exception &e) {
-            error("%s: Deserialize or I/O error - %s", __func__, e.what());
-            return HashReadError;
-        }
-        filein.fclose();
-
-        CDataStream ssObj(vchData, SER_DISK, CLIENT_VERSION);
-
-        // verify stored checksum matches input data
-        uint256 hashTmp = Hash(ssObj.begin(), ssObj.end());
-        if (hashIn != hashTmp)
+        uint64_t fileSize = boost::filesystem::file_size(pathDB);
+        if (fileSize < sizeof(uint256))
         {
-            error("%s: Checksum mismatch, data corrupted", __func__);
-            return IncorrectHash;
+            error("%s: Deserialize or I/O error - file too small", __func__);
+            return HashReadError;
         }
 
+        CDataReader reader(filein, fileSize - sizeof(uint256));
+        CHashVerifier<CDataReader> verifier(&reader);
+        ReadResult result = Ok;
+        std::string strError;
 
         unsigned char pchMsgTmp[4];
         std::string strMagicMessageTmp;
         try {
             // de-serialize file header (file specific magic message) and ..
-            ssObj >> strMagicMessageTmp;
+            verifier >> strMagicMessageTmp;
 
             // ... verify the message matches predefined one
             if (strMagicMessage != strMagicMessageTmp)
@@ -133,7 +151,7 @@ private:
 
 
             // de-serialize file header (network specific magic number) and ..
-            ssObj >> FLATDATA(pchMsgTmp);
+            verifier >> FLATDATA(pchMsgTmp);
 
             // ... verify the network matches ours
             if (memcmp(pchMsgTmp, Params().MessageStart(), sizeof(pchMsgTmp)))
@@ -143,20 +161,50 @@ private:
             }
 
             // de-serialize data into T object
-            ssObj >> objToLoad;
+            if (pobjToLoad)
+                verifier >> *pobjToLoad;
         }
         catch (std::exception &e) {
-            objToLoad.Clear();
+            strError = e.what();
+            result = IncorrectFormat;
+        }
+
+        // checksum whatever was not consumed, then read the stored checksum
+        uint256 hashIn;
+        try {
+            char buf[4096];
+            while (reader.GetRemaining() > 0)
+                verifier.read(buf, std::min<uint64_t>(sizeof(buf), reader.GetRemaining()));
+            filein >> hashIn;
+        }
+        catch (std::exception &e) {
+            if (pobjToLoad)
+                pobjToLoad->Clear();
             error("%s: Deserialize or I/O error - %s", __func__, e.what());
-            return IncorrectFormat;
+            return HashReadError;
         }
+        filein.fclose();
 
-        LogPrintf("Loaded info from %s  %dms\n", strFilename, GetTimeMillis() - nStart);
-        LogPrintf("     %s\n", objToLoad.ToString());
-        if(!fDryRun) {
-            LogPrintf("%s: Cleaning....\n", __func__);
-            objToLoad.CheckAndRemove();
-            LogPrintf("     %s\n", objToLoad.ToString());
+        // verify stored checksum matches input data, this takes precedence over format errors
+        if (hashIn != verifier.GetHash())
+        {
+            if (pobjToLoad)
+                pobjToLoad->Clear();
+            error("%s: Checksum mismatch, data corrupted", __func__);
+            return IncorrectHash;
+        }
+
+        if (result != Ok)
+        {
+            if (pobjToLoad)
+                pobjToLoad->Clear();
+            error("%s: Deserialize or I/O error - %s", __func__, strError);
+            return result;
+        }
+
+        if (pobjToLoad) {
+            LogPrintf("Loaded info from %s  %dms\n", strFilename, GetTimeMillis() - nStart);
+            LogPrintf("     %s\n", pobjToLoad->ToString());
         }
 
         return Ok;
@@ -171,10 +219,14 @@ public:
         strMagicMessage = strMagicMessageIn;
     }
 
-    bool Load(T& objToLoad)
+    /**
+     * Load the object from disk. Pass fCleanup false to skip CheckAndRemove, the caller is then
+     * responsible for running it, e.g. in the background once the node is up.
+     */
+    bool Load(T& objToLoad, bool fCleanup = true)
     {
         LogPrintf("Reading info from %s...\n", strFilename);
-        ReadResult readResult = Read(objToLoad);
+        ReadResult readResult = Read(&objToLoad);
         if (readResult == FileError)
             LogPrintf("Missing file %s, will try to recreate\n", strFilename);
         else if (readResult != Ok)
@@ -190,6 +242,11 @@ public:
                 return false;
             }
         }
+        else if (fCleanup) {
+            LogPrintf("%s: Cleaning....\n", __func__);
+            objToLoad.CheckAndRemove();
+            LogPrintf("     %s\n", objToLoad.ToString());
+        }
         return true;
     }
 
@@ -197,9 +254,9 @@ public:
     {
         int64_t nStart = GetTimeMillis();
 
+        // checking the header and the checksum is enough, the file is not deserialized again
         LogPrintf("Verifying %s format...\n", strFilename);
-        T tmpObjToLoad;
-        ReadResult readResult = Read(tmpObjToLoad, true);
+        ReadResult readResult = Read(NULL);
 
         // there was an error and it was not an error on file opening => do not proceed
         if (readResult == FileError)
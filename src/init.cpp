@@ -25,6 +25,7 @@
 #include "zerocoin.h"
 #include "miner.h"
 #include "net.h"
+#include "netmsgstats.h"
 #include "policy/policy.h"
 #include "rpc/server.h"
 #include "rpc/register.h"
@@ -89,6 +90,7 @@ static CZMQReplierInterface* pzmqReplierInterface = NULL;
 #include "darksend.h"
 #include "xfsnode-payments.h"
 #include "xfsnode-sync.h"
+#include "xfsnode-workers.h"
 #include "xfsnodeman.h"
 #include "xfsnodeconfig.h"
 #include "netfulfilledman.h"
@@ -207,6 +209,28 @@ static CCoinsViewDB *pcoinsdbview = NULL;
 static CCoinsViewErrorCatcher *pcoinscatcher = NULL;
 static boost::scoped_ptr<ECCVerifyHandle> globalVerifyHandle;
 
+/** Write the xfsnode list, payment votes and fulfilled requests to disk, at shutdown and every -xfsnodecacheinterval seconds */
+static void DumpXFSnodeCaches() {
+    // the scheduler may still be dumping when shutdown does, both write through the same <file>.new
+    static CCriticalSection cs_dumpXFSnodeCaches;
+    LOCK(cs_dumpXFSnodeCaches);
+    CFlatDB<CXFSnodeMan> flatdb1("incache.dat", "magicXFSnodeCache");
+    flatdb1.Dump(mnodeman);
+    CFlatDB<CXFSnodePayments> flatdb2("inpayments.dat", "magicXFSnodePaymentsCache");
+    flatdb2.Dump(mnpayments);
+    CFlatDB<CNetFulfilledRequestManager> flatdb4("netfulfilled.dat", "magicFulfilledCache");
+    flatdb4.Dump(netfulfilledman);
+}
+
+/** Drop stale entries from the caches loaded at startup, runs on the scheduler so it does not hold up init */
+static void CleanupXFSnodeCaches() {
+    int64_t nStart = GetTimeMillis();
+    mnodeman.CheckAndRemove();
+    mnpayments.CheckAndRemove();
+    netfulfilledman.CheckAndRemove();
+    LogPrintf("Cleaned loaded xfsnode caches  %dms\n", GetTimeMillis() - nStart);
+}
+
 void Interrupt(boost::thread_group &threadGroup) {
     InterruptHTTPServer();
     InterruptHTTPRPC();
@@ -252,13 +276,9 @@ void PrepareShutdown(){
 #endif
     GenerateBitcoins(false, 0, Params());
     StopNode();
+    xfsnodeWorkers.Stop();
 
-    CFlatDB<CXFSnodeMan> flatdb1("incache.dat", "magicXFSnodeCache");
-    flatdb1.Dump(mnodeman);
-    CFlatDB<CXFSnodePayments> flatdb2("inpayments.dat", "magicXFSnodePaymentsCache");
-    flatdb2.Dump(mnpayments);
-    CFlatDB<CNetFulfilledRequestManager> flatdb4("netfulfilled.dat", "magicFulfilledCache");
-    flatdb4.Dump(netfulfilledman);
+    DumpXFSnodeCaches();
 
     StopTorControl();
     UnregisterNodeSignals(GetNodeSignals());
@@ -422,6 +442,9 @@ std::string HelpMessage(HelpMessageMode mode) {
     strUsage += HelpMessageOpt("-maxorphantx=<n>",
                                strprintf(_("Keep at most <n> unconnectable transactions in memory (default: %u)"),
                                          DEFAULT_MAX_ORPHAN_TRANSACTIONS));
+    strUsage += HelpMessageOpt("-blockreconstructionextratxn=<n>",
+                               strprintf(_("Extra transactions to keep in memory for compact block reconstructions (0-%u, default: %u)"),
+                                         MAX_BLOCK_RECONSTRUCTION_EXTRA_TXN, DEFAULT_BLOCK_RECONSTRUCTION_EXTRA_TXN));
     strUsage += HelpMessageOpt("-maxmempool=<n>",
                                strprintf(_("Keep the transaction memory pool below <n> megabytes (default: %u)"),
                                          DEFAULT_MAX_MEMPOOL_SIZE));
@@ -511,6 +534,9 @@ std::string HelpMessage(HelpMessageMode mode) {
             _("Sets the serialization of raw transaction or block hex returned in non-verbose mode, non-segwit(0) or segwit(1) (default: %d)"),
             DEFAULT_RPC_SERIALIZE_VERSION));
     strUsage += HelpMessageOpt("-seednode=<ip>", _("Connect to a node to retrieve peer addresses, and disconnect"));
+    strUsage += HelpMessageOpt("-socketevents=<mode>",
+                               strprintf(_("Socket events mode, which must be one of: %s (default: %s)"),
+                                         GetSupportedSocketEventsModes(), SocketEventsModeToString(DEFAULT_SOCKETEVENTS)));
     strUsage += HelpMessageOpt("-timeout=<n>",
                                strprintf(_("Specify connection timeout in milliseconds (minimum: 1, default: %d)"),
                                          DEFAULT_CONNECT_TIMEOUT));
@@ -543,6 +569,18 @@ std::string HelpMessage(HelpMessageMode mode) {
     strUsage += HelpMessageOpt("-maxuploadtarget=<n>", strprintf(
             _("Tries to keep outbound traffic under the given target (in MiB per 24h), 0 = no limit (default: %d)"),
             DEFAULT_MAX_UPLOAD_TARGET));
+    strUsage += HelpMessageOpt("-xfsnodeworkers=<n>", strprintf(
+            _("Number of threads processing xfsnode, InstantSend and spork messages (0 to process them with other messages, max: %d, default: %d)"),
+            MAX_XFSNODE_WORKERS, DEFAULT_XFSNODE_WORKERS));
+    strUsage += HelpMessageOpt("-parsigcheck=<n>", strprintf(
+            _("Set the number of xfsnode message signature checking threads (%u to %d, 0 = auto, <0 = leave that many cores free, default: %d)"),
+            -GetNumCores(), MAX_XFSNODE_SIGCHECK_THREADS, DEFAULT_XFSNODE_SIGCHECK_THREADS));
+    strUsage += HelpMessageOpt("-netmsgstatsinterval=<n>", strprintf(
+            _("Write per command network message statistics to netmsgstats.json and publish them over ZMQ every <n> seconds, 0 to disable (default: %d)"),
+            DEFAULT_NETMSGSTATS_INTERVAL));
+    strUsage += HelpMessageOpt("-xfsnodecacheinterval=<n>", strprintf(
+            _("Write the xfsnode caches to disk every <n> seconds, 0 to write them at shutdown only (default: %d)"),
+            DEFAULT_FLATDB_DUMP_INTERVAL));
 
 #ifdef ENABLE_WALLET
     strUsage += CWallet::GetWalletHelpString(showDebug);
@@ -711,6 +749,7 @@ std::string HelpMessage(HelpMessageMode mode) {
     strUsage += HelpMessageOpt("-startclean", "Clear all persistence files on startup; triggers reparsing of Elysium transactions");
     strUsage += HelpMessageOpt("-elysiumtxcache=<num>", "The maximum number of transactions in the input transaction cache (default: 500000)");
     strUsage += HelpMessageOpt("-elysiumprogressfrequency=<seconds>", "Time in seconds after which the initial scanning progress is reported (default: 30)");
+    strUsage += HelpMessageOpt("-elysiumscanthreads=<n>", "Number of threads reading blocks ahead of the initial scan, 0 to read them on the scanning thread (default: 4)");
     strUsage += HelpMessageOpt("-elysiumdebug=<category>", "Enable or disable log categories, can be \"all\" or \"none\"");
     strUsage += HelpMessageOpt("-autocommit=<flag>", "Enable or disable broadcasting of transactions, when creating transactions (default: 1)");
     strUsage += HelpMessageOpt("-overrideforcedshutdown=<flag>", "Disable force shutdown when error (default: 0)");
@@ -1232,8 +1271,14 @@ bool AppInit2(boost::thread_group &threadGroup, CScheduler &scheduler) {
     int nUserMaxConnections = GetArg("-maxconnections", DEFAULT_MAX_PEER_CONNECTIONS);
     nMaxConnections = std::max(nUserMaxConnections, 0);
 
+    std::string strSocketEvents = GetArg("-socketevents", SocketEventsModeToString(DEFAULT_SOCKETEVENTS));
+    if (!SocketEventsModeFromString(strSocketEvents, socketEventsMode))
+        return InitError(strprintf(_("Invalid -socketevents ('%s') specified. Only these modes are supported: %s"),
+                                   strSocketEvents, GetSupportedSocketEventsModes()));
+
     // Trim requested connection counts, to fit into system limitations
-    nMaxConnections = std::max(std::min(nMaxConnections, (int) (FD_SETSIZE - nBind - MIN_CORE_FILEDESCRIPTORS)), 0);
+    if (socketEventsMode == SOCKETEVENTS_SELECT)
+        nMaxConnections = std::max(std::min(nMaxConnections, (int) (FD_SETSIZE - nBind - MIN_CORE_FILEDESCRIPTORS)), 0);
     int nFD = RaiseFileDescriptorLimit(nMaxConnections + MIN_CORE_FILEDESCRIPTORS);
     if (nFD < MIN_CORE_FILEDESCRIPTORS)
         return InitError(_("Not enough file descriptors available."));
@@ -2083,7 +2128,20 @@ bool AppInit2(boost::thread_group &threadGroup, CScheduler &scheduler) {
     if (GetBoolArg("-listenonion", DEFAULT_LISTEN_ONION))
         StartTorControl(threadGroup, scheduler);
 
+    // the message handler reads the worker list unlocked, it has to be complete before the first message arrives
+    int nXFSnodeWorkers = std::max(0, std::min((int)GetArg("-xfsnodeworkers", DEFAULT_XFSNODE_WORKERS), MAX_XFSNODE_WORKERS));
+    // -parsigcheck=0 means autodetect, same as -par
+    int nSigCheckThreads = GetArg("-parsigcheck", DEFAULT_XFSNODE_SIGCHECK_THREADS);
+    if (nSigCheckThreads <= 0)
+        nSigCheckThreads += GetNumCores();
+    nSigCheckThreads = std::max(1, std::min(nSigCheckThreads, MAX_XFSNODE_SIGCHECK_THREADS));
+    if (nXFSnodeWorkers > 0)
+        xfsnodeWorkers.Start(nXFSnodeWorkers, nSigCheckThreads, threadGroup);
+
     StartNode(threadGroup, scheduler);
+    int64_t nNetMsgStatsInterval = GetArg("-netmsgstatsinterval", DEFAULT_NETMSGSTATS_INTERVAL);
+    if (nNetMsgStatsInterval > 0)
+        scheduler.scheduleEvery(&DumpNetMsgStats, nNetMsgStatsInterval);
     // Generate coins in the background
     GenerateBitcoins(GetBoolArg("-gen", DEFAULT_GENERATE), GetArg("-genproclimit", DEFAULT_GENERATE_THREADS),
                      chainparams);
@@ -2185,14 +2243,14 @@ bool AppInit2(boost::thread_group &threadGroup, CScheduler &scheduler) {
     if (GetBoolArg("-persistentxfsnodestate", true)) {
         uiInterface.InitMessage(_("Loading xfsnode cache..."));
         CFlatDB<CXFSnodeMan> flatdb1("incache.dat", "magicXFSnodeCache");
-        if (!flatdb1.Load(mnodeman)) {
+        if (!flatdb1.Load(mnodeman, false)) {
             return InitError("Failed to load xfsnode cache from incache.dat");
         }
 
         if (mnodeman.size()) {
             uiInterface.InitMessage(_("Loading XFSnode payment cache..."));
             CFlatDB<CXFSnodePayments> flatdb2("inpayments.dat", "magicXFSnodePaymentsCache");
-            if (!flatdb2.Load(mnpayments)) {
+            if (!flatdb2.Load(mnpayments, false)) {
                 return InitError("Failed to load xfsnode payments cache from inpayments.dat");
             }
         } else {
@@ -2201,7 +2259,13 @@ bool AppInit2(boost::thread_group &threadGroup, CScheduler &scheduler) {
 
         uiInterface.InitMessage(_("Loading fulfilled requests cache..."));
         CFlatDB<CNetFulfilledRequestManager> flatdb4("netfulfilled.dat", "magicFulfilledCache");
-        flatdb4.Load(netfulfilledman);
+        flatdb4.Load(netfulfilledman, false);
+
+        scheduler.scheduleFromNow(&CleanupXFSnodeCaches, 0);
+
+        int64_t nCacheInterval = GetArg("-xfsnodecacheinterval", DEFAULT_FLATDB_DUMP_INTERVAL);
+        if (nCacheInterval > 0)
+            scheduler.scheduleEvery(&DumpXFSnodeCaches, nCacheInterval);
     }
 
     // if (!flatdb4.Load(netfulfilledman)) {
@@ -2223,8 +2287,6 @@ bool AppInit2(boost::thread_group &threadGroup, CScheduler &scheduler) {
 
     threadGroup.create_thread(boost::bind(&ThreadCheckDarkSendPool));
 
-
-
     // ********************************************************* Step 12: finished
 
     SetRPCWarmupFinished();
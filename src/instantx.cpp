@@ -79,7 +79,7 @@ bool CInstantSend::ProcessTxLockRequest(const CTxLockRequest& txLockRequest)
     // Check to see if we conflict with existing completed lock,
     // fail if so, there can't be 2 completed locks for the same outpoint
     BOOST_FOREACH(const CTxIn& txin, txLockRequest.vin) {
-        std::map<COutPoint, uint256>::iterator it = mapLockedOutpoints.find(txin.prevout);
+        std::unordered_map<COutPoint, uint256, SaltedOutPointHasher>::iterator it = mapLockedOutpoints.find(txin.prevout);
         if(it != mapLockedOutpoints.end()) {
             // Conflicting with complete lock, ignore this one
             // (this could be the one we have but we don't want to try to lock it twice anyway)
@@ -92,7 +92,7 @@ bool CInstantSend::ProcessTxLockRequest(const CTxLockRequest& txLockRequest)
     // Check to see if there are votes for conflicting request,
     // if so - do not fail, just warn user
     BOOST_FOREACH(const CTxIn& txin, txLockRequest.vin) {
-        std::map<COutPoint, std::set<uint256> >::iterator it = mapVotedOutpoints.find(txin.prevout);
+        std::unordered_map<COutPoint, std::set<uint256>, SaltedOutPointHasher>::iterator it = mapVotedOutpoints.find(txin.prevout);
         if(it != mapVotedOutpoints.end()) {
             BOOST_FOREACH(const uint256& hash, it->second) {
                 if(hash != txLockRequest.GetHash()) {
@@ -110,7 +110,7 @@ bool CInstantSend::ProcessTxLockRequest(const CTxLockRequest& txLockRequest)
     }
     LogPrintf("CInstantSend::ProcessTxLockRequest -- accepted, txid=%s\n", txHash.ToString());
 
-    std::map<uint256, CTxLockCandidate>::iterator itLockCandidate = mapTxLockCandidates.find(txHash);
+    lockcandidate_map_t::iterator itLockCandidate = mapTxLockCandidates.find(txHash);
     CTxLockCandidate& txLockCandidate = itLockCandidate->second;
     Vote(txLockCandidate);
     ProcessOrphanTxLockVotes();
@@ -132,7 +132,7 @@ bool CInstantSend::CreateTxLockCandidate(const CTxLockRequest& txLockRequest)
 
     LOCK(cs_instantsend);
 
-    std::map<uint256, CTxLockCandidate>::iterator itLockCandidate = mapTxLockCandidates.find(txHash);
+    lockcandidate_map_t::iterator itLockCandidate = mapTxLockCandidates.find(txHash);
     if(itLockCandidate == mapTxLockCandidates.end()) {
         LogPrintf("CInstantSend::CreateTxLockCandidate -- new, txid=%s\n", txHash.ToString());
 
@@ -186,14 +186,14 @@ void CInstantSend::Vote(CTxLockCandidate& txLockCandidate)
 
         LogPrint("instantsend", "CInstantSend::Vote -- In the top %d (%d)\n", nSignaturesTotal, n);
 
-        std::map<COutPoint, std::set<uint256> >::iterator itVoted = mapVotedOutpoints.find(itOutpointLock->first);
+        std::unordered_map<COutPoint, std::set<uint256>, SaltedOutPointHasher>::iterator itVoted = mapVotedOutpoints.find(itOutpointLock->first);
 
         // Check to see if we already voted for this outpoint,
         // refuse to vote twice or to include the same outpoint in another tx
         bool fAlreadyVoted = false;
         if(itVoted != mapVotedOutpoints.end()) {
             BOOST_FOREACH(const uint256& hash, itVoted->second) {
-                std::map<uint256, CTxLockCandidate>::iterator it2 = mapTxLockCandidates.find(hash);
+                lockcandidate_map_t::iterator it2 = mapTxLockCandidates.find(hash);
                 if(it2->second.HasXFSnodeVoted(itOutpointLock->first, activeXFSnode.vin.prevout)) {
                     // we already voted for this outpoint to be included either in the same tx or in a competing one,
                     // skip it anyway
@@ -264,14 +264,15 @@ bool CInstantSend::ProcessTxLockVote(CNode* pfrom, CTxLockVote& vote)
     // XFSnodes will sometimes propagate votes before the transaction is known to the client,
     // will actually process only after the lock request itself has arrived
 
-    std::map<uint256, CTxLockCandidate>::iterator it = mapTxLockCandidates.find(txHash);
+    lockcandidate_map_t::iterator it = mapTxLockCandidates.find(txHash);
     if(it == mapTxLockCandidates.end()) {
-        if(!mapTxLockVotesOrphan.count(vote.GetHash())) {
-            mapTxLockVotesOrphan[vote.GetHash()] = vote;
+        if(mapTxLockVotesOrphan[txHash].insert(vote.GetHash()).second) {
+            mapTxLockVotes.insert(std::make_pair(vote.GetHash(), vote));
+            queueTxLockVotesOrphan.push_back(std::make_pair(GetTime(), vote.GetHash()));
             LogPrint("instantsend", "CInstantSend::ProcessTxLockVote -- Orphan vote: txid=%s  xfsnode=%s new\n",
                     txHash.ToString(), vote.GetXFSnodeOutpoint().ToStringShort());
             bool fReprocess = true;
-            std::map<uint256, CTxLockRequest>::iterator itLockRequest = mapLockRequestAccepted.find(txHash);
+            lockrequest_map_t::iterator itLockRequest = mapLockRequestAccepted.find(txHash);
             if(itLockRequest == mapLockRequestAccepted.end()) {
                 itLockRequest = mapLockRequestRejected.find(txHash);
                 if(itLockRequest == mapLockRequestRejected.end()) {
@@ -295,10 +296,11 @@ bool CInstantSend::ProcessTxLockVote(CNode* pfrom, CTxLockVote& vote)
         // TODO: make sure this works good enough for multi-quorum
 
         int nXFSnodeOrphanExpireTime = GetTime() + 60*10; // keep time data for 10 minutes
-        if(!mapXFSnodeOrphanVotes.count(vote.GetXFSnodeOutpoint())) {
-            mapXFSnodeOrphanVotes[vote.GetXFSnodeOutpoint()] = nXFSnodeOrphanExpireTime;
+        std::unordered_map<COutPoint, int64_t, SaltedOutPointHasher>::iterator itXFSnodeOrphan = mapXFSnodeOrphanVotes.find(vote.GetXFSnodeOutpoint());
+        if(itXFSnodeOrphan == mapXFSnodeOrphanVotes.end()) {
+            SetXFSnodeOrphanVoteTime(vote.GetXFSnodeOutpoint(), nXFSnodeOrphanExpireTime);
         } else {
-            int64_t nPrevOrphanVote = mapXFSnodeOrphanVotes[vote.GetXFSnodeOutpoint()];
+            int64_t nPrevOrphanVote = itXFSnodeOrphan->second;
             if(nPrevOrphanVote > GetTime() && nPrevOrphanVote > GetAverageXFSnodeOrphanVoteTime()) {
                 LogPrint("instantsend", "CInstantSend::ProcessTxLockVote -- xfsnode is spamming orphan Transaction Lock Votes: txid=%s  xfsnode=%s\n",
                         txHash.ToString(), vote.GetXFSnodeOutpoint().ToStringShort());
@@ -306,7 +308,7 @@ bool CInstantSend::ProcessTxLockVote(CNode* pfrom, CTxLockVote& vote)
                 return false;
             }
             // not spamming, refresh
-            mapXFSnodeOrphanVotes[vote.GetXFSnodeOutpoint()] = nXFSnodeOrphanExpireTime;
+            SetXFSnodeOrphanVoteTime(vote.GetXFSnodeOutpoint(), nXFSnodeOrphanExpireTime);
         }
 
         return true;
@@ -314,13 +316,13 @@ bool CInstantSend::ProcessTxLockVote(CNode* pfrom, CTxLockVote& vote)
 
     LogPrint("instantsend", "CInstantSend::ProcessTxLockVote -- Transaction Lock Vote, txid=%s\n", txHash.ToString());
 
-    std::map<COutPoint, std::set<uint256> >::iterator it1 = mapVotedOutpoints.find(vote.GetOutpoint());
+    std::unordered_map<COutPoint, std::set<uint256>, SaltedOutPointHasher>::iterator it1 = mapVotedOutpoints.find(vote.GetOutpoint());
     if(it1 != mapVotedOutpoints.end()) {
         BOOST_FOREACH(const uint256& hash, it1->second) {
             if(hash != txHash) {
                 // same outpoint was already voted to be locked by another tx lock request,
                 // find out if the same mn voted on this outpoint before
-                std::map<uint256, CTxLockCandidate>::iterator it2 = mapTxLockCandidates.find(hash);
+                lockcandidate_map_t::iterator it2 = mapTxLockCandidates.find(hash);
                 if(it2->second.HasXFSnodeVoted(vote.GetOutpoint(), vote.GetXFSnodeOutpoint())) {
                     // yes, it did, refuse to accept a vote to include the same outpoint in another tx
                     // from the same xfsnode.
@@ -363,9 +365,23 @@ bool CInstantSend::ProcessTxLockVote(CNode* pfrom, CTxLockVote& vote)
 void CInstantSend::ProcessOrphanTxLockVotes()
 {
     LOCK2(cs_main, cs_instantsend);
-    std::map<uint256, CTxLockVote>::iterator it = mapTxLockVotesOrphan.begin();
+    orphanvote_map_t::iterator it = mapTxLockVotesOrphan.begin();
     while(it != mapTxLockVotesOrphan.end()) {
-        if(ProcessTxLockVote(NULL, it->second)) {
+        // the votes stay orphans until their lock request made it into a candidate
+        if(!mapTxLockCandidates.count(it->first)) {
+            ++it;
+            continue;
+        }
+        std::set<uint256>::iterator itHash = it->second.begin();
+        while(itHash != it->second.end()) {
+            lockvote_map_t::iterator itVote = mapTxLockVotes.find(*itHash);
+            if(itVote == mapTxLockVotes.end() || ProcessTxLockVote(NULL, itVote->second)) {
+                it->second.erase(itHash++);
+            } else {
+                ++itHash;
+            }
+        }
+        if(it->second.empty()) {
             mapTxLockVotesOrphan.erase(it++);
         } else {
             ++it;
@@ -390,16 +406,17 @@ bool CInstantSend::IsEnoughOrphanVotesForTxAndOutPoint(const uint256& txHash, co
 {
     // Scan orphan votes to check if this outpoint has enough orphan votes to be locked in some tx.
     LOCK2(cs_main, cs_instantsend);
+    orphanvote_map_t::iterator it = mapTxLockVotesOrphan.find(txHash);
+    if(it == mapTxLockVotesOrphan.end()) return false;
     int nCountVotes = 0;
-    std::map<uint256, CTxLockVote>::iterator it = mapTxLockVotesOrphan.begin();
-    while(it != mapTxLockVotesOrphan.end()) {
-        if(it->second.GetTxHash() == txHash && it->second.GetOutpoint() == outpoint) {
+    BOOST_FOREACH(const uint256& hash, it->second) {
+        lockvote_map_t::iterator itVote = mapTxLockVotes.find(hash);
+        if(itVote != mapTxLockVotes.end() && itVote->second.GetOutpoint() == outpoint) {
             nCountVotes++;
             if(nCountVotes >= COutPointLock::SIGNATURES_REQUIRED) {
                 return true;
             }
         }
-        ++it;
     }
     return false;
 }
@@ -466,7 +483,7 @@ void CInstantSend::LockTransactionInputs(const CTxLockCandidate& txLockCandidate
 bool CInstantSend::GetLockedOutPointTxHash(const COutPoint& outpoint, uint256& hashRet)
 {
     LOCK(cs_instantsend);
-    std::map<COutPoint, uint256>::iterator it = mapLockedOutpoints.find(outpoint);
+    std::unordered_map<COutPoint, uint256, SaltedOutPointHasher>::iterator it = mapLockedOutpoints.find(outpoint);
     if(it == mapLockedOutpoints.end()) return false;
     hashRet = it->second;
     return true;
@@ -567,15 +584,38 @@ int64_t CInstantSend::GetAverageXFSnodeOrphanVoteTime()
     // NOTE: should never actually call this function when mapXFSnodeOrphanVotes is empty
     if(mapXFSnodeOrphanVotes.empty()) return 0;
 
-    std::map<COutPoint, int64_t>::iterator it = mapXFSnodeOrphanVotes.begin();
-    int64_t total = 0;
+    return nXFSnodeOrphanVoteTimeSum / (int64_t)mapXFSnodeOrphanVotes.size();
+}
 
-    while(it != mapXFSnodeOrphanVotes.end()) {
-        total+= it->second;
-        ++it;
+void CInstantSend::SetXFSnodeOrphanVoteTime(const COutPoint& outpointXFSnode, int64_t nTime)
+{
+    std::pair<std::unordered_map<COutPoint, int64_t, SaltedOutPointHasher>::iterator, bool> ret =
+            mapXFSnodeOrphanVotes.insert(std::make_pair(outpointXFSnode, nTime));
+    if(!ret.second) {
+        nXFSnodeOrphanVoteTimeSum -= ret.first->second;
+        ret.first->second = nTime;
     }
+    nXFSnodeOrphanVoteTimeSum += nTime;
+}
 
-    return total / mapXFSnodeOrphanVotes.size();
+void CInstantSend::RemoveTxLockCandidate(lockcandidate_map_t::iterator itLockCandidate)
+{
+    const CTxLockCandidate& txLockCandidate = itLockCandidate->second;
+    uint256 txHash = txLockCandidate.GetHash();
+    std::map<COutPoint, COutPointLock>::const_iterator itOutpointLock = txLockCandidate.mapOutPointLocks.begin();
+    while(itOutpointLock != txLockCandidate.mapOutPointLocks.end()) {
+        mapLockedOutpoints.erase(itOutpointLock->first);
+        mapVotedOutpoints.erase(itOutpointLock->first);
+        ++itOutpointLock;
+    }
+    BOOST_FOREACH(const uint256& hash, txLockCandidate.GetVoteHashes()) {
+        LogPrint("instantsend", "CInstantSend::CheckAndRemove -- Removing expired vote: txid=%s  vote=%s\n",
+                txHash.ToString(), hash.ToString());
+        mapTxLockVotes.erase(hash);
+    }
+    mapLockRequestAccepted.erase(txHash);
+    mapLockRequestRejected.erase(txHash);
+    mapTxLockCandidates.erase(itLockCandidate);
 }
 
 void CInstantSend::CheckAndRemove()
@@ -584,59 +624,47 @@ void CInstantSend::CheckAndRemove()
 
     LOCK(cs_instantsend);
 
-    std::map<uint256, CTxLockCandidate>::iterator itLockCandidate = mapTxLockCandidates.begin();
-
-    // remove expired candidates
-    while(itLockCandidate != mapTxLockCandidates.end()) {
-        CTxLockCandidate &txLockCandidate = itLockCandidate->second;
-        uint256 txHash = txLockCandidate.GetHash();
-        if(txLockCandidate.IsExpired(pCurrentBlockIndex->nHeight)) {
-            LogPrintf("CInstantSend::CheckAndRemove -- Removing expired Transaction Lock Candidate: txid=%s\n", txHash.ToString());
-            std::map<COutPoint, COutPointLock>::iterator itOutpointLock = txLockCandidate.mapOutPointLocks.begin();
-            while(itOutpointLock != txLockCandidate.mapOutPointLocks.end()) {
-                mapLockedOutpoints.erase(itOutpointLock->first);
-                mapVotedOutpoints.erase(itOutpointLock->first);
-                ++itOutpointLock;
-            }
-            mapLockRequestAccepted.erase(txHash);
-            mapLockRequestRejected.erase(txHash);
-            mapTxLockCandidates.erase(itLockCandidate++);
-        } else {
-            ++itLockCandidate;
-        }
+    // remove expired candidates along with their votes, the queue is ordered by the height they expire at
+    int nKeepLock = Params().GetConsensus().nInstantSendKeepLock;
+    while(!setTxLockCandidatesByHeight.empty() &&
+            pCurrentBlockIndex->nHeight - setTxLockCandidatesByHeight.begin()->first > nKeepLock) {
+        uint256 txHash = setTxLockCandidatesByHeight.begin()->second;
+        setTxLockCandidatesByHeight.erase(setTxLockCandidatesByHeight.begin());
+        lockcandidate_map_t::iterator itLockCandidate = mapTxLockCandidates.find(txHash);
+        if(itLockCandidate == mapTxLockCandidates.end()) continue;
+        LogPrintf("CInstantSend::CheckAndRemove -- Removing expired Transaction Lock Candidate: txid=%s\n", txHash.ToString());
+        RemoveTxLockCandidate(itLockCandidate);
     }
 
-    // remove expired votes
-    std::map<uint256, CTxLockVote>::iterator itVote = mapTxLockVotes.begin();
-    while(itVote != mapTxLockVotes.end()) {
-        if(itVote->second.IsExpired(pCurrentBlockIndex->nHeight)) {
-            LogPrint("instantsend", "CInstantSend::CheckAndRemove -- Removing expired vote: txid=%s  xfsnode=%s\n",
-                    itVote->second.GetTxHash().ToString(), itVote->second.GetXFSnodeOutpoint().ToStringShort());
-            mapTxLockVotes.erase(itVote++);
-        } else {
-            ++itVote;
-        }
-    }
-
-    // remove expired orphan votes
-    std::map<uint256, CTxLockVote>::iterator itOrphanVote = mapTxLockVotesOrphan.begin();
-    while(itOrphanVote != mapTxLockVotesOrphan.end()) {
-        if(GetTime() - itOrphanVote->second.GetTimeCreated() > ORPHAN_VOTE_SECONDS) {
-            LogPrint("instantsend", "CInstantSend::CheckAndRemove -- Removing expired orphan vote: txid=%s  xfsnode=%s\n",
-                    itOrphanVote->second.GetTxHash().ToString(), itOrphanVote->second.GetXFSnodeOutpoint().ToStringShort());
-            mapTxLockVotes.erase(itOrphanVote->first);
-            mapTxLockVotesOrphan.erase(itOrphanVote++);
-        } else {
-            ++itOrphanVote;
+    // remove expired orphan votes, the queue is ordered by the time they were received
+    while(!queueTxLockVotesOrphan.empty() &&
+            GetTime() - queueTxLockVotesOrphan.front().first > ORPHAN_VOTE_SECONDS) {
+        uint256 nVoteHash = queueTxLockVotesOrphan.front().second;
+        queueTxLockVotesOrphan.pop_front();
+        lockvote_map_t::iterator itVote = mapTxLockVotes.find(nVoteHash);
+        if(itVote == mapTxLockVotes.end()) continue;
+        const CTxLockVote& vote = itVote->second;
+        orphanvote_map_t::iterator itOrphan = mapTxLockVotesOrphan.find(vote.GetTxHash());
+        if(itOrphan != mapTxLockVotesOrphan.end()) {
+            itOrphan->second.erase(nVoteHash);
+            if(itOrphan->second.empty())
+                mapTxLockVotesOrphan.erase(itOrphan);
         }
+        // votes which were added to their candidate since are removed together with it
+        lockcandidate_map_t::iterator itLockCandidate = mapTxLockCandidates.find(vote.GetTxHash());
+        if(itLockCandidate != mapTxLockCandidates.end() && itLockCandidate->second.HasVote(vote)) continue;
+        LogPrint("instantsend", "CInstantSend::CheckAndRemove -- Removing expired orphan vote: txid=%s  xfsnode=%s\n",
+                vote.GetTxHash().ToString(), vote.GetXFSnodeOutpoint().ToStringShort());
+        mapTxLockVotes.erase(itVote);
     }
 
     // remove expired xfsnode orphan votes (DOS protection)
-    std::map<COutPoint, int64_t>::iterator itXFSnodeOrphan = mapXFSnodeOrphanVotes.begin();
+    std::unordered_map<COutPoint, int64_t, SaltedOutPointHasher>::iterator itXFSnodeOrphan = mapXFSnodeOrphanVotes.begin();
     while(itXFSnodeOrphan != mapXFSnodeOrphanVotes.end()) {
         if(itXFSnodeOrphan->second < GetTime()) {
             LogPrint("instantsend", "CInstantSend::CheckAndRemove -- Removing expired orphan xfsnode vote: xfsnode=%s\n",
                     itXFSnodeOrphan->first.ToStringShort());
+            nXFSnodeOrphanVoteTimeSum -= itXFSnodeOrphan->second;
             mapXFSnodeOrphanVotes.erase(itXFSnodeOrphan++);
         } else {
             ++itXFSnodeOrphan;
@@ -674,7 +702,7 @@ bool CInstantSend::GetTxLockRequest(const uint256& txHash, CTxLockRequest& txLoc
 {
     LOCK(cs_instantsend);
 
-    std::map<uint256, CTxLockCandidate>::iterator it = mapTxLockCandidates.find(txHash);
+    lockcandidate_map_t::iterator it = mapTxLockCandidates.find(txHash);
     if(it == mapTxLockCandidates.end()) return false;
     txLockRequestRet = it->second.txLockRequest;
 
@@ -685,7 +713,7 @@ bool CInstantSend::GetTxLockVote(const uint256& hash, CTxLockVote& txLockVoteRet
 {
     LOCK(cs_instantsend);
 
-    std::map<uint256, CTxLockVote>::iterator it = mapTxLockVotes.find(hash);
+    lockvote_map_t::iterator it = mapTxLockVotes.find(hash);
     if(it == mapTxLockVotes.end()) return false;
     txLockVoteRet = it->second;
 
@@ -700,7 +728,7 @@ bool CInstantSend::IsInstantSendReadyToLock(const uint256& txHash)
     LOCK(cs_instantsend);
     // There must be a successfully verified lock request
     // and all outputs must be locked (i.e. have enough signatures)
-    std::map<uint256, CTxLockCandidate>::iterator it = mapTxLockCandidates.find(txHash);
+    lockcandidate_map_t::iterator it = mapTxLockCandidates.find(txHash);
     return it != mapTxLockCandidates.end() && it->second.IsAllOutPointsReady();
 }
 
@@ -712,7 +740,7 @@ bool CInstantSend::IsLockedInstantSendTransaction(const uint256& txHash)
     LOCK(cs_instantsend);
 
     // there must be a lock candidate
-    std::map<uint256, CTxLockCandidate>::iterator itLockCandidate = mapTxLockCandidates.find(txHash);
+    lockcandidate_map_t::iterator itLockCandidate = mapTxLockCandidates.find(txHash);
     if(itLockCandidate == mapTxLockCandidates.end()) return false;
 
     // which should have outpoints
@@ -737,7 +765,7 @@ int CInstantSend::GetTransactionLockSignatures(const uint256& txHash)
 
     LOCK(cs_instantsend);
 
-    std::map<uint256, CTxLockCandidate>::iterator itLockCandidate = mapTxLockCandidates.find(txHash);
+    lockcandidate_map_t::iterator itLockCandidate = mapTxLockCandidates.find(txHash);
     if(itLockCandidate != mapTxLockCandidates.end()) {
         return itLockCandidate->second.CountVotes();
     }
@@ -751,7 +779,7 @@ bool CInstantSend::IsTxLockRequestTimedOut(const uint256& txHash)
 
     LOCK(cs_instantsend);
 
-    std::map<uint256, CTxLockCandidate>::iterator itLockCandidate = mapTxLockCandidates.find(txHash);
+    lockcandidate_map_t::iterator itLockCandidate = mapTxLockCandidates.find(txHash);
     if (itLockCandidate != mapTxLockCandidates.end()) {
         return !itLockCandidate->second.IsAllOutPointsReady() &&
                 itLockCandidate->second.txLockRequest.IsTimedOut();
@@ -764,9 +792,14 @@ void CInstantSend::Relay(const uint256& txHash)
 {
     LOCK(cs_instantsend);
 
-    std::map<uint256, CTxLockCandidate>::const_iterator itLockCandidate = mapTxLockCandidates.find(txHash);
+    lockcandidate_map_t::const_iterator itLockCandidate = mapTxLockCandidates.find(txHash);
     if (itLockCandidate != mapTxLockCandidates.end()) {
         itLockCandidate->second.Relay();
+        BOOST_FOREACH(const uint256& hash, itLockCandidate->second.GetVoteHashes()) {
+            lockvote_map_t::const_iterator itVote = mapTxLockVotes.find(hash);
+            if(itVote != mapTxLockVotes.end())
+                itVote->second.Relay();
+        }
     }
 }
 
@@ -777,7 +810,7 @@ void CInstantSend::UpdatedBlockTip(const CBlockIndex *pindex)
 
 void CInstantSend::SyncTransaction(const CTransaction& tx, const CBlock* pblock)
 {
-    // Update lock candidates and votes if corresponding tx confirmed
+    // Update lock candidates if corresponding tx confirmed
     // or went from confirmed to 0-confirmed or conflicted.
 
     if (tx.IsCoinBase()) return;
@@ -793,41 +826,17 @@ void CInstantSend::SyncTransaction(const CTransaction& tx, const CBlock* pblock)
     LogPrint("instantsend", "CInstantSend::SyncTransaction -- txid=%s nHeightNew=%d\n", txHash.ToString(), nHeightNew);
 
     // Check lock candidates
-    std::map<uint256, CTxLockCandidate>::iterator itLockCandidate = mapTxLockCandidates.find(txHash);
+    lockcandidate_map_t::iterator itLockCandidate = mapTxLockCandidates.find(txHash);
     if(itLockCandidate != mapTxLockCandidates.end()) {
         LogPrint("instantsend", "CInstantSend::SyncTransaction -- txid=%s nHeightNew=%d lock candidate updated\n",
                 txHash.ToString(), nHeightNew);
+        // votes are dropped together with their lock candidate, only the candidate needs to be requeued
+        int nHeightOld = itLockCandidate->second.GetConfirmedHeight();
+        if(nHeightOld != -1)
+            setTxLockCandidatesByHeight.erase(std::make_pair(nHeightOld, txHash));
         itLockCandidate->second.SetConfirmedHeight(nHeightNew);
-        // Loop through outpoint locks
-        std::map<COutPoint, COutPointLock>::iterator itOutpointLock = itLockCandidate->second.mapOutPointLocks.begin();
-        while(itOutpointLock != itLockCandidate->second.mapOutPointLocks.end()) {
-            // Check corresponding lock votes
-            std::vector<CTxLockVote> vVotes = itOutpointLock->second.GetVotes();
-            std::vector<CTxLockVote>::iterator itVote = vVotes.begin();
-            std::map<uint256, CTxLockVote>::iterator it;
-            while(itVote != vVotes.end()) {
-                uint256 nVoteHash = itVote->GetHash();
-                LogPrint("instantsend", "CInstantSend::SyncTransaction -- txid=%s nHeightNew=%d vote %s updated\n",
-                        txHash.ToString(), nHeightNew, nVoteHash.ToString());
-                it = mapTxLockVotes.find(nVoteHash);
-                if(it != mapTxLockVotes.end()) {
-                    it->second.SetConfirmedHeight(nHeightNew);
-                }
-                ++itVote;
-            }
-            ++itOutpointLock;
-        }
-    }
-
-    // check orphan votes
-    std::map<uint256, CTxLockVote>::iterator itOrphanVote = mapTxLockVotesOrphan.begin();
-    while(itOrphanVote != mapTxLockVotesOrphan.end()) {
-        if(itOrphanVote->second.GetTxHash() == txHash) {
-            LogPrint("instantsend", "CInstantSend::SyncTransaction -- txid=%s nHeightNew=%d vote %s updated\n",
-                    txHash.ToString(), nHeightNew, itOrphanVote->first.ToString());
-            mapTxLockVotes[itOrphanVote->first].SetConfirmedHeight(nHeightNew);
-        }
-        ++itOrphanVote;
+        if(nHeightNew != -1)
+            setTxLockCandidatesByHeight.insert(std::make_pair(nHeightNew, txHash));
     }
 }
 
@@ -1054,28 +1063,19 @@ void CTxLockVote::Relay() const
 //    RelayInv(inv);
 }
 
-bool CTxLockVote::IsExpired(int nHeight) const
-{
-    // Locks and votes expire nInstantSendKeepLock blocks after the block corresponding tx was included into.
-    return (nConfirmedHeight != -1) && (nHeight - nConfirmedHeight > Params().GetConsensus().nInstantSendKeepLock);
-}
-
 //
 // COutPointLock
 //
 
 bool COutPointLock::AddVote(const CTxLockVote& vote)
 {
-    if(mapXFSnodeVotes.count(vote.GetXFSnodeOutpoint()))
-        return false;
-    mapXFSnodeVotes.insert(std::make_pair(vote.GetXFSnodeOutpoint(), vote));
-    return true;
+    return mapXFSnodeVotes.insert(std::make_pair(vote.GetXFSnodeOutpoint(), vote.GetHash())).second;
 }
 
-std::vector<CTxLockVote> COutPointLock::GetVotes() const
+std::vector<uint256> COutPointLock::GetVoteHashes() const
 {
-    std::vector<CTxLockVote> vRet;
-    std::map<COutPoint, CTxLockVote>::const_iterator itVote = mapXFSnodeVotes.begin();
+    std::vector<uint256> vRet;
+    std::map<COutPoint, uint256>::const_iterator itVote = mapXFSnodeVotes.begin();
     while(itVote != mapXFSnodeVotes.end()) {
         vRet.push_back(itVote->second);
         ++itVote;
@@ -1088,13 +1088,10 @@ bool COutPointLock::HasXFSnodeVoted(const COutPoint& outpointXFSnodeIn) const
     return mapXFSnodeVotes.count(outpointXFSnodeIn);
 }
 
-void COutPointLock::Relay() const
+bool COutPointLock::HasVote(const CTxLockVote& vote) const
 {
-    std::map<COutPoint, CTxLockVote>::const_iterator itVote = mapXFSnodeVotes.begin();
-    while(itVote != mapXFSnodeVotes.end()) {
-        itVote->second.Relay();
-        ++itVote;
-    }
+    std::map<COutPoint, uint256>::const_iterator it = mapXFSnodeVotes.find(vote.GetXFSnodeOutpoint());
+    return it != mapXFSnodeVotes.end() && it->second == vote.GetHash();
 }
 
 //
@@ -1132,6 +1129,12 @@ bool CTxLockCandidate::HasXFSnodeVoted(const COutPoint& outpointIn, const COutPo
     return it !=mapOutPointLocks.end() && it->second.HasXFSnodeVoted(outpointXFSnodeIn);
 }
 
+bool CTxLockCandidate::HasVote(const CTxLockVote& vote) const
+{
+    std::map<COutPoint, COutPointLock>::const_iterator it = mapOutPointLocks.find(vote.GetOutpoint());
+    return it != mapOutPointLocks.end() && it->second.HasVote(vote);
+}
+
 int CTxLockCandidate::CountVotes() const
 {
     // Note: do NOT use vote count to figure out if tx is locked, use IsAllOutPointsReady() instead
@@ -1144,18 +1147,20 @@ int CTxLockCandidate::CountVotes() const
     return nCountVotes;
 }
 
-bool CTxLockCandidate::IsExpired(int nHeight) const
+std::vector<uint256> CTxLockCandidate::GetVoteHashes() const
 {
-    // Locks and votes expire nInstantSendKeepLock blocks after the block corresponding tx was included into.
-    return (nConfirmedHeight != -1) && (nHeight - nConfirmedHeight > Params().GetConsensus().nInstantSendKeepLock);
+    std::vector<uint256> vRet;
+    std::map<COutPoint, COutPointLock>::const_iterator itOutpointLock = mapOutPointLocks.begin();
+    while(itOutpointLock != mapOutPointLocks.end()) {
+        std::vector<uint256> vOutpointVotes = itOutpointLock->second.GetVoteHashes();
+        vRet.insert(vRet.end(), vOutpointVotes.begin(), vOutpointVotes.end());
+        ++itOutpointLock;
+    }
+    return vRet;
 }
 
 void CTxLockCandidate::Relay() const
 {
+    // votes live in CInstantSend, which relays them after the transaction
     RelayTransaction(txLockRequest);
-    std::map<COutPoint, COutPointLock>::const_iterator itOutpointLock = mapOutPointLocks.begin();
-    while(itOutpointLock != mapOutPointLocks.end()) {
-        itOutpointLock->second.Relay();
-        ++itOutpointLock;
-    }
 }
@@ -4,9 +4,13 @@
 #ifndef INSTANTX_H
 #define INSTANTX_H
 
+#include "coins.h"
 #include "net.h"
 #include "primitives/transaction.h"
 
+#include <deque>
+#include <unordered_map>
+
 class CTxLockVote;
 class COutPointLock;
 class CTxLockRequest;
@@ -38,22 +42,42 @@ class CInstantSend
 private:
     static const int ORPHAN_VOTE_SECONDS            = 60;
 
+    // txids and outpoints are picked by whoever sends the lock request, so the hash maps are salted
+    class SaltedOutPointHasher
+    {
+    private:
+        SaltedTxidHasher hasher;
+
+    public:
+        size_t operator()(const COutPoint& outpoint) const { return hasher(outpoint.hash) + outpoint.n; }
+    };
+
+    typedef std::unordered_map<uint256, CTxLockRequest, SaltedTxidHasher> lockrequest_map_t;
+    typedef std::unordered_map<uint256, CTxLockVote, SaltedTxidHasher> lockvote_map_t;
+    typedef std::unordered_map<uint256, CTxLockCandidate, SaltedTxidHasher> lockcandidate_map_t;
+    typedef std::unordered_map<uint256, std::set<uint256>, SaltedTxidHasher> orphanvote_map_t;
+
     // Keep track of current block index
     const CBlockIndex *pCurrentBlockIndex;
 
     // maps for AlreadyHave
-    std::map<uint256, CTxLockRequest> mapLockRequestAccepted; // tx hash - tx
-    std::map<uint256, CTxLockRequest> mapLockRequestRejected; // tx hash - tx
-    std::map<uint256, CTxLockVote> mapTxLockVotes; // vote hash - vote
-    std::map<uint256, CTxLockVote> mapTxLockVotesOrphan; // vote hash - vote
+    lockrequest_map_t mapLockRequestAccepted; // tx hash - tx
+    lockrequest_map_t mapLockRequestRejected; // tx hash - tx
+    lockvote_map_t mapTxLockVotes; // vote hash - vote, the only copy of every vote, locks refer to it by hash
+    orphanvote_map_t mapTxLockVotesOrphan; // tx hash - hashes of the votes which arrived before the lock request
+    // (time received, vote hash) of orphan votes, oldest first
+    std::deque<std::pair<int64_t, uint256> > queueTxLockVotesOrphan;
 
-    std::map<uint256, CTxLockCandidate> mapTxLockCandidates; // tx hash - lock candidate
+    lockcandidate_map_t mapTxLockCandidates; // tx hash - lock candidate
+    // (confirmed height, tx hash) of the confirmed lock candidates, in the order they expire
+    std::set<std::pair<int, uint256> > setTxLockCandidatesByHeight;
 
-    std::map<COutPoint, std::set<uint256> > mapVotedOutpoints; // utxo - tx hash set
-    std::map<COutPoint, uint256> mapLockedOutpoints; // utxo - tx hash
+    std::unordered_map<COutPoint, std::set<uint256>, SaltedOutPointHasher> mapVotedOutpoints; // utxo - tx hash set
+    std::unordered_map<COutPoint, uint256, SaltedOutPointHasher> mapLockedOutpoints; // utxo - tx hash
 
     //track xfsnodes who voted with no txreq (for DOS protection)
-    std::map<COutPoint, int64_t> mapXFSnodeOrphanVotes; // mn outpoint - time
+    std::unordered_map<COutPoint, int64_t, SaltedOutPointHasher> mapXFSnodeOrphanVotes; // mn outpoint - time
+    int64_t nXFSnodeOrphanVoteTimeSum; // sum of the times in mapXFSnodeOrphanVotes
 
     bool CreateTxLockCandidate(const CTxLockRequest& txLockRequest);
     void Vote(CTxLockCandidate& txLockCandidate);
@@ -70,12 +94,17 @@ private:
     //update UI and notify external script if any
     void UpdateLockedTransaction(const CTxLockCandidate& txLockCandidate);
     bool ResolveConflicts(const CTxLockCandidate& txLockCandidate, int nMaxBlocks);
+    /// Drop lock candidate with its votes and outpoints, with cs_instantsend held
+    void RemoveTxLockCandidate(lockcandidate_map_t::iterator itLockCandidate);
+    void SetXFSnodeOrphanVoteTime(const COutPoint& outpointXFSnode, int64_t nTime);
 
     bool IsInstantSendReadyToLock(const uint256 &txHash);
 
 public:
     CCriticalSection cs_instantsend;
 
+    CInstantSend() : pCurrentBlockIndex(NULL), nXFSnodeOrphanVoteTimeSum(0) {}
+
     void ProcessMessage(CNode* pfrom, std::string& strCommand, CDataStream& vRecv);
 
     bool ProcessTxLockRequest(const CTxLockRequest& txLockRequest);
@@ -141,7 +170,6 @@ private:
     COutPoint outpointXFSnode;
     std::vector<unsigned char> vchXFSnodeSignature;
     // local memory only
-    int nConfirmedHeight; // when corresponding tx is 0-confirmed or conflicted, nConfirmedHeight is -1
     int64_t nTimeCreated;
 
 public:
@@ -150,7 +178,6 @@ public:
         outpoint(),
         outpointXFSnode(),
         vchXFSnodeSignature(),
-        nConfirmedHeight(-1),
         nTimeCreated(GetTime())
         {}
 
@@ -159,7 +186,6 @@ public:
         outpoint(outpointIn),
         outpointXFSnode(outpointXFSnodeIn),
         vchXFSnodeSignature(),
-        nConfirmedHeight(-1),
         nTimeCreated(GetTime())
         {}
 
@@ -181,8 +207,6 @@ public:
     int64_t GetTimeCreated() const { return nTimeCreated; }
 
     bool IsValid(CNode* pnode) const;
-    void SetConfirmedHeight(int nConfirmedHeightIn) { nConfirmedHeight = nConfirmedHeightIn; }
-    bool IsExpired(int nHeight) const;
 
     bool Sign();
     bool CheckSignature() const;
@@ -194,7 +218,7 @@ class COutPointLock
 {
 private:
     COutPoint outpoint; // utxo
-    std::map<COutPoint, CTxLockVote> mapXFSnodeVotes; // xfsnode outpoint - vote
+    std::map<COutPoint, uint256> mapXFSnodeVotes; // xfsnode outpoint - vote hash
 
 public:
     static const int SIGNATURES_REQUIRED        = 6;
@@ -208,12 +232,11 @@ public:
     COutPoint GetOutpoint() const { return outpoint; }
 
     bool AddVote(const CTxLockVote& vote);
-    std::vector<CTxLockVote> GetVotes() const;
+    std::vector<uint256> GetVoteHashes() const;
     bool HasXFSnodeVoted(const COutPoint& outpointXFSnodeIn) const;
+    bool HasVote(const CTxLockVote& vote) const;
     int CountVotes() const { return mapXFSnodeVotes.size(); }
     bool IsReady() const { return CountVotes() >= SIGNATURES_REQUIRED; }
-
-    void Relay() const;
 };
 
 class CTxLockCandidate
@@ -238,10 +261,12 @@ public:
     bool IsAllOutPointsReady() const;
 
     bool HasXFSnodeVoted(const COutPoint& outpointIn, const COutPoint& outpointXFSnodeIn);
+    bool HasVote(const CTxLockVote& vote) const;
     int CountVotes() const;
 
+    int GetConfirmedHeight() const { return nConfirmedHeight; }
     void SetConfirmedHeight(int nConfirmedHeightIn) { nConfirmedHeight = nConfirmedHeightIn; }
-    bool IsExpired(int nHeight) const;
+    std::vector<uint256> GetVoteHashes() const;
 
     void Relay() const;
 };
@@ -13,12 +13,9 @@
 #include "Zerocoin.h"
 #include "ParallelTasks.h"
 
-#define BOOST_THREAD_PROVIDES_FUTURE
-
 #include <boost/thread/locks.hpp>
 #include <boost/thread/mutex.hpp>
 #include <boost/thread/condition_variable.hpp>
-#include <boost/thread/future.hpp>
 #include <boost/chrono.hpp>
 
 #include <queue>
@@ -26,6 +23,7 @@
 #include <list>
 #include <algorithm>
 #include <functional>
+#include <future>
 
 namespace libzerocoin {
 
@@ -39,7 +37,7 @@ constexpr static int secondsBeforeThreadShutdown = 10;
 static class ParallelOpThreadPool {
 private:
     std::list<boost::thread>                  threads;
-    std::queue<boost::packaged_task<void>>    taskQueue;
+    std::queue<std::packaged_task<void()>>    taskQueue;
     boost::mutex                              taskQueueMutex;
     boost::condition_variable                 taskQueueCondition;
 
@@ -48,7 +46,7 @@ private:
 
     void ThreadProc() {
         for (;;) {
-            boost::packaged_task<void> job;
+            std::packaged_task<void()> job;
             {
                 boost::unique_lock<boost::mutex> lock(taskQueueMutex);
 
@@ -101,11 +99,12 @@ public:
     }
 
     // Post a task to the thread pool and return a future to wait for its completion
-    boost::future<void> PostTask(function<void()> task) {
-        boost::packaged_task<void> packagedTask(std::move(task));
-        boost::future<void> ret = packagedTask.get_future();
+    std::future<void> PostTask(function<void()> task) {
+        std::packaged_task<void()> packagedTask(std::move(task));
+        std::future<void> ret = packagedTask.get_future();
 
-        taskQueueMutex.lock();
+        // starting a thread may throw, the lock must be released then
+        boost::lock_guard<boost::mutex> lock(taskQueueMutex);
 
         // lazy start threads on first request or after shutdown
         if (threads.size() < numberOfThreads)
@@ -114,8 +113,6 @@ public:
         taskQueue.emplace(std::move(packagedTask));
         taskQueueCondition.notify_one();
 
-        taskQueueMutex.unlock();
-
         return ret;
     }
 
@@ -125,9 +122,9 @@ public:
 
 static class ParallelOpThreadPool {
 public:
-    boost::future<void> PostTask(function<void()> task) {
+    std::future<void> PostTask(function<void()> task) {
         task();
-        boost::promise<void> promise;
+        std::promise<void> promise;
         promise.set_value();
         return promise.get_future();
     }
@@ -141,12 +138,21 @@ ParallelTasks::ParallelTasks(int n) {
     tasks.reserve(n);
 }
 
+ParallelTasks::~ParallelTasks() {
+    for (std::future<void> &f: tasks) {
+        if (f.valid())
+            f.wait();
+    }
+}
+
 void ParallelTasks::Add(function<void()> task) {
     tasks.push_back(s_parallelOpThreadPool.PostTask(std::move(task)));
 }
 
 void ParallelTasks::Wait() {
-    for (boost::future<void> &f: tasks)
+    for (std::future<void> &f: tasks)
+        f.wait();
+    for (std::future<void> &f: tasks)
         f.get();
 }
 
@@ -19,26 +19,26 @@
 
 #include <vector>
 #include <functional>
+#include <future>
 
-#define BOOST_THREAD_PROVIDES_FUTURE
-
-
-#include <boost/thread/future.hpp>
 #include <boost/thread.hpp>
 
 namespace libzerocoin {
 
 class ParallelTasks {
 private:
-    vector<boost::future<void>> tasks;
+    std::vector<std::future<void>> tasks;
 
 public:
     ParallelTasks(int n=0);
 
+    // wait for the tasks still running, they may refer to the caller's locals
+    ~ParallelTasks();
+
     // add new task
     void Add(std::function<void()> task);
 
-    // wait for everything added so far
+    // wait for everything added so far, the first exception of a task is rethrown after all of them finished
     void Wait();
 
     // clear all the tasks from the waiting list
@@ -19,6 +19,7 @@
 #include "chainparams.h"
 #include "checkpoints.h"
 #include "checkqueue.h"
+#include "core_memusage.h"
 #include "consensus/consensus.h"
 #include "consensus/merkle.h"
 #include "consensus/validation.h"
@@ -57,6 +58,7 @@
 #include "xfsnode-payments.h"
 #include "xfsnode-sync.h"
 #include "xfsnodeman.h"
+#include "xfsnode-workers.h"
 #include "coins.h"
 
 #include "sigma/coinspend.h"
@@ -757,6 +759,21 @@ CBlockTreeDB *pblocktree = NULL;
 // mapOrphanTransactions
 //
 
+/** Ring buffer of orphaned, rejected and evicted transactions, looked at when reconstructing compact blocks. Protected by cs_main */
+static std::vector<std::pair<uint256, std::shared_ptr<const CTransaction> > > vExtraTxnForCompact;
+static size_t vExtraTxnForCompactIt = 0;
+
+static void AddToCompactExtraTransactions(const std::shared_ptr<const CTransaction> &tx) EXCLUSIVE_LOCKS_REQUIRED(cs_main) {
+    int64_t nMaxExtraTxn = GetArg("-blockreconstructionextratxn", DEFAULT_BLOCK_RECONSTRUCTION_EXTRA_TXN);
+    if (nMaxExtraTxn <= 0)
+        return;
+    size_t max_extra_txn = (size_t)std::min<int64_t>(nMaxExtraTxn, MAX_BLOCK_RECONSTRUCTION_EXTRA_TXN);
+    if (!vExtraTxnForCompact.size())
+        vExtraTxnForCompact.resize(max_extra_txn);
+    vExtraTxnForCompact[vExtraTxnForCompactIt] = std::make_pair(tx->GetWitnessHash(), tx);
+    vExtraTxnForCompactIt = (vExtraTxnForCompactIt + 1) % max_extra_txn;
+}
+
 bool AddOrphanTx(const CTransaction &tx, NodeId peer) EXCLUSIVE_LOCKS_REQUIRED(cs_main) {
     uint256 hash = tx.GetHash();
     if (mapOrphanTransactions.count(hash))
@@ -782,6 +799,8 @@ bool AddOrphanTx(const CTransaction &tx, NodeId peer) EXCLUSIVE_LOCKS_REQUIRED(c
         mapOrphanTransactionsByPrev[txin.prevout].insert(ret.first);
     }
 
+    AddToCompactExtraTransactions(std::make_shared<const CTransaction>(tx));
+
     LogPrint("mempool", "stored orphan tx %s (mapsz %u outsz %u)\n", hash.ToString(),
              mapOrphanTransactions.size(), mapOrphanTransactionsByPrev.size());
     return true;
@@ -1226,10 +1245,14 @@ void LimitMempoolSize(CTxMemPool &pool, size_t limit, unsigned long age) {
         LogPrint("mempool", "Expired %i transactions from the memory pool\n", expired);
 
     std::vector <uint256> vNoSpendsRemaining;
-    pool.TrimToSize(limit, &vNoSpendsRemaining);
+    std::vector <std::shared_ptr<const CTransaction>> vEvicted;
+    pool.TrimToSize(limit, &vNoSpendsRemaining, &vEvicted);
     BOOST_FOREACH(
     const uint256 &removed, vNoSpendsRemaining)
     pcoinsTip->Uncache(removed);
+    // low fee transactions may still make it into a block
+    BOOST_FOREACH(const std::shared_ptr<const CTransaction> &tx, vEvicted)
+        AddToCompactExtraTransactions(tx);
 }
 
 /** Convert CValidationState to a human-readable message for logging */
@@ -3158,6 +3181,9 @@ bool ConnectBlock(const CBlock &block, CValidationState &state, CBlockIndex *pin
 
         pindex->RaiseValidity(BLOCK_VALID_SCRIPTS);
         setDirtyBlockIndex.insert(pindex);
+    } else if (pindex->IsMintSpendDataPinned()) {
+        // reconnected after a reorg, mint and spend data was rebuilt and stays in memory until it's written
+        setDirtyBlockIndex.insert(pindex);
     }
 
     if (fTxIndex)
@@ -3351,6 +3377,9 @@ bool static FlushStateToDisk(CValidationState &state, FlushStateMode mode) {
                 if (!pblocktree->WriteBatchSync(vFiles, nLastBlockFile, vBlocks)) {
                     return AbortNode(state, "Files to write to block index database");
                 }
+                // modified mint and spend data is on disk now and may be evicted from memory
+                BOOST_FOREACH(const CBlockIndex *pindex, vBlocks)
+                    pindex->MintSpendDataWritten();
             }
             // Finally remove any pruned files
             if (fFlushForPrune)
@@ -3369,6 +3398,10 @@ bool static FlushStateToDisk(CValidationState &state, FlushStateMode mode) {
             // Flush the chainstate (which may refer to block index entries).
             if (!pcoinsTip->Flush())
                 return AbortNode(state, "Failed to write to coin database");
+            // Checkpoint zerocoin and sigma state at the same tip, so they don't have to be rebuilt on startup.
+            // Failing to do so is not fatal, the state is rebuilt from the block index then.
+            ZerocoinFlushState(&chainActive);
+            sigma::FlushSigmaState(&chainActive);
             nLastFlush = nNow;
         }
         if (fDoFullFlush || ((mode == FLUSH_STATE_ALWAYS || mode == FLUSH_STATE_PERIODIC) &&
@@ -3545,6 +3578,7 @@ bool static DisconnectTip(CValidationState &state, const CChainParams &chainpara
 	    // Changes to mempool should also be made to Dandelion stempool.
         stempool.UpdateTransactionsFromBlock(vHashUpdate);
     }
+    mnpayments.BlockDisconnected(block, pindexDelete);
     // Update chainActive and related variables.
     UpdateTip(pindexDelete->pprev, chainparams);
 
@@ -3667,6 +3701,7 @@ ConnectTip(CValidationState &state, const CChainParams &chainparams, CBlockIndex
     // Changes to mempool should also be made to Dandelion stempool
     stempool.removeForBlock(pblock->vtx, pindexNew->nHeight, txConflicted, !IsInitialBlockDownload());
 
+    mnpayments.BlockConnected(*pblock, pindexNew);
     // Update chainActive & related variables.
     UpdateTip(pindexNew, chainparams);
     // Tell wallet about transactions that went from mempool
@@ -3674,6 +3709,8 @@ ConnectTip(CValidationState &state, const CChainParams &chainparams, CBlockIndex
     BOOST_FOREACH(
     const CTransaction &tx, txConflicted) {
         SyncWithWallets(tx, pindexNew, NULL);
+        // a competing block may still include it
+        AddToCompactExtraTransactions(std::make_shared<const CTransaction>(tx));
     }
     // ... and about transactions that got confirmed:
     BOOST_FOREACH(
@@ -5475,8 +5512,10 @@ bool static LoadBlockIndexDB() {
 
     // some blocks in index can change as a result of ZerocoinBuildStateFromIndex() call
     set<CBlockIndex *> changes;
-    ZerocoinBuildStateFromIndex(&chainActive, changes);
-    sigma::BuildSigmaStateFromIndex(&chainActive);
+    if (!ZerocoinLoadState(&chainActive))
+        ZerocoinBuildStateFromIndex(&chainActive, changes);
+    if (!sigma::LoadSigmaState(&chainActive))
+        sigma::BuildSigmaStateFromIndex(&chainActive);
     if (!changes.empty()) {
         setDirtyBlockIndex.insert(changes.begin(), changes.end());
         FlushStateToDisk();
@@ -6230,30 +6269,140 @@ bool static AlreadyHave(const CInv &inv) EXCLUSIVE_LOCKS_REQUIRED(cs_main) {
             return mapSporks.count(inv.hash);
 
         case MSG_XFSNODE_PAYMENT_VOTE:
-            return mnpayments.mapXFSnodePaymentVotes.count(inv.hash);
+            return mnpayments.HasPaymentVote(inv.hash);
 
         case MSG_XFSNODE_PAYMENT_BLOCK:
         {
             BlockMap::iterator mi = mapBlockIndex.find(inv.hash);
-            return mi != mapBlockIndex.end() && mnpayments.mapXFSnodeBlocks.find(mi->second->nHeight) != mnpayments.mapXFSnodeBlocks.end();
+            return mi != mapBlockIndex.end() && mnpayments.HasPaymentBlock(mi->second->nHeight);
         }
 
         case MSG_XFSNODE_ANNOUNCE:
-            return mnodeman.mapSeenXFSnodeBroadcast.count(inv.hash) && !mnodeman.IsMnbRecoveryRequested(inv.hash);
+            return mnodeman.HasSeenBroadcast(inv.hash) && !mnodeman.IsMnbRecoveryRequested(inv.hash);
 
         case MSG_XFSNODE_PING:
-            return mnodeman.mapSeenXFSnodePing.count(inv.hash);
+            return mnodeman.HasSeenPing(inv.hash);
 
         case MSG_DSTX:
             return mapDarksendBroadcastTxes.count(inv.hash);
 
         case MSG_XFSNODE_VERIFY:
-            return mnodeman.mapSeenXFSnodeVerification.count(inv.hash);
+            return mnodeman.HasSeenVerification(inv.hash);
     }
     // Don't know what it is, just say we already got one
     return true;
 }
 
+/** Number of blocks near the tip whose serialized block/cmpctblock messages are kept for relay */
+static const unsigned int MAX_RECENT_BLOCK_MESSAGES = 3;
+
+/**
+ * Privacy spends of the block that we never announced. Their proofs are several kilobytes and peers
+ * that didn't see them relayed would need a getblocktxn round trip, so they go along with the
+ * compact block.
+ */
+static std::vector<uint16_t> GetCompactBlockPrefill(const CBlock &block)
+{
+    AssertLockHeld(cs_main);
+    std::vector<uint16_t> vPrefill;
+    size_t nPrefillSize = 0;
+    for (size_t i = 1; i < block.vtx.size() && i <= std::numeric_limits<uint16_t>::max(); i++) {
+        const CTransaction &tx = block.vtx[i];
+        if (!tx.IsSigmaSpend() && !tx.IsZerocoinSpend() && !tx.IsZerocoinRemint())
+            continue;
+        if (mapRelay.count(tx.GetHash()))
+            continue;
+        size_t nTxSize = ::GetSerializeSize(tx, SER_NETWORK, PROTOCOL_VERSION);
+        if (nPrefillSize + nTxSize > MAX_CMPCTBLOCK_PREFILL_SIZE)
+            continue;
+        nPrefillSize += nTxSize;
+        vPrefill.push_back(i);
+    }
+    return vPrefill;
+}
+
+struct CRecentBlockMessages {
+    uint256 hash;
+    std::shared_ptr<const CBlock> block;
+    // keyed by command and serialization version, peers differ in witness flags and protocol version
+    std::map<std::pair<std::string, int>, CSerializedNetMsgRef> mapMessages;
+};
+
+static CCriticalSection cs_recentBlockMessages;
+static std::list<CRecentBlockMessages> listRecentBlockMessages;
+
+/**
+ * A new block is requested by most peers at about the same time. Read it from disk and serialize it
+ * once per (command, version), every peer gets a reference to the same buffer.
+ */
+static CSerializedNetMsgRef GetRecentBlockMessage(const CBlockIndex *pindex, const char *pszCommand, int nSerVersion,
+                                                  const Consensus::Params &consensusParams)
+{
+    LOCK(cs_recentBlockMessages);
+    std::list<CRecentBlockMessages>::iterator it = listRecentBlockMessages.begin();
+    while (it != listRecentBlockMessages.end() && it->hash != pindex->GetBlockHash())
+        ++it;
+
+    if (it == listRecentBlockMessages.end()) {
+        std::shared_ptr<CBlock> pblock = std::make_shared<CBlock>();
+        if (!ReadBlockFromDisk(*pblock, pindex, consensusParams))
+            assert(!"cannot load block from disk");
+        listRecentBlockMessages.push_front(CRecentBlockMessages());
+        listRecentBlockMessages.front().hash = pindex->GetBlockHash();
+        listRecentBlockMessages.front().block = pblock;
+        if (listRecentBlockMessages.size() > MAX_RECENT_BLOCK_MESSAGES)
+            listRecentBlockMessages.pop_back();
+    } else if (it != listRecentBlockMessages.begin()) {
+        listRecentBlockMessages.splice(listRecentBlockMessages.begin(), listRecentBlockMessages, it);
+    }
+
+    CRecentBlockMessages &recent = listRecentBlockMessages.front();
+    std::pair<std::string, int> key = std::make_pair(std::string(pszCommand), nSerVersion);
+    std::map<std::pair<std::string, int>, CSerializedNetMsgRef>::const_iterator mi = recent.mapMessages.find(key);
+    if (mi != recent.mapMessages.end())
+        return mi->second;
+
+    CSerializedNetMsgRef msg;
+    if (key.first == NetMsgType::CMPCTBLOCK) {
+        CBlockHeaderAndShortTxIDs cmpctblock(*recent.block, !(nSerVersion & SERIALIZE_TRANSACTION_NO_WITNESS),
+                                             GetCompactBlockPrefill(*recent.block));
+        msg = MakeSerializedNetMsg(pszCommand, cmpctblock, nSerVersion);
+    } else {
+        msg = MakeSerializedNetMsg(pszCommand, *recent.block, nSerVersion);
+    }
+    recent.mapMessages[key] = msg;
+    return msg;
+}
+
+/**
+ * Serve block/cmpctblock requests for blocks near the tip from the shared message cache.
+ * Returns false if the request has to be answered the usual way.
+ */
+static bool PushRecentBlockMessage(CNode *pfrom, const CInv &inv, const CBlockIndex *pindex,
+                                   const Consensus::Params &consensusParams)
+{
+    AssertLockHeld(cs_main);
+    if (pindex->nHeight < chainActive.Height() - MAX_CMPCTBLOCK_DEPTH)
+        return false;
+
+    const char *pszCommand = NetMsgType::BLOCK;
+    int nSendFlags = 0;
+    if (inv.type == MSG_BLOCK) {
+        nSendFlags = SERIALIZE_TRANSACTION_NO_WITNESS;
+    } else if (inv.type == MSG_WITNESS_BLOCK) {
+        nSendFlags = 0;
+    } else if (inv.type == MSG_CMPCT_BLOCK) {
+        nSendFlags = State(pfrom->GetId())->fWantsCmpctWitness ? 0 : SERIALIZE_TRANSACTION_NO_WITNESS;
+        if (CanDirectFetch(consensusParams))
+            pszCommand = NetMsgType::CMPCTBLOCK;
+    } else {
+        return false;
+    }
+
+    pfrom->PushSerializedMessage(GetRecentBlockMessage(pindex, pszCommand, pfrom->ssSend.GetVersion() | nSendFlags, consensusParams));
+    return true;
+}
+
 void static ProcessGetData(CNode *pfrom, const Consensus::Params &consensusParams) {
     std::deque<CInv>::iterator it = pfrom->vRecvGetData.begin();
 
@@ -6312,53 +6461,55 @@ void static ProcessGetData(CNode *pfrom, const Consensus::Params &consensusParam
                 // Pruned nodes may have deleted the block, so check whether
                 // it's available before trying to send.
                 if (send && (mi->second->nStatus & BLOCK_HAVE_DATA)) {
-                    // Send block from disk
-                    CBlock block;
-                    if (!ReadBlockFromDisk(block, (*mi).second, consensusParams))
-                        assert(!"cannot load block from disk");
-                    if (inv.type == MSG_BLOCK)
-                        pfrom->PushMessageWithFlag(SERIALIZE_TRANSACTION_NO_WITNESS, NetMsgType::BLOCK, block);
-                    else if (inv.type == MSG_WITNESS_BLOCK)
-                        pfrom->PushMessage(NetMsgType::BLOCK, block);
-                    else if (inv.type == MSG_FILTERED_BLOCK) {
-                        bool send = false;
-                        CMerkleBlock merkleBlock;
-                        {
-                            LOCK(pfrom->cs_filter);
-                            if (pfrom->pfilter) {
-                                send = true;
-                                merkleBlock = CMerkleBlock(block, *pfrom->pfilter);
+                    if (!PushRecentBlockMessage(pfrom, inv, mi->second, consensusParams)) {
+                        // Send block from disk
+                        CBlock block;
+                        if (!ReadBlockFromDisk(block, (*mi).second, consensusParams))
+                            assert(!"cannot load block from disk");
+                        if (inv.type == MSG_BLOCK)
+                            pfrom->PushMessageWithFlag(SERIALIZE_TRANSACTION_NO_WITNESS, NetMsgType::BLOCK, block);
+                        else if (inv.type == MSG_WITNESS_BLOCK)
+                            pfrom->PushMessage(NetMsgType::BLOCK, block);
+                        else if (inv.type == MSG_FILTERED_BLOCK) {
+                            bool send = false;
+                            CMerkleBlock merkleBlock;
+                            {
+                                LOCK(pfrom->cs_filter);
+                                if (pfrom->pfilter) {
+                                    send = true;
+                                    merkleBlock = CMerkleBlock(block, *pfrom->pfilter);
+                                }
                             }
+                            if (send) {
+                                pfrom->PushMessage(NetMsgType::MERKLEBLOCK, merkleBlock);
+                                // CMerkleBlock just contains hashes, so also push any transactions in the block the client did not see
+                                // This avoids hurting performance by pointlessly requiring a round-trip
+                                // Note that there is currently no way for a node to request any single transactions we didn't send here -
+                                // they must either disconnect and retry or request the full block.
+                                // Thus, the protocol spec specified allows for us to provide duplicate txn here,
+                                // however we MUST always provide at least what the remote peer needs
+                                typedef std::pair<unsigned int, uint256> PairType;
+                                BOOST_FOREACH(PairType & pair, merkleBlock.vMatchedTxn)
+                                    pfrom->PushMessageWithFlag(SERIALIZE_TRANSACTION_NO_WITNESS, NetMsgType::TX,
+                                            block.vtx[pair.first]);
+                            }
+                            // else
+                            // no response
+                        } else if (inv.type == MSG_CMPCT_BLOCK) {
+                            // If a peer is asking for old blocks, we're almost guaranteed
+                            // they wont have a useful mempool to match against a compact block,
+                            // and we don't feel like constructing the object for them, so
+                            // instead we respond with the full, non-compact block.
+                            bool fPeerWantsWitness = State(pfrom->GetId())->fWantsCmpctWitness;
+                            if (CanDirectFetch(consensusParams) &&
+                                    mi->second->nHeight >= chainActive.Height() - MAX_CMPCTBLOCK_DEPTH) {
+                                CBlockHeaderAndShortTxIDs cmpctblock(block, fPeerWantsWitness, GetCompactBlockPrefill(block));
+                                pfrom->PushMessageWithFlag(fPeerWantsWitness ? 0 : SERIALIZE_TRANSACTION_NO_WITNESS,
+                                        NetMsgType::CMPCTBLOCK, cmpctblock);
+                            } else
+                                pfrom->PushMessageWithFlag(fPeerWantsWitness ? 0 : SERIALIZE_TRANSACTION_NO_WITNESS,
+                                        NetMsgType::BLOCK, block);
                         }
-                        if (send) {
-                            pfrom->PushMessage(NetMsgType::MERKLEBLOCK, merkleBlock);
-                            // CMerkleBlock just contains hashes, so also push any transactions in the block the client did not see
-                            // This avoids hurting performance by pointlessly requiring a round-trip
-                            // Note that there is currently no way for a node to request any single transactions we didn't send here -
-                            // they must either disconnect and retry or request the full block.
-                            // Thus, the protocol spec specified allows for us to provide duplicate txn here,
-                            // however we MUST always provide at least what the remote peer needs
-                            typedef std::pair<unsigned int, uint256> PairType;
-                            BOOST_FOREACH(PairType & pair, merkleBlock.vMatchedTxn)
-                                pfrom->PushMessageWithFlag(SERIALIZE_TRANSACTION_NO_WITNESS, NetMsgType::TX,
-                                        block.vtx[pair.first]);
-                        }
-                        // else
-                        // no response
-                    } else if (inv.type == MSG_CMPCT_BLOCK) {
-                        // If a peer is asking for old blocks, we're almost guaranteed
-                        // they wont have a useful mempool to match against a compact block,
-                        // and we don't feel like constructing the object for them, so
-                        // instead we respond with the full, non-compact block.
-                        bool fPeerWantsWitness = State(pfrom->GetId())->fWantsCmpctWitness;
-                        if (CanDirectFetch(consensusParams) &&
-                                mi->second->nHeight >= chainActive.Height() - MAX_CMPCTBLOCK_DEPTH) {
-                            CBlockHeaderAndShortTxIDs cmpctblock(block, fPeerWantsWitness);
-                            pfrom->PushMessageWithFlag(fPeerWantsWitness ? 0 : SERIALIZE_TRANSACTION_NO_WITNESS,
-                                    NetMsgType::CMPCTBLOCK, cmpctblock);
-                        } else
-                            pfrom->PushMessageWithFlag(fPeerWantsWitness ? 0 : SERIALIZE_TRANSACTION_NO_WITNESS,
-                                    NetMsgType::BLOCK, block);
                     }
 
                     // Trigger the peer node to send a getblocks request for the next batch of inventory
@@ -6490,10 +6641,11 @@ void static ProcessGetData(CNode *pfrom, const Consensus::Params &consensusParam
                 }
 
                 if (!pushed && inv.type == MSG_XFSNODE_PAYMENT_VOTE) {
-                    if(mnpayments.HasVerifiedPaymentVote(inv.hash)) {
+                    CXFSnodePaymentVote vote;
+                    if(mnpayments.GetVerifiedPaymentVote(inv.hash, vote)) {
                         CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
                         ss.reserve(1000);
-                        ss << mnpayments.mapXFSnodePaymentVotes[inv.hash];
+                        ss << vote;
                         pfrom->PushMessage(NetMsgType::XFSNODEPAYMENTVOTE, ss);
                         pushed = true;
                     }
@@ -6506,10 +6658,11 @@ void static ProcessGetData(CNode *pfrom, const Consensus::Params &consensusParam
                         BOOST_FOREACH(CXFSnodePayee& payee, mnpayments.mapXFSnodeBlocks[mi->second->nHeight].vecPayees) {
                             std::vector<uint256> vecVoteHashes = payee.GetVoteHashes();
                             BOOST_FOREACH(uint256& hash, vecVoteHashes) {
-                                if(mnpayments.HasVerifiedPaymentVote(hash)) {
+                                CXFSnodePaymentVote vote;
+                                if(mnpayments.GetVerifiedPaymentVote(hash, vote)) {
                                     CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
                                     ss.reserve(1000);
-                                    ss << mnpayments.mapXFSnodePaymentVotes[hash];
+                                    ss << vote;
                                     pfrom->PushMessage(NetMsgType::XFSNODEPAYMENTVOTE, ss);
                                 }
                             }
@@ -6519,20 +6672,22 @@ void static ProcessGetData(CNode *pfrom, const Consensus::Params &consensusParam
                 }
 
                 if (!pushed && inv.type == MSG_XFSNODE_ANNOUNCE) {
-                    if(mnodeman.mapSeenXFSnodeBroadcast.count(inv.hash)){
+                    CXFSnodeBroadcast mnb;
+                    if(mnodeman.GetSeenBroadcast(inv.hash, mnb)){
                         CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
                         ss.reserve(1000);
-                        ss << mnodeman.mapSeenXFSnodeBroadcast[inv.hash].second;
+                        ss << mnb;
                         pfrom->PushMessage(NetMsgType::MNANNOUNCE, ss);
                         pushed = true;
                     }
                 }
 
                 if (!pushed && inv.type == MSG_XFSNODE_PING) {
-                    if(mnodeman.mapSeenXFSnodePing.count(inv.hash)) {
+                    CXFSnodePing mnp;
+                    if(mnodeman.GetSeenPing(inv.hash, mnp)) {
                         CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
                         ss.reserve(1000);
-                        ss << mnodeman.mapSeenXFSnodePing[inv.hash];
+                        ss << mnp;
                         pfrom->PushMessage(NetMsgType::MNPING, ss);
                         pushed = true;
                     }
@@ -6549,10 +6704,11 @@ void static ProcessGetData(CNode *pfrom, const Consensus::Params &consensusParam
                 }
 
                 if (!pushed && inv.type == MSG_XFSNODE_VERIFY) {
-                    if(mnodeman.mapSeenXFSnodeVerification.count(inv.hash)) {
+                    CXFSnodeVerification mnv;
+                    if(mnodeman.GetSeenVerification(inv.hash, mnv)) {
                         CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
                         ss.reserve(1000);
-                        ss << mnodeman.mapSeenXFSnodeVerification[inv.hash];
+                        ss << mnv;
                         pfrom->PushMessage(NetMsgType::MNVERIFY, ss);
                         pushed = true;
                     }
@@ -6595,7 +6751,7 @@ uint32_t GetFetchFlags(CNode *pfrom, CBlockIndex *pprev, const Consensus::Params
 
 bool static ProcessMessage(CNode *pfrom, string strCommand,
                            CDataStream &vRecv, int64_t nTimeReceived,
-                           const CChainParams &chainparams) {
+                           const CChainParams &chainparams, bool *pfOffloaded = NULL) {
     if (mapArgs.count("-dropmessagestest") && GetRand(atoi(mapArgs["-dropmessagestest"])) == 0) {
         LogPrintf("dropmessagestest DROPPING RECV MESSAGE\n");
         return true;
@@ -7220,16 +7376,34 @@ bool static ProcessMessage(CNode *pfrom, string strCommand,
             pmn->fAllowMixingTx = false;
         }
 
+        CValidationState state;
+
+        // Verify sigma spend proofs before taking cs_main, AcceptToMemoryPool finds them cached afterwards.
+        // Transactions we have, rejected recently or saw confirmed are not verified again
+        int64_t nTimeStart = GetTimeMicros();
+        bool fAlreadyHave;
+        {
+            LOCK(cs_main);
+            fAlreadyHave = AlreadyHave(inv);
+        }
+        bool fSpendProofsValid = fAlreadyHave || !tx.IsSigmaSpend() ||
+                                 sigma::VerifySigmaSpendProofs(tx, state);
+        int64_t nTimeProofs = GetTimeMicros();
+
         LOCK(cs_main);
+        if (!fSpendProofsValid && tx.wit.IsNull()) {
+            // re-sent copies are dropped by AlreadyHave, witness transactions may have been malleated
+            assert(recentRejects);
+            recentRejects->insert(inv.hash);
+        }
 
         bool fMissingInputs = false;
         bool fMissingInputsZerocoin = false;
-        CValidationState state;
         CValidationState dummyState; // Dummy state for Dandelion stempool
 
         pfrom->setAskFor.erase(inv.hash);
         mapAlreadyAskedFor.erase(inv.hash);
-        if (!AlreadyHave(inv) && !tx.IsZerocoinSpend() &&
+        if (fSpendProofsValid && !AlreadyHave(inv) && !tx.IsZerocoinSpend() &&
             AcceptToMemoryPool(mempool, state, tx, true, true, &fMissingInputs, false, 0, true)) {
             LogPrintf("Transaction %s received and added to the mempool.\n",
                       tx.GetHash().ToString());
@@ -7408,6 +7582,9 @@ bool static ProcessMessage(CNode *pfrom, string strCommand,
 //                LogPrint("mempool", "not keeping orphan with rejected parents %s\n", tx.GetHash().ToString());
             }
         }
+        LogPrint("bench", "    - Process tx %s: %.2fms proofs without lock, %.2fms under cs_main\n",
+                 tx.GetHash().ToString(), (nTimeProofs - nTimeStart) * 0.001, (GetTimeMicros() - nTimeProofs) * 0.001);
+
         int nDoS = 0;
         if (state.IsInvalid(nDoS)) {
 //            LogPrint("mempoolrej", "%s from peer=%d was not accepted: %s\n", tx.GetHash().ToString(),
@@ -7420,6 +7597,11 @@ bool static ProcessMessage(CNode *pfrom, string strCommand,
                     state.GetRejectReason().substr(0, MAX_REJECT_MESSAGE_LENGTH), inv.hash);
             if (nDoS > 0) {
                 Misbehaving(pfrom->GetId(), nDoS);
+            } else if (!state.CorruptionPossible()) {
+                // e.g. a spend losing to one with the same serial, miners may have seen it first.
+                // Big ones are skipped, any peer could otherwise fill the ring with near block sized transactions
+                if (RecursiveDynamicUsage(tx) < MAX_EXTRA_TXN_DYNAMIC_USAGE)
+                    AddToCompactExtraTransactions(std::make_shared<const CTransaction>(tx));
             }
         }
         FlushStateToDisk(state, FLUSH_STATE_PERIODIC);
@@ -7431,10 +7613,23 @@ bool static ProcessMessage(CNode *pfrom, string strCommand,
         bool fMissingInputs = false;
         std::list<CTransaction> lRemovedTxn;
         CInv inv(MSG_DANDELION_TX, tx.GetHash());
+        // Verify sigma spend proofs before taking cs_main, AcceptToMemoryPool finds them cached afterwards.
+        // Transactions rejected recently, orphaned or confirmed are neither verified again nor stemmed
+        bool fSkipStem;
+        {
+            LOCK(cs_main);
+            fSkipStem = AlreadyHave(CInv(MSG_TX, inv.hash)) && !mempool.exists(inv.hash);
+        }
+        bool fSpendProofsValid = fSkipStem || !tx.IsSigmaSpend() || stempool.exists(inv.hash) ||
+                                 mempool.exists(inv.hash) || sigma::VerifySigmaSpendProofs(tx, state);
         LOCK(cs_main);
-        if (CNode::isDandelionInbound(pfrom)) {
+        if (!fSpendProofsValid && tx.wit.IsNull()) {
+            assert(recentRejects);
+            recentRejects->insert(inv.hash);
+        }
+        if (CNode::isDandelionInbound(pfrom) && !fSkipStem) {
             if (!stempool.exists(inv.hash)) {
-                bool ret = AcceptToMemoryPool(
+                bool ret = fSpendProofsValid && AcceptToMemoryPool(
                     stempool,
                     state,
                     tx,
@@ -7575,7 +7770,7 @@ bool static ProcessMessage(CNode *pfrom, string strCommand,
                 }
 
                 PartiallyDownloadedBlock &partialBlock = *(*queuedBlockIt)->partialBlock;
-                ReadStatus status = partialBlock.InitData(cmpctblock);
+                ReadStatus status = partialBlock.InitData(cmpctblock, vExtraTxnForCompact);
                 if (status == READ_STATUS_INVALID) {
                     MarkBlockAsReceived(pindex->GetBlockHash()); // Reset in-flight state in case of whitelist
                     Misbehaving(pfrom->GetId(), 100);
@@ -7583,6 +7778,7 @@ bool static ProcessMessage(CNode *pfrom, string strCommand,
                     return true;
                 } else if (status == READ_STATUS_FAILED) {
                     // Duplicate txindexes, the block is now in-flight, so just request it
+                    compactBlockStats.nBlocksFailed++;
                     std::vector <CInv> vInv(1);
                     vInv[0] = CInv(MSG_BLOCK | GetFetchFlags(pfrom, pindex->pprev, chainparams.GetConsensus()),
                                    cmpctblock.header.GetHash());
@@ -7619,7 +7815,7 @@ bool static ProcessMessage(CNode *pfrom, string strCommand,
                 // Optimistically try to reconstruct anyway since we might be
                 // able to without any round trips.
                 PartiallyDownloadedBlock tempBlock(&mempool);
-                ReadStatus status = tempBlock.InitData(cmpctblock);
+                ReadStatus status = tempBlock.InitData(cmpctblock, vExtraTxnForCompact);
                 if (status != READ_STATUS_OK) {
                     // TODO: don't ignore failures
                     return true;
@@ -7704,6 +7900,7 @@ bool static ProcessMessage(CNode *pfrom, string strCommand,
             return true;
         } else if (status == READ_STATUS_FAILED) {
             // Might have collided, fall back to getdata now :(
+            compactBlockStats.nBlocksFailed++;
             std::vector <CInv> invs;
             invs.push_back(CInv(MSG_BLOCK | GetFetchFlags(pfrom, chainActive.Tip(), chainparams.GetConsensus()),
                                 resp.blockhash));
@@ -8123,13 +8320,10 @@ bool static ProcessMessage(CNode *pfrom, string strCommand,
         }
 
         if (found) {
-            //probably one the extensions
-            darkSendPool.ProcessMessage(pfrom, strCommand, vRecv);
-            mnodeman.ProcessMessage(pfrom, strCommand, vRecv);
-            mnpayments.ProcessMessage(pfrom, strCommand, vRecv);
-            instantsend.ProcessMessage(pfrom, strCommand, vRecv);
-            sporkManager.ProcessSpork(pfrom, strCommand, vRecv);
-            xfsnodeSync.ProcessMessage(pfrom, strCommand, vRecv);
+            //probably one the extensions, handled on the xfsnode workers
+            bool fOffloaded = xfsnodeWorkers.ProcessMessage(pfrom, strCommand, vRecv);
+            if (pfOffloaded)
+                *pfOffloaded = fOffloaded;
         } else {
             // Ignore unknown commands for extensibility
             LogPrint("net", "Unknown command \"%s\" from peer=%d\n", SanitizeString(strCommand), pfrom->id);
@@ -8159,8 +8353,8 @@ bool ProcessMessages(CNode *pfrom) {
 
     std::deque<CNetMessage>::iterator it = pfrom->vRecvMsg.begin();
     while (!pfrom->fDisconnect && it != pfrom->vRecvMsg.end()) {
-        // Don't bother if send buffer is too full to respond anyway
-        if (pfrom->nSendSize >= SendBufferSize())
+        // Don't bother if send buffer is too full to respond anyway, or the xfsnode workers are behind
+        if (!pfrom->CanProcessMessages())
             break;
 
         // get next message
@@ -8204,8 +8398,11 @@ bool ProcessMessages(CNode *pfrom) {
 
         // Process message
         bool fRet = false;
+        // a worker records the processing time of the messages handed to it
+        bool fOffloaded = false;
+        int64_t nTimeStart = GetTimeMicros();
         try {
-            fRet = ProcessMessage(pfrom, strCommand, vRecv, msg.nTime, chainparams);
+            fRet = ProcessMessage(pfrom, strCommand, vRecv, msg.nTime, chainparams, &fOffloaded);
             boost::this_thread::interruption_point();
         }
         catch (const std::ios_base::failure &e) {
@@ -8236,6 +8433,12 @@ bool ProcessMessages(CNode *pfrom) {
             PrintExceptionContinue(NULL, "ProcessMessages() 3");
         }
 
+        if (!fOffloaded) {
+            int64_t nTimeProcess = GetTimeMicros() - nTimeStart;
+            pfrom->msgStats.RecordProcessed(strCommand, nTimeProcess);
+            netMsgStats.RecordProcessed(strCommand, nTimeProcess);
+        }
+
         if (!fRet)
             LogPrintf("%s(%s, %u bytes) FAILED peer=%d\n", __func__, SanitizeString(strCommand), nMessageSize,
                       pfrom->id);
@@ -8466,12 +8669,9 @@ bool SendMessages(CNode *pto) {
                     // probably means we're doing an initial-ish-sync or they're slow
                     LogPrint("net", "%s sending header-and-ids %s to peer %d\n", __func__,
                              vHeaders.front().GetHash().ToString(), pto->id);
-                    //TODO: Shouldn't need to reload block from disk, but requires refactor
-                    CBlock block;
-                    assert(ReadBlockFromDisk(block, pBestIndex, consensusParams));
-                    CBlockHeaderAndShortTxIDs cmpctblock(block, state.fWantsCmpctWitness);
-                    pto->PushMessageWithFlag(state.fWantsCmpctWitness ? 0 : SERIALIZE_TRANSACTION_NO_WITNESS,
-                                             NetMsgType::CMPCTBLOCK, cmpctblock);
+                    int nSendFlags = state.fWantsCmpctWitness ? 0 : SERIALIZE_TRANSACTION_NO_WITNESS;
+                    pto->PushSerializedMessage(GetRecentBlockMessage(pBestIndex, NetMsgType::CMPCTBLOCK,
+                                                                     pto->ssSend.GetVersion() | nSendFlags, consensusParams));
                     state.pindexBestHeaderSent = pBestIndex;
                 } else if (state.fPreferHeaders) {
                     if (vHeaders.size() > 1) {
@@ -67,6 +67,12 @@ static const CAmount HIGH_TX_FEE_PER_KB = 0.01 * CENT;
 static const CAmount HIGH_MAX_TX_FEE = 1000 * DEFAULT_MIN_RELAY_TX_FEE;
 /** Default for -maxorphantx, maximum number of orphan transactions kept in memory */
 static const unsigned int DEFAULT_MAX_ORPHAN_TRANSACTIONS = 100;
+/** Default number of orphan+recently-replaced txn to keep around for block reconstruction */
+static const unsigned int DEFAULT_BLOCK_RECONSTRUCTION_EXTRA_TXN = 100;
+/** Upper bound for -blockreconstructionextratxn */
+static const unsigned int MAX_BLOCK_RECONSTRUCTION_EXTRA_TXN = 10000;
+/** Rejected transactions using more memory than this are not kept for block reconstruction */
+static const size_t MAX_EXTRA_TXN_DYNAMIC_USAGE = 100000;
 /** Expiration time for orphan transactions in seconds */
 static const int64_t ORPHAN_TX_EXPIRE_TIME = 20 * 60;
 /** Minimum time between orphan transactions expire time checks in seconds */
@@ -128,6 +128,7 @@ ServiceFlags nRelevantServices = NODE_NETWORK;
 //
 bool fDiscover = true;
 bool fListen = true;
+SocketEventsMode socketEventsMode = DEFAULT_SOCKETEVENTS;
 ServiceFlags nLocalServices = NODE_NETWORK;
 bool fRelayTxes = true;
 CCriticalSection cs_mapLocalHost;
@@ -155,8 +156,67 @@ NodeId nLastNodeId = 0;
 CCriticalSection cs_nLastNodeId;
 
 static CSemaphore *semOutbound = NULL;
+static CSocketEvents *pSocketEvents = NULL;
 boost::condition_variable messageHandlerCondition;
 
+// Nodes with complete messages or pending getdata, in the order they became ready
+static boost::mutex mutexReadyNodes;
+static std::deque<CNode *> vReadyNodes;
+
+// Capacity classes of pooled receive buffers, a buffer is reused for messages up to its class size
+static const size_t RECV_BUFFER_CLASS_SIZE[] = {1024, 16 * 1024, 256 * 1024, MAX_PROTOCOL_MESSAGE_LENGTH};
+// Number of buffers kept per class
+static const size_t RECV_BUFFER_CLASS_COUNT[] = {256, 64, 16, 2};
+static const int RECV_BUFFER_CLASSES = sizeof(RECV_BUFFER_CLASS_SIZE) / sizeof(RECV_BUFFER_CLASS_SIZE[0]);
+
+// Message payload buffers are allocated ahead by at most this much, so a peer can't make us allocate by just announcing a large message
+static const unsigned int RECV_BUFFER_PREALLOC = 256 * 1024;
+
+static CCriticalSection cs_vRecvBufferPool;
+static std::vector<CSerializeData> vRecvBufferPool[RECV_BUFFER_CLASSES];
+
+static int GetRecvBufferClass(size_t nSize) {
+    int nClass = 0;
+    while (nClass < RECV_BUFFER_CLASSES - 1 && RECV_BUFFER_CLASS_SIZE[nClass] < nSize)
+        nClass++;
+    return nClass;
+}
+
+/** Take a pooled buffer for a message of nSize bytes, vch is left alone if there is none */
+static void AcquireRecvBuffer(CSerializeData &vch, size_t nSize) {
+    int nClass = GetRecvBufferClass(nSize);
+    {
+        LOCK(cs_vRecvBufferPool);
+        if (!vRecvBufferPool[nClass].empty()) {
+            vch.swap(vRecvBufferPool[nClass].back());
+            vRecvBufferPool[nClass].pop_back();
+            return;
+        }
+    }
+    // small messages are cheap to allocate ahead, that way the buffer can go to the pool afterwards
+    if (nClass == 0)
+        vch.reserve(RECV_BUFFER_CLASS_SIZE[0]);
+}
+
+/** Return the buffer of a finished message to the pool */
+static void ReleaseRecvBuffer(CSerializeData &vch) {
+    size_t nCapacity = vch.capacity();
+    if (nCapacity < RECV_BUFFER_CLASS_SIZE[0] || nCapacity > 2 * RECV_BUFFER_CLASS_SIZE[RECV_BUFFER_CLASSES - 1])
+        return;
+
+    // the class whose messages are guaranteed to fit
+    int nClass = 0;
+    while (nClass < RECV_BUFFER_CLASSES - 1 && RECV_BUFFER_CLASS_SIZE[nClass + 1] <= nCapacity)
+        nClass++;
+
+    vch.clear();
+    LOCK(cs_vRecvBufferPool);
+    if (vRecvBufferPool[nClass].size() < RECV_BUFFER_CLASS_COUNT[nClass]) {
+        vRecvBufferPool[nClass].push_back(CSerializeData());
+        vRecvBufferPool[nClass].back().swap(vch);
+    }
+}
+
 // Signals for message handling
 static CNodeSignals g_signals;
 
@@ -428,7 +488,7 @@ CNode *ConnectNode(CAddress addrConnect, const char *pszDest, bool fCountFailure
     if (pszDest ? ConnectSocketByName(addrConnect, hSocket, pszDest, Params().GetDefaultPort(), nConnectTimeout,
                                       &proxyConnectionFailed) :
         ConnectSocket(addrConnect, hSocket, nConnectTimeout, &proxyConnectionFailed)) {
-        if (!IsSelectableSocket(hSocket)) {
+        if (socketEventsMode == SOCKETEVENTS_SELECT && !IsSelectableSocket(hSocket)) {
             LogPrintf("Cannot create connection: non-selectable socket created (fd >= FD_SETSIZE ?)\n");
             CloseSocket(hSocket);
             return NULL;
@@ -507,6 +567,9 @@ void CNode::CloseSocketDisconnect() {
     fDisconnect = true;
     if (hSocket != INVALID_SOCKET) {
         LogPrint("net", "disconnecting peer=%d\n", id);
+        // stop epoll from reporting events for this node, they would carry a dangling cookie once it's deleted
+        if (fSocketEventsRegistered && pSocketEvents)
+            pSocketEvents->Unregister(hSocket);
         CloseSocket(hSocket);
     }
 
@@ -706,6 +769,7 @@ void CNode::copyStats(CNodeStats &stats) {
     X(mapSendBytesPerMsgCmd);
     X(nRecvBytes);
     X(mapRecvBytesPerMsgCmd);
+    msgStats.GetStats(stats.mapMsgStats);
     X(fWhitelisted);
 
     // It is common for nodes with good ping times to suddenly become lagged,
@@ -731,7 +795,25 @@ void CNode::copyStats(CNodeStats &stats) {
 #undef X
 
 // requires LOCK(cs_vRecvMsg)
-bool CNode::ReceiveMsgBytes(const char *pch, unsigned int nBytes) {
+unsigned int CNode::GetRecvPayloadSpace(char *&pch) {
+    if (vRecvMsg.empty() || !vRecvMsg.back().in_data || vRecvMsg.back().complete())
+        return 0;
+    return vRecvMsg.back().GetDataSpace(pch);
+}
+
+// requires LOCK(cs_vRecvMsg)
+bool CNode::ReceiveMsgBytes(const char *pch, unsigned int nBytes, unsigned int nPayloadBytes) {
+    bool fComplete = false;
+    if (nPayloadBytes > 0) {
+        CNetMessage &msg = vRecvMsg.back();
+        assert(msg.in_data && nPayloadBytes <= msg.hdr.nMessageSize - msg.nDataPos);
+        msg.nDataPos += nPayloadBytes;
+        if (msg.complete()) {
+            RecordRecvMsg(msg);
+            fComplete = true;
+        }
+    }
+
     while (nBytes > 0) {
 
         // get current incomplete message, or create a new one
@@ -760,49 +842,83 @@ bool CNode::ReceiveMsgBytes(const char *pch, unsigned int nBytes) {
         nBytes -= handled;
 
         if (msg.complete()) {
-
-            //store received bytes per message command
-            //to prevent a memory DOS, only allow valid commands
-            mapMsgCmdSize::iterator i = mapRecvBytesPerMsgCmd.find(msg.hdr.pchCommand);
-            if (i == mapRecvBytesPerMsgCmd.end())
-                i = mapRecvBytesPerMsgCmd.find(NET_MESSAGE_COMMAND_OTHER);
-            assert(i != mapRecvBytesPerMsgCmd.end());
-            i->second += msg.hdr.nMessageSize + CMessageHeader::HEADER_SIZE;
-
-            msg.nTime = GetTimeMicros();
-            messageHandlerCondition.notify_one();
+            RecordRecvMsg(msg);
+            fComplete = true;
         }
     }
 
+    if (fComplete)
+        WakeMessageHandler();
+
     return true;
 }
 
-int CNetMessage::readHeader(const char *pch, unsigned int nBytes) {
-    // copy data to temporary parsing buffer
-    unsigned int nRemaining = 24 - nHdrPos;
-    unsigned int nCopy = std::min(nRemaining, nBytes);
-
-    memcpy(&hdrbuf[nHdrPos], pch, nCopy);
-    nHdrPos += nCopy;
+void CNode::RecordRecvMsg(CNetMessage &msg) {
+    //store received bytes per message command
+    //to prevent a memory DOS, only allow valid commands
+    mapMsgCmdSize::iterator i = mapRecvBytesPerMsgCmd.find(msg.hdr.pchCommand);
+    if (i == mapRecvBytesPerMsgCmd.end())
+        i = mapRecvBytesPerMsgCmd.find(NET_MESSAGE_COMMAND_OTHER);
+    assert(i != mapRecvBytesPerMsgCmd.end());
+    i->second += msg.hdr.nMessageSize + CMessageHeader::HEADER_SIZE;
+    msgStats.RecordRecv(msg.hdr.GetCommand(), msg.hdr.nMessageSize + CMessageHeader::HEADER_SIZE);
+    netMsgStats.RecordRecv(msg.hdr.GetCommand(), msg.hdr.nMessageSize + CMessageHeader::HEADER_SIZE);
 
-    // if header incomplete, exit
-    if (nHdrPos < 24)
-        return nCopy;
+    msg.nTime = GetTimeMicros();
+}
 
-    // deserialize to CMessageHeader
-    try {
-        hdrbuf >> hdr;
+void CNode::WakeMessageHandler() {
+    {
+        boost::lock_guard<boost::mutex> lock(mutexReadyNodes);
+        if (fReadyQueued)
+            return;
+        fReadyQueued = true;
+        AddRef();
+        vReadyNodes.push_back(this);
     }
-    catch (const std::exception &) {
-        return -1;
+    messageHandlerCondition.notify_one();
+}
+
+CNetMessage::~CNetMessage() {
+    ReleaseRecvBuffer(vRecv.vch);
+}
+
+int CNetMessage::readHeader(const char *pch, unsigned int nBytes) {
+    const char *pchHeader;
+    unsigned int nCopy;
+    if (nHdrPos == 0 && nBytes >= CMessageHeader::HEADER_SIZE) {
+        // the whole header is at hand, parse it where it is
+        pchHeader = pch;
+        nCopy = CMessageHeader::HEADER_SIZE;
+        nHdrPos = CMessageHeader::HEADER_SIZE;
+    } else {
+        // copy data to temporary parsing buffer
+        unsigned int nRemaining = CMessageHeader::HEADER_SIZE - nHdrPos;
+        nCopy = std::min(nRemaining, nBytes);
+
+        memcpy(&pchHdrBuf[nHdrPos], pch, nCopy);
+        nHdrPos += nCopy;
+
+        // if header incomplete, exit
+        if (nHdrPos < CMessageHeader::HEADER_SIZE)
+            return nCopy;
+        pchHeader = pchHdrBuf;
     }
 
+    // same layout as the serialized CMessageHeader
+    memcpy(hdr.pchMessageStart, pchHeader, MESSAGE_START_SIZE);
+    memcpy(hdr.pchCommand, pchHeader + MESSAGE_START_SIZE, CMessageHeader::COMMAND_SIZE);
+    hdr.nMessageSize = ReadLE32((const unsigned char *) pchHeader + CMessageHeader::MESSAGE_SIZE_OFFSET);
+    hdr.nChecksum = ReadLE32((const unsigned char *) pchHeader + CMessageHeader::CHECKSUM_OFFSET);
+
     // reject messages larger than MAX_SIZE
     if (hdr.nMessageSize > MAX_SIZE)
         return -1;
 
     // switch state to reading message data
     in_data = true;
+    if (hdr.nMessageSize <= MAX_PROTOCOL_MESSAGE_LENGTH)
+        AcquireRecvBuffer(vRecv.vch, hdr.nMessageSize);
 
     return nCopy;
 }
@@ -813,7 +929,7 @@ int CNetMessage::readData(const char *pch, unsigned int nBytes) {
 
     if (vRecv.size() < nDataPos + nCopy) {
         // Allocate up to 256 KiB ahead, but never more than the total message size.
-        vRecv.resize(std::min(hdr.nMessageSize, nDataPos + nCopy + 256 * 1024));
+        vRecv.resize(std::min(hdr.nMessageSize, nDataPos + nCopy + RECV_BUFFER_PREALLOC));
     }
 
     memcpy(&vRecv[nDataPos], pch, nCopy);
@@ -822,26 +938,64 @@ int CNetMessage::readData(const char *pch, unsigned int nBytes) {
     return nCopy;
 }
 
+unsigned int CNetMessage::GetDataSpace(char *&pch) {
+    if (vRecv.size() < hdr.nMessageSize && vRecv.size() < nDataPos + RECV_BUFFER_PREALLOC)
+        vRecv.resize(std::min(hdr.nMessageSize, nDataPos + RECV_BUFFER_PREALLOC));
+
+    pch = (char *) &vRecv[nDataPos];
+    return vRecv.size() - nDataPos;
+}
+
 
 // requires LOCK(cs_vSend)
 void SocketSendData(CNode *pnode) {
-    std::deque<CSerializeData>::iterator it = pnode->vSendMsg.begin();
+    std::deque<CSerializedNetMsgRef>::iterator it = pnode->vSendMsg.begin();
 
     while (it != pnode->vSendMsg.end()) {
-        const CSerializeData &data = *it;
-        assert(data.size() > pnode->nSendOffset);
-        int nBytes = send(pnode->hSocket, &data[pnode->nSendOffset], data.size() - pnode->nSendOffset,
+        const CSerializedNetMsg &msg = **it;
+        const size_t nMsgSize = msg.size();
+        assert(nMsgSize > pnode->nSendOffset);
+        const size_t nHeaderLeft = pnode->nSendOffset < msg.header.size() ? msg.header.size() - pnode->nSendOffset : 0;
+        const size_t nDataOffset = nHeaderLeft ? 0 : pnode->nSendOffset - msg.header.size();
+        pnode->fSendReady = false;
+#ifdef WIN32
+        // one buffer at a time, the payload follows in the next iteration if the header went out in full
+        size_t nToSend = nHeaderLeft ? nHeaderLeft : msg.data.size() - nDataOffset;
+        int nBytes = send(pnode->hSocket, nHeaderLeft ? &msg.header[pnode->nSendOffset] : &msg.data[nDataOffset], nToSend,
                           MSG_NOSIGNAL | MSG_DONTWAIT);
+#else
+        // header and payload live in separate (possibly shared) buffers, gather them into a single syscall
+        size_t nToSend = nMsgSize - pnode->nSendOffset;
+        struct iovec iov[2];
+        int nIov = 0;
+        if (nHeaderLeft) {
+            iov[nIov].iov_base = (void *) &msg.header[pnode->nSendOffset];
+            iov[nIov].iov_len = nHeaderLeft;
+            nIov++;
+        }
+        if (msg.data.size() > nDataOffset) {
+            iov[nIov].iov_base = (void *) &msg.data[nDataOffset];
+            iov[nIov].iov_len = msg.data.size() - nDataOffset;
+            nIov++;
+        }
+        struct msghdr mh;
+        memset(&mh, 0, sizeof(mh));
+        mh.msg_iov = iov;
+        mh.msg_iovlen = nIov;
+        int nBytes = sendmsg(pnode->hSocket, &mh, MSG_NOSIGNAL | MSG_DONTWAIT);
+#endif
         if (nBytes > 0) {
+            // some buffer space was left, let the socket thread find out whether there is more
+            pnode->fSendReady = true;
             pnode->nLastSend = GetTime();
             pnode->nSendBytes += nBytes;
             pnode->nSendOffset += nBytes;
             pnode->RecordBytesSent(nBytes);
-            if (pnode->nSendOffset == data.size()) {
+            if (pnode->nSendOffset == nMsgSize) {
                 pnode->nSendOffset = 0;
-                pnode->nSendSize -= data.size();
+                pnode->nSendSize -= nMsgSize;
                 it++;
-            } else {
+            } else if ((size_t) nBytes < nToSend) {
                 // could not send full message; stop sending more
                 break;
             }
@@ -852,6 +1006,9 @@ void SocketSendData(CNode *pnode) {
                 if (nErr != WSAEWOULDBLOCK && nErr != WSAEMSGSIZE && nErr != WSAEINTR && nErr != WSAEINPROGRESS) {
                     LogPrintf("socket send error %s\n", NetworkErrorString(nErr));
                     pnode->CloseSocketDisconnect();
+                } else if (nErr != WSAEWOULDBLOCK) {
+                    // not out of buffer space, no edge is coming so try again later
+                    pnode->fSendReady = true;
                 }
             }
             // couldn't send anything at all
@@ -864,6 +1021,20 @@ void SocketSendData(CNode *pnode) {
         assert(pnode->nSendSize == 0);
     }
     pnode->vSendMsg.erase(pnode->vSendMsg.begin(), it);
+
+    if (pnode->fProcessPaused && pnode->CanProcessMessages()) {
+        pnode->fProcessPaused = false;
+        pnode->WakeMessageHandler();
+    }
+}
+
+void FinalizeSerializedNetMsg(CSerializedNetMsg &msg, int nVersion) {
+    CMessageHeader hdr(Params().MessageStart(), msg.strCommand.c_str(), msg.data.size());
+    uint256 hash = Hash(msg.data.begin(), msg.data.end());
+    memcpy(&hdr.nChecksum, &hash, sizeof(hdr.nChecksum));
+    CDataStream ssHeader(SER_NETWORK, nVersion);
+    ssHeader << hdr;
+    ssHeader.GetAndClear(msg.header);
 }
 
 static std::list<CNode *> vNodesDisconnected;
@@ -1109,7 +1280,7 @@ static void AcceptConnection(const ListenSocket &hListenSocket) {
         return;
     }
 
-    if (!IsSelectableSocket(hSocket)) {
+    if (socketEventsMode == SOCKETEVENTS_SELECT && !IsSelectableSocket(hSocket)) {
         LogPrintf("connection from %s dropped: non-selectable socket\n", addr.ToString());
         CloseSocket(hSocket);
         return;
@@ -1243,8 +1414,28 @@ void CNode::CloseDandelionConnections(const CNode* const pnode)
               CNode::GetDandelionRoutingDataDebugString());
 }
 
+// Wake up at least this often (ms) to check on nodes that have nothing to receive or send
+static const int64_t SOCKET_EVENTS_TIMEOUT = 50;
+
+/** Whether we want more data for the node, requires cs_vRecvMsg */
+static bool CanReceiveMore(CNode *pnode) {
+    return pnode->vRecvMsg.empty() || !pnode->vRecvMsg.front().complete() ||
+           pnode->GetTotalRecvSize() <= ReceiveFloodSize();
+}
+
 void ThreadSocketHandler() {
     unsigned int nPrevNodeCount = 0;
+
+    CSocketEvents &socketEvents = *pSocketEvents;
+    LogPrintf("Using %s for socket events\n", SocketEventsModeToString(socketEventsMode));
+    const bool fEdgeTriggered = socketEvents.IsEdgeTriggered();
+    if (fEdgeTriggered) {
+        BOOST_FOREACH(ListenSocket &hListenSocket, vhListenSocket) {
+            socketEvents.Register(hListenSocket.socket, &hListenSocket, false);
+        }
+    }
+    bool fMoreWork = false;
+
     while (true) {
         //
         // Disconnect nodes
@@ -1314,24 +1505,12 @@ void ThreadSocketHandler() {
         //
         // Find which sockets have data to receive
         //
-        struct timeval timeout;
-        timeout.tv_sec = 0;
-        timeout.tv_usec = 50000; // frequency to poll pnode->vSend
-
-        fd_set fdsetRecv;
-        fd_set fdsetSend;
-        fd_set fdsetError;
-        FD_ZERO(&fdsetRecv);
-        FD_ZERO(&fdsetSend);
-        FD_ZERO(&fdsetError);
-        SOCKET hSocketMax = 0;
-        bool have_fds = false;
-
-        BOOST_FOREACH(
-        const ListenSocket &hListenSocket, vhListenSocket) {
-            FD_SET(hListenSocket.socket, &fdsetRecv);
-            hSocketMax = std::max(hSocketMax, hListenSocket.socket);
-            have_fds = true;
+        std::vector<CSocketEvents::Socket> vSockets;
+        if (!fEdgeTriggered) {
+            BOOST_FOREACH(ListenSocket &hListenSocket, vhListenSocket) {
+                CSocketEvents::Socket socket = {hListenSocket.socket, &hListenSocket, CSocketEvents::EVENT_RECV};
+                vSockets.push_back(socket);
+            }
         }
 
         {
@@ -1340,9 +1519,21 @@ void ThreadSocketHandler() {
             {
                 if (pnode->hSocket == INVALID_SOCKET)
                     continue;
-                FD_SET(pnode->hSocket, &fdsetError);
-                hSocketMax = std::max(hSocketMax, pnode->hSocket);
-                have_fds = true;
+
+                if (fEdgeTriggered) {
+                    // Readiness is tracked per node and only changes on events, so there is nothing
+                    // to do here except registering new sockets.
+                    if (!pnode->fSocketEventsRegistered) {
+                        pnode->fSocketEventsRegistered = true;
+                        if (!socketEvents.Register(pnode->hSocket, pnode, true))
+                            pnode->fDisconnect = true;
+                    }
+                    continue;
+                }
+
+                pnode->fRecvReady = false;
+                pnode->fSendReady = false;
+                CSocketEvents::Socket socket = {pnode->hSocket, pnode, CSocketEvents::EVENT_ERROR};
 
                 // Implement the following logic:
                 // * If there is data to send, select() for sending data. As this only
@@ -1359,37 +1550,43 @@ void ThreadSocketHandler() {
                 // * We send some data.
                 // * We wait for data to be received (and disconnect after timeout).
                 // * We process a message in the buffer (message handler thread).
+                // With edge-triggered events the same rules are applied when servicing the socket below.
                 {
                     TRY_LOCK(pnode->cs_vSend, lockSend);
-                    if (lockSend && !pnode->vSendMsg.empty()) {
-                        FD_SET(pnode->hSocket, &fdsetSend);
-                        continue;
-                    }
+                    if (lockSend && !pnode->vSendMsg.empty())
+                        socket.nInterest |= CSocketEvents::EVENT_SEND;
                 }
-                {
+                if (!(socket.nInterest & CSocketEvents::EVENT_SEND)) {
                     TRY_LOCK(pnode->cs_vRecvMsg, lockRecv);
-                    if (lockRecv && (
-                            pnode->vRecvMsg.empty() || !pnode->vRecvMsg.front().complete() ||
-                            pnode->GetTotalRecvSize() <= ReceiveFloodSize()))
-                        FD_SET(pnode->hSocket, &fdsetRecv);
+                    if (lockRecv && CanReceiveMore(pnode))
+                        socket.nInterest |= CSocketEvents::EVENT_RECV;
                 }
+                vSockets.push_back(socket);
             }
         }
 
-        int nSelect = select(have_fds ? hSocketMax + 1 : 0,
-                             &fdsetRecv, &fdsetSend, &fdsetError, &timeout);
-        boost::this_thread::interruption_point();
+        // don't sleep if the previous round left sockets with data still to read or write
+        std::vector<CSocketEvents::Event> vEvents;
+        bool fAllReady = !socketEvents.Wait(vSockets, fMoreWork ? 0 : SOCKET_EVENTS_TIMEOUT, vEvents);
+        fMoreWork = false;
 
-        if (nSelect == SOCKET_ERROR) {
-            if (have_fds) {
-                int nErr = WSAGetLastError();
-                LogPrintf("socket select error %s\n", NetworkErrorString(nErr));
-                for (unsigned int i = 0; i <= hSocketMax; i++)
-                    FD_SET(i, &fdsetRecv);
+        std::set<const ListenSocket *> setListenReady;
+        BOOST_FOREACH(const CSocketEvents::Event &event, vEvents) {
+            bool fListenSocket = false;
+            BOOST_FOREACH(const ListenSocket &hListenSocket, vhListenSocket) {
+                if (event.cookie == &hListenSocket) {
+                    setListenReady.insert(&hListenSocket);
+                    fListenSocket = true;
+                }
             }
-            FD_ZERO(&fdsetSend);
-            FD_ZERO(&fdsetError);
-            MilliSleep(timeout.tv_usec / 1000);
+            if (fListenSocket)
+                continue;
+
+            CNode *pnode = static_cast<CNode *>(event.cookie);
+            if (event.nEvents & (CSocketEvents::EVENT_RECV | CSocketEvents::EVENT_ERROR))
+                pnode->fRecvReady = true;
+            if (event.nEvents & CSocketEvents::EVENT_SEND)
+                pnode->fSendReady = true;
         }
 
         //
@@ -1398,7 +1595,7 @@ void ThreadSocketHandler() {
         BOOST_FOREACH(
         const ListenSocket &hListenSocket, vhListenSocket)
         {
-            if (hListenSocket.socket != INVALID_SOCKET && FD_ISSET(hListenSocket.socket, &fdsetRecv)) {
+            if (hListenSocket.socket != INVALID_SOCKET && (fAllReady || setListenReady.count(&hListenSocket))) {
                 AcceptConnection(hListenSocket);
             }
         }
@@ -1422,19 +1619,57 @@ void ThreadSocketHandler() {
             //
             if (pnode->hSocket == INVALID_SOCKET)
                 continue;
-            if (FD_ISSET(pnode->hSocket, &fdsetRecv) || FD_ISSET(pnode->hSocket, &fdsetError)) {
+            if (fAllReady)
+                pnode->fRecvReady = true;
+            if (pnode->fRecvReady) {
+                bool fSendPending = false;
+                if (fEdgeTriggered) {
+                    TRY_LOCK(pnode->cs_vSend, lockSend);
+                    fSendPending = lockSend && !pnode->vSendMsg.empty();
+                }
                 TRY_LOCK(pnode->cs_vRecvMsg, lockRecv);
-                if (lockRecv) {
+                if (lockRecv && !fSendPending && (!fEdgeTriggered || CanReceiveMore(pnode))) {
                     {
                         // typical socket buffer is 8K-64K
                         char pchBuf[0x10000];
+#ifdef WIN32
+                        size_t nToRecv = sizeof(pchBuf);
+                        unsigned int nPayloadSpace = 0;
                         int nBytes = recv(pnode->hSocket, pchBuf, sizeof(pchBuf), MSG_DONTWAIT);
+#else
+                        // the rest of a message already being received goes straight into its payload
+                        // buffer, only what follows it is copied out of pchBuf
+                        char *pchPayload = NULL;
+                        unsigned int nPayloadSpace = pnode->GetRecvPayloadSpace(pchPayload);
+                        struct iovec iov[2];
+                        int nIov = 0;
+                        if (nPayloadSpace > 0) {
+                            iov[nIov].iov_base = pchPayload;
+                            iov[nIov].iov_len = nPayloadSpace;
+                            nIov++;
+                        }
+                        iov[nIov].iov_base = pchBuf;
+                        iov[nIov].iov_len = sizeof(pchBuf);
+                        nIov++;
+                        size_t nToRecv = nPayloadSpace + sizeof(pchBuf);
+                        struct msghdr mh;
+                        memset(&mh, 0, sizeof(mh));
+                        mh.msg_iov = iov;
+                        mh.msg_iovlen = nIov;
+                        int nBytes = recvmsg(pnode->hSocket, &mh, MSG_DONTWAIT);
+#endif
                         if (nBytes > 0) {
-                            if (!pnode->ReceiveMsgBytes(pchBuf, nBytes))
+                            unsigned int nPayloadBytes = std::min((unsigned int) nBytes, nPayloadSpace);
+                            if (!pnode->ReceiveMsgBytes(pchBuf, nBytes - nPayloadBytes, nPayloadBytes))
                                 pnode->CloseSocketDisconnect();
                             pnode->nLastRecv = GetTime();
                             pnode->nRecvBytes += nBytes;
                             pnode->RecordBytesRecv(nBytes);
+                            // a short read means the socket is drained, the next edge tells about new data
+                            if ((size_t) nBytes < nToRecv)
+                                pnode->fRecvReady = false;
+                            else if (fEdgeTriggered)
+                                fMoreWork = true;
                         } else if (nBytes == 0) {
                             // socket closed gracefully
                             if (!pnode->fDisconnect)
@@ -1448,6 +1683,8 @@ void ThreadSocketHandler() {
                                 if (!pnode->fDisconnect)
                                     LogPrintf("socket recv error %s\n", NetworkErrorString(nErr));
                                 pnode->CloseSocketDisconnect();
+                            } else if (nErr == WSAEWOULDBLOCK) {
+                                pnode->fRecvReady = false;
                             }
                         }
                     }
@@ -1459,10 +1696,13 @@ void ThreadSocketHandler() {
             //
             if (pnode->hSocket == INVALID_SOCKET)
                 continue;
-            if (FD_ISSET(pnode->hSocket, &fdsetSend)) {
+            if (pnode->fSendReady) {
                 TRY_LOCK(pnode->cs_vSend, lockSend);
-                if (lockSend)
+                if (lockSend && !pnode->vSendMsg.empty()) {
                     SocketSendData(pnode);
+                    if (fEdgeTriggered && pnode->fSendReady && !pnode->vSendMsg.empty())
+                        fMoreWork = true;
+                }
             }
 
             //
@@ -1989,11 +2229,79 @@ bool OpenNetworkConnection(
 }
 
 
+// Process one message (or the pending getdata) of a node taken from the ready queue
+static void ProcessReadyNode(CNode *pnode) {
+    if (pnode->fDisconnect)
+        return;
+
+    bool fMoreWork = false;
+    {
+        TRY_LOCK(pnode->cs_vRecvMsg, lockRecv);
+        if (lockRecv) {
+            if (!GetNodeSignals().ProcessMessages(pnode))
+                pnode->CloseSocketDisconnect();
+
+            if (!pnode->vRecvGetData.empty() ||
+                (!pnode->vRecvMsg.empty() && pnode->vRecvMsg[0].complete())) {
+                // set the flag before checking, so the socket thread can't drain the buffer in between unnoticed
+                pnode->fProcessPaused = true;
+                if (pnode->CanProcessMessages()) {
+                    pnode->fProcessPaused = false;
+                    fMoreWork = true;
+                }
+            }
+        } else {
+            // socket thread is appending to vRecvMsg, come back to it later
+            fMoreWork = true;
+        }
+    }
+    boost::this_thread::interruption_point();
+
+    // Send right away what processing the message produced, e.g. getdata for announced blocks
+    {
+        TRY_LOCK(pnode->cs_vSend, lockSend);
+        if (lockSend)
+            GetNodeSignals().SendMessages(pnode);
+    }
+    boost::this_thread::interruption_point();
+
+    // Back of the queue, so one busy peer can't starve the others
+    if (fMoreWork)
+        pnode->WakeMessageHandler();
+}
+
 void ThreadMessageHandler() {
-    boost::mutex condition_mutex;
-    boost::unique_lock<boost::mutex> lock(condition_mutex);
+    int64_t nNextSendMessages = GetTimeMillis();
 
     while (true) {
+        CNode *pnodeReady = NULL;
+        {
+            boost::unique_lock<boost::mutex> lock(mutexReadyNodes);
+            while (vReadyNodes.empty()) {
+                int64_t nWait = nNextSendMessages - GetTimeMillis();
+                if (nWait <= 0)
+                    break;
+                messageHandlerCondition.timed_wait(lock, boost::posix_time::microsec_clock::universal_time() +
+                                                         boost::posix_time::milliseconds(nWait));
+            }
+            if (!vReadyNodes.empty()) {
+                pnodeReady = vReadyNodes.front();
+                vReadyNodes.pop_front();
+                pnodeReady->fReadyQueued = false;
+            }
+        }
+        boost::this_thread::interruption_point();
+
+        if (pnodeReady) {
+            ProcessReadyNode(pnodeReady);
+            pnodeReady->Release();
+        }
+
+        // Timer driven SendMessages pass over all nodes: pings, inventory trickling, block download
+        // requests and timeouts don't depend on anything being received
+        if (GetTimeMillis() < nNextSendMessages)
+            continue;
+
         std::vector < CNode * > vNodesCopy;
         {
             LOCK(cs_vNodes);
@@ -2004,37 +2312,23 @@ void ThreadMessageHandler() {
             }
         }
 
-        bool fSleep = true;
-
         BOOST_FOREACH(CNode * pnode, vNodesCopy)
         {
             if (pnode->fDisconnect)
                 continue;
 
-            // Receive messages
-            {
-                TRY_LOCK(pnode->cs_vRecvMsg, lockRecv);
-                if (lockRecv) {
-                    if (!GetNodeSignals().ProcessMessages(pnode))
-                        pnode->CloseSocketDisconnect();
-
-                    if (pnode->nSendSize < SendBufferSize()) {
-                        if (!pnode->vRecvGetData.empty() ||
-                            (!pnode->vRecvMsg.empty() && pnode->vRecvMsg[0].complete())) {
-                            fSleep = false;
-                        }
-                    }
-                }
-            }
-            boost::this_thread::interruption_point();
-
-            // Send messages
             {
                 TRY_LOCK(pnode->cs_vSend, lockSend);
                 if (lockSend)
                     GetNodeSignals().SendMessages(pnode);
             }
             boost::this_thread::interruption_point();
+
+            // backstop for a requeue missed by the socket thread
+            if (pnode->fProcessPaused && pnode->CanProcessMessages()) {
+                pnode->fProcessPaused = false;
+                pnode->WakeMessageHandler();
+            }
         }
 
         {
@@ -2043,9 +2337,7 @@ void ThreadMessageHandler() {
             pnode->Release();
         }
 
-        if (fSleep)
-            messageHandlerCondition.timed_wait(lock, boost::posix_time::microsec_clock::universal_time() +
-                                                     boost::posix_time::milliseconds(100));
+        nNextSendMessages = GetTimeMillis() + MESSAGE_HANDLER_INTERVAL;
     }
 }
 
@@ -2325,6 +2617,14 @@ void StartNode(boost::thread_group &threadGroup, CScheduler &scheduler) {
         semOutbound = new CSemaphore(nMaxOutbound);
     }
 
+    if (pSocketEvents == NULL) {
+        pSocketEvents = new CSocketEvents(socketEventsMode);
+        if (pSocketEvents->GetMode() != socketEventsMode) {
+            // new sockets must stay below FD_SETSIZE from now on
+            socketEventsMode = pSocketEvents->GetMode();
+        }
+    }
+
     if (pnodeLocalHost == NULL)
         pnodeLocalHost = new CNode(INVALID_SOCKET, CAddress(CService("127.0.0.1", 0), nLocalServices));
 
@@ -2402,9 +2702,12 @@ public:
         delete pnode;
         vNodes.clear();
         vNodesDisconnected.clear();
+        vReadyNodes.clear();
         vhListenSocket.clear();
         delete semOutbound;
         semOutbound = NULL;
+        delete pSocketEvents;
+        pSocketEvents = NULL;
         delete pnodeLocalHost;
         pnodeLocalHost = NULL;
 
@@ -2818,6 +3121,12 @@ CNode::CNode(SOCKET hSocketIn, const CAddress &addrIn, const std::string &addrNa
     nRefCount = 0;
     nSendSize = 0;
     nSendOffset = 0;
+    fRecvReady = false;
+    fSendReady = false;
+    fSocketEventsRegistered = false;
+    fReadyQueued = false;
+    fProcessPaused = false;
+    nOffloadedMsgs = 0;
     hashContinue = uint256();
     nStartingHeight = -1;
     filterInventoryKnown.reset();
@@ -2945,6 +3254,8 @@ void CNode::EndMessage(const char *pszCommand) UNLOCK_FUNCTION(cs_vSend) {
 
     //log total amount of bytes per command
     mapSendBytesPerMsgCmd[std::string(pszCommand)] += nSize + CMessageHeader::HEADER_SIZE;
+    msgStats.RecordSent(pszCommand, nSize + CMessageHeader::HEADER_SIZE);
+    netMsgStats.RecordSent(pszCommand, nSize + CMessageHeader::HEADER_SIZE);
 
     // Set the checksum
     uint256 hash = Hash(ssSend.begin() + CMessageHeader::HEADER_SIZE, ssSend.end());
@@ -2955,17 +3266,39 @@ void CNode::EndMessage(const char *pszCommand) UNLOCK_FUNCTION(cs_vSend) {
 
     LogPrint("net", "(%d bytes) peer=%d\n", nSize, id);
 
-    std::deque<CSerializeData>::iterator it = vSendMsg.insert(vSendMsg.end(), CSerializeData());
-    ssSend.GetAndClear(*it);
-    nSendSize += (*it).size();
+    std::shared_ptr<CSerializedNetMsg> msg = std::make_shared<CSerializedNetMsg>();
+    msg->strCommand = pszCommand;
+    ssSend.GetAndClear(msg->data);
+    nSendSize += msg->size();
+    vSendMsg.push_back(msg);
 
     // If write queue empty, attempt "optimistic write"
-    if (it == vSendMsg.begin())
+    if (vSendMsg.size() == 1)
         SocketSendData(this);
 
     LEAVE_CRITICAL_SECTION(cs_vSend);
 }
 
+void CNode::PushSerializedMessage(const CSerializedNetMsgRef &msg) {
+    LOCK(cs_vSend);
+    if (mapArgs.count("-dropmessagestest") && GetRand(GetArg("-dropmessagestest", 2)) == 0) {
+        LogPrint("net", "dropmessages DROPPING SEND MESSAGE\n");
+        return;
+    }
+
+    mapSendBytesPerMsgCmd[msg->strCommand] += msg->size();
+    msgStats.RecordSent(msg->strCommand, msg->size());
+    netMsgStats.RecordSent(msg->strCommand, msg->size());
+    LogPrint("net", "sending: %s (%d bytes, shared) peer=%d\n", SanitizeString(msg->strCommand), msg->data.size(), id);
+
+    nSendSize += msg->size();
+    vSendMsg.push_back(msg);
+
+    // If write queue empty, attempt "optimistic write"
+    if (vSendMsg.size() == 1)
+        SocketSendData(this);
+}
+
 //
 // CBanDB
 //
@@ -12,8 +12,10 @@
 #include "fs.h"
 #include "limitedmap.h"
 #include "netbase.h"
+#include "netmsgstats.h"
 #include "protocol.h"
 #include "random.h"
+#include "socketevents.h"
 #include "streams.h"
 #include "sync.h"
 #include "uint256.h"
@@ -22,6 +24,7 @@
 
 #include <atomic>
 #include <deque>
+#include <memory>
 #include <stdint.h>
 
 #ifndef WIN32
@@ -42,6 +45,10 @@ namespace boost {
 
 /** Time between pings automatically sent out for latency probing and keepalive (in seconds). */
 static const int PING_INTERVAL = 2 * 60;
+/** Time between SendMessages passes over all peers in the message handler (in milliseconds). */
+static const int64_t MESSAGE_HANDLER_INTERVAL = 100;
+/** Maximum number of a peer's messages queued for other threads before the message handler stops reading its messages */
+static const int MAX_OFFLOADED_MESSAGES = 100;
 /** Time after which to disconnect, after waiting for a ping response (or inactivity). */
 static const int TIMEOUT_INTERVAL = 20 * 60;
 /** Run the feeler connection loop once every 2 minutes or 120 seconds. **/
@@ -162,6 +169,8 @@ CAddress GetLocalAddress(const CNetAddr *paddrPeer = NULL);
 
 extern bool fDiscover;
 extern bool fListen;
+/** How the socket handler thread waits for socket readiness, set from -socketevents */
+extern SocketEventsMode socketEventsMode;
 extern ServiceFlags nLocalServices;
 extern ServiceFlags nRelevantServices;
 extern bool fRelayTxes;
@@ -213,6 +222,7 @@ public:
     mapMsgCmdSize mapSendBytesPerMsgCmd;
     uint64_t nRecvBytes;
     mapMsgCmdSize mapRecvBytesPerMsgCmd;
+    mapNetMsgTypeStats mapMsgStats;
     bool fWhitelisted;
     double dPingTime;
     double dPingWait;
@@ -227,23 +237,26 @@ class CNetMessage {
 public:
     bool in_data;                   // parsing header (false) or data (true)
 
-    CDataStream hdrbuf;             // partially received header
+    char pchHdrBuf[CMessageHeader::HEADER_SIZE]; // partially received header
     CMessageHeader hdr;             // complete header
     unsigned int nHdrPos;
 
-    CDataStream vRecv;              // received message data
+    CDataStream vRecv;              // received message data, the buffer is recycled once the message is gone
     unsigned int nDataPos;
 
     int64_t nTime;                  // time (in microseconds) of message receipt.
 
-    CNetMessage(const CMessageHeader::MessageStartChars& pchMessageStartIn, int nTypeIn, int nVersionIn) : hdrbuf(nTypeIn, nVersionIn), hdr(pchMessageStartIn), vRecv(nTypeIn, nVersionIn) {
-        hdrbuf.resize(24);
+    CNetMessage(const CMessageHeader::MessageStartChars& pchMessageStartIn, int nTypeIn, int nVersionIn) : hdr(pchMessageStartIn), vRecv(nTypeIn, nVersionIn) {
         in_data = false;
         nHdrPos = 0;
         nDataPos = 0;
         nTime = 0;
     }
 
+    CNetMessage(CNetMessage &&) = default;
+    CNetMessage& operator=(CNetMessage &&) = default;
+    ~CNetMessage();
+
     bool complete() const
     {
         if (!in_data)
@@ -253,14 +266,48 @@ public:
 
     void SetVersion(int nVersionIn)
     {
-        hdrbuf.SetVersion(nVersionIn);
         vRecv.SetVersion(nVersionIn);
     }
 
     int readHeader(const char *pch, unsigned int nBytes);
     int readData(const char *pch, unsigned int nBytes);
+
+    /** Room in the payload buffer that can be filled directly, ahead of nDataPos */
+    unsigned int GetDataSpace(char *&pch);
+};
+
+/**
+ * Serialized message ready to go to the wire. It is never modified once queued, so the same
+ * message (e.g. a freshly mined block) can sit in the send queues of many peers at once.
+ * Messages built by PushMessage keep the header inside data and leave header empty.
+ */
+class CSerializedNetMsg {
+public:
+    std::string strCommand;
+    CSerializeData header;
+    CSerializeData data;
+
+    size_t size() const { return header.size() + data.size(); }
 };
 
+typedef std::shared_ptr<const CSerializedNetMsg> CSerializedNetMsgRef;
+
+/** Fill in the message header for msg.data, which must hold the payload only */
+void FinalizeSerializedNetMsg(CSerializedNetMsg &msg, int nVersion);
+
+/** Serialize obj once into a message that can be queued to any number of peers with PushSerializedMessage */
+template<typename T>
+CSerializedNetMsgRef MakeSerializedNetMsg(const char *pszCommand, const T &obj, int nVersion)
+{
+    std::shared_ptr<CSerializedNetMsg> msg = std::make_shared<CSerializedNetMsg>();
+    msg->strCommand = pszCommand;
+    CDataStream ssPayload(SER_NETWORK, nVersion);
+    ssPayload << obj;
+    ssPayload.GetAndClear(msg->data);
+    FinalizeSerializedNetMsg(*msg, nVersion);
+    return msg;
+}
+
 
 typedef enum BanReason
 {
@@ -335,15 +382,36 @@ public:
     size_t nSendSize; // total size of all vSendMsg entries
     size_t nSendOffset; // offset inside the first vSendMsg already sent
     uint64_t nSendBytes;
-    std::deque<CSerializeData> vSendMsg;
+    std::deque<CSerializedNetMsgRef> vSendMsg;
     CCriticalSection cs_vSend;
 
+    // Socket readiness as last reported by the socket events backend. With edge-triggered events it
+    // stays set until recv()/send() run out of data/buffer space. fSendReady is cleared by whoever
+    // attempts a send, right before the send() call, so an edge reported meanwhile isn't lost.
+    bool fRecvReady;
+    std::atomic<bool> fSendReady;
+    bool fSocketEventsRegistered;
+
     std::deque<CInv> vRecvGetData;
     std::deque<CNetMessage> vRecvMsg;
     CCriticalSection cs_vRecvMsg;
     uint64_t nRecvBytes;
     int nRecvVersion;
 
+    // Set while the node sits in the message handler's ready queue (guarded by the queue mutex).
+    // fProcessPaused is set when it has work left but its send buffer is full, the socket thread
+    // requeues it once enough data went out.
+    bool fReadyQueued;
+    std::atomic<bool> fProcessPaused;
+    // messages handed to the xfsnode message workers and not processed yet
+    std::atomic<int> nOffloadedMsgs;
+
+    /** Whether the message handler should process more of this node's messages right now */
+    bool CanProcessMessages() const
+    {
+        return nSendSize < SendBufferSize() && nOffloadedMsgs < MAX_OFFLOADED_MESSAGES;
+    }
+
     int64_t nLastSend;
     int64_t nLastRecv;
     int64_t nTimeConnected;
@@ -382,6 +450,8 @@ public:
     bool fXFSnode;
 
     const uint64_t nKeyedNetGroup;
+    // messages, bytes and processing time per command, netMsgStats has the totals over all peers
+    CNetMsgStats msgStats;
 protected:
 
     // Denial-of-service detection/prevention
@@ -401,6 +471,9 @@ protected:
     // Basic fuzz-testing
     void Fuzz(int nChance); // modifies ssSend
 
+    // requires LOCK(cs_vRecvMsg)
+    void RecordRecvMsg(CNetMessage &msg);
+
 public:
     uint256 hashContinue;
     int nStartingHeight;
@@ -519,7 +592,12 @@ public:
     }
 
     // requires LOCK(cs_vRecvMsg)
-    bool ReceiveMsgBytes(const char *pch, unsigned int nBytes);
+    /** Where recv() can put payload of the message being received, without going through ReceiveMsgBytes' buffer */
+    unsigned int GetRecvPayloadSpace(char *&pch);
+
+    // requires LOCK(cs_vRecvMsg)
+    /** Parse received bytes, nPayloadBytes were already put at the space returned by GetRecvPayloadSpace */
+    bool ReceiveMsgBytes(const char *pch, unsigned int nBytes, unsigned int nPayloadBytes = 0);
 
     // requires LOCK(cs_vRecvMsg)
     void SetRecvVersion(int nVersionIn)
@@ -608,6 +686,12 @@ public:
 
     void PushVersion();
 
+    /** Queue the node for ThreadMessageHandler, it holds a reference until the node is processed */
+    void WakeMessageHandler();
+
+    /** Queue a message serialized with MakeSerializedNetMsg, the buffer is shared rather than copied */
+    void PushSerializedMessage(const CSerializedNetMsgRef &msg);
+
 
     void PushMessage(const char* pszCommand)
     {
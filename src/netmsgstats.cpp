@@ -0,0 +1,131 @@
+// Copyright (c) 2020 The XFS Core Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "netmsgstats.h"
+
+#include "protocol.h"
+#include "util.h"
+#include "validationinterface.h"
+
+#include <set>
+
+#include <univalue.h>
+
+CNetMsgStats netMsgStats;
+
+static const std::string NET_MSG_STATS_COMMAND_OTHER = "*other*";
+
+static const std::string& NormalizeCommand(const std::string &strCommand)
+{
+    static const std::set<std::string> setKnownCommands(getAllNetMessageTypes().begin(), getAllNetMessageTypes().end());
+    return setKnownCommands.count(strCommand) ? strCommand : NET_MSG_STATS_COMMAND_OTHER;
+}
+
+CNetMsgTypeStats::CNetMsgTypeStats() :
+    nMsgsRecv(0), nBytesRecv(0), nMsgsSent(0), nBytesSent(0), nMsgsProcessed(0),
+    nProcessTimeMicros(0), nMaxProcessTimeMicros(0)
+{
+    for (int i = 0; i < NET_MSG_PROCESS_TIME_BUCKETS; i++)
+        vProcessTimeHist[i] = 0;
+}
+
+CNetMsgTypeStats& CNetMsgTypeStats::operator+=(const CNetMsgTypeStats &other)
+{
+    nMsgsRecv += other.nMsgsRecv;
+    nBytesRecv += other.nBytesRecv;
+    nMsgsSent += other.nMsgsSent;
+    nBytesSent += other.nBytesSent;
+    nMsgsProcessed += other.nMsgsProcessed;
+    nProcessTimeMicros += other.nProcessTimeMicros;
+    nMaxProcessTimeMicros = std::max(nMaxProcessTimeMicros, other.nMaxProcessTimeMicros);
+    for (int i = 0; i < NET_MSG_PROCESS_TIME_BUCKETS; i++)
+        vProcessTimeHist[i] += other.vProcessTimeHist[i];
+    return *this;
+}
+
+void CNetMsgStats::RecordRecv(const std::string &strCommand, uint64_t nBytes)
+{
+    LOCK(cs);
+    CNetMsgTypeStats &stats = mapStats[NormalizeCommand(strCommand)];
+    stats.nMsgsRecv++;
+    stats.nBytesRecv += nBytes;
+}
+
+void CNetMsgStats::RecordSent(const std::string &strCommand, uint64_t nBytes)
+{
+    LOCK(cs);
+    CNetMsgTypeStats &stats = mapStats[NormalizeCommand(strCommand)];
+    stats.nMsgsSent++;
+    stats.nBytesSent += nBytes;
+}
+
+void CNetMsgStats::RecordProcessed(const std::string &strCommand, int64_t nMicros)
+{
+    int nBucket = 0;
+    while (nBucket < NET_MSG_PROCESS_TIME_BUCKETS - 1 && nMicros > NET_MSG_PROCESS_TIME_BOUNDS[nBucket])
+        nBucket++;
+
+    LOCK(cs);
+    CNetMsgTypeStats &stats = mapStats[NormalizeCommand(strCommand)];
+    stats.nMsgsProcessed++;
+    stats.nProcessTimeMicros += nMicros;
+    stats.nMaxProcessTimeMicros = std::max(stats.nMaxProcessTimeMicros, nMicros);
+    stats.vProcessTimeHist[nBucket]++;
+}
+
+void CNetMsgStats::GetStats(mapNetMsgTypeStats &mapStatsOut) const
+{
+    LOCK(cs);
+    mapStatsOut = mapStats;
+}
+
+UniValue NetMsgStatsToJSON(const mapNetMsgTypeStats &mapStats)
+{
+    UniValue ret(UniValue::VOBJ);
+    for (mapNetMsgTypeStats::const_iterator it = mapStats.begin(); it != mapStats.end(); ++it) {
+        const CNetMsgTypeStats &stats = it->second;
+        UniValue obj(UniValue::VOBJ);
+        obj.push_back(Pair("msgs_recv", stats.nMsgsRecv));
+        obj.push_back(Pair("bytes_recv", stats.nBytesRecv));
+        obj.push_back(Pair("msgs_sent", stats.nMsgsSent));
+        obj.push_back(Pair("bytes_sent", stats.nBytesSent));
+        obj.push_back(Pair("msgs_processed", stats.nMsgsProcessed));
+        obj.push_back(Pair("process_time_us", stats.nProcessTimeMicros));
+        obj.push_back(Pair("max_process_time_us", stats.nMaxProcessTimeMicros));
+
+        UniValue hist(UniValue::VOBJ);
+        for (int i = 0; i < NET_MSG_PROCESS_TIME_BUCKETS - 1; i++)
+            hist.push_back(Pair(strprintf("le_%d", NET_MSG_PROCESS_TIME_BOUNDS[i]), stats.vProcessTimeHist[i]));
+        hist.push_back(Pair("inf", stats.vProcessTimeHist[NET_MSG_PROCESS_TIME_BUCKETS - 1]));
+        obj.push_back(Pair("process_time_hist_us", hist));
+
+        ret.push_back(Pair(it->first, obj));
+    }
+    return ret;
+}
+
+void DumpNetMsgStats()
+{
+    mapNetMsgTypeStats mapStats;
+    netMsgStats.GetStats(mapStats);
+
+    UniValue obj(UniValue::VOBJ);
+    obj.push_back(Pair("time", GetTime()));
+    obj.push_back(Pair("stats", NetMsgStatsToJSON(mapStats)));
+    std::string strJSON = obj.write() + "\n";
+
+    // write to a temporary file and rename, readers never see a partial dump
+    fs::path pathTmp = GetDataDir() / "netmsgstats.json.new";
+    FILE *file = fsbridge::fopen(pathTmp, "w");
+    if (file == NULL) {
+        LogPrintf("%s: failed to open %s\n", __func__, pathTmp.string());
+    } else {
+        bool fWritten = fwrite(strJSON.data(), 1, strJSON.size(), file) == strJSON.size();
+        fclose(file);
+        if (!fWritten || !RenameOver(pathTmp, GetDataDir() / "netmsgstats.json"))
+            LogPrintf("%s: failed to write netmsgstats.json\n", __func__);
+    }
+
+    GetMainSignals().NotifyNetMsgStats();
+}
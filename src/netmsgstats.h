@@ -0,0 +1,68 @@
+// Copyright (c) 2020 The XFS Core Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_NETMSGSTATS_H
+#define BITCOIN_NETMSGSTATS_H
+
+#include "sync.h"
+
+#include <map>
+#include <stdint.h>
+#include <string>
+
+class UniValue;
+
+/** Upper bounds (in microseconds) of the processing time histogram buckets, the last bucket takes everything above */
+static const int64_t NET_MSG_PROCESS_TIME_BOUNDS[] = {10, 100, 1000, 10000, 100000, 1000000};
+static const int NET_MSG_PROCESS_TIME_BUCKETS = sizeof(NET_MSG_PROCESS_TIME_BOUNDS) / sizeof(NET_MSG_PROCESS_TIME_BOUNDS[0]) + 1;
+
+/** Default interval of the periodic network message statistics dump (in seconds), 0 disables it */
+static const int64_t DEFAULT_NETMSGSTATS_INTERVAL = 0;
+
+/** Counters for one message command */
+struct CNetMsgTypeStats
+{
+    uint64_t nMsgsRecv;
+    uint64_t nBytesRecv;
+    uint64_t nMsgsSent;
+    uint64_t nBytesSent;
+    uint64_t nMsgsProcessed;
+    int64_t nProcessTimeMicros;
+    int64_t nMaxProcessTimeMicros;
+    uint64_t vProcessTimeHist[NET_MSG_PROCESS_TIME_BUCKETS];
+
+    CNetMsgTypeStats();
+    CNetMsgTypeStats& operator+=(const CNetMsgTypeStats &other);
+};
+
+typedef std::map<std::string, CNetMsgTypeStats> mapNetMsgTypeStats; //command, stats
+
+/**
+ * Message, byte and processing time counters per command. Commands we don't know are counted
+ * under "*other*" so a peer can't grow the map with made up commands.
+ */
+class CNetMsgStats
+{
+private:
+    mutable CCriticalSection cs;
+    mapNetMsgTypeStats mapStats;
+
+public:
+    void RecordRecv(const std::string &strCommand, uint64_t nBytes);
+    void RecordSent(const std::string &strCommand, uint64_t nBytes);
+    void RecordProcessed(const std::string &strCommand, int64_t nMicros);
+
+    void GetStats(mapNetMsgTypeStats &mapStatsOut) const;
+};
+
+/** Totals over all peers, including the ones that already disconnected */
+extern CNetMsgStats netMsgStats;
+
+/** Statistics in the format of the getnetmsgstats RPC */
+UniValue NetMsgStatsToJSON(const mapNetMsgTypeStats &mapStats);
+
+/** Write the totals to netmsgstats.json in the data directory and notify listeners, called every -netmsgstatsinterval seconds */
+void DumpNetMsgStats();
+
+#endif // BITCOIN_NETMSGSTATS_H
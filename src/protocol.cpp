@@ -98,6 +98,7 @@ const static std::string allNetMessageTypes[] = {
         NetMsgType::BLOCKTXN,
 		NetMsgType::DANDELIONTX,
         //xfsnode
+        NetMsgType::TXLOCKVOTE,
         NetMsgType::TXLOCKREQUEST,
         NetMsgType::XFSNODEPAYMENTVOTE,
         NetMsgType::XFSNODEPAYMENTBLOCK,
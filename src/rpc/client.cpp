@@ -109,6 +109,7 @@ static const CRPCConvertParam vRPCConvertParams[] =
     { "prioritisetransaction", 2 },
     { "setban", 2 },
     { "setban", 3 },
+    { "getnetmsgstats", 0 },
     { "getmempoolancestors", 1 },
     { "getmempooldescendants", 1 },
     { "getblockhashes", 0 },
@@ -4,11 +4,13 @@
 
 #include "rpc/server.h"
 
+#include "blockencodings.h"
 #include "chainparams.h"
 #include "clientversion.h"
 #include "main.h"
 #include "net.h"
 #include "netbase.h"
+#include "netmsgstats.h"
 #include "protocol.h"
 #include "sync.h"
 #include "timedata.h"
@@ -376,6 +378,97 @@ UniValue getnettotals(const UniValue& params, bool fHelp)
     return obj;
 }
 
+UniValue getnetmsgstats(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() > 1)
+        throw runtime_error(
+            "getnetmsgstats ( nodeid )\n"
+            "\nReturns network message statistics per command, over all peers since startup or for a single connected peer.\n"
+            "\nArguments:\n"
+            "1. nodeid   (numeric, optional) Only return statistics of this peer (see getpeerinfo for node ids)\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"command\": {                   (json object) Unknown commands are counted under \"*other*\"\n"
+            "    \"msgs_recv\": n,              (numeric) Messages received\n"
+            "    \"bytes_recv\": n,             (numeric) Bytes received, including message headers\n"
+            "    \"msgs_sent\": n,              (numeric) Messages sent\n"
+            "    \"bytes_sent\": n,             (numeric) Bytes sent, including message headers\n"
+            "    \"msgs_processed\": n,         (numeric) Messages processed by the message handler\n"
+            "    \"process_time_us\": n,        (numeric) Total processing time in microseconds\n"
+            "    \"max_process_time_us\": n,    (numeric) Longest processing time in microseconds\n"
+            "    \"process_time_hist_us\": {    (json object) Number of messages by processing time\n"
+            "      \"le_10\": n,                (numeric) Processed in at most 10 microseconds\n"
+            "      ...\n"
+            "      \"inf\": n                   (numeric) Processed in more than 1 second\n"
+            "    }\n"
+            "  },\n"
+            "  ...\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getnetmsgstats", "")
+            + HelpExampleCli("getnetmsgstats", "3")
+            + HelpExampleRpc("getnetmsgstats", "3")
+       );
+
+    mapNetMsgTypeStats mapStats;
+    if (params.size() == 0) {
+        netMsgStats.GetStats(mapStats);
+    } else {
+        NodeId id = params[0].get_int();
+        bool fFound = false;
+        LOCK(cs_vNodes);
+        BOOST_FOREACH(CNode* pnode, vNodes) {
+            if (pnode->GetId() == id) {
+                pnode->msgStats.GetStats(mapStats);
+                fFound = true;
+                break;
+            }
+        }
+        if (!fFound)
+            throw JSONRPCError(RPC_CLIENT_NODE_NOT_CONNECTED, "Node not found in connected nodes");
+    }
+
+    return NetMsgStatsToJSON(mapStats);
+}
+
+UniValue getcompactblockstats(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() != 0)
+        throw runtime_error(
+            "getcompactblockstats\n"
+            "\nReturns statistics about the reconstruction of compact blocks received since startup.\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"blocks\": n,              (numeric) Blocks reconstructed from compact blocks\n"
+            "  \"blocks_round_trip\": n,   (numeric) Of which needed transactions requested with getblocktxn\n"
+            "  \"blocks_failed\": n,       (numeric) Reconstructions given up in favour of downloading the full block\n"
+            "  \"hit_rate\": x.xxx,        (numeric) Share of block transactions that didn't have to be requested\n"
+            "  \"txn_prefilled\": n,       (numeric) Transactions sent along with the compact block\n"
+            "  \"txn_mempool\": n,         (numeric) Transactions found in the mempool\n"
+            "  \"txn_extra\": n,           (numeric) Transactions found among orphaned, rejected and evicted ones\n"
+            "  \"txn_requested\": n        (numeric) Transactions requested with getblocktxn\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getcompactblockstats", "")
+            + HelpExampleRpc("getcompactblockstats", "")
+       );
+
+    LOCK(cs_main);
+    const CompactBlockStats &stats = compactBlockStats;
+    uint64_t nTxTotal = stats.nTxPrefilled + stats.nTxMempool + stats.nTxExtra + stats.nTxRequested;
+
+    UniValue obj(UniValue::VOBJ);
+    obj.push_back(Pair("blocks", stats.nBlocks));
+    obj.push_back(Pair("blocks_round_trip", stats.nBlocksRoundTrip));
+    obj.push_back(Pair("blocks_failed", stats.nBlocksFailed));
+    obj.push_back(Pair("hit_rate", nTxTotal ? 1.0 - (double)stats.nTxRequested / nTxTotal : 1.0));
+    obj.push_back(Pair("txn_prefilled", stats.nTxPrefilled));
+    obj.push_back(Pair("txn_mempool", stats.nTxMempool));
+    obj.push_back(Pair("txn_extra", stats.nTxExtra));
+    obj.push_back(Pair("txn_requested", stats.nTxRequested));
+    return obj;
+}
+
 static UniValue GetNetworksInfo()
 {
     UniValue networks(UniValue::VARR);
@@ -581,6 +674,8 @@ static const CRPCCommand commands[] =
     { "network",            "disconnectnode",         &disconnectnode,         true  },
     { "network",            "getaddednodeinfo",       &getaddednodeinfo,       true  },
     { "network",            "getnettotals",           &getnettotals,           true  },
+    { "network",            "getnetmsgstats",         &getnetmsgstats,         true  },
+    { "network",            "getcompactblockstats",   &getcompactblockstats,   true  },
     { "network",            "getnetworkinfo",         &getnetworkinfo,         true  },
     { "network",            "setban",                 &setban,                 true  },
     { "network",            "listbanned",             &listbanned,             true  },
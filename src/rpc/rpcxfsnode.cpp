@@ -161,8 +161,7 @@ UniValue xfsnode(const UniValue &params, bool fHelp) {
         if (strMode == "enabled")
             return mnodeman.CountEnabled();
 
-        int nCount;
-        mnodeman.GetNextXFSnodeInQueueForPayment(true, nCount);
+        int nCount = mnodeman.CountQualifiedForPayment(true);
 
         if (strMode == "qualify")
             return nCount;
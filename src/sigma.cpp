@@ -4,6 +4,7 @@
 #include "timedata.h"
 #include "chainparams.h"
 #include "util.h"
+#include "random.h"
 #include "base58.h"
 #include "definition.h"
 #include "txmempool.h"
@@ -16,6 +17,7 @@
 #include "xfsnode-payments.h"
 #include "xfsnode-sync.h"
 #include "primitives/zerocoin.h"
+#include "libzerocoin/ParallelTasks.h"
 
 #include <atomic>
 #include <sstream>
@@ -30,6 +32,86 @@ namespace sigma {
 
 static CSigmaState sigmaState;
 
+static const char *SIGMA_STATE_FILENAME = "sigmastate.dat";
+static const std::string SIGMA_STATE_MAGIC = "sigmastate";
+static const int SIGMA_STATE_SNAPSHOT_VERSION = 1;
+
+// Tip of the chain the snapshot on disk was taken at
+static uint256 sigmaStateSnapshotTip;
+
+namespace {
+
+/**
+ * Proofs of sigma spends verified already, so a spend is verified once for the memory pool, Dandelion stempool
+ * and the block it gets into. Entries commit to the spend, its metadata and the blocks its anonymity set is
+ * built from, block contents are immutable so the same entry always means the same anonymity set.
+ */
+class CSigmaSpendProofCache
+{
+private:
+    struct EntryHasher {
+        size_t operator()(const uint256 &entry) const { return entry.GetCheapHash(); }
+    };
+
+    uint256 nonce;
+    std::unordered_set<uint256, EntryHasher> setValid;
+    CCriticalSection cs;
+
+public:
+    CSigmaSpendProofCache()
+    {
+        GetRandBytes(nonce.begin(), 32);
+    }
+
+    uint256 ComputeEntry(const CTxIn &txin, CoinDenomination denomination, const uint256 &txHashForMetadata,
+                         bool fPadding, const CBlockIndex *lastBlock, const CBlockIndex *firstBlock) const
+    {
+        CHashWriter ss(SER_GETHASH, PROTOCOL_VERSION);
+        ss << nonce << *(const CScriptBase*)(&txin.scriptSig) << (int)denomination << txHashForMetadata << fPadding
+           << lastBlock->GetBlockHash() << firstBlock->GetBlockHash();
+        return ss.GetHash();
+    }
+
+    bool Get(const uint256 &entry)
+    {
+        LOCK(cs);
+        return setValid.count(entry) > 0;
+    }
+
+    void Set(const uint256 &entry)
+    {
+        LOCK(cs);
+        while (setValid.size() >= MAX_SIGMA_PROOF_CACHE_SIZE) {
+            size_t bucket = GetRand(setValid.bucket_count());
+            if (setValid.begin(bucket) != setValid.end(bucket))
+                setValid.erase(*setValid.begin(bucket));
+        }
+        setValid.insert(entry);
+    }
+};
+
+CSigmaSpendProofCache sigmaSpendProofCache;
+
+}
+
+// Build a vector with all the public coins with given denomination and accumulator id from the first block of
+// the group up to lastBlock.
+static void GetAnonymitySet(
+        const CBlockIndex *lastBlock,
+        const CBlockIndex *firstBlock,
+        const pair<sigma::CoinDenomination, int> &denominationAndId,
+        std::vector<sigma::PublicCoin> &anonymity_set) {
+    for (const CBlockIndex *index = lastBlock; ; index = index->pprev) {
+        if (index->GetSigmaMintCount(denominationAndId) > 0) {
+            auto mintSpendData = index->GetMintSpendData();
+            const auto &pubCoins = mintSpendData->sigmaMintedPubCoins.at(denominationAndId);
+            anonymity_set.insert(anonymity_set.end(), pubCoins.begin(), pubCoins.end());
+        }
+        if (index == firstBlock)
+            break;
+    }
+}
+
 static bool CheckSigmaSpendSerial(
         CValidationState &state,
         CSigmaTxInfo *sigmaTxInfo,
@@ -269,20 +351,6 @@ bool CheckSigmaSpendTransaction(
         while (index != coinGroup.firstBlock && index->GetBlockHash() != accumulatorBlockHash)
             index = index->pprev;
 
-        // Build a vector with all the public coins with given denomination and accumulator id before
-        // the block on which the spend occured.
-        // This list of public coins is required by function "Verify" of CoinSpend.
-        std::vector<sigma::PublicCoin> anonymity_set;
-        while(true) {
-            BOOST_FOREACH(const sigma::PublicCoin& pubCoinValue,
-                    index->sigmaMintedPubCoins[denominationAndId]) {
-                anonymity_set.push_back(pubCoinValue);
-            }
-            if (index == coinGroup.firstBlock)
-                break;
-            index = index->pprev;
-        }
-
         bool fPadding = spend->getVersion() >= ZEROCOIN_TX_VERSION_3_1;
         if (!isVerifyDB) {
             bool fShouldPad = (nHeight != INT_MAX && nHeight >= params.nSigmaPaddingBlock) ||
@@ -291,7 +359,18 @@ bool CheckSigmaSpendTransaction(
                 return state.DoS(1, error("Incorrect sigma spend transaction version"));
         }
 
-        passVerify = spend->Verify(anonymity_set, newMetaData, fPadding);
+        uint256 proofCacheEntry = sigmaSpendProofCache.ComputeEntry(
+            txin, targetDenominations[vinIndex], txHashForMetadata, fPadding, index, coinGroup.firstBlock);
+        passVerify = sigmaSpendProofCache.Get(proofCacheEntry);
+        if (!passVerify) {
+            // This list of public coins is required by function "Verify" of CoinSpend.
+            std::vector<sigma::PublicCoin> anonymity_set;
+            GetAnonymitySet(index, coinGroup.firstBlock, denominationAndId, anonymity_set);
+
+            passVerify = spend->Verify(anonymity_set, newMetaData, fPadding);
+            if (passVerify)
+                sigmaSpendProofCache.Set(proofCacheEntry);
+        }
         if (passVerify) {
             Scalar serial = spend->getCoinSerialNumber();
             // do not check for duplicates in case we've seen exact copy of this tx in this block before
@@ -501,6 +580,92 @@ bool CheckSigmaTransaction(
     return true;
 }
 
+bool VerifySigmaSpendProofs(const CTransaction &tx, CValidationState &state) {
+    if (!tx.IsSigmaSpend())
+        return true;
+
+    struct SpendToVerify {
+        std::unique_ptr<sigma::CoinSpend> spend;
+        std::vector<sigma::PublicCoin> anonymitySet;
+        uint256 txHashForMetadata;
+        int coinGroupId;
+        bool fPadding;
+        uint256 proofCacheEntry;
+        bool fValid;
+    };
+    std::vector<SpendToVerify> spends;
+
+    {
+        // Only collect the anonymity sets under the lock. Anything malformed is left to CheckTransaction
+        // to report properly
+        LOCK(cs_main);
+
+        CMutableTransaction txTemp = tx;
+        BOOST_FOREACH(CTxIn &txTempIn, txTemp.vin) {
+            if (txTempIn.scriptSig.IsSigmaSpend())
+                txTempIn.scriptSig.clear();
+        }
+        uint256 txHashForMetadata = txTemp.GetHash();
+
+        for (const CTxIn &txin : tx.vin) {
+            SpendToVerify spend;
+            uint32_t coinGroupId;
+            try {
+                std::tie(spend.spend, coinGroupId) = ParseSigmaSpend(txin);
+            }
+            catch (CBadTxIn&) {
+                return true;
+            }
+            catch (std::exception&) {
+                return true;
+            }
+
+            sigma::CoinDenomination denomination = spend.spend->getDenomination();
+            CSigmaState::SigmaCoinGroupInfo coinGroup;
+            if (!sigmaState.GetCoinGroupInfo(denomination, coinGroupId, coinGroup))
+                return true;
+
+            CBlockIndex *index = coinGroup.lastBlock;
+            uint256 accumulatorBlockHash = spend.spend->getAccumulatorBlockHash();
+            while (index != coinGroup.firstBlock && index->GetBlockHash() != accumulatorBlockHash)
+                index = index->pprev;
+
+            spend.txHashForMetadata = txHashForMetadata;
+            spend.coinGroupId = coinGroupId;
+            spend.fPadding = spend.spend->getVersion() >= ZEROCOIN_TX_VERSION_3_1;
+            spend.proofCacheEntry = sigmaSpendProofCache.ComputeEntry(
+                txin, denomination, txHashForMetadata, spend.fPadding, index, coinGroup.firstBlock);
+            if (sigmaSpendProofCache.Get(spend.proofCacheEntry))
+                continue;
+
+            GetAnonymitySet(index, coinGroup.firstBlock, std::make_pair(denomination, (int)coinGroupId), spend.anonymitySet);
+            spend.fValid = false;
+            spends.push_back(std::move(spend));
+        }
+    }
+
+    if (spends.empty())
+        return true;
+
+    libzerocoin::ParallelTasks tasks(spends.size());
+    for (SpendToVerify &spend: spends) {
+        tasks.Add([&spend]() {
+            sigma::SpendMetaData metaData(spend.coinGroupId, spend.spend->getAccumulatorBlockHash(), spend.txHashForMetadata);
+            spend.fValid = spend.spend->Verify(spend.anonymitySet, metaData, spend.fPadding);
+        });
+    }
+    tasks.Wait();
+
+    for (const SpendToVerify &spend: spends) {
+        if (!spend.fValid)
+            return state.DoS(100, error("VerifySigmaSpendProofs: verification failed for tx %s", tx.GetHash().ToString()),
+                             REJECT_INVALID, "bad-txns-sigma-spend-proof");
+        sigmaSpendProofCache.Set(spend.proofCacheEntry);
+    }
+
+    return true;
+}
+
 void RemoveSigmaSpendsReferencingBlock(CTxMemPool& pool, CBlockIndex* blockIndex) {
     LOCK2(cs_main, pool.cs);
     std::vector<CTransaction> txn_to_remove;
@@ -598,8 +763,9 @@ bool ConnectBlockSigma(
     // Add zerocoin transaction information to index
     if (pblock && pblock->sigmaTxInfo) {
         if (!fJustCheck) {
-            pindexNew->sigmaMintedPubCoins.clear();
-            pindexNew->sigmaSpentSerials.clear();
+            CBlockMintSpendData &mintSpendData = pindexNew->GetMintSpendDataForUpdate();
+            mintSpendData.sigmaMintedPubCoins.clear();
+            mintSpendData.sigmaSpentSerials.clear();
         }
 
         if (!CheckSigmaBlock(state, *pblock)) {
@@ -618,7 +784,7 @@ bool ConnectBlockSigma(
             }
 
             if (!fJustCheck) {
-                pindexNew->sigmaSpentSerials.insert(serial);
+                pindexNew->GetMintSpendDataForUpdate().sigmaSpentSerials.insert(serial);
                 sigmaState.AddSpend(serial.first, serial.second.denomination, serial.second.coinGroupId);
             }
         }
@@ -732,6 +898,35 @@ bool BuildSigmaStateFromIndex(CChain *chain) {
     return true;
 }
 
+bool LoadSigmaState(CChain *chain) {
+    if (chain->Tip() == NULL)
+        return false;
+
+    int64_t nStart = GetTimeMillis();
+    if (!sigmaState.ReadSnapshot(GetDataDir() / SIGMA_STATE_FILENAME, chain))
+        return false;
+
+    sigmaStateSnapshotTip = chain->Tip()->GetBlockHash();
+    LogPrintf("Loaded sigma state at block %s: %d mints, %d spends  %dms\n",
+        sigmaStateSnapshotTip.ToString(), sigmaState.GetMints().size(), sigmaState.GetSpends().size(),
+        GetTimeMillis() - nStart);
+    return true;
+}
+
+bool FlushSigmaState(CChain *chain) {
+    CBlockIndex *tip = chain->Tip();
+    if (tip == NULL || tip->GetBlockHash() == sigmaStateSnapshotTip)
+        return true;
+
+    int64_t nStart = GetTimeMillis();
+    if (!sigmaState.WriteSnapshot(GetDataDir() / SIGMA_STATE_FILENAME, tip->GetBlockHash()))
+        return false;
+
+    sigmaStateSnapshotTip = tip->GetBlockHash();
+    LogPrint("sigma", "Written sigma state at block %s  %dms\n", sigmaStateSnapshotTip.ToString(), GetTimeMillis() - nStart);
+    return true;
+}
+
 // CZerocoinTxInfoV3
 
 void CSigmaTxInfo::Complete() {
@@ -882,7 +1077,7 @@ void CSigmaState::AddMintsToStateAndBlockIndex(
             containers.AddMint(mint, CMintedCoinInfo::make(denomination, mintCoinGroupId, index->nHeight));
 
             LogPrintf("AddMintsToStateAndBlockIndex: mint added denomination=%d, id=%d\n", denomination, mintCoinGroupId);
-            index->sigmaMintedPubCoins[{denomination, mintCoinGroupId}].push_back(mint);
+            index->GetMintSpendDataForUpdate().sigmaMintedPubCoins[{denomination, mintCoinGroupId}].push_back(mint);
         }
     }
 }
@@ -892,9 +1087,13 @@ void CSigmaState::AddSpend(const Scalar &serial, CoinDenomination denom, int coi
 }
 
 void CSigmaState::AddBlock(CBlockIndex *index) {
+    if (!index->HasMintSpendData())
+        return;
+
+    auto mintSpendData = index->GetMintSpendData();
     BOOST_FOREACH(
         const PAIRTYPE(PAIRTYPE(sigma::CoinDenomination, int), vector<sigma::PublicCoin>) &pubCoins,
-            index->sigmaMintedPubCoins) {
+            mintSpendData->sigmaMintedPubCoins) {
         if (!pubCoins.second.empty()) {
             SigmaCoinGroupInfo& coinGroup = coinGroups[pubCoins.first];
 
@@ -910,16 +1109,21 @@ void CSigmaState::AddBlock(CBlockIndex *index) {
         }
     }
 
-    BOOST_FOREACH(const spend_info_container::value_type &serial, index->sigmaSpentSerials) {
+    BOOST_FOREACH(const spend_info_container::value_type &serial, mintSpendData->sigmaSpentSerials) {
         AddSpend(serial.first, serial.second.denomination, serial.second.coinGroupId);
     }
 }
 
 void CSigmaState::RemoveBlock(CBlockIndex *index) {
+    if (!index->HasMintSpendData())
+        return;
+
+    auto mintSpendData = index->GetMintSpendData();
+
     // roll back accumulator updates
     BOOST_FOREACH(
         const PAIRTYPE(PAIRTYPE(sigma::CoinDenomination, int),vector<sigma::PublicCoin>) &coin,
-        index->sigmaMintedPubCoins)
+        mintSpendData->sigmaMintedPubCoins)
     {
         SigmaCoinGroupInfo   &coinGroup = coinGroups[coin.first];
         int  nMintsToForget = coin.second.size();
@@ -942,13 +1146,13 @@ void CSigmaState::RemoveBlock(CBlockIndex *index) {
             do {
                 assert(coinGroup.lastBlock != coinGroup.firstBlock);
                 coinGroup.lastBlock = coinGroup.lastBlock->pprev;
-            } while (coinGroup.lastBlock->sigmaMintedPubCoins.count(coin.first) == 0);
+            } while (coinGroup.lastBlock->GetSigmaMintCount(coin.first) == 0);
         }
     }
 
     // roll back mints
     BOOST_FOREACH(const PAIRTYPE(PAIRTYPE(sigma::CoinDenomination, int),vector<sigma::PublicCoin>) &pubCoins,
-                  index->sigmaMintedPubCoins) {
+                  mintSpendData->sigmaMintedPubCoins) {
         BOOST_FOREACH(const sigma::PublicCoin &coin, pubCoins.second) {
             auto coins = containers.GetMints().equal_range(coin);
             auto coinIt = find_if(
@@ -963,7 +1167,7 @@ void CSigmaState::RemoveBlock(CBlockIndex *index) {
     }
 
     // roll back spends
-    BOOST_FOREACH(const spend_info_container::value_type &serial, index->sigmaSpentSerials) {
+    BOOST_FOREACH(const spend_info_container::value_type &serial, mintSpendData->sigmaSpentSerials) {
         containers.RemoveSpend(serial.first);
     }
 }
@@ -1031,18 +1235,16 @@ int CSigmaState::GetCoinSetForSpend(
     for (CBlockIndex *block = coinGroup.lastBlock;
             ;
             block = block->pprev) {
-        if (block->sigmaMintedPubCoins[denomAndId].size() > 0) {
-            if (block->nHeight <= maxHeight) {
-                if (numberOfCoins == 0) {
-                    // latest block satisfying given conditions
-                    // remember block hash
-                    blockHash_out = block->GetBlockHash();
-                }
-                numberOfCoins += block->sigmaMintedPubCoins[denomAndId].size();
-                coins_out.insert(coins_out.end(),
-                        block->sigmaMintedPubCoins[denomAndId].begin(),
-                        block->sigmaMintedPubCoins[denomAndId].end());
+        if (block->nHeight <= maxHeight && block->GetSigmaMintCount(denomAndId) > 0) {
+            if (numberOfCoins == 0) {
+                // latest block satisfying given conditions
+                // remember block hash
+                blockHash_out = block->GetBlockHash();
             }
+            auto mintSpendData = block->GetMintSpendData();
+            const vector<sigma::PublicCoin> &pubCoins = mintSpendData->sigmaMintedPubCoins.at(denomAndId);
+            numberOfCoins += pubCoins.size();
+            coins_out.insert(coins_out.end(), pubCoins.begin(), pubCoins.end());
         }
         if (block == coinGroup.firstBlock) {
             break ;
@@ -1117,6 +1319,142 @@ void CSigmaState::Reset() {
     containers.Reset();
 }
 
+bool CSigmaState::WriteSnapshot(const fs::path &path, const uint256 &tipHash) const {
+    // Generate random temporary filename
+    unsigned short randv = 0;
+    GetRandBytes((unsigned char *) &randv, sizeof(randv));
+    fs::path pathTmp = path;
+    pathTmp += strprintf(".%04x", randv);
+
+    FILE *file = fsbridge::fopen(pathTmp, "wb");
+    CAutoFile fileout(file, SER_DISK, CLIENT_VERSION);
+    if (fileout.IsNull())
+        return error("%s: Failed to open file %s", __func__, pathTmp.string());
+
+    // serialize state straight into the file, checksum data up to that point, then append checksum
+    try {
+        CHashForwarder<CAutoFile> ss(&fileout);
+        ss << SIGMA_STATE_MAGIC;
+        ss << FLATDATA(::Params().MessageStart());
+        ss << SIGMA_STATE_SNAPSHOT_VERSION;
+        ss << tipHash;
+
+        WriteCompactSize(ss, latestCoinIds.size());
+        for (const auto &latestId : latestCoinIds)
+            ss << static_cast<int>(latestId.first) << latestId.second;
+
+        // blocks are stored by hash and resolved against the block index on load
+        WriteCompactSize(ss, coinGroups.size());
+        for (const auto &group : coinGroups) {
+            ss << static_cast<int>(group.first.first) << group.first.second;
+            ss << group.second.firstBlock->GetBlockHash() << group.second.lastBlock->GetBlockHash();
+            ss << group.second.nCoins;
+        }
+
+        WriteCompactSize(ss, containers.GetMints().size());
+        for (const auto &mint : containers.GetMints())
+            ss << mint.first << mint.second;
+
+        WriteCompactSize(ss, containers.GetSpends().size());
+        for (const auto &spend : containers.GetSpends())
+            ss << spend.first << spend.second;
+
+        fileout << ss.GetHash();
+    }
+    catch (const std::exception &e) {
+        fileout.fclose();
+        fs::remove(pathTmp);
+        return error("%s: Serialize or I/O error - %s", __func__, e.what());
+    }
+    FileCommit(fileout.Get());
+    fileout.fclose();
+
+    // replace existing snapshot, if any, with the new one
+    if (!RenameOver(pathTmp, path))
+        return error("%s: Rename-into-place failed", __func__);
+
+    return true;
+}
+
+bool CSigmaState::ReadSnapshot(const fs::path &path, CChain *chain) {
+    FILE *file = fsbridge::fopen(path, "rb");
+    CAutoFile filein(file, SER_DISK, CLIENT_VERSION);
+    // Snapshot is missing on the first start, nothing to report
+    if (filein.IsNull())
+        return false;
+
+    Reset();
+
+    try {
+        CHashVerifier<CAutoFile> ss(&filein);
+
+        std::string strMagic;
+        unsigned char pchMsgTmp[4];
+        int nSnapshotVersion;
+        uint256 snapshotTip;
+        ss >> strMagic >> FLATDATA(pchMsgTmp) >> nSnapshotVersion >> snapshotTip;
+        if (strMagic != SIGMA_STATE_MAGIC || memcmp(pchMsgTmp, ::Params().MessageStart(), sizeof(pchMsgTmp)))
+            return error("%s: Invalid magic", __func__);
+        if (nSnapshotVersion != SIGMA_STATE_SNAPSHOT_VERSION)
+            return error("%s: Unsupported snapshot version %d", __func__, nSnapshotVersion);
+        if (snapshotTip != chain->Tip()->GetBlockHash()) {
+            LogPrintf("%s: Snapshot is taken at block %s which is not the tip\n", __func__, snapshotTip.ToString());
+            return false;
+        }
+
+        for (uint64_t n = ReadCompactSize(ss); n > 0; n--) {
+            int denomination, id;
+            ss >> denomination >> id;
+            latestCoinIds[CoinDenomination(denomination)] = id;
+        }
+
+        for (uint64_t n = ReadCompactSize(ss); n > 0; n--) {
+            int denomination, id;
+            uint256 firstBlockHash, lastBlockHash;
+            SigmaCoinGroupInfo group;
+            ss >> denomination >> id >> firstBlockHash >> lastBlockHash >> group.nCoins;
+
+            BlockMap::const_iterator firstBlock = mapBlockIndex.find(firstBlockHash);
+            BlockMap::const_iterator lastBlock = mapBlockIndex.find(lastBlockHash);
+            if (firstBlock == mapBlockIndex.end() || !chain->Contains(firstBlock->second) ||
+                    lastBlock == mapBlockIndex.end() || !chain->Contains(lastBlock->second)) {
+                Reset();
+                return error("%s: Coin group %d of denomination %d refers to a block not in the chain", __func__, id, denomination);
+            }
+            group.firstBlock = firstBlock->second;
+            group.lastBlock = lastBlock->second;
+            coinGroups[std::make_pair(CoinDenomination(denomination), id)] = group;
+        }
+
+        for (uint64_t n = ReadCompactSize(ss); n > 0; n--) {
+            sigma::PublicCoin pubCoin;
+            CMintedCoinInfo coinInfo;
+            ss >> pubCoin >> coinInfo;
+            containers.AddMint(pubCoin, coinInfo);
+        }
+
+        for (uint64_t n = ReadCompactSize(ss); n > 0; n--) {
+            Scalar serial;
+            CSpendCoinInfo coinInfo;
+            ss >> serial >> coinInfo;
+            containers.AddSpend(serial, coinInfo);
+        }
+
+        uint256 hashIn;
+        filein >> hashIn;
+        if (hashIn != ss.GetHash()) {
+            Reset();
+            return error("%s: Checksum mismatch, data corrupted", __func__);
+        }
+    }
+    catch (const std::exception &e) {
+        Reset();
+        return error("%s: Deserialize or I/O error - %s", __func__, e.what());
+    }
+
+    return true;
+}
+
 CSigmaState* CSigmaState::GetState() {
     return &sigmaState;
 }
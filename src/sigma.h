@@ -6,6 +6,7 @@
 #include "sigma/coin.h"
 #include "sigma/coinspend.h"
 #include "consensus/validation.h"
+#include "fs.h"
 #include <secp256k1/include/Scalar.h>
 #include <secp256k1/include/GroupElement.h>
 #include "sigma/params.h"
@@ -55,6 +56,9 @@ CAmount GetSpendAmount(const CTxIn& in);
 CAmount GetSpendAmount(const CTransaction& tx);
 bool CheckSigmaBlock(CValidationState &state, const CBlock& block);
 
+/** Maximum number of verified sigma spend proofs to remember */
+static const unsigned int MAX_SIGMA_PROOF_CACHE_SIZE = 10000;
+
 bool CheckSigmaTransaction(
   const CTransaction &tx,
 	CValidationState &state,
@@ -65,6 +69,13 @@ bool CheckSigmaTransaction(
   bool fStatefulSigmaCheck,
   CSigmaTxInfo *zerocoinTxInfo);
 
+/**
+ * Verifies proofs of the sigma spend transaction in parallel without holding cs_main, which is only taken to collect
+ * the anonymity sets. Verified proofs are cached, so subsequent CheckSigmaTransaction calls for the memory pool or
+ * the block don't verify them again. Returns false only if some proof is invalid.
+ */
+bool VerifySigmaSpendProofs(const CTransaction &tx, CValidationState &state);
+
 void DisconnectTipSigma(CBlock &block, CBlockIndex *pindexDelete);
 
 bool ConnectBlockSigma(
@@ -84,6 +95,17 @@ bool GetOutPoint(COutPoint& outPoint, const uint256 &pubCoinValueHash);
 
 bool BuildSigmaStateFromIndex(CChain *chain);
 
+/*
+ * Load the sigma state from the snapshot file. Fails if the snapshot is missing, corrupted or wasn't
+ * taken at the tip of the chain, in which case the state has to be rebuilt with BuildSigmaStateFromIndex
+ */
+bool LoadSigmaState(CChain *chain);
+
+/*
+ * Write the snapshot of the sigma state at the tip of the chain, unless it was already written for this tip
+ */
+bool FlushSigmaState(CChain *chain);
+
 Scalar GetSigmaSpendSerialNumber(const CTransaction &tx, const CTxIn &txin);
 CAmount GetSigmaSpendInput(const CTransaction &tx);
 
@@ -158,6 +180,12 @@ public:
     // Reset to initial values
     void Reset();
 
+    // Write coin groups, mints and spends to the snapshot file, marking it with the hash of the tip block
+    bool WriteSnapshot(const fs::path &path, const uint256 &tipHash) const;
+
+    // Replace the state with the contents of the snapshot file. Fails if the snapshot wasn't taken at the tip
+    bool ReadSnapshot(const fs::path &path, CChain *chain);
+
     // Check if there is a conflicting tx in the blockchain or mempool
     bool CanAddSpendToMempool(const Scalar& coinSerial);
 
@@ -4,8 +4,13 @@
 #include "r1_proof_generator.h"
 #include "sigmaplus_proof.h"
 
+#include "../libzerocoin/ParallelTasks.h"
+
+#include <algorithm>
 #include <cstddef>
 
+#include <boost/thread.hpp>
+
 namespace sigma {
 
 template <class Exponent, class GroupElement>
@@ -14,6 +19,7 @@ class SigmaPlusProver{
 public:
     SigmaPlusProver(const GroupElement& g,
                     const std::vector<GroupElement>& h_gens, int n, int m);
+
     void proof(const std::vector<GroupElement>& commits,
                std::size_t l,
                const Exponent& r,
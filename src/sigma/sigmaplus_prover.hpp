@@ -1,6 +1,9 @@
 #include <math.h>
 namespace sigma {
 
+// Polynomials are computed in chunks of at least this size, smaller chunks aren't worth a thread
+static const std::size_t MIN_POLYNOMIALS_PER_THREAD = 256;
+
 template<class Exponent, class GroupElement>
 SigmaPlusProver<Exponent, GroupElement>::SigmaPlusProver(
         const GroupElement& g,
@@ -41,20 +44,38 @@ void SigmaPlusProver<Exponent, GroupElement>::proof(
     std::vector<Exponent> a;
     r1prover.proof(a, proof_out.r1Proof_, true /*Skip generation of final response*/);
 
-    // Compute coefficients of Polynomials P_I(x), for all I from [0..N].
+    // Compute coefficients of Polynomials P_I(x), for all I from [0..N]. Coefficients are stored by degree,
+    // P_k[k][i] is the coefficient of x^k in P_i(x), so every G_k multiexponentiation takes its vector as is.
+    // Degree m coefficient isn't needed for G_k and is dropped.
     std::size_t N = setSize;
-    std::vector <std::vector<Exponent>> P_i_k;
-    P_i_k.resize(N);
+    std::vector<std::vector<Exponent>> P_k(m_, std::vector<Exponent>(N));
 
     // last polynomial is special case if fPadding is true
-    for (std::size_t i = 0; i < (fPadding ? N-1 : N); ++i) {
-        std::vector<Exponent>& coefficients = P_i_k[i];
-        std::vector<uint64_t> I = SigmaPrimitives<Exponent, GroupElement>::convert_to_nal(i, n_, m_);
-        coefficients.push_back(a[I[0]]);
-        coefficients.push_back(sigma[I[0]]);
-        for (int j = 1; j < m_; ++j) {
-            SigmaPrimitives<Exponent, GroupElement>::new_factor(sigma[j * n_ + I[j]], a[j * n_ + I[j]], coefficients);
-        }
+    std::size_t nPolynomials = fPadding ? N-1 : N;
+    std::size_t nChunks = std::min<std::size_t>(
+        std::max(boost::thread::hardware_concurrency(), 1u),
+        (nPolynomials + MIN_POLYNOMIALS_PER_THREAD - 1) / MIN_POLYNOMIALS_PER_THREAD);
+
+    // the tasks run on the shared pool, which has a thread per core, and are waited for on any exit
+    libzerocoin::ParallelTasks coefficientTasks(nChunks);
+    for (std::size_t chunk = 0; chunk < nChunks; ++chunk) {
+        std::size_t begin = nPolynomials * chunk / nChunks;
+        std::size_t end = nPolynomials * (chunk + 1) / nChunks;
+        coefficientTasks.Add([this, &a, &sigma, &P_k, begin, end]() {
+            std::vector<Exponent> coefficients;
+            coefficients.reserve(m_ + 1);
+            for (std::size_t i = begin; i < end; ++i) {
+                std::vector<uint64_t> I = SigmaPrimitives<Exponent, GroupElement>::convert_to_nal(i, n_, m_);
+                coefficients.clear();
+                coefficients.push_back(a[I[0]]);
+                coefficients.push_back(sigma[I[0]]);
+                for (int j = 1; j < m_; ++j) {
+                    SigmaPrimitives<Exponent, GroupElement>::new_factor(sigma[j * n_ + I[j]], a[j * n_ + I[j]], coefficients);
+                }
+                for (int k = 0; k < m_; ++k)
+                    P_k[k][i] = coefficients[k];
+            }
+        });
     }
 
     if (fPadding) {
@@ -105,23 +126,24 @@ void SigmaPlusProver<Exponent, GroupElement>::proof(
                 p_i_sum[j + k] += polynomial[k];
         }
 
-        P_i_k[N-1] = p_i_sum;
+        for (int k = 0; k < m_; ++k)
+            P_k[k][N-1] = p_i_sum[k];
     }
 
-    //computing G_k`s;
-    std::vector <GroupElement> Gk;
-    Gk.reserve(m_);
+    coefficientTasks.Wait();
+
+    //computing G_k`s, multiexponentiations are independent
+    std::vector <GroupElement> Gk(m_);
+    libzerocoin::ParallelTasks multiExponentTasks(m_);
     for (int k = 0; k < m_; ++k) {
-        std::vector <Exponent> P_i;
-        P_i.reserve(N);
-        for (size_t i = 0; i < N; ++i) {
-            P_i.emplace_back(P_i_k[i][k]);
-        }
-        secp_primitives::MultiExponent mult(commits, P_i);
-        GroupElement c_k = mult.get_multiple();
-        c_k += SigmaPrimitives<Exponent, GroupElement>::commit(g_, Exponent(uint64_t(0)), h_[0], Pk[k]);
-        Gk.emplace_back(c_k);
+        multiExponentTasks.Add([this, &commits, &P_k, &Pk, &Gk, k]() {
+            secp_primitives::MultiExponent mult(commits, P_k[k]);
+            GroupElement c_k = mult.get_multiple();
+            c_k += SigmaPrimitives<Exponent, GroupElement>::commit(g_, Exponent(uint64_t(0)), h_[0], Pk[k]);
+            Gk[k] = c_k;
+        });
     }
+    multiExponentTasks.Wait();
     proof_out.Gk_ = Gk;
 
     // Compute value of challenge X, then continue R1 proof and sigma final response proof.
@@ -0,0 +1,205 @@
+// Copyright (c) 2020 The XFS Core Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "socketevents.h"
+
+#include "netbase.h"
+#include "util.h"
+
+#ifdef HAVE_SYS_EPOLL_H
+#include <sys/epoll.h>
+#endif
+
+#include <algorithm>
+
+#include <boost/foreach.hpp>
+#include <boost/thread.hpp>
+
+// epoll_wait() returns at most this many events per call, the rest are picked up by the next call
+static const int MAX_EPOLL_EVENTS = 1024;
+
+bool SocketEventsModeFromString(const std::string& str, SocketEventsMode& mode)
+{
+    if (str == "select") {
+        mode = SOCKETEVENTS_SELECT;
+        return true;
+    }
+#ifdef HAVE_SYS_EPOLL_H
+    if (str == "epoll") {
+        mode = SOCKETEVENTS_EPOLL;
+        return true;
+    }
+#endif
+    return false;
+}
+
+std::string SocketEventsModeToString(SocketEventsMode mode)
+{
+    switch (mode) {
+    case SOCKETEVENTS_SELECT: return "select";
+    case SOCKETEVENTS_EPOLL: return "epoll";
+    }
+    return "unknown";
+}
+
+std::string GetSupportedSocketEventsModes()
+{
+#ifdef HAVE_SYS_EPOLL_H
+    return "select, epoll";
+#else
+    return "select";
+#endif
+}
+
+CSocketEvents::CSocketEvents(SocketEventsMode modeIn) : mode(modeIn)
+{
+#ifdef HAVE_SYS_EPOLL_H
+    epollFd = -1;
+    if (mode == SOCKETEVENTS_EPOLL) {
+        epollFd = epoll_create1(EPOLL_CLOEXEC);
+        if (epollFd < 0) {
+            LogPrintf("epoll_create1 failed: %s, falling back to select()\n", NetworkErrorString(errno));
+            mode = SOCKETEVENTS_SELECT;
+        }
+    }
+#else
+    mode = SOCKETEVENTS_SELECT;
+#endif
+}
+
+CSocketEvents::~CSocketEvents()
+{
+#ifdef HAVE_SYS_EPOLL_H
+    if (epollFd >= 0)
+        close(epollFd);
+#endif
+}
+
+bool CSocketEvents::Register(SOCKET hSocket, void *cookie, bool fEdgeTriggered)
+{
+#ifdef HAVE_SYS_EPOLL_H
+    if (mode == SOCKETEVENTS_EPOLL) {
+        struct epoll_event event;
+        event.events = EPOLLIN | EPOLLRDHUP | (fEdgeTriggered ? (EPOLLOUT | EPOLLET) : 0);
+        event.data.ptr = cookie;
+        if (epoll_ctl(epollFd, EPOLL_CTL_ADD, hSocket, &event) != 0) {
+            LogPrintf("epoll_ctl failed to add socket: %s\n", NetworkErrorString(errno));
+            return false;
+        }
+    }
+#endif
+    return true;
+}
+
+void CSocketEvents::Unregister(SOCKET hSocket)
+{
+#ifdef HAVE_SYS_EPOLL_H
+    // the kernel only drops a socket from the epoll set once every descriptor of it is closed
+    if (mode == SOCKETEVENTS_EPOLL)
+        epoll_ctl(epollFd, EPOLL_CTL_DEL, hSocket, NULL);
+#endif
+}
+
+bool CSocketEvents::Wait(const std::vector<Socket> &vSockets, int64_t nTimeoutMillis, std::vector<Event> &vEvents)
+{
+    vEvents.clear();
+#ifdef HAVE_SYS_EPOLL_H
+    if (mode == SOCKETEVENTS_EPOLL)
+        return WaitEpoll(nTimeoutMillis, vEvents);
+#endif
+    return WaitSelect(vSockets, nTimeoutMillis, vEvents);
+}
+
+bool CSocketEvents::WaitSelect(const std::vector<Socket> &vSockets, int64_t nTimeoutMillis, std::vector<Event> &vEvents)
+{
+    struct timeval timeout;
+    timeout.tv_sec = nTimeoutMillis / 1000;
+    timeout.tv_usec = (nTimeoutMillis % 1000) * 1000;
+
+    fd_set fdsetRecv;
+    fd_set fdsetSend;
+    fd_set fdsetError;
+    FD_ZERO(&fdsetRecv);
+    FD_ZERO(&fdsetSend);
+    FD_ZERO(&fdsetError);
+    SOCKET hSocketMax = 0;
+    bool have_fds = false;
+
+    BOOST_FOREACH(const Socket &socket, vSockets) {
+        if (socket.hSocket == INVALID_SOCKET || !IsSelectableSocket(socket.hSocket))
+            continue;
+        if (socket.nInterest & EVENT_RECV)
+            FD_SET(socket.hSocket, &fdsetRecv);
+        if (socket.nInterest & EVENT_SEND)
+            FD_SET(socket.hSocket, &fdsetSend);
+        if (socket.nInterest & EVENT_ERROR)
+            FD_SET(socket.hSocket, &fdsetError);
+        hSocketMax = std::max(hSocketMax, socket.hSocket);
+        have_fds = true;
+    }
+
+    int nSelect = select(have_fds ? hSocketMax + 1 : 0,
+                         &fdsetRecv, &fdsetSend, &fdsetError, &timeout);
+    boost::this_thread::interruption_point();
+
+    if (nSelect == SOCKET_ERROR) {
+        if (have_fds) {
+            int nErr = WSAGetLastError();
+            LogPrintf("socket select error %s\n", NetworkErrorString(nErr));
+        }
+        MilliSleep(nTimeoutMillis);
+        return false;
+    }
+
+    if (nSelect == 0)
+        return true;
+
+    BOOST_FOREACH(const Socket &socket, vSockets) {
+        if (socket.hSocket == INVALID_SOCKET || !IsSelectableSocket(socket.hSocket))
+            continue;
+        unsigned int nEvents = 0;
+        if (FD_ISSET(socket.hSocket, &fdsetRecv))
+            nEvents |= EVENT_RECV;
+        if (FD_ISSET(socket.hSocket, &fdsetSend))
+            nEvents |= EVENT_SEND;
+        if (FD_ISSET(socket.hSocket, &fdsetError))
+            nEvents |= EVENT_ERROR;
+        if (nEvents != 0) {
+            Event event = {socket.cookie, nEvents};
+            vEvents.push_back(event);
+        }
+    }
+    return true;
+}
+
+#ifdef HAVE_SYS_EPOLL_H
+bool CSocketEvents::WaitEpoll(int64_t nTimeoutMillis, std::vector<Event> &vEvents)
+{
+    struct epoll_event events[MAX_EPOLL_EVENTS];
+    int nEvents = epoll_wait(epollFd, events, MAX_EPOLL_EVENTS, (int)nTimeoutMillis);
+    boost::this_thread::interruption_point();
+
+    if (nEvents < 0) {
+        if (errno == EINTR)
+            return true;
+        LogPrintf("socket epoll_wait error %s\n", NetworkErrorString(errno));
+        MilliSleep(nTimeoutMillis);
+        return false;
+    }
+
+    vEvents.reserve(nEvents);
+    for (int i = 0; i < nEvents; i++) {
+        unsigned int nFlags = 0;
+        if (events[i].events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP))
+            nFlags |= EVENT_RECV;
+        if (events[i].events & EPOLLOUT)
+            nFlags |= EVENT_SEND;
+        if (events[i].events & EPOLLERR)
+            nFlags |= EVENT_ERROR;
+        Event event = {events[i].data.ptr, nFlags};
+        vEvents.push_back(event);
+    }
+    return true;
+}
+#endif
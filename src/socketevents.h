@@ -0,0 +1,96 @@
+// Copyright (c) 2020 The XFS Core Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_SOCKETEVENTS_H
+#define BITCOIN_SOCKETEVENTS_H
+
+#if defined(HAVE_CONFIG_H)
+#include "config/bitcoin-config.h"
+#endif
+
+#include "compat.h"
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+enum SocketEventsMode {
+    SOCKETEVENTS_SELECT,
+    SOCKETEVENTS_EPOLL,
+};
+
+#ifdef HAVE_SYS_EPOLL_H
+static const SocketEventsMode DEFAULT_SOCKETEVENTS = SOCKETEVENTS_EPOLL;
+#else
+static const SocketEventsMode DEFAULT_SOCKETEVENTS = SOCKETEVENTS_SELECT;
+#endif
+
+/** Parse -socketevents value, fails for unknown modes and for modes not supported on this platform */
+bool SocketEventsModeFromString(const std::string& str, SocketEventsMode& mode);
+std::string SocketEventsModeToString(SocketEventsMode mode);
+/** Comma separated list of modes supported on this platform */
+std::string GetSupportedSocketEventsModes();
+
+/**
+ * Waits for socket readiness.
+ *
+ * select() is level-triggered: the caller passes the sockets it is interested in to every Wait() call
+ * and gets back the ones that are ready right now. It can't handle sockets >= FD_SETSIZE.
+ *
+ * epoll is edge-triggered for sockets registered with fEdgeTriggered: an event is only reported when
+ * the socket becomes ready, so the caller has to remember readiness until recv()/send() return
+ * EWOULDBLOCK. Interest passed to Wait() is ignored, sockets are reported until they are closed or
+ * unregistered.
+ */
+class CSocketEvents
+{
+public:
+    static const unsigned int EVENT_RECV = 1;
+    static const unsigned int EVENT_SEND = 2;
+    static const unsigned int EVENT_ERROR = 4;
+
+    struct Socket {
+        SOCKET hSocket;
+        void *cookie;
+        unsigned int nInterest;
+    };
+
+    struct Event {
+        void *cookie;
+        unsigned int nEvents;
+    };
+
+    explicit CSocketEvents(SocketEventsMode modeIn);
+    ~CSocketEvents();
+
+    SocketEventsMode GetMode() const { return mode; }
+    bool IsEdgeTriggered() const { return mode == SOCKETEVENTS_EPOLL; }
+
+    /** Start watching socket (epoll only, no-op for select). Cookie is returned with its events. */
+    bool Register(SOCKET hSocket, void *cookie, bool fEdgeTriggered);
+    /** Stop watching socket, call before closing it so no more events are reported with its cookie. */
+    void Unregister(SOCKET hSocket);
+
+    /**
+     * Wait up to nTimeoutMillis for events. Returns false on error, in which case the caller
+     * should treat all sockets as ready and let recv()/send() sort it out.
+     */
+    bool Wait(const std::vector<Socket> &vSockets, int64_t nTimeoutMillis, std::vector<Event> &vEvents);
+
+private:
+    SocketEventsMode mode;
+#ifdef HAVE_SYS_EPOLL_H
+    int epollFd;
+#endif
+
+    bool WaitSelect(const std::vector<Socket> &vSockets, int64_t nTimeoutMillis, std::vector<Event> &vEvents);
+#ifdef HAVE_SYS_EPOLL_H
+    bool WaitEpoll(int64_t nTimeoutMillis, std::vector<Event> &vEvents);
+#endif
+
+    CSocketEvents(const CSocketEvents&);
+    CSocketEvents& operator=(const CSocketEvents&);
+};
+
+#endif // BITCOIN_SOCKETEVENTS_H
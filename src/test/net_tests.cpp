@@ -164,4 +164,58 @@ BOOST_AUTO_TEST_CASE(cnode_simple_test)
     BOOST_CHECK(pnode2->fFeeler == false);
 }
 
+BOOST_AUTO_TEST_CASE(cnode_receive_msg_bytes)
+{
+    in_addr ipv4Addr;
+    ipv4Addr.s_addr = 0xa0b0c001;
+    CAddress addr = CAddress(CService(ipv4Addr, 7777), NODE_NETWORK);
+    CNode* pnode = new CNode(INVALID_SOCKET, addr, "", true);
+    LOCK(pnode->cs_vRecvMsg);
+
+    // ping with an 8 byte nonce, followed by a 300000 byte message
+    std::vector<char> vPayload1(8, 0x11), vPayload2(300000, 0x22);
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    ss << CMessageHeader(Params().MessageStart(), "ping", vPayload1.size());
+    ss.write(&vPayload1[0], vPayload1.size());
+    ss << CMessageHeader(Params().MessageStart(), "block", vPayload2.size());
+    ss.write(&vPayload2[0], vPayload2.size());
+    std::vector<char> vData(ss.begin(), ss.end());
+
+    // byte by byte, the header has to be put together from pieces
+    for (size_t i = 0; i < 32; i++)
+        BOOST_CHECK(pnode->ReceiveMsgBytes(&vData[i], 1));
+    BOOST_CHECK_EQUAL(pnode->vRecvMsg.size(), 1);
+    BOOST_CHECK(pnode->vRecvMsg[0].complete());
+    BOOST_CHECK(pnode->vRecvMsg[0].hdr.GetCommand() == "ping");
+    BOOST_CHECK(std::equal(vPayload1.begin(), vPayload1.end(), pnode->vRecvMsg[0].vRecv.begin()));
+
+    // header in one piece, then the payload partly put in place the way the socket handler does it
+    size_t nPos = 32;
+    BOOST_CHECK(pnode->ReceiveMsgBytes(&vData[nPos], 1000));
+    nPos += 1000;
+    while (nPos < vData.size()) {
+        char *pch = NULL;
+        unsigned int nSpace = pnode->GetRecvPayloadSpace(pch);
+        BOOST_CHECK(nSpace > 0);
+        unsigned int nPayloadBytes = std::min<size_t>(nSpace, vData.size() - nPos);
+        memcpy(pch, &vData[nPos], nPayloadBytes);
+        BOOST_CHECK(pnode->ReceiveMsgBytes(NULL, 0, nPayloadBytes));
+        nPos += nPayloadBytes;
+    }
+    char *pch = NULL;
+    BOOST_CHECK_EQUAL(pnode->GetRecvPayloadSpace(pch), 0);
+    BOOST_CHECK_EQUAL(pnode->vRecvMsg.size(), 2);
+    BOOST_CHECK(pnode->vRecvMsg[1].complete());
+    BOOST_CHECK(pnode->vRecvMsg[1].hdr.GetCommand() == "block");
+    BOOST_CHECK(std::equal(vPayload2.begin(), vPayload2.end(), pnode->vRecvMsg[1].vRecv.begin()));
+
+    // both messages in a single chunk, buffers of the old ones go back to the pool
+    pnode->vRecvMsg.clear();
+    BOOST_CHECK(pnode->ReceiveMsgBytes(&vData[0], vData.size()));
+    BOOST_CHECK_EQUAL(pnode->vRecvMsg.size(), 2);
+    BOOST_CHECK(pnode->vRecvMsg[0].complete() && pnode->vRecvMsg[1].complete());
+    BOOST_CHECK_EQUAL(pnode->vRecvMsg[1].vRecv.size(), vPayload2.size());
+    BOOST_CHECK(std::equal(vPayload2.begin(), vPayload2.end(), pnode->vRecvMsg[1].vRecv.begin()));
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,89 @@
+// Copyright (c) 2020 The XFS Core Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "netmsgstats.h"
+
+#include "protocol.h"
+
+#include "test/test_bitcoin.h"
+
+#include <string>
+#include <vector>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(netmsgstats_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(netmsgstats_known_commands)
+{
+    CNetMsgStats stats;
+    const std::vector<std::string> &allMessages = getAllNetMessageTypes();
+    for (size_t i = 0; i < allMessages.size(); i++)
+        stats.RecordRecv(allMessages[i], i + 1);
+
+    // every known command is counted on its own, including the ones only the xfsnode code handles
+    mapNetMsgTypeStats mapStats;
+    stats.GetStats(mapStats);
+    BOOST_CHECK_EQUAL(mapStats.size(), allMessages.size());
+    for (size_t i = 0; i < allMessages.size(); i++) {
+        BOOST_CHECK_EQUAL(mapStats[allMessages[i]].nMsgsRecv, 1U);
+        BOOST_CHECK_EQUAL(mapStats[allMessages[i]].nBytesRecv, i + 1);
+    }
+    BOOST_CHECK(mapStats.count(NetMsgType::TXLOCKVOTE));
+    BOOST_CHECK(mapStats.count(NetMsgType::TXLOCKREQUEST));
+    BOOST_CHECK(mapStats.count(NetMsgType::MNANNOUNCE));
+    BOOST_CHECK(!mapStats.count("*other*"));
+}
+
+BOOST_AUTO_TEST_CASE(netmsgstats_unknown_commands)
+{
+    CNetMsgStats stats;
+    stats.RecordRecv(NetMsgType::TX, 250);
+    stats.RecordSent(NetMsgType::TX, 300);
+    stats.RecordRecv("madeup", 1000);
+    stats.RecordRecv("madeup2", 2000);
+    stats.RecordSent("", 10);
+    stats.RecordRecv("TX", 20); // commands are case sensitive
+
+    // unknown commands share one bucket, so a peer can't grow the map
+    mapNetMsgTypeStats mapStats;
+    stats.GetStats(mapStats);
+    BOOST_CHECK_EQUAL(mapStats.size(), 2U);
+    BOOST_CHECK_EQUAL(mapStats[NetMsgType::TX].nMsgsRecv, 1U);
+    BOOST_CHECK_EQUAL(mapStats[NetMsgType::TX].nBytesRecv, 250U);
+    BOOST_CHECK_EQUAL(mapStats[NetMsgType::TX].nMsgsSent, 1U);
+    BOOST_CHECK_EQUAL(mapStats[NetMsgType::TX].nBytesSent, 300U);
+    BOOST_CHECK_EQUAL(mapStats["*other*"].nMsgsRecv, 3U);
+    BOOST_CHECK_EQUAL(mapStats["*other*"].nBytesRecv, 3020U);
+    BOOST_CHECK_EQUAL(mapStats["*other*"].nMsgsSent, 1U);
+    BOOST_CHECK_EQUAL(mapStats["*other*"].nBytesSent, 10U);
+}
+
+BOOST_AUTO_TEST_CASE(netmsgstats_process_time_buckets)
+{
+    CNetMsgStats stats;
+    stats.RecordProcessed(NetMsgType::BLOCK, 0);
+    stats.RecordProcessed(NetMsgType::BLOCK, 10);      // bounds are inclusive
+    stats.RecordProcessed(NetMsgType::BLOCK, 11);
+    stats.RecordProcessed(NetMsgType::BLOCK, 1000000);
+    stats.RecordProcessed(NetMsgType::BLOCK, 5000000); // above the last bound
+    stats.RecordProcessed("madeup", 50);
+
+    mapNetMsgTypeStats mapStats;
+    stats.GetStats(mapStats);
+    const CNetMsgTypeStats &block = mapStats[NetMsgType::BLOCK];
+    BOOST_CHECK_EQUAL(block.nMsgsProcessed, 5U);
+    BOOST_CHECK_EQUAL(block.nProcessTimeMicros, 6000021);
+    BOOST_CHECK_EQUAL(block.nMaxProcessTimeMicros, 5000000);
+    BOOST_CHECK_EQUAL(block.vProcessTimeHist[0], 2U);
+    BOOST_CHECK_EQUAL(block.vProcessTimeHist[1], 1U);
+    BOOST_CHECK_EQUAL(block.vProcessTimeHist[NET_MSG_PROCESS_TIME_BUCKETS - 2], 1U);
+    BOOST_CHECK_EQUAL(block.vProcessTimeHist[NET_MSG_PROCESS_TIME_BUCKETS - 1], 1U);
+
+    const CNetMsgTypeStats &other = mapStats["*other*"];
+    BOOST_CHECK_EQUAL(other.nMsgsProcessed, 1U);
+    BOOST_CHECK_EQUAL(other.vProcessTimeHist[1], 1U);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
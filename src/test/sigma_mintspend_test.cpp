@@ -165,4 +165,54 @@ BOOST_AUTO_TEST_CASE(sigma_mintspend_test)
         sigmaState->Reset();
     }
 }
+
+/*
+* Mint and spend data of a block that is disconnected and connected again is released from memory
+* once it's written to disk
+*/
+BOOST_AUTO_TEST_CASE(sigma_mintspend_reorg_releases_data)
+{
+    sigma::CSigmaState *sigmaState = sigma::CSigmaState::GetState();
+    string stringError;
+
+    CreateAndProcessEmptyBlocks(201, scriptPubKey);
+    pwalletMain->SetBroadcastTransactions(true);
+
+    vector<pair<std::string, int>> denominationPairs;
+    denominationPairs.push_back(std::make_pair("1", 1));
+    BOOST_CHECK_MESSAGE(pwalletMain->CreateZerocoinMintModel(
+        stringError, denominationPairs, SIGMA), stringError + " - Create Mint failed");
+    BOOST_CHECK_MESSAGE(mempool.size() == 1, "Mint was not added to mempool");
+
+    CBlock b = CreateAndProcessBlock({}, scriptPubKey);
+    CreateAndProcessBlock({}, scriptPubKey);
+
+    CBlockIndex *pindexMint = mapBlockIndex[b.GetHash()];
+    BOOST_CHECK(chainActive.Contains(pindexMint));
+    BOOST_CHECK(pindexMint->HasMintSpendData());
+    FlushStateToDisk();
+    BOOST_CHECK_MESSAGE(!pindexMint->IsMintSpendDataPinned(), "Mint and spend data kept after it was written");
+
+    {
+        LOCK(cs_main);
+        CValidationState state;
+        BOOST_CHECK(InvalidateBlock(state, Params(), pindexMint));
+        BOOST_CHECK(!chainActive.Contains(pindexMint));
+        BOOST_CHECK(ReconsiderBlock(state, pindexMint));
+    }
+    // the block keeps BLOCK_VALID_SCRIPTS, nothing else marks it dirty when it's connected again
+    FlushStateToDisk();
+
+    CValidationState state;
+    BOOST_CHECK(ActivateBestChain(state, Params()));
+    BOOST_CHECK_MESSAGE(chainActive.Contains(pindexMint), "Block not connected again");
+    BOOST_CHECK(pindexMint->HasMintSpendData());
+
+    FlushStateToDisk();
+    BOOST_CHECK_MESSAGE(!pindexMint->IsMintSpendDataPinned(), "Mint and spend data of reconnected block kept in memory");
+
+    mempool.clear();
+    sigmaState->Reset();
+}
+
 BOOST_AUTO_TEST_SUITE_END()
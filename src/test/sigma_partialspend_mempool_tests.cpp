@@ -153,6 +153,15 @@ BOOST_AUTO_TEST_CASE(partialspend)
         // This confirms that double spend is blocked and cannot enter mempool
         BOOST_CHECK_MESSAGE(mempool.size() == 0, "Mempool not empty although mempool should reject double spend");
 
+        // Proofs of the double spend are still valid, only its serial gets it rejected
+        CValidationState proofState;
+        BOOST_CHECK_MESSAGE(sigma::VerifySigmaSpendProofs(dtx, proofState), "Valid spend proofs rejected");
+
+        // Proofs are bound to the rest of the transaction
+        CMutableTransaction tamperedTx = dtx;
+        tamperedTx.vout[0].nValue -= 1;
+        BOOST_CHECK_MESSAGE(!sigma::VerifySigmaSpendProofs(tamperedTx, proofState), "Spend proofs accepted for modified transaction");
+
         // Temporary disable usedCoinSerials check to force double spend in mempool
         auto tempSerials = sigmaState->containers.usedCoinSerials;
         auto tempPubcoins = sigmaState->containers.mintedPubCoins;
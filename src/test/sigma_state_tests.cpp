@@ -560,9 +560,9 @@ BOOST_AUTO_TEST_CASE(sigma_getcoingroupinfo_existing)
     sigmaState->GetCoinGroupInfo(pubcoin.getDenomination(), 1, result);
     BOOST_CHECK_MESSAGE(result.nCoins == 1,
         "Unexpected number of coins in group.");
-    BOOST_CHECK_MESSAGE(result.firstBlock->mintedPubCoins.size() == index.mintedPubCoins.size(),
+    BOOST_CHECK_MESSAGE(result.firstBlock->GetMintSpendData()->mintedPubCoins.size() == index.GetMintSpendData()->mintedPubCoins.size(),
         "Unexpected first block index for Group info.");
-    BOOST_CHECK_MESSAGE(result.lastBlock->mintedPubCoins.size() == index.mintedPubCoins.size(),
+    BOOST_CHECK_MESSAGE(result.lastBlock->GetMintSpendData()->mintedPubCoins.size() == index.GetMintSpendData()->mintedPubCoins.size(),
         "Unexpected last block index for Group info.");
 
     sigmaState->Reset();
@@ -627,8 +627,8 @@ BOOST_AUTO_TEST_CASE(zerocoin_sigma_addblock_minted_spend)
     std::pair<sigma::CoinDenomination, int> denomination1Group1(
         sigma::CoinDenomination::SIGMA_DENOM_1,1);
 
-	index.sigmaMintedPubCoins[denomination1Group1].push_back(pubcoin1);
-	index.sigmaMintedPubCoins[denomination1Group1].push_back(pubcoin2);
+	index.GetMintSpendDataForUpdate().sigmaMintedPubCoins[denomination1Group1].push_back(pubcoin1);
+	index.GetMintSpendDataForUpdate().sigmaMintedPubCoins[denomination1Group1].push_back(pubcoin2);
 
 	sigmaState->AddBlock(&index);
 	BOOST_CHECK_MESSAGE(sigmaState->GetMints().size() == 2,
@@ -651,8 +651,8 @@ BOOST_AUTO_TEST_CASE(zerocoin_sigma_addblock_minted_spend)
 	auto spendSerial = coinSpend.getCoinSerialNumber();
 
     CBlockIndex index2 = CreateBlockIndex(2);
-	index2.sigmaSpentSerials.clear();
-	index2.sigmaSpentSerials.insert(std::make_pair(spendSerial, sigma::CSpendCoinInfo::make(coinSpend.getDenomination(), 0)));
+	index2.GetMintSpendDataForUpdate().sigmaSpentSerials.clear();
+	index2.GetMintSpendDataForUpdate().sigmaSpentSerials.insert(std::make_pair(spendSerial, sigma::CSpendCoinInfo::make(coinSpend.getDenomination(), 0)));
 	sigmaState->AddBlock(&index2);
 	BOOST_CHECK_MESSAGE(sigmaState->GetMints().size() == 2,
 	  "Unexpected mintedPubCoins size, add new block without additional minted.");
@@ -666,7 +666,7 @@ BOOST_AUTO_TEST_CASE(zerocoin_sigma_addblock_minted_spend)
     pubcoin3 = privcoin3.getPublicCoin();
     CBlockIndex index3 = CreateBlockIndex(3);
 
-    index3.sigmaMintedPubCoins[denomination1Group1].push_back(pubcoin3);
+    index3.GetMintSpendDataForUpdate().sigmaMintedPubCoins[denomination1Group1].push_back(pubcoin3);
     sigmaState->AddBlock(&index3);
     BOOST_CHECK_MESSAGE(sigmaState->GetMints().size() == 3,
 	  "Unexpected mintedPubCoins size, add new block with one more minted.");
@@ -689,7 +689,7 @@ BOOST_AUTO_TEST_CASE(zerocoin_sigma_removeblock_remove)
 
     auto index1 = CreateBlockIndex(1);
     std::pair<sigma::CoinDenomination, int> denomination1Group1(sigma::CoinDenomination::SIGMA_DENOM_1, 1);
-    index1.sigmaMintedPubCoins[denomination1Group1] = pubCoins;
+    index1.GetMintSpendDataForUpdate().sigmaMintedPubCoins[denomination1Group1] = pubCoins;
 
     // add index 2 with 10 minted and 1 spend
     auto coins2 = generateCoins(params,10, sigma::CoinDenomination::SIGMA_DENOM_1);
@@ -697,15 +697,15 @@ BOOST_AUTO_TEST_CASE(zerocoin_sigma_removeblock_remove)
 
     auto index2 = CreateBlockIndex(2);
     std::pair<sigma::CoinDenomination, int> denomination1Group2(sigma::CoinDenomination::SIGMA_DENOM_1, 2);
-    index2.sigmaMintedPubCoins[denomination1Group2] = pubCoins2;
+    index2.GetMintSpendDataForUpdate().sigmaMintedPubCoins[denomination1Group2] = pubCoins2;
 
     // Doesn't really matter what metadata we give here, it must pass.
     sigma::SpendMetaData metaData(0, uint256S("120"), uint256S("120"));
 
     sigma::CoinSpend coinSpend(params, coins[0], pubCoins, metaData, true);
 
-    index2.sigmaSpentSerials.clear();
-    index2.sigmaSpentSerials.insert(std::make_pair(coinSpend.getCoinSerialNumber(), sigma::CSpendCoinInfo::make(coinSpend.getDenomination(), 0)));
+    index2.GetMintSpendDataForUpdate().sigmaSpentSerials.clear();
+    index2.GetMintSpendDataForUpdate().sigmaSpentSerials.insert(std::make_pair(coinSpend.getCoinSerialNumber(), sigma::CSpendCoinInfo::make(coinSpend.getDenomination(), 0)));
 
     sigmaState->AddBlock(&index1);
     sigmaState->AddBlock(&index2);
@@ -921,7 +921,7 @@ BOOST_AUTO_TEST_CASE(sigma_build_state)
     std::pair<sigma::CoinDenomination, int> denomination1Group1(sigma::CoinDenomination::SIGMA_DENOM_1, 1);
     std::pair<sigma::CoinDenomination, int> denomination10Group1(sigma::CoinDenomination::SIGMA_DENOM_10, 1);
 
-    index1.sigmaMintedPubCoins[denomination1Group1] = pubCoins;
+    index1.GetMintSpendDataForUpdate().sigmaMintedPubCoins[denomination1Group1] = pubCoins;
 
     chainActive.SetTip(&index1);
 
@@ -936,10 +936,10 @@ BOOST_AUTO_TEST_CASE(sigma_build_state)
     secp_primitives::Scalar serial;
     serial.randomize();
 
-    index2.sigmaSpentSerials.insert(std::make_pair(serial, sigma::CSpendCoinInfo::make(sigma::CoinDenomination::SIGMA_DENOM_1, 0)));
+    index2.GetMintSpendDataForUpdate().sigmaSpentSerials.insert(std::make_pair(serial, sigma::CSpendCoinInfo::make(sigma::CoinDenomination::SIGMA_DENOM_1, 0)));
 
-    index2.sigmaMintedPubCoins[denomination1Group1] = pubCoins2;
-    index2.sigmaMintedPubCoins[denomination10Group1] = pubCoins3;
+    index2.GetMintSpendDataForUpdate().sigmaMintedPubCoins[denomination1Group1] = pubCoins2;
+    index2.GetMintSpendDataForUpdate().sigmaMintedPubCoins[denomination10Group1] = pubCoins3;
 
     chainActive.SetTip(&index2);
 
@@ -1054,7 +1054,7 @@ BOOST_AUTO_TEST_CASE(sigma_getcoinsetforspend)
     auto coins3 = generateCoins(params, 5, sigma::CoinDenomination::SIGMA_DENOM_10);
     auto pubCoins3 = getPubcoins(coins3);
 
-    indexes[nextIndex].sigmaMintedPubCoins[denomination1Group1] = pubCoins;
+    indexes[nextIndex].GetMintSpendDataForUpdate().sigmaMintedPubCoins[denomination1Group1] = pubCoins;
     chainActive.SetTip(&indexes[nextIndex]);
 
     nextIndex++;
@@ -1064,9 +1064,9 @@ BOOST_AUTO_TEST_CASE(sigma_getcoinsetforspend)
     secp_primitives::Scalar serial;
     serial.randomize();
 
-    indexes[nextIndex].sigmaSpentSerials.insert(std::make_pair(serial, sigma::CSpendCoinInfo::make(sigma::CoinDenomination::SIGMA_DENOM_1, 0)));
-    indexes[nextIndex].sigmaMintedPubCoins[denomination1Group1] = pubCoins2;
-    indexes[nextIndex].sigmaMintedPubCoins[denomination10Group1] = pubCoins3;
+    indexes[nextIndex].GetMintSpendDataForUpdate().sigmaSpentSerials.insert(std::make_pair(serial, sigma::CSpendCoinInfo::make(sigma::CoinDenomination::SIGMA_DENOM_1, 0)));
+    indexes[nextIndex].GetMintSpendDataForUpdate().sigmaMintedPubCoins[denomination1Group1] = pubCoins2;
+    indexes[nextIndex].GetMintSpendDataForUpdate().sigmaMintedPubCoins[denomination10Group1] = pubCoins3;
 
     chainActive.SetTip(&indexes[nextIndex]);
 
@@ -1199,5 +1199,68 @@ BOOST_AUTO_TEST_CASE(sigma_surge_detection_failure_anywhere)
     sigmaState->Reset();
 }
 
+BOOST_AUTO_TEST_CASE(sigma_state_snapshot)
+{
+    sigma::CSigmaState *sigmaState = sigma::CSigmaState::GetState();
+    auto params = sigma::Params::get_default();
+    CBlockIndex *oldTip = chainActive.Tip();
+
+    std::vector<uint256> hashes(4);
+    std::vector<CBlockIndex> indexes(4);
+    for (int i = 0; i < 4; i++) {
+        hashes[i] = ArithToUint256(arith_uint256(i + 1));
+        indexes[i].nHeight = i;
+        indexes[i].pprev = i > 0 ? &indexes[i - 1] : NULL;
+        indexes[i].phashBlock = &hashes[i];
+        mapBlockIndex[hashes[i]] = &indexes[i];
+    }
+
+    std::pair<sigma::CoinDenomination, int> denomination1Group1(sigma::CoinDenomination::SIGMA_DENOM_1, 1);
+    std::pair<sigma::CoinDenomination, int> denomination10Group1(sigma::CoinDenomination::SIGMA_DENOM_10, 1);
+
+    auto pubCoins = getPubcoins(generateCoins(params, 5, sigma::CoinDenomination::SIGMA_DENOM_1));
+    auto pubCoins2 = getPubcoins(generateCoins(params, 2, sigma::CoinDenomination::SIGMA_DENOM_10));
+    indexes[1].GetMintSpendDataForUpdate().sigmaMintedPubCoins[denomination1Group1] = pubCoins;
+    indexes[2].GetMintSpendDataForUpdate().sigmaMintedPubCoins[denomination10Group1] = pubCoins2;
+
+    secp_primitives::Scalar serial;
+    serial.randomize();
+    indexes[2].GetMintSpendDataForUpdate().sigmaSpentSerials.insert(std::make_pair(serial, sigma::CSpendCoinInfo::make(sigma::CoinDenomination::SIGMA_DENOM_1, 1)));
+
+    chainActive.SetTip(&indexes[3]);
+    sigma::BuildSigmaStateFromIndex(&chainActive);
+
+    fs::path path = GetDataDir() / "sigmastate_test.dat";
+    BOOST_CHECK(sigmaState->WriteSnapshot(path, chainActive.Tip()->GetBlockHash()));
+
+    sigmaState->Reset();
+    BOOST_CHECK_MESSAGE(sigmaState->ReadSnapshot(path, &chainActive), "Expect snapshot taken at the tip to be loaded");
+
+    sigma::CSigmaState::SigmaCoinGroupInfo group;
+    BOOST_CHECK(sigmaState->GetCoinGroupInfo(sigma::CoinDenomination::SIGMA_DENOM_1, 1, group));
+    BOOST_CHECK_MESSAGE(group.firstBlock == &indexes[1], "Expect firstBlock == index1");
+    BOOST_CHECK_MESSAGE(group.lastBlock == &indexes[1], "Expect lastBlock == index1");
+    BOOST_CHECK_MESSAGE(group.nCoins == 5, "Expect nCoins == 5");
+
+    BOOST_CHECK(sigmaState->GetCoinGroupInfo(sigma::CoinDenomination::SIGMA_DENOM_10, 1, group));
+    BOOST_CHECK_MESSAGE(group.firstBlock == &indexes[2], "Expect firstBlock == index2");
+    BOOST_CHECK_MESSAGE(group.nCoins == 2, "Expect nCoins == 2");
+
+    BOOST_CHECK(sigmaState->GetLatestCoinID(sigma::CoinDenomination::SIGMA_DENOM_1) == 1);
+    BOOST_CHECK(sigmaState->GetMints().size() == 7);
+    BOOST_CHECK(sigmaState->GetMintedCoinHeightAndId(pubCoins2[1]) == std::make_pair(2, 1));
+    BOOST_CHECK(sigmaState->IsUsedCoinSerial(serial));
+
+    // snapshot must not be used once the tip has moved
+    chainActive.SetTip(&indexes[2]);
+    BOOST_CHECK_MESSAGE(!sigmaState->ReadSnapshot(path, &chainActive), "Expect snapshot of another tip to be rejected");
+    BOOST_CHECK(sigmaState->GetMints().empty());
+
+    sigmaState->Reset();
+    fs::remove(path);
+    for (const uint256 &hash : hashes)
+        mapBlockIndex.erase(hash);
+    chainActive.SetTip(oldTip);
+}
 
 BOOST_AUTO_TEST_SUITE_END()
@@ -235,5 +235,109 @@ BOOST_AUTO_TEST_CASE(Test_EnforceXFSnodePayment)
 }
 
 
+// The lookup as it was before the paid blocks index: walk back from pindex and read every block with votes for the payee
+static const CBlockIndex* ScanLastPaidBlock(CXFSnodePayments& payments, const CScript& payee, const CBlockIndex *pindex,
+                                            int nAfterHeight, int nMaxBlocksToScanBack)
+{
+    for (int i = 0; pindex && pindex->nHeight > nAfterHeight && i < nMaxBlocksToScanBack; i++, pindex = pindex->pprev) {
+        if (!payments.mapXFSnodeBlocks.count(pindex->nHeight) ||
+                !payments.mapXFSnodeBlocks[pindex->nHeight].HasPayeeWithVotes(payee, 2))
+            continue;
+
+        CBlock block;
+        if (!ReadBlockFromDisk(block, pindex, Params().GetConsensus()))
+            return NULL;
+        CAmount nXFSnodePayment = GetXFSnodePayment(Params().GetConsensus(), false, pindex->nHeight);
+        BOOST_FOREACH(const CTxOut& txout, block.vtx[0].vout) {
+            if (txout.scriptPubKey == payee && txout.nValue == nXFSnodePayment)
+                return pindex;
+        }
+    }
+    return NULL;
+}
+
+BOOST_AUTO_TEST_CASE(Test_PaidBlocksIndex)
+{
+    const Consensus::Params& params = Params().GetConsensus();
+    mnpayments.Clear();
+
+    std::vector<CScript> vPayees;
+    vPayees.push_back(scriptPubKeyXFSnode);
+    for (int i = 0; i < 3; i++) {
+        CKey key;
+        key.MakeNewKey(true);
+        vPayees.push_back(GetScriptForDestination(key.GetPubKey().GetID()));
+    }
+
+    // on regtest the miner pays itself the xfsnode payment, redirect it to the payees in turn
+    std::vector<CMutableTransaction> noTxns;
+    for (int i = 0; i < 40; i++) {
+        CBlock block = CreateBlock(noTxns, scriptPubKeyXFSnode);
+        CMutableTransaction coinbase(block.vtx[0]);
+        BOOST_REQUIRE(coinbase.vout.size() > 1);
+        BOOST_REQUIRE_EQUAL(coinbase.vout[1].nValue, GetXFSnodePayment(params, false, chainActive.Height() + 1));
+        coinbase.vout[1].scriptPubKey = vPayees[i % vPayees.size()];
+        block.vtx[0] = coinbase;
+        block.fChecked = false;
+        block.hashMerkleRoot = BlockMerkleRoot(block);
+        while (!CheckProofOfWork(block.GetPoWHash(), block.nBits, params)) {
+            ++block.nNonce;
+        }
+        BOOST_CHECK(ProcessBlock(block));
+    }
+
+    // every payee has votes on most blocks
+    const CBlockIndex *pindexTip = chainActive.Tip();
+    for (int nHeight = pindexTip->nHeight - 60; nHeight <= pindexTip->nHeight; nHeight++) {
+        CXFSnodeBlockPayees payees(nHeight);
+        for (size_t i = 0; i < vPayees.size(); i++) {
+            if ((nHeight + i) % 7 == 0) continue;
+            CXFSnodePayee payee(vPayees[i], uint256());
+            payee.AddVoteHash(uint256());
+            payees.vecPayees.push_back(payee);
+        }
+        mnpayments.mapXFSnodeBlocks[nHeight] = payees;
+    }
+
+    // mnpayments was indexed as the blocks were connected, the other one indexes on lookups
+    CXFSnodePayments paymentsLazy;
+    paymentsLazy.mapXFSnodeBlocks = mnpayments.mapXFSnodeBlocks;
+
+    const int vAfterHeights[] = {-1, pindexTip->nHeight - 25};
+    const int vMaxBlocksToScanBack[] = {1, 8, 30, 100};
+    for (int nTipOffset = 12; nTipOffset >= 0; nTipOffset -= 3) {
+        const CBlockIndex *pindex = pindexTip->GetAncestor(pindexTip->nHeight - nTipOffset);
+        BOOST_FOREACH(const CScript& payee, vPayees) {
+            BOOST_FOREACH(int nAfterHeight, vAfterHeights) {
+                BOOST_FOREACH(int nMaxBlocksToScanBack, vMaxBlocksToScanBack) {
+                    const CBlockIndex *pindexPaid = ScanLastPaidBlock(mnpayments, payee, pindex, nAfterHeight, nMaxBlocksToScanBack);
+                    BOOST_CHECK(mnpayments.FindLastPaidBlock(payee, pindex, nAfterHeight, nMaxBlocksToScanBack) == pindexPaid);
+                    BOOST_CHECK(paymentsLazy.FindLastPaidBlock(payee, pindex, nAfterHeight, nMaxBlocksToScanBack) == pindexPaid);
+                }
+            }
+        }
+    }
+
+    // a block that can't be read stops the lookup, once it can be read again the next lookup gets past it
+    CXFSnodePayments paymentsRetry;
+    paymentsRetry.mapXFSnodeBlocks = mnpayments.mapXFSnodeBlocks;
+    CBlockIndex *pindexUnreadable = chainActive[pindexTip->nHeight - 10];
+    const unsigned int nDataPos = pindexUnreadable->nDataPos;
+    pindexUnreadable->nDataPos = pindexUnreadable->pprev->nDataPos;
+    BOOST_FOREACH(const CScript& payee, vPayees) {
+        const CBlockIndex *pindexPaid = paymentsRetry.FindLastPaidBlock(payee, pindexTip, -1, 100);
+        BOOST_CHECK(!pindexPaid || pindexPaid->nHeight > pindexUnreadable->nHeight);
+    }
+    pindexUnreadable->nDataPos = nDataPos;
+
+    const CBlockIndex *pindexAbove = chainActive[pindexUnreadable->nHeight + 1];
+    BOOST_FOREACH(const CScript& payee, vPayees) {
+        const CBlockIndex *pindexPaid = ScanLastPaidBlock(mnpayments, payee, pindexAbove, -1, 100);
+        BOOST_CHECK(pindexPaid != NULL);
+        BOOST_CHECK(paymentsRetry.FindLastPaidBlock(payee, pindexAbove, -1, 100) == pindexPaid);
+    }
+
+    mnpayments.Clear();
+}
 
 BOOST_AUTO_TEST_SUITE_END()
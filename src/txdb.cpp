@@ -343,12 +343,8 @@ bool CBlockTreeDB::LoadBlockIndexGuts(boost::function<CBlockIndex*(const uint256
                 pindexNew->nStatus        = diskindex.nStatus;
                 pindexNew->nTx            = diskindex.nTx;
 
-                pindexNew->accumulatorChanges = diskindex.accumulatorChanges;
-                pindexNew->mintedPubCoins     = diskindex.mintedPubCoins;
-                pindexNew->spentSerials       = diskindex.spentSerials;
-
-                pindexNew->sigmaMintedPubCoins   = diskindex.sigmaMintedPubCoins;
-                pindexNew->sigmaSpentSerials     = diskindex.sigmaSpentSerials;
+                // mint and spend data is loaded again on demand, only keep the counts
+                pindexNew->UpdateMintSpendSummary(*diskindex.GetMintSpendDataPtr());
                 pindexNew->nStakeModifier = diskindex.nStakeModifier;
                 pindexNew->vchBlockSig    = diskindex.vchBlockSig; // qtum
 
@@ -367,6 +363,15 @@ bool CBlockTreeDB::LoadBlockIndexGuts(boost::function<CBlockIndex*(const uint256
     return true;
 }
 
+bool CBlockTreeDB::ReadBlockMintSpendData(const uint256 &blockHash, std::shared_ptr<CBlockMintSpendData> &data)
+{
+    CDiskBlockIndex diskindex;
+    if (!Read(make_pair(DB_BLOCK_INDEX, blockHash), diskindex))
+        return false;
+    data = diskindex.GetMintSpendDataPtr();
+    return true;
+}
+
 int CBlockTreeDB::GetBlockIndexVersion()
 {
     // Get random block index entry, check its version. The only reason for these functions to exist
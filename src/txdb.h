@@ -131,6 +131,7 @@ public:
     bool WriteFlag(const std::string &name, bool fValue);
     bool ReadFlag(const std::string &name, bool &fValue);
     bool LoadBlockIndexGuts(boost::function<CBlockIndex*(const uint256&)> insertBlockIndex);
+    bool ReadBlockMintSpendData(const uint256 &blockHash, std::shared_ptr<CBlockMintSpendData> &data);
     int GetBlockIndexVersion();
     int GetBlockIndexVersion(uint256 const & blockHash);
     bool AddTotalSupply(CAmount const & supply);
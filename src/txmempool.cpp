@@ -1255,7 +1255,8 @@ void CTxMemPool::trackPackageRemoved(const CFeeRate &rate) {
     }
 }
 
-void CTxMemPool::TrimToSize(size_t sizelimit, std::vector <uint256> *pvNoSpendsRemaining) {
+void CTxMemPool::TrimToSize(size_t sizelimit, std::vector <uint256> *pvNoSpendsRemaining,
+                            std::vector <std::shared_ptr<const CTransaction>> *pvEvicted) {
     LOCK(cs);
 
     unsigned nTxnRemoved = 0;
@@ -1276,6 +1277,11 @@ void CTxMemPool::TrimToSize(size_t sizelimit, std::vector <uint256> *pvNoSpendsR
         CalculateDescendants(mapTx.project<0>(it), stage);
         nTxnRemoved += stage.size();
 
+        if (pvEvicted) {
+            BOOST_FOREACH(txiter it, stage)
+                pvEvicted->push_back(it->GetSharedTx());
+        }
+
         std::vector <CTransaction> txn;
         if (pvNoSpendsRemaining) {
             txn.reserve(stage.size());
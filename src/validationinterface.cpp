@@ -32,6 +32,7 @@ void RegisterValidationInterface(CValidationInterface* pwalletIn) {
     g_signals.NotifyAPIStatus.connect(boost::bind(&CValidationInterface::NotifyAPIStatus, pwalletIn));
     g_signals.NotifyXFSnodeList.connect(boost::bind(&CValidationInterface::NotifyXFSnodeList, pwalletIn));
     g_signals.UpdatedBalance.connect(boost::bind(&CValidationInterface::UpdatedBalance, pwalletIn));
+    g_signals.NotifyNetMsgStats.connect(boost::bind(&CValidationInterface::NotifyNetMsgStats, pwalletIn));
 }
 
 void UnregisterValidationInterface(CValidationInterface* pwalletIn) {
@@ -53,6 +54,7 @@ void UnregisterValidationInterface(CValidationInterface* pwalletIn) {
     g_signals.NotifyAPIStatus.disconnect(boost::bind(&CValidationInterface::NotifyAPIStatus, pwalletIn));
     g_signals.NotifyXFSnodeList.disconnect(boost::bind(&CValidationInterface::NotifyXFSnodeList, pwalletIn));
     g_signals.UpdatedBalance.disconnect(boost::bind(&CValidationInterface::UpdatedBalance, pwalletIn));
+    g_signals.NotifyNetMsgStats.disconnect(boost::bind(&CValidationInterface::NotifyNetMsgStats, pwalletIn));
 }
 
 void UnregisterAllValidationInterfaces() {
@@ -74,6 +76,7 @@ void UnregisterAllValidationInterfaces() {
     g_signals.NotifyAPIStatus.disconnect_all_slots();
     g_signals.NotifyXFSnodeList.disconnect_all_slots();
     g_signals.UpdatedBalance.disconnect_all_slots();
+    g_signals.NotifyNetMsgStats.disconnect_all_slots();
 }
 
 void SyncWithWallets(const CTransaction &tx, const CBlockIndex *pindex, const CBlock *pblock) {
@@ -51,6 +51,7 @@ protected:
     virtual void NotifyAPIStatus() {}
     virtual void NotifyXFSnodeList() {}
     virtual void UpdatedBalance() {}
+    virtual void NotifyNetMsgStats() {}
     friend void ::RegisterValidationInterface(CValidationInterface*);
     friend void ::UnregisterValidationInterface(CValidationInterface*);
     friend void ::UnregisterAllValidationInterfaces();
@@ -93,6 +94,8 @@ struct CMainSignals {
     boost::signals2::signal<void ()> NotifyXFSnodeList;
     /** Notifies listeners of balance */
     boost::signals2::signal<void ()> UpdatedBalance;
+    /** Notifies listeners that network message statistics were dumped */
+    boost::signals2::signal<void ()> NotifyNetMsgStats;
 };
 
 CMainSignals& GetMainSignals();
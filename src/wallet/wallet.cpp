@@ -50,8 +50,10 @@
 #include "hdmint/tracker.h"
 
 #include <assert.h>
+#include <atomic>
 #include <boost/algorithm/string/replace.hpp>
 #include <boost/filesystem.hpp>
+#include <boost/scope_exit.hpp>
 #include <boost/thread.hpp>
 
 #ifdef ENABLE_CLIENTAPI
@@ -6856,34 +6858,73 @@ bool CWallet::CreateMultipleSigmaSpendTransaction(
             uint256 txHashForMetadata = txTemp.GetHash();
             LogPrintf("txNew.GetHash: %s\n", txHashForMetadata.ToString());
 
+            // Proofs of different inputs don't depend on each other, create and verify them concurrently.
+            // Every proof spreads over several threads itself, so don't run more than one per core.
+            std::vector<std::unique_ptr<sigma::CoinSpend>> newSpends(tempStorages.size());
+            std::vector<char> spendVerified(tempStorages.size(), 0);
+            std::vector<std::exception_ptr> spendErrors(tempStorages.size());
+            std::atomic<size_t> nextSpend(0);
+
+            auto createSpends = [&]() {
+                for (size_t index = nextSpend++; index < tempStorages.size(); index = nextSpend++) {
+                    const TempStorage &tempStorage = tempStorages[index];
+
+                    // We use incomplete transaction hash for now as a metadata
+                    sigma::SpendMetaData metaData(
+                        tempStorage.serializedId,
+                        tempStorage.blockHash,
+                        txHashForMetadata);
+
+                    bool fPadding = tempStorage.txVersion >= ZEROCOIN_TX_VERSION_3_1;
+
+                    try {
+                        newSpends[index].reset(new sigma::CoinSpend(sigmaParams,
+                                                                    tempStorage.privateCoin,
+                                                                    tempStorage.anonimity_set,
+                                                                    metaData,
+                                                                    fPadding));
+                        newSpends[index]->setVersion(tempStorage.txVersion);
+                        spendVerified[index] = newSpends[index]->Verify(tempStorage.anonimity_set, metaData, fPadding);
+                    } catch (...) {
+                        spendErrors[index] = std::current_exception();
+                    }
+                }
+            };
+
+            // The prover fills the ParallelTasks pool with its own tasks, waiting for them from a task of the same
+            // pool could leave every pool thread blocked, so the proofs get threads of their own.
+            {
+                size_t nSpendThreads = std::min<size_t>(std::max(boost::thread::hardware_concurrency(), 1u), tempStorages.size());
+                boost::thread_group spendThreads;
+                // the threads use the locals above, join them however this scope is left
+                BOOST_SCOPE_EXIT(&spendThreads) {
+                    // join() is an interruption point, it mustn't throw from here
+                    boost::this_thread::disable_interruption di;
+                    spendThreads.join_all();
+                } BOOST_SCOPE_EXIT_END
+                for (size_t i = 1; i < nSpendThreads; i++)
+                    spendThreads.create_thread(createSpends);
+                createSpends();
+            }
+
+            BOOST_FOREACH(const std::exception_ptr &error, spendErrors) {
+                if (error)
+                    std::rethrow_exception(error);
+            }
+
             std::vector<sigma::CoinSpend> spends;
             // Iterator of std::vector<std::pair<int64_t, sigma::CoinDenomination>>::const_iterator
             for (auto it = denominations.begin(); it != denominations.end(); it++)
             {
                 unsigned index = it - denominations.begin();
 
-                // We use incomplete transaction hash for now as a metadata
-                sigma::SpendMetaData metaData(
-                    tempStorages[index].serializedId,
-                    tempStorages[index].blockHash,
-                    txHashForMetadata);
-
-
                 TempStorage tempStorage = tempStorages.at(index);
                 CSigmaEntry coinToUse = tempStorage.coinToUse;
 
-                bool fPadding = tempStorage.txVersion >= ZEROCOIN_TX_VERSION_3_1;
-
-                // Recreate CoinSpend object
-                sigma::CoinSpend spend(sigmaParams,
-                                       tempStorage.privateCoin,
-                                       tempStorage.anonimity_set,
-                                       metaData,
-                                       fPadding);
-                spend.setVersion(tempStorage.txVersion);
+                sigma::CoinSpend &spend = *newSpends[index];
                 spends.push_back(spend);
                 // Verify the coinSpend
-                if (!spend.Verify(tempStorage.anonimity_set, metaData, fPadding)) {
+                if (!spendVerified[index]) {
                     strFailReason = _("the spend coin transaction did not verify");
                     return false;
                 }
@@ -11,6 +11,8 @@
 #include "spork.h"
 #include "util.h"
 
+#include <algorithm>
+
 #include <boost/lexical_cast.hpp>
 
 /** Object for who's going to get paid on which blocks */
@@ -19,6 +21,7 @@ CXFSnodePayments mnpayments;
 CCriticalSection cs_vecPayees;
 CCriticalSection cs_mapXFSnodeBlocks;
 CCriticalSection cs_mapXFSnodePaymentVotes;
+CCriticalSection cs_mapPaidBlocks;
 
 /**
 * IsBlockValueValid
@@ -289,7 +292,10 @@ void CXFSnodePayments::ProcessMessage(CNode *pfrom, std::string &strCommand, CDa
         if (netfulfilledman.HasFulfilledRequest(pfrom->addr, NetMsgType::XFSNODEPAYMENTSYNC)) {
             // Asking for the payments list multiple times in a short period of time is no good
             LogPrintf("XFSNODEPAYMENTSYNC -- peer already asked me for the list, peer=%d\n", pfrom->id);
-            if (!fTestNet) Misbehaving(pfrom->GetId(), 20);
+            if (!fTestNet) {
+                LOCK(cs_main);
+                Misbehaving(pfrom->GetId(), 20);
+            }
             return;
         }
         netfulfilledman.AddFulfilledRequest(pfrom->addr, NetMsgType::XFSNODEPAYMENTSYNC);
@@ -308,7 +314,10 @@ void CXFSnodePayments::ProcessMessage(CNode *pfrom, std::string &strCommand, CDa
 
         uint256 nHash = vote.GetHash();
 
-        pfrom->setAskFor.erase(nHash);
+        {
+            LOCK(cs_main);
+            pfrom->setAskFor.erase(nHash);
+        }
 
         {
             LOCK(cs_mapXFSnodePaymentVotes);
@@ -353,7 +362,10 @@ void CXFSnodePayments::ProcessMessage(CNode *pfrom, std::string &strCommand, CDa
         if (!vote.CheckSignature(mnInfo.pubKeyXFSnode, pCurrentBlockIndex->nHeight, nDos)) {
             if (nDos) {
                 LogPrintf("XFSNODEPAYMENTVOTE -- ERROR: invalid signature\n");
-                if (!fTestNet) Misbehaving(pfrom->GetId(), nDos);
+                if (!fTestNet) {
+                    LOCK(cs_main);
+                    Misbehaving(pfrom->GetId(), nDos);
+                }
             } else {
                 // only warn about anything non-critical (i.e. nDos == 0) in debug mode
                 LogPrint("mnpayments", "XFSNODEPAYMENTVOTE -- WARNING: invalid signature\n");
@@ -380,11 +392,15 @@ void CXFSnodePayments::ProcessMessage(CNode *pfrom, std::string &strCommand, CDa
     }
 }
 
+std::string CXFSnodePaymentVote::GetSignatureMessage() const {
+    return vinXFSnode.prevout.ToStringShort() +
+           boost::lexical_cast<std::string>(nBlockHeight) +
+           ScriptToAsmStr(payee);
+}
+
 bool CXFSnodePaymentVote::Sign() {
     std::string strError;
-    std::string strMessage = vinXFSnode.prevout.ToStringShort() +
-                             boost::lexical_cast<std::string>(nBlockHeight) +
-                             ScriptToAsmStr(payee);
+    std::string strMessage = GetSignatureMessage();
 
     if (!darkSendSigner.SignMessage(strMessage, vchSig, activeXFSnode.keyXFSnode)) {
         LogPrintf("CXFSnodePaymentVote::Sign -- SignMessage() failed\n");
@@ -428,6 +444,21 @@ bool CXFSnodePayments::IsScheduled(CXFSnode &mn, int nNotBlockHeight) {
     return false;
 }
 
+void CXFSnodePayments::GetScheduledPayees(int nNotBlockHeight, std::set<CScript>& setPayeesRet) {
+    LOCK(cs_mapXFSnodeBlocks);
+
+    setPayeesRet.clear();
+    if (!pCurrentBlockIndex) return;
+
+    CScript payee;
+    for (int64_t h = pCurrentBlockIndex->nHeight; h <= pCurrentBlockIndex->nHeight + 8; h++) {
+        if (h == nNotBlockHeight) continue;
+        if (mapXFSnodeBlocks.count(h) && mapXFSnodeBlocks[h].GetBestPayee(payee)) {
+            setPayeesRet.insert(payee);
+        }
+    }
+}
+
 bool CXFSnodePayments::AddPaymentVote(const CXFSnodePaymentVote &vote) {
     LogPrint("xfsnode-payments", "CXFSnodePayments::AddPaymentVote\n");
     uint256 blockHash = uint256();
@@ -455,6 +486,25 @@ bool CXFSnodePayments::HasVerifiedPaymentVote(uint256 hashIn) {
     return it != mapXFSnodePaymentVotes.end() && it->second.IsVerified();
 }
 
+bool CXFSnodePayments::HasPaymentVote(const uint256& hashIn) {
+    LOCK(cs_mapXFSnodePaymentVotes);
+    return mapXFSnodePaymentVotes.count(hashIn);
+}
+
+bool CXFSnodePayments::GetVerifiedPaymentVote(const uint256& hashIn, CXFSnodePaymentVote& voteRet) {
+    LOCK(cs_mapXFSnodePaymentVotes);
+    std::map<uint256, CXFSnodePaymentVote>::iterator it = mapXFSnodePaymentVotes.find(hashIn);
+    if (it == mapXFSnodePaymentVotes.end() || !it->second.IsVerified())
+        return false;
+    voteRet = it->second;
+    return true;
+}
+
+bool CXFSnodePayments::HasPaymentBlock(int nBlockHeight) {
+    LOCK(cs_mapXFSnodeBlocks);
+    return mapXFSnodeBlocks.count(nBlockHeight);
+}
+
 void CXFSnodeBlockPayees::AddPayee(const CXFSnodePaymentVote &vote) {
     LOCK(cs_vecPayees);
 
@@ -664,6 +714,7 @@ bool CXFSnodePaymentVote::IsValid(CNode *pnode, int nValidationHeight, std::stri
         if (nRank > MNPAYMENTS_SIGNATURES_TOTAL * 2 && nBlockHeight > nValidationHeight) {
             strError = strprintf("XFSnode is not in the top %d (%d)", MNPAYMENTS_SIGNATURES_TOTAL * 2, nRank);
             LogPrintf("CXFSnodePaymentVote::IsValid -- Error: %s\n", strError);
+            LOCK(cs_main);
             Misbehaving(pnode->GetId(), 20);
         }
         // Still invalid however
@@ -750,9 +801,7 @@ bool CXFSnodePaymentVote::CheckSignature(const CPubKey &pubKeyXFSnode, int nVali
     // do not ban by default
     nDos = 0;
 
-    std::string strMessage = vinXFSnode.prevout.ToStringShort() +
-                             boost::lexical_cast<std::string>(nBlockHeight) +
-                             ScriptToAsmStr(payee);
+    std::string strMessage = GetSignatureMessage();
 
     std::string strError = "";
     if (!darkSendSigner.VerifyMessage(pubKeyXFSnode, vchSig, strMessage, strError)) {
@@ -911,3 +960,117 @@ void CXFSnodePayments::UpdatedBlockTip(const CBlockIndex *pindex) {
     
     ProcessBlock(pindex->nHeight + 5);
 }
+
+void CXFSnodePayments::AddPaidBlock(const CBlock& block, int nHeight) {
+    if (block.vtx.empty()) return;
+    CAmount nXFSnodePayment = GetXFSnodePayment(Params().GetConsensus(), false, nHeight);
+    BOOST_FOREACH(const CTxOut& txout, block.vtx[0].vout) {
+        if (txout.nValue != nXFSnodePayment) continue;
+        std::vector<int>& vHeights = mapPaidBlocks[txout.scriptPubKey];
+        if (std::find(vHeights.begin(), vHeights.end(), nHeight) == vHeights.end())
+            vHeights.push_back(nHeight);
+    }
+}
+
+void CXFSnodePayments::IndexPaidBlocksFrom(int nHeight) {
+    AssertLockHeld(cs_mapPaidBlocks);
+
+    int64_t nStart = GetTimeMillis();
+    int nBlocks = 0;
+    while (nPaidBlocksFromHeight > nHeight) {
+        const CBlockIndex *pindex = pindexPaidBlocksTip->GetAncestor(nPaidBlocksFromHeight - 1);
+        CBlock block;
+        if (!pindex || !ReadBlockFromDisk(block, pindex, Params().GetConsensus())) {
+            // the lookup stops at this block like a scan would, the range stays unindexed and the next lookup retries it
+            LogPrintf("CXFSnodePayments::IndexPaidBlocksFrom -- ReadBlockFromDisk failed at height %d\n", nPaidBlocksFromHeight - 1);
+            break;
+        }
+        AddPaidBlock(block, pindex->nHeight);
+        nPaidBlocksFromHeight--;
+        nBlocks++;
+    }
+    LogPrint("mnpayments", "CXFSnodePayments::IndexPaidBlocksFrom -- indexed %d blocks in %dms\n", nBlocks, GetTimeMillis() - nStart);
+}
+
+void CXFSnodePayments::BlockConnected(const CBlock& block, const CBlockIndex *pindex) {
+    if (fLiteMode) return;
+    // taken before cs_mapPaidBlocks, lookups come in with the xfsnode list locked
+    int nLimit = GetStorageLimit();
+
+    LOCK(cs_mapPaidBlocks);
+    if (!pindexPaidBlocksTip || pindex->pprev != pindexPaidBlocksTip) {
+        mapPaidBlocks.clear();
+        nPaidBlocksFromHeight = pindex->nHeight;
+    }
+    AddPaidBlock(block, pindex->nHeight);
+    pindexPaidBlocksTip = pindex;
+
+    // nobody looks further back than the storage limit, prune once twice as much was indexed
+    if (nPaidBlocksFromHeight < pindex->nHeight - 2 * nLimit) {
+        nPaidBlocksFromHeight = pindex->nHeight - nLimit;
+        std::map<CScript, std::vector<int> >::iterator it = mapPaidBlocks.begin();
+        while (it != mapPaidBlocks.end()) {
+            std::vector<int>& vHeights = it->second;
+            vHeights.erase(std::remove_if(vHeights.begin(), vHeights.end(),
+                                          [this](int nHeight) { return nHeight < nPaidBlocksFromHeight; }),
+                           vHeights.end());
+            if (vHeights.empty()) {
+                mapPaidBlocks.erase(it++);
+            } else {
+                ++it;
+            }
+        }
+    }
+}
+
+void CXFSnodePayments::BlockDisconnected(const CBlock& block, const CBlockIndex *pindex) {
+    if (fLiteMode) return;
+    LOCK(cs_mapPaidBlocks);
+    if (pindex != pindexPaidBlocksTip || nPaidBlocksFromHeight >= pindex->nHeight) {
+        mapPaidBlocks.clear();
+        pindexPaidBlocksTip = NULL;
+        return;
+    }
+
+    BOOST_FOREACH(const CTxOut& txout, block.vtx[0].vout) {
+        std::map<CScript, std::vector<int> >::iterator it = mapPaidBlocks.find(txout.scriptPubKey);
+        if (it == mapPaidBlocks.end()) continue;
+        std::vector<int>& vHeights = it->second;
+        vHeights.erase(std::remove(vHeights.begin(), vHeights.end(), pindex->nHeight), vHeights.end());
+        if (vHeights.empty()) mapPaidBlocks.erase(it);
+    }
+    pindexPaidBlocksTip = pindex->pprev;
+}
+
+const CBlockIndex* CXFSnodePayments::FindLastPaidBlock(const CScript& payee, const CBlockIndex *pindex, int nAfterHeight, int nMaxBlocksToScanBack) {
+    int nFromHeight = std::max(std::max(pindex->nHeight - nMaxBlocksToScanBack + 1, nAfterHeight + 1), 0);
+    if (nFromHeight > pindex->nHeight) return NULL;
+
+    std::vector<int> vHeights;
+    {
+        LOCK(cs_mapPaidBlocks);
+        if (!pindexPaidBlocksTip || pindexPaidBlocksTip->GetAncestor(pindex->nHeight) != pindex) {
+            // not on the chain we have indexed, start over from pindex
+            mapPaidBlocks.clear();
+            pindexPaidBlocksTip = pindex;
+            nPaidBlocksFromHeight = pindex->nHeight + 1;
+        }
+        if (nFromHeight < nPaidBlocksFromHeight)
+            IndexPaidBlocksFrom(nFromHeight);
+
+        std::map<CScript, std::vector<int> >::const_iterator it = mapPaidBlocks.find(payee);
+        if (it == mapPaidBlocks.end()) return NULL;
+        BOOST_FOREACH(int nHeight, it->second) {
+            if (nHeight >= nFromHeight && nHeight <= pindex->nHeight)
+                vHeights.push_back(nHeight);
+        }
+    }
+    std::sort(vHeights.rbegin(), vHeights.rend());
+
+    LOCK(cs_mapXFSnodeBlocks);
+    BOOST_FOREACH(int nHeight, vHeights) {
+        if (mapXFSnodeBlocks.count(nHeight) && mapXFSnodeBlocks[nHeight].HasPayeeWithVotes(payee, 2))
+            return pindex->GetAncestor(nHeight);
+    }
+    return NULL;
+}
@@ -28,7 +28,8 @@ static const int MIN_XFSNODE_PAYMENT_PROTO_VERSION_2 = PROTOCOL_VERSION;
 
 extern CCriticalSection cs_vecPayees;
 extern CCriticalSection cs_mapXFSnodeBlocks;
-extern CCriticalSection cs_mapXFSnodePayeeVotes;
+extern CCriticalSection cs_mapXFSnodePaymentVotes;
+extern CCriticalSection cs_mapPaidBlocks;
 
 extern CXFSnodePayments mnpayments;
 
@@ -148,6 +149,8 @@ public:
         return ss.GetHash();
     }
 
+    /// Message the signature is made over
+    std::string GetSignatureMessage() const;
     bool Sign();
     bool CheckSignature(const CPubKey& pubKeyXFSnode, int nValidationHeight, int &nDos);
 
@@ -176,17 +179,29 @@ private:
     // Keep track of current block index
     const CBlockIndex *pCurrentBlockIndex;
 
+    // heights of the blocks whose coinbase pays a xfsnode payment sized output, by output script
+    std::map<CScript, std::vector<int> > mapPaidBlocks;
+    // mapPaidBlocks covers the blocks from nPaidBlocksFromHeight up to pindexPaidBlocksTip
+    const CBlockIndex *pindexPaidBlocksTip;
+    int nPaidBlocksFromHeight;
+
+    void AddPaidBlock(const CBlock& block, int nHeight);
+    /// Index older blocks down to nHeight, with cs_mapPaidBlocks held
+    void IndexPaidBlocksFrom(int nHeight);
+
 public:
     std::map<uint256, CXFSnodePaymentVote> mapXFSnodePaymentVotes;
     std::map<int, CXFSnodeBlockPayees> mapXFSnodeBlocks;
     std::map<COutPoint, int> mapXFSnodesLastVote;
 
-    CXFSnodePayments() : nStorageCoeff(1.25), nMinBlocksToStore(5000) {}
+    CXFSnodePayments() : nStorageCoeff(1.25), nMinBlocksToStore(5000), pindexPaidBlocksTip(NULL), nPaidBlocksFromHeight(0) {}
 
     ADD_SERIALIZE_METHODS;
 
     template <typename Stream, typename Operation>
     inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion) {
+        // the cache is dumped periodically while votes keep coming in
+        LOCK2(cs_mapXFSnodeBlocks, cs_mapXFSnodePaymentVotes);
         READWRITE(mapXFSnodePaymentVotes);
         READWRITE(mapXFSnodeBlocks);
     }
@@ -195,6 +210,10 @@ public:
 
     bool AddPaymentVote(const CXFSnodePaymentVote& vote);
     bool HasVerifiedPaymentVote(uint256 hashIn);
+    bool HasPaymentVote(const uint256& hashIn);
+    /// Copy of a verified vote, safe to use while message workers update the map
+    bool GetVerifiedPaymentVote(const uint256& hashIn, CXFSnodePaymentVote& voteRet);
+    bool HasPaymentBlock(int nBlockHeight);
     bool ProcessBlock(int nBlockHeight);
 
     void Sync(CNode* node);
@@ -204,6 +223,8 @@ public:
     bool GetBlockPayee(int nBlockHeight, CScript& payee);
     bool IsTransactionValid(const CTransaction& txNew, int nBlockHeight, bool fMTP);
     bool IsScheduled(CXFSnode& mn, int nNotBlockHeight);
+    /// Best payees of the blocks IsScheduled looks at, for checking many xfsnodes at once
+    void GetScheduledPayees(int nNotBlockHeight, std::set<CScript>& setPayeesRet);
 
     bool CanVote(COutPoint outXFSnode, int nBlockHeight);
 
@@ -220,6 +241,16 @@ public:
     int GetStorageLimit();
 
     void UpdatedBlockTip(const CBlockIndex *pindex);
+
+    /// Keep the paid blocks index in line with the active chain, called before the tip is updated
+    void BlockConnected(const CBlock& block, const CBlockIndex *pindex);
+    void BlockDisconnected(const CBlock& block, const CBlockIndex *pindex);
+    /**
+     * Find the last block up to pindex, above nAfterHeight and not more than nMaxBlocksToScanBack blocks back,
+     * that paid payee and had payee among its voted payees. Blocks are only read from disk the first time
+     * a height is looked at.
+     */
+    const CBlockIndex* FindLastPaidBlock(const CScript& payee, const CBlockIndex *pindex, int nAfterHeight, int nMaxBlocksToScanBack);
 };
 
 #endif
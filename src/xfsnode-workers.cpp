@@ -0,0 +1,192 @@
+// Copyright (c) 2020 The XFS Core Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "xfsnode-workers.h"
+
+#include "darksend.h"
+#include "instantx.h"
+#include "main.h"
+#include "netmsgstats.h"
+#include "protocol.h"
+#include "spork.h"
+#include "sync.h"
+#include "util.h"
+#include "utilstrencodings.h"
+#include "xfsnode-payments.h"
+#include "xfsnode-sync.h"
+#include "xfsnodeman.h"
+
+#include <algorithm>
+
+#include <boost/bind.hpp>
+#include <boost/function.hpp>
+#include <boost/thread.hpp>
+
+CXFSnodeMessageWorkers xfsnodeWorkers;
+
+// PrivateSend, spork and sync message handling wasn't written for concurrent callers
+static CCriticalSection cs_serializedSubsystems;
+
+void CXFSnodeMessageWorkers::ProcessSubsystemMessage(CNode *pfrom, std::string &strCommand, CDataStream &vRecv)
+{
+    {
+        LOCK(cs_serializedSubsystems);
+        darkSendPool.ProcessMessage(pfrom, strCommand, vRecv);
+    }
+    mnodeman.ProcessMessage(pfrom, strCommand, vRecv);
+    mnpayments.ProcessMessage(pfrom, strCommand, vRecv);
+    instantsend.ProcessMessage(pfrom, strCommand, vRecv);
+    {
+        LOCK(cs_serializedSubsystems);
+        sporkManager.ProcessSpork(pfrom, strCommand, vRecv);
+        xfsnodeSync.ProcessMessage(pfrom, strCommand, vRecv);
+    }
+}
+
+void CXFSnodeMessageWorkers::CacheBatchSigners(const std::deque<Message> &vBatch)
+{
+    int nHeight;
+    {
+        LOCK(cs_main);
+        nHeight = chainActive.Height();
+    }
+
+    // only pre-recover signers for messages that pass the cheap checks, so junk
+    // can't make us do the expensive part ahead of the handler rejecting it
+    std::vector<std::pair<std::string, std::vector<unsigned char> > > vMessages;
+    BOOST_FOREACH(const Message &msg, vBatch) {
+        try {
+            CDataStream vRecv(msg.vRecv);
+            if (msg.strCommand == NetMsgType::MNANNOUNCE) {
+                CXFSnodeBroadcast mnb;
+                vRecv >> mnb;
+                int nDos = 0;
+                if (mnodeman.HasSeenBroadcast(mnb.GetHash()) || !mnb.SimpleCheck(nDos)) continue;
+                vMessages.push_back(std::make_pair(mnb.GetSignatureMessage(), mnb.vchSig));
+                if (!mnb.lastPing.vchSig.empty())
+                    vMessages.push_back(std::make_pair(mnb.lastPing.GetSignatureMessage(), mnb.lastPing.vchSig));
+            } else if (msg.strCommand == NetMsgType::MNPING) {
+                CXFSnodePing mnp;
+                vRecv >> mnp;
+                int nDos = 0;
+                if (mnodeman.HasSeenPing(mnp.GetHash()) || !mnodeman.Has(mnp.vin) || !mnp.SimpleCheck(nDos)) continue;
+                vMessages.push_back(std::make_pair(mnp.GetSignatureMessage(), mnp.vchSig));
+            } else if (msg.strCommand == NetMsgType::XFSNODEPAYMENTVOTE) {
+                CXFSnodePaymentVote vote;
+                vRecv >> vote;
+                if (mnpayments.HasVerifiedPaymentVote(vote.GetHash())) continue;
+                if (vote.nBlockHeight < nHeight - mnpayments.GetStorageLimit() || vote.nBlockHeight > nHeight + 20) continue;
+                if (!mnodeman.Has(vote.vinXFSnode)) continue;
+                vMessages.push_back(std::make_pair(vote.GetSignatureMessage(), vote.vchSig));
+            }
+        } catch (const std::ios_base::failure &) {
+            // reported when the message is processed
+        }
+    }
+
+    // the same message relayed by several peers is checked once
+    std::sort(vMessages.begin(), vMessages.end());
+    vMessages.erase(std::unique(vMessages.begin(), vMessages.end()), vMessages.end());
+    if (vMessages.size() >= MIN_SIGNATURE_BATCH_SIZE)
+        darkSendSigner.CacheMessageSigners(vMessages);
+}
+
+void CXFSnodeMessageWorkers::Start(int nThreads, int nSigCheckThreads, boost::thread_group &threadGroup)
+{
+    assert(vWorkers.empty());
+    for (int i = 0; i < nThreads; i++)
+        vWorkers.push_back(std::unique_ptr<Worker>(new Worker()));
+
+    for (int i = 0; i < nThreads; i++) {
+        boost::function<void()> fn = boost::bind(&CXFSnodeMessageWorkers::ThreadWorker, this, vWorkers[i].get());
+        threadGroup.create_thread(boost::bind(&TraceThread<boost::function<void()> >, "xfsnodeworker", fn));
+    }
+    LogPrintf("Using %d threads for xfsnode message processing\n", nThreads);
+
+    StartMessageSigCheckThreads(std::max(nSigCheckThreads - 1, 0), threadGroup);
+    LogPrintf("Using %d threads for xfsnode message signature checks\n", nSigCheckThreads);
+}
+
+void CXFSnodeMessageWorkers::Stop()
+{
+    BOOST_FOREACH(std::unique_ptr<Worker> &worker, vWorkers) {
+        boost::lock_guard<boost::mutex> lock(worker->mutex);
+        BOOST_FOREACH(Message &msg, worker->queue) {
+            msg.pfrom->nOffloadedMsgs--;
+            msg.pfrom->Release();
+        }
+        worker->queue.clear();
+    }
+}
+
+bool CXFSnodeMessageWorkers::ProcessMessage(CNode *pfrom, const std::string &strCommand, CDataStream &vRecv)
+{
+    if (vWorkers.empty()) {
+        std::string strCommandCopy = strCommand;
+        ProcessSubsystemMessage(pfrom, strCommandCopy, vRecv);
+        return false;
+    }
+
+    Worker *worker = vWorkers[pfrom->id % vWorkers.size()].get();
+    pfrom->AddRef();
+    pfrom->nOffloadedMsgs++;
+    {
+        boost::lock_guard<boost::mutex> lock(worker->mutex);
+        worker->queue.push_back(Message(pfrom, strCommand, vRecv));
+    }
+    worker->cond.notify_one();
+    return true;
+}
+
+void CXFSnodeMessageWorkers::ThreadWorker(Worker *worker)
+{
+    // the queue is taken as a whole, a burst of messages costs one lock round trip
+    std::deque<Message> vBatch;
+    while (true) {
+        {
+            boost::unique_lock<boost::mutex> lock(worker->mutex);
+            while (worker->queue.empty())
+                worker->cond.wait(lock);
+            vBatch.swap(worker->queue);
+        }
+        if (vBatch.size() >= MIN_SIGNATURE_BATCH_SIZE) {
+            // the check threads are interrupted on shutdown as well, this thread has to see the batch through
+            boost::this_thread::disable_interruption di;
+            CacheBatchSigners(vBatch);
+        }
+
+        while (!vBatch.empty()) {
+            Message &msg = vBatch.front();
+            CNode *pfrom = msg.pfrom;
+            if (!pfrom->fDisconnect) {
+                int64_t nTimeStart = GetTimeMicros();
+                try {
+                    ProcessSubsystemMessage(pfrom, msg.strCommand, msg.vRecv);
+                } catch (const std::ios_base::failure &e) {
+                    // under-length, over-long or non-canonical message, same as on the message handler
+                    LogPrintf("%s(%s, %u bytes): Exception '%s' caught\n", __func__, SanitizeString(msg.strCommand),
+                              msg.vRecv.size(), e.what());
+                } catch (const boost::thread_interrupted &) {
+                    throw;
+                } catch (const std::exception &e) {
+                    PrintExceptionContinue(&e, "CXFSnodeMessageWorkers::ThreadWorker()");
+                } catch (...) {
+                    PrintExceptionContinue(NULL, "CXFSnodeMessageWorkers::ThreadWorker()");
+                }
+                int64_t nTimeProcess = GetTimeMicros() - nTimeStart;
+                pfrom->msgStats.RecordProcessed(msg.strCommand, nTimeProcess);
+                netMsgStats.RecordProcessed(msg.strCommand, nTimeProcess);
+            }
+
+            // the message handler may be waiting for the queue to drain
+            if (--pfrom->nOffloadedMsgs < MAX_OFFLOADED_MESSAGES && pfrom->fProcessPaused) {
+                pfrom->fProcessPaused = false;
+                pfrom->WakeMessageHandler();
+            }
+            pfrom->Release();
+            vBatch.pop_front();
+            boost::this_thread::interruption_point();
+        }
+    }
+}
@@ -0,0 +1,84 @@
+// Copyright (c) 2020 The XFS Core Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+#ifndef XFSNODE_WORKERS_H
+#define XFSNODE_WORKERS_H
+
+#include "net.h"
+#include "streams.h"
+
+#include <deque>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+
+namespace boost {
+    class thread_group;
+} // namespace boost
+
+class CXFSnodeMessageWorkers;
+
+/** Default number of threads processing xfsnode, InstantSend and spork messages, 0 processes them on the message handler */
+static const int DEFAULT_XFSNODE_WORKERS = 2;
+static const int MAX_XFSNODE_WORKERS = 16;
+/** Default number of threads checking the signatures of a burst, the worker included, 0 = one per core */
+static const int DEFAULT_XFSNODE_SIGCHECK_THREADS = 0;
+static const int MAX_XFSNODE_SIGCHECK_THREADS = 16;
+/** Batches with fewer signed messages are checked one by one as they are processed */
+static const size_t MIN_SIGNATURE_BATCH_SIZE = 8;
+
+extern CXFSnodeMessageWorkers xfsnodeWorkers;
+
+//
+// CXFSnodeMessageWorkers : process xfsnode subsystem messages off the message handler thread
+//
+// Messages of a peer always go to the same worker, so they are processed in the order they were
+// received. Workers run in parallel, most of the time goes to signature checks which the
+// subsystems do outside of their locks. A burst of broadcasts, pings and payment votes, like a
+// list sync, has its signatures checked on all cores before it is processed. Subsystems without locking of their own (PrivateSend,
+// sporks, sync) are serialized. The message handler stops taking messages from a peer while
+// MAX_OFFLOADED_MESSAGES of them are queued.
+//
+class CXFSnodeMessageWorkers
+{
+private:
+    struct Message {
+        CNode *pfrom;
+        std::string strCommand;
+        CDataStream vRecv;
+
+        Message(CNode *pfromIn, const std::string &strCommandIn, const CDataStream &vRecvIn) :
+            pfrom(pfromIn), strCommand(strCommandIn), vRecv(vRecvIn) {}
+    };
+
+    struct Worker {
+        boost::mutex mutex;
+        boost::condition_variable cond;
+        std::deque<Message> queue;
+    };
+
+    // filled by Start() before StartNode(), read without a lock and immutable afterwards
+    std::vector<std::unique_ptr<Worker> > vWorkers;
+
+    void ThreadWorker(Worker *worker);
+    /// Check the signatures of a burst of broadcasts, pings and votes in parallel, processing them hits the cache then
+    static void CacheBatchSigners(const std::deque<Message> &vBatch);
+
+public:
+    /** Start nThreads workers, with 0 messages keep being processed by the caller of ProcessMessage.
+        nSigCheckThreads threads check a burst of signatures, the worker that got it is one of them */
+    void Start(int nThreads, int nSigCheckThreads, boost::thread_group &threadGroup);
+    /** Drop queued messages, call after the worker threads were interrupted and joined */
+    void Stop();
+
+    /** Hand message to a worker, or process it right away if there are none. Returns true if it was handed over. */
+    bool ProcessMessage(CNode *pfrom, const std::string &strCommand, CDataStream &vRecv);
+
+    /** Run message through all xfsnode subsystems */
+    static void ProcessSubsystemMessage(CNode *pfrom, std::string &strCommand, CDataStream &vRecv);
+};
+
+#endif
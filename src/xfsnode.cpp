@@ -110,10 +110,16 @@ CXFSnode::CXFSnode(const CXFSnodeBroadcast &mnb) :
 bool CXFSnode::UpdateFromNewBroadcast(CXFSnodeBroadcast &mnb) {
     if (mnb.sigTime <= sigTime && !mnb.fRecovery) return false;
 
-    pubKeyXFSnode = mnb.pubKeyXFSnode;
+    if (pubKeyXFSnode != mnb.pubKeyXFSnode) {
+        pubKeyXFSnode = mnb.pubKeyXFSnode;
+        mnodeman.UpdatedXFSnodePubKey();
+    }
     sigTime = mnb.sigTime;
     vchSig = mnb.vchSig;
-    nProtocolVersion = mnb.nProtocolVersion;
+    if (nProtocolVersion != mnb.nProtocolVersion) {
+        nProtocolVersion = mnb.nProtocolVersion;
+        mnodeman.UpdatedXFSnodeState();
+    }
     addr = mnb.addr;
     nPoSeBanScore = 0;
     nPoSeBanHeight = 0;
@@ -372,6 +378,7 @@ std::string CXFSnode::GetStatus() const {
 void CXFSnode::SetStatus(int newState) {
     if(nActiveState!=newState){
         nActiveState = newState;
+        mnodeman.UpdatedXFSnodeState();
         if(IsMyXFSnode())
             GetMainSignals().UpdatedXFSnode(*this);
     }
@@ -510,47 +517,19 @@ void CXFSnode::UpdateLastPaid(const CBlockIndex *pindex, int nMaxBlocksToScanBac
         return;
     }
 
-    const Consensus::Params &params = Params().GetConsensus();
-    const CBlockIndex *BlockReading = pindex;
-
     CScript mnpayee = GetScriptForDestination(pubKeyCollateralAddress.GetID());
     LogPrint("xfsnode", "CXFSnode::UpdateLastPaidBlock -- searching for block with payment to %s\n", vin.prevout.ToStringShort());
 
-    LOCK(cs_mapXFSnodeBlocks);
-
-    for (int i = 0; BlockReading && BlockReading->nHeight > nBlockLastPaid && i < nMaxBlocksToScanBack; i++) {
-//        LogPrintf("mnpayments.mapXFSnodeBlocks.count(BlockReading->nHeight)=%s\n", mnpayments.mapXFSnodeBlocks.count(BlockReading->nHeight));
-//        LogPrintf("mnpayments.mapXFSnodeBlocks[BlockReading->nHeight].HasPayeeWithVotes(mnpayee, 2)=%s\n", mnpayments.mapXFSnodeBlocks[BlockReading->nHeight].HasPayeeWithVotes(mnpayee, 2));
-        if (mnpayments.mapXFSnodeBlocks.count(BlockReading->nHeight) &&
-            mnpayments.mapXFSnodeBlocks[BlockReading->nHeight].HasPayeeWithVotes(mnpayee, 2)) {
-            // LogPrintf("i=%s, BlockReading->nHeight=%s\n", i, BlockReading->nHeight);
-            CBlock block;
-            if (!ReadBlockFromDisk(block, BlockReading, Params().GetConsensus())) // shouldn't really happen
-            {
-                LogPrintf("ReadBlockFromDisk failed\n");
-                continue;
-            }
-            CAmount nXFSnodePayment = GetXFSnodePayment(params, false,BlockReading->nHeight);
-
-            BOOST_FOREACH(CTxOut txout, block.vtx[0].vout)
-            if (mnpayee == txout.scriptPubKey && nXFSnodePayment == txout.nValue) {
-                SetBlockLastPaid(BlockReading->nHeight);
-                SetTimeLastPaid(BlockReading->nTime);
-                LogPrint("xfsnode", "CXFSnode::UpdateLastPaidBlock -- searching for block with payment to %s -- found new %d\n", vin.prevout.ToStringShort(), nBlockLastPaid);
-                return;
-            }
-        }
-
-        if (BlockReading->pprev == NULL) {
-            assert(BlockReading);
-            break;
-        }
-        BlockReading = BlockReading->pprev;
+    const CBlockIndex *pindexPaid = mnpayments.FindLastPaidBlock(mnpayee, pindex, nBlockLastPaid, nMaxBlocksToScanBack);
+    if (pindexPaid) {
+        SetBlockLastPaid(pindexPaid->nHeight);
+        SetTimeLastPaid(pindexPaid->nTime);
+        LogPrint("xfsnode", "CXFSnode::UpdateLastPaidBlock -- searching for block with payment to %s -- found new %d\n", vin.prevout.ToStringShort(), nBlockLastPaid);
+        return;
     }
 
     // Last payment for this xfsnode wasn't found in latest mnpayments blocks
     // or it was found in mnpayments blocks but wasn't found in the blockchain.
-    // LogPrint("xfsnode", "CXFSnode::UpdateLastPaidBlock -- searching for block with payment to %s -- keeping old %d\n", vin.prevout.ToStringShort(), nBlockLastPaid);
 }
 
 bool CXFSnodeBroadcast::Create(std::string strService, std::string strKeyXFSnode, std::string strTxHash, std::string strOutputIndex, std::string &strErrorRet, CXFSnodeBroadcast &mnbRet, bool fOffline) {
@@ -823,15 +802,18 @@ bool CXFSnodeBroadcast::CheckOutpoint(int &nDos) {
     return true;
 }
 
+std::string CXFSnodeBroadcast::GetSignatureMessage() const {
+    return addr.ToString() + boost::lexical_cast<std::string>(sigTime) +
+           pubKeyCollateralAddress.GetID().ToString() + pubKeyXFSnode.GetID().ToString() +
+           boost::lexical_cast<std::string>(nProtocolVersion);
+}
+
 bool CXFSnodeBroadcast::Sign(CKey &keyCollateralAddress) {
     std::string strError;
-    std::string strMessage;
 
     sigTime = GetAdjustedTime();
 
-    strMessage = addr.ToString() + boost::lexical_cast<std::string>(sigTime) +
-                 pubKeyCollateralAddress.GetID().ToString() + pubKeyXFSnode.GetID().ToString() +
-                 boost::lexical_cast<std::string>(nProtocolVersion);
+    std::string strMessage = GetSignatureMessage();
 
     if (!darkSendSigner.SignMessage(strMessage, vchSig, keyCollateralAddress)) {
         LogPrintf("CXFSnodeBroadcast::Sign -- SignMessage() failed\n");
@@ -847,14 +829,10 @@ bool CXFSnodeBroadcast::Sign(CKey &keyCollateralAddress) {
 }
 
 bool CXFSnodeBroadcast::CheckSignature(int &nDos) {
-    std::string strMessage;
+    std::string strMessage = GetSignatureMessage();
     std::string strError = "";
     nDos = 0;
 
-    strMessage = addr.ToString() + boost::lexical_cast<std::string>(sigTime) +
-                 pubKeyCollateralAddress.GetID().ToString() + pubKeyXFSnode.GetID().ToString() +
-                 boost::lexical_cast<std::string>(nProtocolVersion);
-
     LogPrint("xfsnode", "CXFSnodeBroadcast::CheckSignature -- strMessage: %s  pubKeyCollateralAddress address: %s  sig: %s\n", strMessage, CBitcoinAddress(pubKeyCollateralAddress.GetID()).ToString(), EncodeBase64(&vchSig[0], vchSig.size()));
 
     if (!darkSendSigner.VerifyMessage(pubKeyCollateralAddress, vchSig, strMessage, strError)) {
@@ -882,12 +860,16 @@ CXFSnodePing::CXFSnodePing(CTxIn &vinNew) {
     vchSig = std::vector < unsigned char > ();
 }
 
+std::string CXFSnodePing::GetSignatureMessage() const {
+    return vin.ToString() + blockHash.ToString() + boost::lexical_cast<std::string>(sigTime);
+}
+
 bool CXFSnodePing::Sign(CKey &keyXFSnode, CPubKey &pubKeyXFSnode) {
     std::string strError;
     std::string strXFSNodeSignMessage;
 
     sigTime = GetAdjustedTime();
-    std::string strMessage = vin.ToString() + blockHash.ToString() + boost::lexical_cast<std::string>(sigTime);
+    std::string strMessage = GetSignatureMessage();
 
     if (!darkSendSigner.SignMessage(strMessage, vchSig, keyXFSnode)) {
         LogPrintf("CXFSnodePing::Sign -- SignMessage() failed\n");
@@ -903,7 +885,7 @@ bool CXFSnodePing::Sign(CKey &keyXFSnode, CPubKey &pubKeyXFSnode) {
 }
 
 bool CXFSnodePing::CheckSignature(CPubKey &pubKeyXFSnode, int &nDos) {
-    std::string strMessage = vin.ToString() + blockHash.ToString() + boost::lexical_cast<std::string>(sigTime);
+    std::string strMessage = GetSignatureMessage();
     std::string strError = "";
     nDos = 0;
 
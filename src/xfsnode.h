@@ -80,6 +80,8 @@ public:
 
     bool IsExpired() { return GetTime() - sigTime > XFSNODE_NEW_START_REQUIRED_SECONDS; }
 
+    /// Message the signature is made over
+    std::string GetSignatureMessage() const;
     bool Sign(CKey& keyXFSnode, CPubKey& pubKeyXFSnode);
     bool CheckSignature(CPubKey& pubKeyXFSnode, int &nDos);
     bool SimpleCheck(int& nDos);
@@ -385,6 +387,8 @@ public:
     bool Update(CXFSnode* pmn, int& nDos);
     bool CheckOutpoint(int& nDos);
 
+    /// Message the signature is made over
+    std::string GetSignatureMessage() const;
     bool Sign(CKey& keyCollateralAddress);
     bool CheckSignature(int& nDos);
     void RelayXFSNode();
@@ -15,20 +15,13 @@
 #include "util.h"
 #include "validationinterface.h"
 
+#include <limits>
+
 /** XFSnode manager */
 CXFSnodeMan mnodeman;
 
 const std::string CXFSnodeMan::SERIALIZATION_VERSION_STRING = "CXFSnodeMan-Version-4";
 
-struct CompareLastPaidBlock
-{
-    bool operator()(const std::pair<int, CXFSnode*>& t1,
-                    const std::pair<int, CXFSnode*>& t2) const
-    {
-        return (t1.first != t2.first) ? (t1.first < t2.first) : (t1.second->vin < t2.second->vin);
-    }
-};
-
 struct CompareScoreMN
 {
     bool operator()(const std::pair<int64_t, CXFSnode*>& t1,
@@ -116,6 +109,7 @@ CXFSnodeMan::CXFSnodeMan() : cs(),
   fXFSnodesRemoved(false),
 //  vecDirtyGovernanceObjectHashes(),
   nLastWatchdogVoteTime(0),
+  nRankCacheVersion(0),
   mapSeenXFSnodeBroadcast(),
   mapSeenXFSnodePing(),
   nDsqCount(0)
@@ -129,6 +123,8 @@ bool CXFSnodeMan::Add(CXFSnode &mn)
     if (pmn == NULL) {
         LogPrint("xfsnode", "CXFSnodeMan::Add -- Adding new XFSnode: addr=%s, %i now\n", mn.addr.ToString(), size() + 1);
         vXFSnodes.push_back(mn);
+        AddToLookupMaps(vXFSnodes.size() - 1);
+        ++nRankCacheVersion;
         indexXFSnodes.AddXFSnodeVIN(mn.vin);
         fXFSnodesAdded = true;
         return true;
@@ -193,6 +189,7 @@ void CXFSnodeMan::CheckAndRemove()
         // Remove spent xfsnodes, prepare structures and make requests to reasure the state of inactive ones
         std::vector<CXFSnode>::iterator it = vXFSnodes.begin();
         std::vector<std::pair<int, CXFSnode> > vecXFSnodeRanks;
+        bool fErased = false;
         // ask for up to MNB_RECOVERY_MAX_ASK_ENTRIES xfsnode entries at a time
         int nAskForMnbRecovery = MNB_RECOVERY_MAX_ASK_ENTRIES;
         while(it != vXFSnodes.end()) {
@@ -210,6 +207,7 @@ void CXFSnodeMan::CheckAndRemove()
 //                it->FlagGovernanceItemsAsDirty();
                 it = vXFSnodes.erase(it);
                 fXFSnodesRemoved = true;
+                fErased = true;
             } else {
                 bool fAsk = pCurrentBlockIndex &&
                             (nAskForMnbRecovery > 0) &&
@@ -245,6 +243,10 @@ void CXFSnodeMan::CheckAndRemove()
                 ++it;
             }
         }
+        // positions of the entries behind the removed ones changed
+        if(fErased) {
+            RebuildLookupMaps();
+        }
 
         // proces replies for XFSNODE_NEW_START_REQUIRED xfsnodes
         LogPrint("xfsnode", "CXFSnodeMan::CheckAndRemove -- mMnbRecoveryGoodReplies size=%d\n", (int)mMnbRecoveryGoodReplies.size());
@@ -369,6 +371,11 @@ void CXFSnodeMan::Clear()
 {
     LOCK(cs);
     vXFSnodes.clear();
+    mapIndexByOutpoint.clear();
+    mapIndexByCollateralKey.clear();
+    mapIndexByXFSnodeKey.clear();
+    setPaymentQueue.clear();
+    mapRankCache.clear();
     mAskedUsForXFSnodeList.clear();
     mWeAskedForXFSnodeList.clear();
     mWeAskedForXFSnodeListEntry.clear();
@@ -446,55 +453,77 @@ void CXFSnodeMan::DsegUpdate(CNode* pnode)
     LogPrint("xfsnode", "CXFSnodeMan::DsegUpdate -- asked %s for the list\n", pnode->addr.ToString());
 }
 
-CXFSnode* CXFSnodeMan::Find(const std::string &txHash, const std::string outputIndex)
+void CXFSnodeMan::AddToLookupMaps(size_t nPos)
 {
-    LOCK(cs);
+    const CXFSnode& mn = vXFSnodes[nPos];
+    mapIndexByOutpoint.insert(std::make_pair(mn.vin.prevout, nPos));
+    mapIndexByCollateralKey.insert(std::make_pair(mn.pubKeyCollateralAddress.GetID(), nPos));
+    mapIndexByXFSnodeKey.insert(std::make_pair(mn.pubKeyXFSnode, nPos));
+    setPaymentQueue.insert(std::make_pair(mn.GetLastPaidBlock(), mn.vin));
+}
 
-    BOOST_FOREACH(CXFSnode& mn, vXFSnodes)
-    {
-        COutPoint outpoint = mn.vin.prevout;
+void CXFSnodeMan::RebuildLookupMaps()
+{
+    mapIndexByOutpoint.clear();
+    mapIndexByCollateralKey.clear();
+    mapIndexByXFSnodeKey.clear();
+    setPaymentQueue.clear();
+    for(size_t i = 0; i < vXFSnodes.size(); ++i) {
+        AddToLookupMaps(i);
+    }
+    ++nRankCacheVersion;
+}
 
-        if(txHash==outpoint.hash.ToString().substr(0,64) &&
-           outputIndex==to_string(outpoint.n))
-            return &mn;
+void CXFSnodeMan::UpdatedXFSnodePubKey()
+{
+    LOCK(cs);
+    mapIndexByXFSnodeKey.clear();
+    for(size_t i = 0; i < vXFSnodes.size(); ++i) {
+        mapIndexByXFSnodeKey.insert(std::make_pair(vXFSnodes[i].pubKeyXFSnode, i));
     }
-    return NULL;
+}
+
+CXFSnode* CXFSnodeMan::Find(const std::string &txHash, const std::string outputIndex)
+{
+    // only the exact strings uint256::ToString() and to_string() produce can match
+    uint256 hash = uint256S(txHash);
+    if(hash.ToString() != txHash) return NULL;
+    uint32_t n;
+    if(!ParseUInt32(outputIndex, &n) || outputIndex != to_string(n)) return NULL;
+
+    return Find(CTxIn(COutPoint(hash, n)));
 }
 
 CXFSnode* CXFSnodeMan::Find(const CScript &payee)
 {
     LOCK(cs);
 
-    BOOST_FOREACH(CXFSnode& mn, vXFSnodes)
-    {
-        if(GetScriptForDestination(mn.pubKeyCollateralAddress.GetID()) == payee)
-            return &mn;
-    }
-    return NULL;
+    // payees are always pay-to-pubkey-hash of the collateral key
+    CTxDestination dest;
+    if(!ExtractDestination(payee, dest) || !boost::get<CKeyID>(&dest)) return NULL;
+    std::unordered_map<CKeyID, size_t, KeyIDHasher>::const_iterator it = mapIndexByCollateralKey.find(boost::get<CKeyID>(dest));
+    if(it == mapIndexByCollateralKey.end()) return NULL;
+    CXFSnode& mn = vXFSnodes[it->second];
+    if(GetScriptForDestination(mn.pubKeyCollateralAddress.GetID()) != payee) return NULL;
+    return &mn;
 }
 
 CXFSnode* CXFSnodeMan::Find(const CTxIn &vin)
 {
     LOCK(cs);
 
-    BOOST_FOREACH(CXFSnode& mn, vXFSnodes)
-    {
-        if(mn.vin.prevout == vin.prevout)
-            return &mn;
-    }
-    return NULL;
+    std::unordered_map<COutPoint, size_t, OutPointHasher>::const_iterator it = mapIndexByOutpoint.find(vin.prevout);
+    if(it == mapIndexByOutpoint.end()) return NULL;
+    return &vXFSnodes[it->second];
 }
 
 CXFSnode* CXFSnodeMan::Find(const CPubKey &pubKeyXFSnode)
 {
     LOCK(cs);
 
-    BOOST_FOREACH(CXFSnode& mn, vXFSnodes)
-    {
-        if(mn.pubKeyXFSnode == pubKeyXFSnode)
-            return &mn;
-    }
-    return NULL;
+    std::unordered_map<CPubKey, size_t, PubKeyHasher>::const_iterator it = mapIndexByXFSnodeKey.find(pubKeyXFSnode);
+    if(it == mapIndexByXFSnodeKey.end()) return NULL;
+    return &vXFSnodes[it->second];
 }
 
 bool CXFSnodeMan::Get(const CPubKey& pubKeyXFSnode, CXFSnode& xfsnode)
@@ -552,7 +581,37 @@ bool CXFSnodeMan::Has(const CTxIn& vin)
     return (pMN != NULL);
 }
 
-char* CXFSnodeMan::GetNotQualifyReason(CXFSnode& mn, int nBlockHeight, bool fFilterSigTime, int nMnCount)
+bool CXFSnodeMan::GetSeenBroadcast(const uint256& hash, CXFSnodeBroadcast& mnbRet)
+{
+    LOCK(cs);
+    std::map<uint256, std::pair<int64_t, CXFSnodeBroadcast> >::const_iterator it = mapSeenXFSnodeBroadcast.find(hash);
+    if (it == mapSeenXFSnodeBroadcast.end())
+        return false;
+    mnbRet = it->second.second;
+    return true;
+}
+
+bool CXFSnodeMan::GetSeenPing(const uint256& hash, CXFSnodePing& mnpRet)
+{
+    LOCK(cs);
+    std::map<uint256, CXFSnodePing>::const_iterator it = mapSeenXFSnodePing.find(hash);
+    if (it == mapSeenXFSnodePing.end())
+        return false;
+    mnpRet = it->second;
+    return true;
+}
+
+bool CXFSnodeMan::GetSeenVerification(const uint256& hash, CXFSnodeVerification& mnvRet)
+{
+    LOCK(cs);
+    std::map<uint256, CXFSnodeVerification>::const_iterator it = mapSeenXFSnodeVerification.find(hash);
+    if (it == mapSeenXFSnodeVerification.end())
+        return false;
+    mnvRet = it->second;
+    return true;
+}
+
+char* CXFSnodeMan::GetNotQualifyReason(CXFSnode& mn, int nBlockHeight, bool fFilterSigTime, int nMnCount, const std::set<CScript>* pScheduledPayees)
 {
     if (!mn.IsValidForPayment()) {
         char* reasonStr = new char[256];
@@ -569,7 +628,10 @@ char* CXFSnodeMan::GetNotQualifyReason(CXFSnode& mn, int nBlockHeight, bool fFil
         return reasonStr;
     }
     //it's in the list (up to 8 entries ahead of current block to allow propagation) -- so let's skip it
-    if (mnpayments.IsScheduled(mn, nBlockHeight)) {
+    bool fScheduled = pScheduledPayees ?
+            pScheduledPayees->count(GetScriptForDestination(mn.pubKeyCollateralAddress.GetID())) > 0 :
+            mnpayments.IsScheduled(mn, nBlockHeight);
+    if (fScheduled) {
         // LogPrintf("mnpayments.IsScheduled!\n");
         char* reasonStr = new char[256];
         sprintf(reasonStr, "false: 'is scheduled'");
@@ -658,103 +720,97 @@ CXFSnode* CXFSnodeMan::GetNextXFSnodeInQueueForPayment(bool fFilterSigTime, int&
     return GetNextXFSnodeInQueueForPayment(pCurrentBlockIndex->nHeight, fFilterSigTime, nCount);
 }
 
+bool CXFSnodeMan::IsQualifiedForPayment(CXFSnode& mn, int nBlockHeight, bool fFilterSigTime, int nMnCount, const std::set<CScript>& setScheduledPayees)
+{
+    char* reasonStr = GetNotQualifyReason(mn, nBlockHeight, fFilterSigTime, nMnCount, &setScheduledPayees);
+    if (!reasonStr) return true;
+    delete [] reasonStr;
+    return false;
+}
+
+int CXFSnodeMan::ScanPaymentQueue(int nBlockHeight, bool fFilterSigTime, int nMnCount, size_t nMaxCandidates, int nMinCount, std::vector<CXFSnode*>& vCandidatesRet)
+{
+    std::set<CScript> setScheduledPayees;
+    mnpayments.GetScheduledPayees(nBlockHeight, setScheduledPayees);
+    bool fLogReasons = LogAcceptCategory("xfsnodeman");
+
+    int nCount = 0;
+    vCandidatesRet.clear();
+    for(std::set<std::pair<int, CTxIn> >::const_iterator it = setPaymentQueue.begin(); it != setPaymentQueue.end(); ++it) {
+        if(vCandidatesRet.size() >= nMaxCandidates && nCount >= nMinCount) break;
+
+        CXFSnode* pmn = Find(it->second);
+        if(!pmn) continue;
+        if(!IsQualifiedForPayment(*pmn, nBlockHeight, fFilterSigTime, nMnCount, setScheduledPayees)) {
+            if(fLogReasons) {
+                char* reasonStr = GetNotQualifyReason(*pmn, nBlockHeight, fFilterSigTime, nMnCount, &setScheduledPayees);
+                LogPrint("xfsnodeman", "XFSnode, %s, addr(%s), qualify %s\n",
+                         pmn->vin.prevout.ToStringShort(), CBitcoinAddress(pmn->pubKeyCollateralAddress.GetID()).ToString(), reasonStr ? reasonStr : "true");
+                delete [] reasonStr;
+            }
+            continue;
+        }
+        nCount++;
+        if(vCandidatesRet.size() < nMaxCandidates) {
+            vCandidatesRet.push_back(pmn);
+        }
+    }
+    return nCount;
+}
+
 CXFSnode* CXFSnodeMan::GetNextXFSnodeInQueueForPayment(int nBlockHeight, bool fFilterSigTime, int& nCount)
 {
     // Need LOCK2 here to ensure consistent locking order because the GetBlockHash call below locks cs_main
     LOCK2(cs_main,cs);
 
     CXFSnode *pBestXFSnode = NULL;
-    std::vector<std::pair<int, CXFSnode*> > vecXFSnodeLastPaid;
 
-    /*
-        Make a vector with all of the last paid times
-    */
+    // Look at 1/10 of the oldest nodes (by last payment), calculate their scores and pay the best one
+    //  -- This doesn't look at who is being paid in the +8-10 blocks, allowing for double payments very rarely
+    //  -- 1/100 payments should be a double payment on mainnet - (1/(3000/10))*2
+    //  -- (chance per block * chances before IsScheduled will fire)
     int nMnCount = CountEnabled();
-    int index = 0;
-    BOOST_FOREACH(CXFSnode &mn, vXFSnodes)
-    {
-        index += 1;
-        // LogPrintf("index=%s, mn=%s\n", index, mn.ToString());
-        /*if (!mn.IsValidForPayment()) {
-            LogPrint("xfsnodeman", "XFSnode, %s, addr(%s), not-qualified: 'not valid for payment'\n",
-                     mn.vin.prevout.ToStringShort(), CBitcoinAddress(mn.pubKeyCollateralAddress.GetID()).ToString());
-            continue;
-        }
-        // //check protocol version
-        if (mn.nProtocolVersion < mnpayments.GetMinXFSnodePaymentsProto()) {
-            // LogPrintf("Invalid nProtocolVersion!\n");
-            // LogPrintf("mn.nProtocolVersion=%s!\n", mn.nProtocolVersion);
-            // LogPrintf("mnpayments.GetMinXFSnodePaymentsProto=%s!\n", mnpayments.GetMinXFSnodePaymentsProto());
-            LogPrint("xfsnodeman", "XFSnode, %s, addr(%s), not-qualified: 'invalid nProtocolVersion'\n",
-                     mn.vin.prevout.ToStringShort(), CBitcoinAddress(mn.pubKeyCollateralAddress.GetID()).ToString());
-            continue;
-        }
-        //it's in the list (up to 8 entries ahead of current block to allow propagation) -- so let's skip it
-        if (mnpayments.IsScheduled(mn, nBlockHeight)) {
-            // LogPrintf("mnpayments.IsScheduled!\n");
-            LogPrint("xfsnodeman", "XFSnode, %s, addr(%s), not-qualified: 'IsScheduled'\n",
-                     mn.vin.prevout.ToStringShort(), CBitcoinAddress(mn.pubKeyCollateralAddress.GetID()).ToString());
-            continue;
-        }
-        //it's too new, wait for a cycle
-        if (fFilterSigTime && mn.sigTime + (nMnCount * 2.6 * 60) > GetAdjustedTime()) {
-            // LogPrintf("it's too new, wait for a cycle!\n");
-            LogPrint("xfsnodeman", "XFSnode, %s, addr(%s), not-qualified: 'it's too new, wait for a cycle!', sigTime=%s, will be qualifed after=%s\n",
-                     mn.vin.prevout.ToStringShort(), CBitcoinAddress(mn.pubKeyCollateralAddress.GetID()).ToString(), DateTimeStrFormat("%Y-%m-%d %H:%M UTC", mn.sigTime).c_str(), DateTimeStrFormat("%Y-%m-%d %H:%M UTC", mn.sigTime + (nMnCount * 2.6 * 60)).c_str());
-            continue;
-        }
-        //make sure it has at least as many confirmations as there are xfsnodes
-        if (mn.GetCollateralAge() < nMnCount) {
-            // LogPrintf("mn.GetCollateralAge()=%s!\n", mn.GetCollateralAge());
-            // LogPrintf("nMnCount=%s!\n", nMnCount);
-            LogPrint("xfsnodeman", "XFSnode, %s, addr(%s), not-qualified: 'mn.GetCollateralAge() < nMnCount', CollateralAge=%d, nMnCount=%d\n",
-                     mn.vin.prevout.ToStringShort(), CBitcoinAddress(mn.pubKeyCollateralAddress.GetID()).ToString(), mn.GetCollateralAge(), nMnCount);
-            continue;
-        }*/
-        char* reasonStr = GetNotQualifyReason(mn, nBlockHeight, fFilterSigTime, nMnCount);
-        if (reasonStr != NULL) {
-            LogPrint("xfsnodeman", "XFSnode, %s, addr(%s), qualify %s\n",
-                     mn.vin.prevout.ToStringShort(), CBitcoinAddress(mn.pubKeyCollateralAddress.GetID()).ToString(), reasonStr);
-            delete [] reasonStr;
-            continue;
-        }
-        vecXFSnodeLastPaid.push_back(std::make_pair(mn.GetLastPaidBlock(), &mn));
-    }
-    nCount = (int)vecXFSnodeLastPaid.size();
+    int nTenthNetwork = nMnCount/10;
+    std::vector<CXFSnode*> vecCandidates;
+    // the queue is already sorted by last paid block, only walk it as far as the pick and the check below need
+    nCount = ScanPaymentQueue(nBlockHeight, fFilterSigTime, nMnCount, std::max(nTenthNetwork, 1),
+                              fFilterSigTime ? nMnCount / 3 : 0, vecCandidates);
 
     //when the network is in the process of upgrading, don't penalize nodes that recently restarted
     if(fFilterSigTime && nCount < nMnCount / 3) {
-        // LogPrintf("Need Return, nCount=%s, nMnCount/3=%s\n", nCount, nMnCount/3);
         return GetNextXFSnodeInQueueForPayment(nBlockHeight, false, nCount);
     }
 
-    // Sort them low to high
-    sort(vecXFSnodeLastPaid.begin(), vecXFSnodeLastPaid.end(), CompareLastPaidBlock());
-
     uint256 blockHash;
     if(!GetBlockHash(blockHash, nBlockHeight - 101)) {
         LogPrintf("CXFSnode::GetNextXFSnodeInQueueForPayment -- ERROR: GetBlockHash() failed at nBlockHeight %d\n", nBlockHeight - 101);
         return NULL;
     }
-    // Look at 1/10 of the oldest nodes (by last payment), calculate their scores and pay the best one
-    //  -- This doesn't look at who is being paid in the +8-10 blocks, allowing for double payments very rarely
-    //  -- 1/100 payments should be a double payment on mainnet - (1/(3000/10))*2
-    //  -- (chance per block * chances before IsScheduled will fire)
-    int nTenthNetwork = nMnCount/10;
-    int nCountTenth = 0;
     arith_uint256 nHighest = 0;
-    BOOST_FOREACH (PAIRTYPE(int, CXFSnode*)& s, vecXFSnodeLastPaid){
-        arith_uint256 nScore = s.second->CalculateScore(blockHash);
+    BOOST_FOREACH(CXFSnode* pmn, vecCandidates) {
+        arith_uint256 nScore = pmn->CalculateScore(blockHash);
         if(nScore > nHighest){
             nHighest = nScore;
-            pBestXFSnode = s.second;
+            pBestXFSnode = pmn;
         }
-        nCountTenth++;
-        if(nCountTenth >= nTenthNetwork) break;
     }
     return pBestXFSnode;
 }
 
+int CXFSnodeMan::CountQualifiedForPayment(bool fFilterSigTime)
+{
+    LOCK2(cs_main,cs);
+    if(!pCurrentBlockIndex) return 0;
+
+    int nMnCount = CountEnabled();
+    std::vector<CXFSnode*> vecCandidates;
+    int nCount = ScanPaymentQueue(pCurrentBlockIndex->nHeight, fFilterSigTime, nMnCount, 0, std::numeric_limits<int>::max(), vecCandidates);
+    if(fFilterSigTime && nCount < nMnCount / 3) {
+        return CountQualifiedForPayment(false);
+    }
+    return nCount;
+}
+
 CXFSnode* CXFSnodeMan::FindRandomNotInVec(const std::vector<CTxIn> &vecToExclude, int nProtocolVersion)
 {
     LOCK(cs);
@@ -798,25 +854,23 @@ CXFSnode* CXFSnodeMan::FindRandomNotInVec(const std::vector<CTxIn> &vecToExclude
     return NULL;
 }
 
-int CXFSnodeMan::GetXFSnodeRank(const CTxIn& vin, int nBlockHeight, int nMinProtocol, bool fOnlyActive)
+const CXFSnodeMan::RankList& CXFSnodeMan::GetRankList(const uint256& blockHash, int nMinProtocol, RankFilter filter)
 {
-    std::vector<std::pair<int64_t, CXFSnode*> > vecXFSnodeScores;
-
-    //make sure we know about this block
-    uint256 blockHash = uint256();
-    if(!GetBlockHash(blockHash, nBlockHeight)) return -1;
+    AssertLockHeld(cs);
 
-    LOCK(cs);
+    int nVersion = nRankCacheVersion;
+    std::tuple<uint256, int, int> key(blockHash, nMinProtocol, filter);
+    std::map<std::tuple<uint256, int, int>, RankList>::iterator it = mapRankCache.find(key);
+    if(it != mapRankCache.end() && it->second.nVersion == nVersion) {
+        return it->second;
+    }
 
-    // scan for winner
+    std::vector<std::pair<int64_t, CXFSnode*> > vecXFSnodeScores;
     BOOST_FOREACH(CXFSnode& mn, vXFSnodes) {
         if(mn.nProtocolVersion < nMinProtocol) continue;
-        if(fOnlyActive) {
-            if(!mn.IsEnabled()) continue;
-        }
-        else {
-            if(!mn.IsValidForPayment()) continue;
-        }
+        if(filter == RANK_ENABLED && !mn.IsEnabled()) continue;
+        if(filter == RANK_VALID_FOR_PAYMENT && !mn.IsValidForPayment()) continue;
+
         int64_t nScore = mn.CalculateScore(blockHash).GetCompact(false);
 
         vecXFSnodeScores.push_back(std::make_pair(nScore, &mn));
@@ -824,18 +878,43 @@ int CXFSnodeMan::GetXFSnodeRank(const CTxIn& vin, int nBlockHeight, int nMinProt
 
     sort(vecXFSnodeScores.rbegin(), vecXFSnodeScores.rend(), CompareScoreMN());
 
+    if(it == mapRankCache.end()) {
+        // keys are ordered by block hash, so this drops a list of a random block
+        if(mapRankCache.size() >= MAX_RANK_CACHE_SIZE) {
+            mapRankCache.erase(mapRankCache.begin());
+        }
+        it = mapRankCache.insert(std::make_pair(key, RankList())).first;
+    }
+    RankList& rankList = it->second;
+    rankList.nVersion = nVersion;
+    rankList.vecRanked.clear();
+    rankList.mapRanks.clear();
+    rankList.vecRanked.reserve(vecXFSnodeScores.size());
     int nRank = 0;
-    BOOST_FOREACH (PAIRTYPE(int64_t, CXFSnode*)& scorePair, vecXFSnodeScores) {
+    BOOST_FOREACH (PAIRTYPE(int64_t, CXFSnode*)& s, vecXFSnodeScores) {
         nRank++;
-        if(scorePair.second->vin.prevout == vin.prevout) return nRank;
+        rankList.vecRanked.push_back(s.second->vin);
+        rankList.mapRanks.insert(std::make_pair(s.second->vin.prevout, nRank));
     }
+    return rankList;
+}
+
+int CXFSnodeMan::GetXFSnodeRank(const CTxIn& vin, int nBlockHeight, int nMinProtocol, bool fOnlyActive)
+{
+    //make sure we know about this block
+    uint256 blockHash = uint256();
+    if(!GetBlockHash(blockHash, nBlockHeight)) return -1;
+
+    LOCK(cs);
 
-    return -1;
+    const RankList& rankList = GetRankList(blockHash, nMinProtocol, fOnlyActive ? RANK_ENABLED : RANK_VALID_FOR_PAYMENT);
+    std::unordered_map<COutPoint, int, OutPointHasher>::const_iterator it = rankList.mapRanks.find(vin.prevout);
+    if(it == rankList.mapRanks.end()) return -1;
+    return it->second;
 }
 
 std::vector<std::pair<int, CXFSnode> > CXFSnodeMan::GetXFSnodeRanks(int nBlockHeight, int nMinProtocol)
 {
-    std::vector<std::pair<int64_t, CXFSnode*> > vecXFSnodeScores;
     std::vector<std::pair<int, CXFSnode> > vecXFSnodeRanks;
 
     //make sure we know about this block
@@ -844,23 +923,15 @@ std::vector<std::pair<int, CXFSnode> > CXFSnodeMan::GetXFSnodeRanks(int nBlockHe
 
     LOCK(cs);
 
-    // scan for winner
-    BOOST_FOREACH(CXFSnode& mn, vXFSnodes) {
-
-        if(mn.nProtocolVersion < nMinProtocol || !mn.IsEnabled()) continue;
-
-        int64_t nScore = mn.CalculateScore(blockHash).GetCompact(false);
-
-        vecXFSnodeScores.push_back(std::make_pair(nScore, &mn));
-    }
-
-    sort(vecXFSnodeScores.rbegin(), vecXFSnodeScores.rend(), CompareScoreMN());
-
+    const RankList& rankList = GetRankList(blockHash, nMinProtocol, RANK_ENABLED);
+    vecXFSnodeRanks.reserve(rankList.vecRanked.size());
     int nRank = 0;
-    BOOST_FOREACH (PAIRTYPE(int64_t, CXFSnode*)& s, vecXFSnodeScores) {
+    BOOST_FOREACH(const CTxIn& vin, rankList.vecRanked) {
         nRank++;
-        s.second->SetRank(nRank);
-        vecXFSnodeRanks.push_back(std::make_pair(nRank, *s.second));
+        CXFSnode* pmn = Find(vin);
+        if(!pmn) continue;
+        pmn->SetRank(nRank);
+        vecXFSnodeRanks.push_back(std::make_pair(nRank, *pmn));
     }
 
     return vecXFSnodeRanks;
@@ -868,8 +939,6 @@ std::vector<std::pair<int, CXFSnode> > CXFSnodeMan::GetXFSnodeRanks(int nBlockHe
 
 CXFSnode* CXFSnodeMan::GetXFSnodeByRank(int nRank, int nBlockHeight, int nMinProtocol, bool fOnlyActive)
 {
-    std::vector<std::pair<int64_t, CXFSnode*> > vecXFSnodeScores;
-
     LOCK(cs);
 
     uint256 blockHash;
@@ -878,28 +947,9 @@ CXFSnode* CXFSnodeMan::GetXFSnodeByRank(int nRank, int nBlockHeight, int nMinPro
         return NULL;
     }
 
-    // Fill scores
-    BOOST_FOREACH(CXFSnode& mn, vXFSnodes) {
-
-        if(mn.nProtocolVersion < nMinProtocol) continue;
-        if(fOnlyActive && !mn.IsEnabled()) continue;
-
-        int64_t nScore = mn.CalculateScore(blockHash).GetCompact(false);
-
-        vecXFSnodeScores.push_back(std::make_pair(nScore, &mn));
-    }
-
-    sort(vecXFSnodeScores.rbegin(), vecXFSnodeScores.rend(), CompareScoreMN());
-
-    int rank = 0;
-    BOOST_FOREACH (PAIRTYPE(int64_t, CXFSnode*)& s, vecXFSnodeScores){
-        rank++;
-        if(rank == nRank) {
-            return s.second;
-        }
-    }
-
-    return NULL;
+    const RankList& rankList = GetRankList(blockHash, nMinProtocol, fOnlyActive ? RANK_ENABLED : RANK_ALL);
+    if(nRank < 1 || nRank > (int)rankList.vecRanked.size()) return NULL;
+    return Find(rankList.vecRanked[nRank - 1]);
 }
 
 void CXFSnodeMan::ProcessXFSnodeConnections()
@@ -956,7 +1006,10 @@ void CXFSnodeMan::ProcessMessage(CNode* pfrom, std::string& strCommand, CDataStr
         CXFSnodeBroadcast mnb;
         vRecv >> mnb;
 
-        pfrom->setAskFor.erase(mnb.GetHash());
+        {
+            LOCK(cs_main);
+            pfrom->setAskFor.erase(mnb.GetHash());
+        }
 
         LogPrintf("MNANNOUNCE -- XFSnode announce, xfsnode=%s\n", mnb.vin.prevout.ToStringShort());
 
@@ -966,6 +1019,7 @@ void CXFSnodeMan::ProcessMessage(CNode* pfrom, std::string& strCommand, CDataStr
             // use announced XFSnode as a peer
             addrman.Add(CAddress(mnb.addr, NODE_NETWORK), pfrom->addr, 2*60*60);
         } else if(nDos > 0) {
+            LOCK(cs_main);
             Misbehaving(pfrom->GetId(), nDos);
         }
 
@@ -979,7 +1033,10 @@ void CXFSnodeMan::ProcessMessage(CNode* pfrom, std::string& strCommand, CDataStr
 
         uint256 nHash = mnp.GetHash();
 
-        pfrom->setAskFor.erase(nHash);
+        {
+            LOCK(cs_main);
+            pfrom->setAskFor.erase(nHash);
+        }
 
         LogPrint("xfsnode", "MNPING -- XFSnode ping, xfsnode=%s\n", mnp.vin.prevout.ToStringShort());
 
@@ -1023,7 +1080,8 @@ void CXFSnodeMan::ProcessMessage(CNode* pfrom, std::string& strCommand, CDataStr
 
         LogPrint("xfsnode", "DSEG -- XFSnode list, xfsnode=%s\n", vin.prevout.ToStringShort());
 
-        LOCK(cs);
+        // Need LOCK2 here to ensure consistent locking order because Misbehaving below requires cs_main
+        LOCK2(cs_main, cs);
 
         if(vin == CTxIn()) { //only should ask for this once
             //local network
@@ -1665,7 +1723,12 @@ void CXFSnodeMan::UpdateLastPaid()
                              pCurrentBlockIndex->nHeight, nMaxBlocksToScanBack, IsFirstRun ? "true" : "false");
 
     BOOST_FOREACH(CXFSnode& mn, vXFSnodes) {
+        int nBlockLastPaidPrev = mn.GetLastPaidBlock();
         mn.UpdateLastPaid(pCurrentBlockIndex, nMaxBlocksToScanBack);
+        if(mn.GetLastPaidBlock() != nBlockLastPaidPrev) {
+            setPaymentQueue.erase(std::make_pair(nBlockLastPaidPrev, mn.vin));
+            setPaymentQueue.insert(std::make_pair(mn.GetLastPaidBlock(), mn.vin));
+        }
     }
 
     // every time is like the first time if winners list is not synced
@@ -7,6 +7,12 @@
 
 #include "xfsnode.h"
 #include "sync.h"
+#include "crypto/common.h"
+
+#include <atomic>
+#include <set>
+#include <tuple>
+#include <unordered_map>
 
 using namespace std;
 
@@ -110,6 +116,9 @@ private:
     static const int MNB_RECOVERY_WAIT_SECONDS      = 60;
     static const int MNB_RECOVERY_RETRY_SECONDS     = 3 * 60 * 60;
 
+    /// Rank lists kept at a time, a handful of heights are asked for over and over
+    static const size_t MAX_RANK_CACHE_SIZE         = 64;
+
 
     // critical section to protect the inner data structures
     mutable CCriticalSection cs;
@@ -119,6 +128,41 @@ private:
 
     // map to hold all MNs
     std::vector<CXFSnode> vXFSnodes;
+
+    // Entries are collateral-backed, so the keys can't be picked freely to provoke collisions
+    struct OutPointHasher {
+        size_t operator()(const COutPoint& outpoint) const { return outpoint.hash.GetCheapHash() ^ outpoint.n; }
+    };
+    struct KeyIDHasher {
+        size_t operator()(const CKeyID& keyID) const { return ReadLE64(keyID.begin()); }
+    };
+    struct PubKeyHasher {
+        size_t operator()(const CPubKey& pubKey) const { return pubKey.size() > 8 ? ReadLE64(pubKey.begin() + 1) : 0; }
+    };
+    // positions in vXFSnodes, for keys shared by several entries the first one
+    std::unordered_map<COutPoint, size_t, OutPointHasher> mapIndexByOutpoint;
+    std::unordered_map<CKeyID, size_t, KeyIDHasher> mapIndexByCollateralKey;
+    std::unordered_map<CPubKey, size_t, PubKeyHasher> mapIndexByXFSnodeKey;
+    // (last paid block, vin) of all entries, in the order they are considered for payment
+    std::set<std::pair<int, CTxIn> > setPaymentQueue;
+
+    // which entries take part in a rank list
+    enum RankFilter {
+        RANK_ALL,
+        RANK_ENABLED,
+        RANK_VALID_FOR_PAYMENT
+    };
+    struct RankList {
+        // value of nRankCacheVersion the list was built at
+        int nVersion;
+        // entries by rank, best first
+        std::vector<CTxIn> vecRanked;
+        std::unordered_map<COutPoint, int, OutPointHasher> mapRanks;
+    };
+    // rank lists by block hash, min protocol and filter
+    std::map<std::tuple<uint256, int, int>, RankList> mapRankCache;
+    // bumped on every change to the list, entry states and protocol versions, lists of older versions are stale
+    std::atomic<int> nRankCacheVersion;
     // who's asked for the XFSnode list and the last time
     std::map<CNetAddr, int64_t> mAskedUsForXFSnodeList;
     // who we asked for the XFSnode list and the last time
@@ -154,6 +198,22 @@ private:
 
     friend class CXFSnodeSync;
 
+    /// Add the entry at nPos to the lookup maps and the payment queue, keys already there keep pointing to the earlier entry
+    void AddToLookupMaps(size_t nPos);
+    /// Rebuild the lookup maps and the payment queue after entries were removed
+    void RebuildLookupMaps();
+
+    /// GetNotQualifyReason without a reason, with the scheduled payees looked up beforehand
+    bool IsQualifiedForPayment(CXFSnode& mn, int nBlockHeight, bool fFilterSigTime, int nMnCount, const std::set<CScript>& setScheduledPayees);
+    /**
+     * Walk the payment queue from the entry paid longest ago. Collects the first nMaxCandidates qualified
+     * entries and stops once it has them and has counted nMinCount qualified ones. Returns the count.
+     */
+    int ScanPaymentQueue(int nBlockHeight, bool fFilterSigTime, int nMnCount, size_t nMaxCandidates, int nMinCount, std::vector<CXFSnode*>& vCandidatesRet);
+
+    /// Entries ranked by score for blockHash, computed once per block and kept until something it depends on changes
+    const RankList& GetRankList(const uint256& blockHash, int nMinProtocol, RankFilter filter);
+
 public:
     // Keep track of all broadcasts I've seen
     std::map<uint256, std::pair<int64_t, CXFSnodeBroadcast> > mapSeenXFSnodeBroadcast;
@@ -180,6 +240,9 @@ public:
         }
 
         READWRITE(vXFSnodes);
+        if(ser_action.ForRead()) {
+            RebuildLookupMaps();
+        }
         READWRITE(mAskedUsForXFSnodeList);
         READWRITE(mWeAskedForXFSnodeList);
         READWRITE(mWeAskedForXFSnodeListEntry);
@@ -232,6 +295,11 @@ public:
     CXFSnode* Find(const CTxIn& vin);
     CXFSnode* Find(const CPubKey& pubKeyXFSnode);
 
+    /// Call after pubKeyXFSnode of an entry changed
+    void UpdatedXFSnodePubKey();
+    /// Call after nActiveState or nProtocolVersion of an entry changed
+    void UpdatedXFSnodeState() { ++nRankCacheVersion; }
+
     /// Versions of Find that are safe to use from outside the class
     bool Get(const CPubKey& pubKeyXFSnode, CXFSnode& xfsnode);
     bool Get(const CTxIn& vin, CXFSnode& xfsnode);
@@ -281,18 +349,30 @@ public:
 
     bool Has(const CTxIn& vin);
 
+    bool HasSeenBroadcast(const uint256& hash) { LOCK(cs); return mapSeenXFSnodeBroadcast.count(hash); }
+    bool HasSeenPing(const uint256& hash) { LOCK(cs); return mapSeenXFSnodePing.count(hash); }
+    /// Copy of a seen broadcast, safe to use while message workers update the map
+    bool GetSeenBroadcast(const uint256& hash, CXFSnodeBroadcast& mnbRet);
+    /// Copy of a seen ping, safe to use while message workers update the map
+    bool GetSeenPing(const uint256& hash, CXFSnodePing& mnpRet);
+    bool HasSeenVerification(const uint256& hash) { LOCK(cs); return mapSeenXFSnodeVerification.count(hash); }
+    bool GetSeenVerification(const uint256& hash, CXFSnodeVerification& mnvRet);
+
     xfsnode_info_t GetXFSnodeInfo(const CTxIn& vin);
 
     xfsnode_info_t GetXFSnodeInfo(const CPubKey& pubKeyXFSnode);
 
-    char* GetNotQualifyReason(CXFSnode& mn, int nBlockHeight, bool fFilterSigTime, int nMnCount);
+    /// Why mn can't be paid at nBlockHeight, NULL if it can. Pass pScheduledPayees to use payees looked up beforehand.
+    char* GetNotQualifyReason(CXFSnode& mn, int nBlockHeight, bool fFilterSigTime, int nMnCount, const std::set<CScript>* pScheduledPayees = NULL);
 
     UniValue GetNotQualifyReasonToUniValue(CXFSnode& mn, int nBlockHeight, bool fFilterSigTime, int nMnCount);
 
-    /// Find an entry in the xfsnode list that is next to be paid
+    /// Find an entry in the xfsnode list that is next to be paid, nCount is the number of qualified entries looked at
     CXFSnode* GetNextXFSnodeInQueueForPayment(int nBlockHeight, bool fFilterSigTime, int& nCount);
     /// Same as above but use current block height
     CXFSnode* GetNextXFSnodeInQueueForPayment(bool fFilterSigTime, int& nCount);
+    /// Number of entries qualified for payment at current block height, as used by GetNextXFSnodeInQueueForPayment
+    int CountQualifiedForPayment(bool fFilterSigTime);
 
     /// Find a random entry
     CXFSnode* FindRandomNotInVec(const std::vector<CTxIn> &vecToExclude, int nProtocolVersion = -1);
@@ -324,7 +404,7 @@ public:
     void UpdateXFSnodeList(CXFSnodeBroadcast mnb);
     /// Perform complete check and only then update list and maps
     bool CheckMnbAndUpdateXFSnodeList(CNode* pfrom, CXFSnodeBroadcast mnb, int& nDos);
-    bool IsMnbRecoveryRequested(const uint256& hash) { return mMnbRecoveryRequests.count(hash); }
+    bool IsMnbRecoveryRequested(const uint256& hash) { LOCK(cs); return mMnbRecoveryRequests.count(hash); }
 
     void UpdateLastPaid();
 
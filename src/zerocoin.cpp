@@ -4,6 +4,7 @@
 #include "timedata.h"
 #include "chainparams.h"
 #include "util.h"
+#include "random.h"
 #include "base58.h"
 #include "definition.h"
 #include "wallet/wallet.h"
@@ -11,6 +12,7 @@
 #include "xfsnode-payments.h"
 #include "xfsnode-sync.h"
 #include "sigma/remint.h"
+#include "libzerocoin/ParallelTasks.h"
 
 #include <atomic>
 #include <sstream>
@@ -35,6 +37,31 @@ libzerocoin::Params *ZCParamsV2 = new libzerocoin::Params(bnTrustedModulusV2, bn
 
 static CZerocoinState zerocoinState;
 
+static const char *ZEROCOIN_STATE_FILENAME = "zerocoinstate.dat";
+static const std::string ZEROCOIN_STATE_MAGIC = "zerocoinstate";
+static const int ZEROCOIN_STATE_SNAPSHOT_VERSION = 1;
+
+// Tip of the chain the snapshot on disk was taken at. Reset to null when the state changes without the tip moving
+static uint256 zerocoinStateSnapshotTip;
+
+// Accumulator change of the coin group made by the block, either calculated with the native modulus of the group
+// or with the alternative one
+static bool GetAccumulatorChange(const CBlockIndex *index, const pair<int,int> &denomAndId, bool fAlternativeModulus,
+                                 pair<CBigNum,int> &accChange) {
+    if (fAlternativeModulus) {
+        auto it = index->alternativeAccumulatorChanges.find(denomAndId);
+        if (it == index->alternativeAccumulatorChanges.end())
+            return false;
+        accChange = it->second;
+        return true;
+    }
+
+    if (index->GetZerocoinMintCount(denomAndId) == 0)
+        return false;
+    accChange = index->GetMintSpendData()->accumulatorChanges.at(denomAndId);
+    return true;
+}
+
 static bool CheckZerocoinSpendSerial(CValidationState &state, const Consensus::Params &params, CZerocoinTxInfo *zerocoinTxInfo, libzerocoin::CoinDenomination denomination, const CBigNum &serial, int nHeight, bool fConnectTip) {
     if (nHeight > params.nCheckBugFixedAtBlock) {
         // check for zerocoin transaction in this block as well
@@ -385,15 +412,15 @@ bool CheckSpendZcoinTransaction(const CTransaction &tx,
 				index = index->pprev;
 		}
 
-        decltype(&CBlockIndex::accumulatorChanges) accChanges = fModulusV2 == fModulusV2InIndex ?
-                    &CBlockIndex::accumulatorChanges : &CBlockIndex::alternativeAccumulatorChanges;
+        bool fAlternativeModulus = fModulusV2 != fModulusV2InIndex;
 
         // Enumerate all the accumulator changes seen in the blockchain starting with the latest block
         // In most cases the latest accumulator value will be used for verification
         do {
-            if ((index->*accChanges).count(denominationAndId) > 0) {
+            pair<CBigNum,int> accChange;
+            if (GetAccumulatorChange(index, denominationAndId, fAlternativeModulus, accChange)) {
                 libzerocoin::Accumulator accumulator(zcParams,
-                                                     (index->*accChanges)[denominationAndId].first,
+                                                     accChange.first,
                                                      targetDenominations[vinIndex]);
                 LogPrintf("CheckSpendZcoinTransaction: accumulator=%s\n", accumulator.getValue().ToString().substr(0,15));
                 passVerify = spend->Verify(accumulator, newMetadata);
@@ -412,15 +439,15 @@ bool CheckSpendZcoinTransaction(const CTransaction &tx,
         if (!passVerify && spendVersion == ZEROCOIN_TX_VERSION_1) {
             // Build vector of coins sorted by the time of mint
             index = coinGroup.lastBlock;
-            vector<CBigNum> pubCoins = index->mintedPubCoins[denominationAndId];
-            if (index != coinGroup.firstBlock) {
-                do {
-                    index = index->pprev;
-                    if (index->mintedPubCoins.count(denominationAndId) > 0)
-                        pubCoins.insert(pubCoins.begin(),
-                                        index->mintedPubCoins[denominationAndId].cbegin(),
-                                        index->mintedPubCoins[denominationAndId].cend());
-                } while (index != coinGroup.firstBlock);
+            vector<CBigNum> pubCoins;
+            for (;;) {
+                auto mintSpendData = index->GetMintSpendData();
+                auto blockPubCoins = mintSpendData->mintedPubCoins.find(denominationAndId);
+                if (blockPubCoins != mintSpendData->mintedPubCoins.end())
+                    pubCoins.insert(pubCoins.begin(), blockPubCoins->second.cbegin(), blockPubCoins->second.cend());
+                if (index == coinGroup.firstBlock)
+                    break;
+                index = index->pprev;
             }
 
             libzerocoin::Accumulator accumulator(zcParams, targetDenominations[vinIndex]);
@@ -715,9 +742,10 @@ bool ConnectBlockZC(CValidationState &state, const CChainParams &chainParams, CB
 
 	    if (!fJustCheck) {
             // clear the state
-			pindexNew->spentSerials.clear();
-            pindexNew->mintedPubCoins.clear();
-            pindexNew->accumulatorChanges.clear();
+            CBlockMintSpendData &mintSpendData = pindexNew->GetMintSpendDataForUpdate();
+			mintSpendData.spentSerials.clear();
+            mintSpendData.mintedPubCoins.clear();
+            mintSpendData.accumulatorChanges.clear();
             pindexNew->alternativeAccumulatorChanges.clear();
         }
 
@@ -727,7 +755,7 @@ bool ConnectBlockZC(CValidationState &state, const CChainParams &chainParams, CB
                     return false;
 
                 if (!fJustCheck) {
-                    pindexNew->spentSerials.insert(serial.first);
+                    pindexNew->GetMintSpendDataForUpdate().spentSerials.insert(serial.first);
                     zerocoinState.AddSpend(serial.first);
                 }
 
@@ -752,7 +780,8 @@ bool ConnectBlockZC(CValidationState &state, const CChainParams &chainParams, CB
             LogPrintf("ConnectTipZC: mint added denomination=%d, id=%d\n", denomination, mintId);
             pair<int,int> denomAndId = make_pair(denomination, mintId);
 
-            pindexNew->mintedPubCoins[denomAndId].push_back(mint.second);
+            CBlockMintSpendData &mintSpendData = pindexNew->GetMintSpendDataForUpdate();
+            mintSpendData.mintedPubCoins[denomAndId].push_back(mint.second);
 
             CZerocoinState::CoinGroupInfo coinGroupInfo;
             zerocoinState.GetCoinGroupInfo(denomination, mintId, coinGroupInfo);
@@ -763,13 +792,13 @@ bool ConnectBlockZC(CValidationState &state, const CChainParams &chainParams, CB
                                                  (libzerocoin::CoinDenomination)denomination);
             accumulator += pubCoin;
 
-            if (pindexNew->accumulatorChanges.count(denomAndId) > 0) {
-                pair<CBigNum,int> &accChange = pindexNew->accumulatorChanges[denomAndId];
+            if (mintSpendData.accumulatorChanges.count(denomAndId) > 0) {
+                pair<CBigNum,int> &accChange = mintSpendData.accumulatorChanges[denomAndId];
                 accChange.first = accumulator.getValue();
                 accChange.second++;
             }
             else {
-                pindexNew->accumulatorChanges[denomAndId] = make_pair(accumulator.getValue(), 1);
+                mintSpendData.accumulatorChanges[denomAndId] = make_pair(accumulator.getValue(), 1);
             }
             // invalidate alternative accumulator value for this denomination and id
             pindexNew->alternativeAccumulatorChanges.erase(denomAndId);
@@ -813,6 +842,33 @@ bool ZerocoinBuildStateFromIndex(CChain *chain, set<CBlockIndex *> &changes) {
     return true;
 }
 
+bool ZerocoinLoadState(CChain *chain) {
+    if (chain->Tip() == NULL)
+        return false;
+
+    int64_t nStart = GetTimeMillis();
+    if (!zerocoinState.ReadSnapshot(GetDataDir() / ZEROCOIN_STATE_FILENAME, chain))
+        return false;
+
+    zerocoinStateSnapshotTip = chain->Tip()->GetBlockHash();
+    LogPrintf("Loaded zerocoin state at block %s  %dms\n", zerocoinStateSnapshotTip.ToString(), GetTimeMillis() - nStart);
+    return true;
+}
+
+bool ZerocoinFlushState(CChain *chain) {
+    CBlockIndex *tip = chain->Tip();
+    if (tip == NULL || tip->GetBlockHash() == zerocoinStateSnapshotTip)
+        return true;
+
+    int64_t nStart = GetTimeMillis();
+    if (!zerocoinState.WriteSnapshot(GetDataDir() / ZEROCOIN_STATE_FILENAME, chain))
+        return false;
+
+    zerocoinStateSnapshotTip = tip->GetBlockHash();
+    LogPrint("zerocoin", "Written zerocoin state at block %s  %dms\n", zerocoinStateSnapshotTip.ToString(), GetTimeMillis() - nStart);
+    return true;
+}
+
 // CZerocoinTxInfo
 
 void CZerocoinTxInfo::Complete() {
@@ -867,7 +923,9 @@ int CZerocoinState::AddMint(CBlockIndex *index, int denomination, const CBigNum
             coinGroup.firstBlock = coinGroup.lastBlock = index;
         }
         else {
-            previousAccValue = coinGroup.lastBlock->accumulatorChanges[make_pair(denomination,mintId)].first;
+            pair<CBigNum,int> accChange;
+            if (GetAccumulatorChange(coinGroup.lastBlock, make_pair(denomination,mintId), false, accChange))
+                previousAccValue = accChange.first;
             coinGroup.lastBlock = index;
         }
     }
@@ -892,7 +950,11 @@ void CZerocoinState::AddSpend(const CBigNum &serial) {
 }
 
 void CZerocoinState::AddBlock(CBlockIndex *index, const Consensus::Params &params) {
-    BOOST_FOREACH(const PAIRTYPE(PAIRTYPE(int,int), PAIRTYPE(CBigNum,int)) &accUpdate, index->accumulatorChanges)
+    if (!index->HasMintSpendData())
+        return;
+
+    auto mintSpendData = index->GetMintSpendData();
+    BOOST_FOREACH(const PAIRTYPE(PAIRTYPE(int,int), PAIRTYPE(CBigNum,int)) &accUpdate, mintSpendData->accumulatorChanges)
     {
         CoinGroupInfo   &coinGroup = coinGroups[accUpdate.first];
 
@@ -902,7 +964,7 @@ void CZerocoinState::AddBlock(CBlockIndex *index, const Consensus::Params &param
         coinGroup.nCoins += accUpdate.second.second;
     }
 
-    BOOST_FOREACH(const PAIRTYPE(PAIRTYPE(int,int),vector<CBigNum>) &pubCoins, index->mintedPubCoins) {
+    BOOST_FOREACH(const PAIRTYPE(PAIRTYPE(int,int),vector<CBigNum>) &pubCoins, mintSpendData->mintedPubCoins) {
         latestCoinIds[pubCoins.first.first] = pubCoins.first.second;
         BOOST_FOREACH(const CBigNum &coin, pubCoins.second) {
             CMintedCoinInfo coinInfo;
@@ -914,15 +976,20 @@ void CZerocoinState::AddBlock(CBlockIndex *index, const Consensus::Params &param
     }
 
     if (index->nHeight > params.nCheckBugFixedAtBlock) {
-        BOOST_FOREACH(const CBigNum &serial, index->spentSerials) {
+        BOOST_FOREACH(const CBigNum &serial, mintSpendData->spentSerials) {
             usedCoinSerials.insert(serial);
         }
     }
 }
 
 void CZerocoinState::RemoveBlock(CBlockIndex *index) {
+    if (!index->HasMintSpendData())
+        return;
+
+    auto mintSpendData = index->GetMintSpendData();
+
     // roll back accumulator updates
-    BOOST_FOREACH(const PAIRTYPE(PAIRTYPE(int,int), PAIRTYPE(CBigNum,int)) &accUpdate, index->accumulatorChanges)
+    BOOST_FOREACH(const PAIRTYPE(PAIRTYPE(int,int), PAIRTYPE(CBigNum,int)) &accUpdate, mintSpendData->accumulatorChanges)
     {
         CoinGroupInfo   &coinGroup = coinGroups[accUpdate.first];
         int  nMintsToForget = accUpdate.second.second;
@@ -940,12 +1007,12 @@ void CZerocoinState::RemoveBlock(CBlockIndex *index) {
             do {
                 assert(coinGroup.lastBlock != coinGroup.firstBlock);
                 coinGroup.lastBlock = coinGroup.lastBlock->pprev;
-            } while (coinGroup.lastBlock->accumulatorChanges.count(accUpdate.first) == 0);
+            } while (coinGroup.lastBlock->GetZerocoinMintCount(accUpdate.first) == 0);
         }
     }
 
     // roll back mints
-    BOOST_FOREACH(const PAIRTYPE(PAIRTYPE(int,int),vector<CBigNum>) &pubCoins, index->mintedPubCoins) {
+    BOOST_FOREACH(const PAIRTYPE(PAIRTYPE(int,int),vector<CBigNum>) &pubCoins, mintSpendData->mintedPubCoins) {
         BOOST_FOREACH(const CBigNum &coin, pubCoins.second) {
             auto coins = mintedPubCoins.equal_range(coin);
             auto coinIt = find_if(coins.first, coins.second, [=](const decltype(mintedPubCoins)::value_type &v) {
@@ -958,7 +1025,7 @@ void CZerocoinState::RemoveBlock(CBlockIndex *index) {
     }
 
     // roll back spends
-    BOOST_FOREACH(const CBigNum &serial, index->spentSerials) {
+    BOOST_FOREACH(const CBigNum &serial, mintSpendData->spentSerials) {
         usedCoinSerials.erase(serial);
     }
 }
@@ -991,34 +1058,27 @@ int CZerocoinState::GetAccumulatorValueForSpend(CChain *chain, int maxHeight, in
     CoinGroupInfo coinGroup = coinGroups[denomAndId];
     CBlockIndex *lastBlock = coinGroup.lastBlock;
 
-    assert(lastBlock->accumulatorChanges.count(denomAndId) > 0);
-    assert(coinGroup.firstBlock->accumulatorChanges.count(denomAndId) > 0);
+    assert(lastBlock->GetZerocoinMintCount(denomAndId) > 0);
+    assert(coinGroup.firstBlock->GetZerocoinMintCount(denomAndId) > 0);
 
     // is native modulus for denomination and id v2?
     bool nativeModulusIsV2 = IsZerocoinTxV2((libzerocoin::CoinDenomination)denomination, Params().GetConsensus(), id);
-    // field in the block index structure for accesing accumulator changes
-    decltype(&CBlockIndex::accumulatorChanges) accChangeField;
-    if (nativeModulusIsV2 != useModulusV2) {
+    // use accumulator changes calculated with alternative modulus?
+    bool fAlternativeModulus = nativeModulusIsV2 != useModulusV2;
+    if (fAlternativeModulus)
         CalculateAlternativeModulusAccumulatorValues(chain, denomination, id);
-        accChangeField = &CBlockIndex::alternativeAccumulatorChanges;
-    }
-    else {
-        accChangeField = &CBlockIndex::accumulatorChanges;
-    }
 
     int numberOfCoins = 0;
     for (;;) {
-        map<pair<int,int>, pair<CBigNum,int>> &accumulatorChanges = lastBlock->*accChangeField;
-        if (accumulatorChanges.count(denomAndId) > 0) {
-            if (lastBlock->nHeight <= maxHeight) {
-                if (numberOfCoins == 0) {
-                    // latest block satisfying given conditions
-                    // remember accumulator value and block hash
-                    accumulator = accumulatorChanges[denomAndId].first;
-                    blockHash = lastBlock->GetBlockHash();
-                }
-                numberOfCoins += accumulatorChanges[denomAndId].second;
+        pair<CBigNum,int> accChange;
+        if (lastBlock->nHeight <= maxHeight && GetAccumulatorChange(lastBlock, denomAndId, fAlternativeModulus, accChange)) {
+            if (numberOfCoins == 0) {
+                // latest block satisfying given conditions
+                // remember accumulator value and block hash
+                accumulator = accChange.first;
+                blockHash = lastBlock->GetBlockHash();
             }
+            numberOfCoins += accChange.second;
         }
 
         if (lastBlock == coinGroup.firstBlock)
@@ -1047,34 +1107,33 @@ libzerocoin::AccumulatorWitness CZerocoinState::GetWitnessForSpend(CChain *chain
 
     libzerocoin::Params *zcParams = useModulusV2 ? ZCParamsV2 : ZCParams;
     bool nativeModulusIsV2 = IsZerocoinTxV2((libzerocoin::CoinDenomination)denomination, Params().GetConsensus(), id);
-    decltype(&CBlockIndex::accumulatorChanges) accChangeField;
-    if (nativeModulusIsV2 != useModulusV2) {
+    bool fAlternativeModulus = nativeModulusIsV2 != useModulusV2;
+    if (fAlternativeModulus)
         CalculateAlternativeModulusAccumulatorValues(chain, denomination, id);
-        accChangeField = &CBlockIndex::alternativeAccumulatorChanges;
-    }
-    else {
-        accChangeField = &CBlockIndex::accumulatorChanges;
-    }
 
     // Find accumulator value preceding mint operation
     CBlockIndex *mintBlock = (*chain)[mintHeight];
     CBlockIndex *block = mintBlock;
     libzerocoin::Accumulator accumulator(zcParams, d);
     if (block != coinGroup.firstBlock) {
+        pair<CBigNum,int> accChange;
         do {
             block = block->pprev;
-        } while ((block->*accChangeField).count(denomAndId) == 0);
-        accumulator = libzerocoin::Accumulator(zcParams, (block->*accChangeField)[denomAndId].first, d);
+        } while (!GetAccumulatorChange(block, denomAndId, fAlternativeModulus, accChange));
+        accumulator = libzerocoin::Accumulator(zcParams, accChange.first, d);
     }
 
     // Now add to the accumulator every coin minted since that moment except pubCoin
     block = coinGroup.lastBlock;
     for (;;) {
-        if (block->nHeight <= maxHeight && block->mintedPubCoins.count(denomAndId) > 0) {
-            vector<CBigNum> &pubCoins = block->mintedPubCoins[denomAndId];
-            for (const CBigNum &coin: pubCoins) {
-                if (block != mintBlock || coin != pubCoin)
-                    accumulator += libzerocoin::PublicCoin(zcParams, coin, d);
+        if (block->nHeight <= maxHeight && block->GetZerocoinMintCount(denomAndId) > 0) {
+            auto mintSpendData = block->GetMintSpendData();
+            auto pubCoins = mintSpendData->mintedPubCoins.find(denomAndId);
+            if (pubCoins != mintSpendData->mintedPubCoins.end()) {
+                for (const CBigNum &coin: pubCoins->second) {
+                    if (block != mintBlock || coin != pubCoin)
+                        accumulator += libzerocoin::PublicCoin(zcParams, coin, d);
+                }
             }
         }
         if (block != mintBlock)
@@ -1114,18 +1173,21 @@ void CZerocoinState::CalculateAlternativeModulusAccumulatorValues(CChain *chain,
 
     CBlockIndex *block = coinGroup.firstBlock;
     for (;;) {
-        if (block->accumulatorChanges.count(denomAndId) > 0) {
+        if (block->GetZerocoinMintCount(denomAndId) > 0) {
             if (block->alternativeAccumulatorChanges.count(denomAndId) > 0)
                 // already calculated, update accumulator with cached value
                 accumulator = libzerocoin::Accumulator(altParams, block->alternativeAccumulatorChanges[denomAndId].first, d);
             else {
                 // re-create accumulator changes with alternative params
-                assert(block->mintedPubCoins.count(denomAndId) > 0);
-                const vector<CBigNum> &mintedCoins = block->mintedPubCoins[denomAndId];
+                auto mintSpendData = block->GetMintSpendData();
+                assert(mintSpendData->mintedPubCoins.count(denomAndId) > 0);
+                const vector<CBigNum> &mintedCoins = mintSpendData->mintedPubCoins.at(denomAndId);
                 BOOST_FOREACH(const CBigNum &c, mintedCoins) {
                     accumulator += libzerocoin::PublicCoin(altParams, c, d);
                 }
                 block->alternativeAccumulatorChanges[denomAndId] = make_pair(accumulator.getValue(), (int)mintedCoins.size());
+                // make sure calculated value gets to the snapshot
+                zerocoinStateSnapshotTip.SetNull();
             }
         }
 
@@ -1147,22 +1209,23 @@ bool CZerocoinState::TestValidity(CChain *chain) {
 
         CBlockIndex *block = coinGroup.second.firstBlock;
         for (;;) {
-            if (block->accumulatorChanges.count(coinGroup.first) > 0) {
-                if (block->mintedPubCoins.count(coinGroup.first) == 0) {
+            auto mintSpendData = block->GetMintSpendData();
+            if (mintSpendData->accumulatorChanges.count(coinGroup.first) > 0) {
+                if (mintSpendData->mintedPubCoins.count(coinGroup.first) == 0) {
                     fprintf(stderr, "  no minted coins\n");
                     return false;
                 }
 
-                BOOST_FOREACH(const CBigNum &pubCoin, block->mintedPubCoins[coinGroup.first]) {
+                BOOST_FOREACH(const CBigNum &pubCoin, mintSpendData->mintedPubCoins.at(coinGroup.first)) {
                     acc += libzerocoin::PublicCoin(zcParams, pubCoin, (libzerocoin::CoinDenomination)coinGroup.first.first);
                 }
 
-                if (acc.getValue() != block->accumulatorChanges[coinGroup.first].first) {
+                if (acc.getValue() != mintSpendData->accumulatorChanges.at(coinGroup.first).first) {
                     fprintf (stderr, "  accumulator value mismatch at height %d\n", block->nHeight);
                     return false;
                 }
 
-                if (block->accumulatorChanges[coinGroup.first].second != (int)block->mintedPubCoins[coinGroup.first].size()) {
+                if (mintSpendData->accumulatorChanges.at(coinGroup.first).second != (int)mintSpendData->mintedPubCoins.at(coinGroup.first).size()) {
                     fprintf(stderr, "  number of minted coins mismatch at height %d\n", block->nHeight);
                     return false;
                 }
@@ -1183,45 +1246,238 @@ bool CZerocoinState::TestValidity(CChain *chain) {
 set<CBlockIndex *> CZerocoinState::RecalculateAccumulators(CChain *chain) {
     set<CBlockIndex *> changes;
 
+    // Recalculated accumulator values for every coin group. Groups are independent chains of accumulator updates,
+    // calculate them in parallel and apply to the block index afterwards
+    typedef vector<pair<CBlockIndex *, CBigNum>> AccumulatorValues;
+    vector<pair<pair<int,int>, AccumulatorValues>> groupAccumulatorValues;
+
     BOOST_FOREACH(const PAIRTYPE(PAIRTYPE(int,int), CoinGroupInfo) &coinGroup, coinGroups) {
         // Skip non-modulusv2 groups
-        if (!IsZerocoinTxV2((libzerocoin::CoinDenomination)coinGroup.first.first, Params().GetConsensus(), coinGroup.first.second))
-            continue;
+        if (IsZerocoinTxV2((libzerocoin::CoinDenomination)coinGroup.first.first, Params().GetConsensus(), coinGroup.first.second))
+            groupAccumulatorValues.push_back(make_pair(coinGroup.first, AccumulatorValues()));
+    }
 
-        libzerocoin::Accumulator acc(&ZCParamsV2->accumulatorParams, (libzerocoin::CoinDenomination)coinGroup.first.first);
+    libzerocoin::ParallelTasks tasks(groupAccumulatorValues.size());
+    for (auto &groupValues: groupAccumulatorValues) {
+        const pair<int,int> &denomAndId = groupValues.first;
+        const CoinGroupInfo &coinGroup = coinGroups.at(denomAndId);
+        AccumulatorValues &values = groupValues.second;
+
+        tasks.Add([chain, &denomAndId, &coinGroup, &values]() {
+            libzerocoin::CoinDenomination d = (libzerocoin::CoinDenomination)denomAndId.first;
+            libzerocoin::Accumulator acc(&ZCParamsV2->accumulatorParams, d);
+
+            // Try to calculate accumulator for the first batch of mints. If it doesn't match we need to recalculate the rest of it
+            // Block index is shared between the tasks, only read from it here
+            CBlockIndex *block = coinGroup.firstBlock;
+            for (;;) {
+                // data of different blocks is loaded in parallel, keep it alive while in use
+                auto mintSpendData = block->GetMintSpendData();
+                auto accChange = mintSpendData->accumulatorChanges.find(denomAndId);
+                if (accChange != mintSpendData->accumulatorChanges.end()) {
+                    auto pubCoins = mintSpendData->mintedPubCoins.find(denomAndId);
+                    if (pubCoins != mintSpendData->mintedPubCoins.end()) {
+                        BOOST_FOREACH(const CBigNum &pubCoin, pubCoins->second) {
+                            acc += libzerocoin::PublicCoin(ZCParamsV2, pubCoin, d);
+                        }
+                    }
 
-        // Try to calculate accumulator for the first batch of mints. If it doesn't match we need to recalculate the rest of it
-        CBlockIndex *block = coinGroup.second.firstBlock;
-        for (;;) {
-            if (block->accumulatorChanges.count(coinGroup.first) > 0) {
-                BOOST_FOREACH(const CBigNum &pubCoin, block->mintedPubCoins[coinGroup.first]) {
-                    acc += libzerocoin::PublicCoin(ZCParamsV2, pubCoin, (libzerocoin::CoinDenomination)coinGroup.first.first);
-                }
+                    // First block case is special: do the check
+                    if (block == coinGroup.firstBlock) {
+                        if (acc.getValue() != accChange->second.first)
+                            // recalculation is needed
+                            LogPrintf("ZerocoinState: accumulator recalculation for denomination=%d, id=%d\n", denomAndId.first, denomAndId.second);
+                        else
+                            // everything's ok
+                            break;
+                    }
 
-                // First block case is special: do the check
-                if (block == coinGroup.second.firstBlock) {
-                    if (acc.getValue() != block->accumulatorChanges[coinGroup.first].first)
-                        // recalculation is needed
-                        LogPrintf("ZerocoinState: accumulator recalculation for denomination=%d, id=%d\n", coinGroup.first.first, coinGroup.first.second);
-                    else
-                        // everything's ok
-                        break;
+                    values.push_back(make_pair(block, acc.getValue()));
                 }
 
-                block->accumulatorChanges[coinGroup.first] = make_pair(acc.getValue(), (int)block->mintedPubCoins[coinGroup.first].size());
-                changes.insert(block);
+                if (block != coinGroup.lastBlock)
+                    block = (*chain)[block->nHeight+1];
+                else
+                    break;
             }
-
-            if (block != coinGroup.second.lastBlock)
-                block = (*chain)[block->nHeight+1];
-            else
-                break;
+        });
+    }
+    tasks.Wait();
+
+    for (auto &groupValues: groupAccumulatorValues) {
+        const pair<int,int> &denomAndId = groupValues.first;
+        for (auto &blockValue: groupValues.second) {
+            CBlockIndex *block = blockValue.first;
+            CBlockMintSpendData &mintSpendData = block->GetMintSpendDataForUpdate();
+            mintSpendData.accumulatorChanges[denomAndId] = make_pair(blockValue.second, (int)mintSpendData.mintedPubCoins[denomAndId].size());
+            changes.insert(block);
         }
     }
 
     return changes;
 }
 
+bool CZerocoinState::WriteSnapshot(const fs::path &path, CChain *chain) const {
+    // Generate random temporary filename
+    unsigned short randv = 0;
+    GetRandBytes((unsigned char *) &randv, sizeof(randv));
+    fs::path pathTmp = path;
+    pathTmp += strprintf(".%04x", randv);
+
+    FILE *file = fsbridge::fopen(pathTmp, "wb");
+    CAutoFile fileout(file, SER_DISK, CLIENT_VERSION);
+    if (fileout.IsNull())
+        return error("%s: Failed to open file %s", __func__, pathTmp.string());
+
+    // serialize state straight into the file, checksum data up to that point, then append checksum
+    try {
+        CHashForwarder<CAutoFile> ss(&fileout);
+        ss << ZEROCOIN_STATE_MAGIC;
+        ss << FLATDATA(Params().MessageStart());
+        ss << ZEROCOIN_STATE_SNAPSHOT_VERSION;
+        ss << chain->Tip()->GetBlockHash();
+
+        ss << latestCoinIds;
+
+        // blocks are stored by hash and resolved against the block index on load
+        WriteCompactSize(ss, coinGroups.size());
+        BOOST_FOREACH(const PAIRTYPE(PAIRTYPE(int,int), CoinGroupInfo) &coinGroup, coinGroups) {
+            ss << coinGroup.first;
+            ss << coinGroup.second.firstBlock->GetBlockHash() << coinGroup.second.lastBlock->GetBlockHash();
+            ss << coinGroup.second.nCoins;
+        }
+
+        WriteCompactSize(ss, mintedPubCoins.size());
+        for (const auto &mint: mintedPubCoins)
+            ss << mint.first << mint.second.denomination << mint.second.id << mint.second.nHeight;
+
+        WriteCompactSize(ss, usedCoinSerials.size());
+        for (const CBigNum &serial: usedCoinSerials)
+            ss << serial;
+
+        // Accumulator values for alternative modulus are not a part of the block index, save the ones calculated so far
+        vector<pair<const CBlockIndex *, pair<int,int>>> alternativeAccumulatorChanges;
+        BOOST_FOREACH(const PAIRTYPE(PAIRTYPE(int,int), CoinGroupInfo) &coinGroup, coinGroups) {
+            for (const CBlockIndex *block = coinGroup.second.lastBlock; ; block = block->pprev) {
+                if (block->alternativeAccumulatorChanges.count(coinGroup.first) > 0)
+                    alternativeAccumulatorChanges.push_back(make_pair(block, coinGroup.first));
+                if (block == coinGroup.second.firstBlock)
+                    break;
+            }
+        }
+
+        WriteCompactSize(ss, alternativeAccumulatorChanges.size());
+        for (const auto &change: alternativeAccumulatorChanges)
+            ss << change.first->GetBlockHash() << change.second << change.first->alternativeAccumulatorChanges.at(change.second);
+
+        fileout << ss.GetHash();
+    }
+    catch (const std::exception &e) {
+        fileout.fclose();
+        fs::remove(pathTmp);
+        return error("%s: Serialize or I/O error - %s", __func__, e.what());
+    }
+    FileCommit(fileout.Get());
+    fileout.fclose();
+
+    // replace existing snapshot, if any, with the new one
+    if (!RenameOver(pathTmp, path))
+        return error("%s: Rename-into-place failed", __func__);
+
+    return true;
+}
+
+bool CZerocoinState::ReadSnapshot(const fs::path &path, CChain *chain) {
+    FILE *file = fsbridge::fopen(path, "rb");
+    CAutoFile filein(file, SER_DISK, CLIENT_VERSION);
+    // Snapshot is missing on the first start, nothing to report
+    if (filein.IsNull())
+        return false;
+
+    Reset();
+
+    // Look up block in the active chain by its hash
+    auto findBlock = [chain](const uint256 &blockHash) -> CBlockIndex * {
+        BlockMap::const_iterator mi = mapBlockIndex.find(blockHash);
+        if (mi == mapBlockIndex.end() || !chain->Contains(mi->second))
+            throw std::runtime_error("block " + blockHash.ToString() + " is not in the chain");
+        return mi->second;
+    };
+
+    // alternative accumulator values are applied only once the whole snapshot is verified
+    vector<pair<CBlockIndex *, pair<pair<int,int>, pair<CBigNum,int>>>> alternativeAccumulatorChanges;
+
+    try {
+        CHashVerifier<CAutoFile> ss(&filein);
+
+        std::string strMagic;
+        unsigned char pchMsgTmp[4];
+        int nSnapshotVersion;
+        uint256 snapshotTip;
+        ss >> strMagic >> FLATDATA(pchMsgTmp) >> nSnapshotVersion >> snapshotTip;
+        if (strMagic != ZEROCOIN_STATE_MAGIC || memcmp(pchMsgTmp, Params().MessageStart(), sizeof(pchMsgTmp)))
+            return error("%s: Invalid magic", __func__);
+        if (nSnapshotVersion != ZEROCOIN_STATE_SNAPSHOT_VERSION)
+            return error("%s: Unsupported snapshot version %d", __func__, nSnapshotVersion);
+        if (snapshotTip != chain->Tip()->GetBlockHash()) {
+            LogPrintf("%s: Snapshot is taken at block %s which is not the tip\n", __func__, snapshotTip.ToString());
+            return false;
+        }
+
+        ss >> latestCoinIds;
+
+        for (uint64_t n = ReadCompactSize(ss); n > 0; n--) {
+            pair<int,int> denomAndId;
+            uint256 firstBlockHash, lastBlockHash;
+            CoinGroupInfo coinGroup;
+            ss >> denomAndId >> firstBlockHash >> lastBlockHash >> coinGroup.nCoins;
+            coinGroup.firstBlock = findBlock(firstBlockHash);
+            coinGroup.lastBlock = findBlock(lastBlockHash);
+            coinGroups[denomAndId] = coinGroup;
+        }
+
+        uint64_t nMints = ReadCompactSize(ss);
+        mintedPubCoins.reserve(nMints);
+        for (; nMints > 0; nMints--) {
+            CBigNum pubCoin;
+            CMintedCoinInfo coinInfo;
+            ss >> pubCoin >> coinInfo.denomination >> coinInfo.id >> coinInfo.nHeight;
+            mintedPubCoins.insert(make_pair(pubCoin, coinInfo));
+        }
+
+        uint64_t nSerials = ReadCompactSize(ss);
+        usedCoinSerials.reserve(nSerials);
+        for (; nSerials > 0; nSerials--) {
+            CBigNum serial;
+            ss >> serial;
+            usedCoinSerials.insert(serial);
+        }
+
+        for (uint64_t n = ReadCompactSize(ss); n > 0; n--) {
+            uint256 blockHash;
+            pair<pair<int,int>, pair<CBigNum,int>> change;
+            ss >> blockHash >> change;
+            alternativeAccumulatorChanges.push_back(make_pair(findBlock(blockHash), change));
+        }
+
+        uint256 hashIn;
+        filein >> hashIn;
+        if (hashIn != ss.GetHash()) {
+            Reset();
+            return error("%s: Checksum mismatch, data corrupted", __func__);
+        }
+    }
+    catch (const std::exception &e) {
+        Reset();
+        return error("%s: Deserialize or I/O error - %s", __func__, e.what());
+    }
+
+    for (const auto &change: alternativeAccumulatorChanges)
+        change.first->alternativeAccumulatorChanges[change.second.first] = change.second.second;
+
+    return true;
+}
+
 bool CZerocoinState::AddSpendToMempool(const vector<CBigNum> &coinSerials, uint256 txHash) {
     BOOST_FOREACH(CBigNum coinSerial, coinSerials){
         if (IsUsedCoinSerial(coinSerial) || mempoolCoinSerials.count(coinSerial))
@@ -5,6 +5,7 @@
 #include "chain.h"
 #include "coins.h"
 #include "consensus/validation.h"
+#include "fs.h"
 #include "libzerocoin/Zerocoin.h"
 #include "zerocoin_params.h"
 #include <unordered_set>
@@ -66,6 +67,13 @@ int ZerocoinGetNHeight(const CBlockHeader &block);
 
 bool ZerocoinBuildStateFromIndex(CChain *chain, set<CBlockIndex *> &changes);
 
+// Load zerocoin state from the snapshot file. Fails if the snapshot is missing, corrupted or wasn't taken at the tip
+// of the chain, in which case the state has to be rebuilt with ZerocoinBuildStateFromIndex
+bool ZerocoinLoadState(CChain *chain);
+
+// Write the snapshot of zerocoin state at the tip of the chain, unless it was already written and hasn't changed since
+bool ZerocoinFlushState(CChain *chain);
+
 CBigNum ZerocoinGetSpendSerialNumber(const CTransaction &tx, const CTxIn &txin);
 
 /*
@@ -151,10 +159,17 @@ public:
     // Reset to initial values
     void Reset();
 
+    // Write coin groups, mints, spends and calculated alternative modulus accumulator values to the snapshot file
+    bool WriteSnapshot(const fs::path &path, CChain *chain) const;
+
+    // Replace the state with the contents of the snapshot file. Fails if the snapshot wasn't taken at the tip
+    bool ReadSnapshot(const fs::path &path, CChain *chain);
+
     // Test function
     bool TestValidity(CChain *chain);
 
-    // Recalculate accumulators. Needed if upgrade from pre-modulusv2 version is detected
+    // Recalculate accumulators. Needed if upgrade from pre-modulusv2 version is detected. Coin groups are
+    // independent of each other and are processed in parallel
     // Returns set of indices that changed
     set<CBlockIndex *> RecalculateAccumulators(CChain *chain);
 
@@ -67,6 +67,11 @@ bool CZMQAbstract::NotifyBalance()
     return true;
 }
 
+bool CZMQAbstract::NotifyNetMsgStats()
+{
+    return true;
+}
+
 bool CZMQAbstract::SendMultipart(const void* data, size_t size, ...)
 {
     va_list args;
@@ -63,6 +63,7 @@ public:
     virtual bool NotifyMintStatusUpdate(std::string update);
     virtual bool NotifySettingsUpdate(std::string update);
     virtual bool NotifyBalance();
+    virtual bool NotifyNetMsgStats();
 
     /* send message with or without topic value. */
     bool SendMessage();
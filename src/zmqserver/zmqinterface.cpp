@@ -151,6 +151,7 @@ CZMQPublisherInterface* CZMQPublisherInterface::Create()
         "pubsettings", 
         "pubstatus",
         "pubxfsnodelist",
+        "pubnetmsgstats",
     };
 
     factories["pubblock"] = CZMQAbstract::Create<CZMQBlockDataTopic>;
@@ -162,6 +163,7 @@ CZMQPublisherInterface* CZMQPublisherInterface::Create()
     factories["pubsettings"] = CZMQAbstract::Create<CZMQSettingsTopic>;
     factories["pubstatus"] = CZMQAbstract::Create<CZMQAPIStatusTopic>;
     factories["pubxfsnodelist"] = CZMQAbstract::Create<CZMQXFSnodeListTopic>;
+    factories["pubnetmsgstats"] = CZMQAbstract::Create<CZMQNetMsgStatsTopic>;
     
     BOOST_FOREACH(string pubIndex, pubIndexes)
     {
@@ -359,3 +361,20 @@ void CZMQPublisherInterface::UpdatedBalance()
         }
     }
 }
+
+void CZMQPublisherInterface::NotifyNetMsgStats()
+{
+    for (std::list<CZMQAbstract*>::iterator i = notifiers.begin(); i!=notifiers.end(); )
+    {
+        CZMQAbstract *notifier = *i;
+        if (notifier->NotifyNetMsgStats())
+        {
+            i++;
+        }
+        else
+        {
+            notifier->Shutdown();
+            i = notifiers.erase(i);
+        }
+    }
+}
@@ -45,6 +45,7 @@ protected:
     void UpdatedMintStatus(std::string update);
     void UpdatedSettings(std::string update);
     void UpdatedBalance();
+    void NotifyNetMsgStats();
     
 };
 
@@ -303,4 +303,10 @@ bool CZMQBalanceEvent::NotifyBalance()
 {
     Execute();
     return true;
-}
\ No newline at end of file
+}
+
+bool CZMQNetMsgStatsEvent::NotifyNetMsgStats()
+{
+    Execute();
+    return true;
+}
@@ -132,6 +132,14 @@ public:
     bool NotifyBalance();
 };
 
+class CZMQNetMsgStatsEvent : virtual public CZMQAbstractPublisher
+{
+    /* Periodic network message statistics dump
+    */
+public:
+    bool NotifyNetMsgStats();
+};
+
 /* Topics. inheriting from an event class implies publishing on that event. 
    'method' string is the API method called in client-api/ 
 */
@@ -203,4 +211,11 @@ public:
     void SetMethod(){ method= "mintStatus";}
 };
 
+class CZMQNetMsgStatsTopic : public CZMQNetMsgStatsEvent
+{
+public:
+    void SetTopic(){ topic = "netMsgStats";}
+    void SetMethod(){ method= "netMsgStats";}
+};
+
 #endif // ZCOIN_ZMQ_ZMQPUBLISHER_H